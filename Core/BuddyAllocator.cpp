@@ -61,17 +61,15 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     , m_maxBlockSize(maxBlockSize)
     , m_minBlockSize(MinBlockSize)
     , m_pBackingHeap(nullptr)
-#if defined(PROFILE) || defined(_DEBUG)
     , m_SpaceUsed(0)
     , m_InternalFragmentation(0)
-#endif
 {
     ASSERT(Math::IsDivisible(maxBlockSize, m_minBlockSize));
     ASSERT(Math::IsPowerOfTwo(maxBlockSize / m_minBlockSize));
 
     m_maxOrder = UnitSizeToOrder(SizeToUnitSize(maxBlockSize));
 
-    Reset();
+    m_freeBlocks.Initialize(m_maxOrder);
 }
 
 void BuddyAllocator::Initialize()
@@ -106,159 +104,123 @@ void BuddyAllocator::Destroy()
     }
 }
 
-size_t BuddyAllocator::AllocateBlock(UINT order)
+BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
 {
-    size_t offset;
+    size_t size = numElements * elementSize;
+    size_t unitSize = SizeToUnitSize(size);
+    UINT order = UnitSizeToOrder(unitSize);
 
-    if (order > m_maxOrder)
+    size_t offset = m_freeBlocks.Allocate(order);
+    if (offset == BuddyOffsetAllocator::kInvalidOffset)
     {
-        throw(std::bad_alloc()); // Can't allocate a block that large  
+        // There are no blocks available for the requested size so  
+        // return the NULL block type  
+        return new BuddyBlock();
     }
 
-    auto it = m_freeBlocks[order].begin();
+    uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
 
-    if (it == m_freeBlocks[order].end())
-    {
-        // No free nodes in the requested pool.  Try to find a higher-order block and split it.  
-        size_t left = AllocateBlock(order + 1);
+    uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
 
-        size_t size = OrderToUnitSize(order);
+    m_SpaceUsed.fetch_add(paddedSize, std::memory_order_relaxed);
+    m_InternalFragmentation.fetch_add(paddedSize - size, std::memory_order_relaxed);
 
-        size_t right = left + size;
-
-        m_freeBlocks[order].insert(right); // Add the right block to the free pool  
-
-        offset = left; // Return the left block  
+    BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
+        paddedSize, //total size (padded to fit a block)
+        numElements * elementSize);
+        
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
+    {
+        pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
     }
-
     else
     {
-        offset = *it;
-
-        // Remove the block from the free list  
-        m_freeBlocks[order].erase(it);
+        //TODO: To be truely thread-safe this operation should be atomic to guard against
+        //      the case in which blocks from this allocator are used on multiple threads 
+        //      (because it's really only 1 resource underneath)
+        pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
     }
 
-    return offset;
+    return pBlock;
 }
 
-void BuddyAllocator::DeallocateBlock(size_t offset, UINT order)
+void BuddyAllocator::Deallocate(BuddyBlock* pBlock, uint64_t fenceValue)
 {
-    // See if the buddy block is free  
-    size_t size = OrderToUnitSize(order);
-
-    size_t buddy = GetBuddyOffset(offset, size);
-
-    auto it = m_freeBlocks[order].find(buddy);
+    ASSERT(IsOwner(*pBlock));
 
-    if (it != m_freeBlocks[order].end())
+    if (fenceValue == 0)
     {
-        // Deallocate merged blocks  
-        DeallocateBlock(min(offset, buddy), order + 1);
-        // Remove the buddy from the free list  
-        m_freeBlocks[order].erase(it);
-    }
-    else
-    {
-        // Add the block to the free list  
-        m_freeBlocks[order].insert(offset); // throw(std::bad_alloc) 
+        fenceValue = g_CommandManager.GetGraphicsQueue().GetNextFenceValue();
     }
+    pBlock->m_fenceValue = fenceValue;
+
+    // A block behind an older fence of the same queue only waits longer, it is never freed early
+    lock_guard<mutex> lock(m_retiredMutex);
+    m_deferredDeletionQueues[fenceValue >> 56].push(pBlock);
 }
 
-BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
+ConcurrentBuddyOffsetAllocator::Block BuddyAllocator::GetOffsetBlock(const BuddyBlock& block) const
 {
-    size_t size = numElements * elementSize;
-    size_t unitSize = SizeToUnitSize(size);
-    UINT order = UnitSizeToOrder(unitSize);
-
-    try
-    {
-        size_t offset = AllocateBlock(order);
-        uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
-
-        uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
-
-        INCREASE_BUDDY_COUNTER(m_SpaceUsed, paddedSize);
-        INCREASE_BUDDY_COUNTER(m_InternalFragmentation, (paddedSize - size));
-
-        BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
-            paddedSize, //total size (padded to fit a block)
-            numElements * elementSize);
-            
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
-        {
-            pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
-        }
-        else
-        {
-            //TODO: To be truely thread-safe this operation should be atomic to guard against
-            //      the case in which blocks from this allocator are used on multiple threads 
-            //      (because it's really only 1 resource underneath)
-            pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
-        }
+    ConcurrentBuddyOffsetAllocator::Block offsetBlock;
+    offsetBlock.Offset = SizeToUnitSize(block.GetOffset() - m_baseOffset);
+    offsetBlock.Order = UnitSizeToOrder(SizeToUnitSize(block.GetSize()));
+    return offsetBlock;
+}
 
-        return pBlock;
-    }
+void BuddyAllocator::ReleaseBlock(BuddyBlock* pBlock)
+{
+    m_SpaceUsed.fetch_sub(pBlock->GetSize(), std::memory_order_relaxed);
+    m_InternalFragmentation.fetch_sub(pBlock->GetSize() - pBlock->m_unpaddedSize, std::memory_order_relaxed);
 
-    catch (std::bad_alloc&)
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
-        // There are no blocks available for the requested size so  
-        // return the NULL block type  
-        return new BuddyBlock();
+        // Release the resource
+        pBlock->Destroy();
     }
+    delete(pBlock);
 }
 
-/*
-void BuddyAllocator::Deallocate(BuddyBlock* pBlock)
-{
-    pBlock->m_fenceValue = g_CommandManager.GetNextFenceValue();
-    m_deferredDeletionQueue.push(pBlock);
-}
-*/
-
-void BuddyAllocator::DeallocateInternal(BuddyBlock* pBlock)
+void BuddyAllocator::CleanUpAllocations()
 {
-    ASSERT(IsOwner(*pBlock));
-
-    size_t offset = SizeToUnitSize(pBlock->GetOffset() - m_baseOffset);
-
-    size_t size = SizeToUnitSize(pBlock->GetSize());
-
-    UINT order = UnitSizeToOrder(size);
-
-    try
+    vector<BuddyBlock*> completedBlocks;
     {
-        DeallocateBlock(offset, order); // throw(std::bad_alloc)
-
-        DECREASE_BUDDY_COUNTER(m_SpaceUsed, size);
-        DECREASE_BUDDY_COUNTER(m_InternalFragmentation, (size - pBlock->m_unpaddedSize));
-        
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
+        lock_guard<mutex> lock(m_retiredMutex);
+        for (auto& retiredBlocks : m_deferredDeletionQueues)
         {
-            // Release the resource
-            pBlock->Destroy();
+            while (retiredBlocks.empty() == false &&
+                g_CommandManager.IsFenceComplete(retiredBlocks.front()->m_fenceValue))
+            {
+                completedBlocks.push_back(retiredBlocks.front());
+                retiredBlocks.pop();
+            }
         }
-        delete(pBlock);
     }
 
-    catch (std::bad_alloc&)
+    if (completedBlocks.empty())
+        return;
+
+    // Small blocks go to the magazine of this thread, the rest back to the offset allocator under one lock
+    vector<ConcurrentBuddyOffsetAllocator::Block> offsetBlocks(completedBlocks.size());
+    for (size_t i = 0; i < completedBlocks.size(); ++i)
     {
-        // Deallocate failed trying to add the free block to the pool  
-        // resulting in a leak.  Unfortunately there is not much we can do.  
-        // Fortunately this is expected to be extremely rare as the storage  
-        // needed for each deallocate is very small.  
+        offsetBlocks[i] = GetOffsetBlock(*completedBlocks[i]);
+        ReleaseBlock(completedBlocks[i]);
     }
-};
+    m_freeBlocks.DeallocateBatch(offsetBlocks.data(), offsetBlocks.size());
+}
 
-/*
-void BuddyAllocator::CleanUpAllocations()
+BuddyAllocatorStats BuddyAllocator::GetStats()
 {
-    while (m_deferredDeletionQueue.empty() == false &&
-        g_CommandManager.IsFenceComplete(m_deferredDeletionQueue.front()->m_fenceValue))
+    BuddyAllocatorStats stats;
+    stats.Offsets = m_freeBlocks.GetStats();
+    stats.SpaceUsed = m_SpaceUsed.load(std::memory_order_relaxed);
+    stats.InternalFragmentation = m_InternalFragmentation.load(std::memory_order_relaxed);
+    stats.RetiredBlocks = 0;
+
+    lock_guard<mutex> lock(m_retiredMutex);
+    for (auto& retiredBlocks : m_deferredDeletionQueues)
     {
-        BuddyBlock* pBlock = m_deferredDeletionQueue.front();
-        m_deferredDeletionQueue.pop();
-
-        DeallocateInternal(pBlock);
+        stats.RetiredBlocks += retiredBlocks.size();
     }
-}*/
+    return stats;
+}
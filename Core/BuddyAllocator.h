@@ -21,22 +21,15 @@
 #pragma once
 
 #include "GpuBuffer.h"
+#include "BuddyOffsetAllocator.h"
 #include <vector>
 #include <queue>
 #include <mutex>
-#include <set>
+#include <atomic>
 
 // Unfortunately the api restricts the minimum size of a placed buffer resource to 64k
 #define MIN_PLACED_BUFFER_SIZE (64 * 1024)
 
-#if defined(PROFILE) || defined(_DEBUG)
-#define INCREASE_BUDDY_COUNTER(A, B) (A = A + B);
-#define DECREASE_BUDDY_COUNTER(A, B) (A = A - B);
-#else
-#define INCREASE_BUDDY_COUNTER(A, B)
-#define DECREASE_BUDDY_COUNTER(A, B)
-#endif
-
 enum kBuddyAllocationStrategy
 {
     // This strategy uses Placed Resources to sub-allocate a buffer out of an underlying ID3D12Heap.
@@ -75,6 +68,18 @@ struct BuddyBlock
     void Destroy();
 };
 
+struct BuddyAllocatorStats
+{
+    BuddyOffsetStats Offsets;
+    // bytes of the allocated blocks, and how much of that is padding up to the block size
+    size_t SpaceUsed;
+    size_t InternalFragmentation;
+    // waiting for their fence
+    size_t RetiredBlocks;
+};
+
+// Allocate, Deallocate and CleanUpAllocations are thread-safe, so loading threads can create their buffers
+// without going through the render thread.
 class BuddyAllocator
 {
 public:
@@ -87,33 +92,37 @@ public:
 
     BuddyBlock* Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData = nullptr);
 
-    void Deallocate(BuddyBlock* pBlock);
+    // The block is freed by CleanUpAllocations once the fence has completed, 0 waits for the next fence of the graphics queue
+    void Deallocate(BuddyBlock* pBlock, uint64_t fenceValue = 0);
 
     inline bool IsOwner(const BuddyBlock &block)
     {
         return block.GetOffset() >= m_baseOffset && block.GetSize() <= m_maxBlockSize;
     }
 
+    // Not thread-safe
     inline void Reset()
     {
-        // Clear the free blocks collection  
-        m_freeBlocks.clear();
-
         // Initialize the pool with a free inner block of max inner block size  
-        m_freeBlocks.resize(m_maxOrder + 1);
-        m_freeBlocks[m_maxOrder].insert((size_t)0);
+        m_freeBlocks.Reset();
     }
 
     void CleanUpAllocations();
 
+    BuddyAllocatorStats GetStats();
+
 private:
     ID3D12Heap* m_pBackingHeap;
     ByteAddressBuffer m_BackingResource;
 
     const D3D12_HEAP_TYPE m_heapType;
 
-    std::queue<BuddyBlock*> m_deferredDeletionQueue;
-    std::vector<std::set<size_t>> m_freeBlocks;
+    // One list per command list type, the fence values of a queue only grow
+    static const uint32_t kQueueTypes = 4;
+    std::mutex m_retiredMutex;
+    std::queue<BuddyBlock*> m_deferredDeletionQueues[kQueueTypes];
+    // Offsets and sizes in units of m_minBlockSize
+    ConcurrentBuddyOffsetAllocator m_freeBlocks;
     UINT m_maxOrder;
     const size_t m_baseOffset;
     const size_t m_maxBlockSize;
@@ -131,19 +140,12 @@ private:
         return Math::Log2(size); // Log2 rounds up fractions to next whole value
     }
 
-    inline size_t GetBuddyOffset(const size_t &offset, const size_t &size)
-    {
-        return offset ^ size;
-    }
-
-    void DeallocateInternal(BuddyBlock* pBlock);
+    ConcurrentBuddyOffsetAllocator::Block GetOffsetBlock(const BuddyBlock& block) const;
+    // Counters, the placed resource and the block itself, after its offset was freed
+    void ReleaseBlock(BuddyBlock* pBlock);
 
     size_t OrderToUnitSize(UINT order) const { return ((size_t)1) << order; }
-    size_t AllocateBlock(UINT order);
-    void DeallocateBlock(size_t offset, UINT order);
 
-#if defined(PROFILE) || defined(_DEBUG)
-    size_t m_SpaceUsed;
-    size_t m_InternalFragmentation;
-#endif
+    std::atomic<size_t> m_SpaceUsed;
+    std::atomic<size_t> m_InternalFragmentation;
 };
@@ -0,0 +1,363 @@
+//
+// Offset bookkeeping of the BuddyAllocator, see BuddyOffsetAllocator.h
+//
+
+#include "BuddyOffsetAllocator.h"
+#include "Util/Assertions.h"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+void BuddyOffsetAllocator::Bitmap::Resize(size_t bitCount)
+{
+    m_levels.clear();
+    size_t wordCount = (bitCount + 63) / 64;
+    while (true)
+    {
+        m_levels.emplace_back(wordCount, 0ull);
+        if (wordCount == 1)
+            break;
+        wordCount = (wordCount + 63) / 64;
+    }
+}
+
+void BuddyOffsetAllocator::Bitmap::Clear()
+{
+    for (auto& level : m_levels)
+        std::fill(level.begin(), level.end(), 0ull);
+}
+
+void BuddyOffsetAllocator::Bitmap::Set(size_t index)
+{
+    for (auto& level : m_levels)
+    {
+        level[index >> 6] |= 1ull << (index & 63);
+        index >>= 6;
+    }
+}
+
+void BuddyOffsetAllocator::Bitmap::Reset(size_t index)
+{
+    for (auto& level : m_levels)
+    {
+        uint64_t& word = level[index >> 6];
+        word &= ~(1ull << (index & 63));
+        // the summary bit stays while the word has other free blocks
+        if (word != 0)
+            break;
+        index >>= 6;
+    }
+}
+
+size_t BuddyOffsetAllocator::Bitmap::FindFirst() const
+{
+    ASSERT(!IsEmpty());
+    size_t index = 0;
+    for (size_t level = m_levels.size(); level-- > 0;)
+        index = (index << 6) + FindFirstSet(m_levels[level][index]);
+    return index;
+}
+
+void BuddyOffsetAllocator::Initialize(uint32_t maxOrder)
+{
+    ASSERT(maxOrder < 64);
+    m_maxOrder = maxOrder;
+    m_freeBlocks.resize(maxOrder + 1);
+    for (uint32_t order = 0; order <= maxOrder; ++order)
+        m_freeBlocks[order].Resize(((size_t)1) << (maxOrder - order));
+
+    Reset();
+}
+
+void BuddyOffsetAllocator::Reset()
+{
+    for (auto& bitmap : m_freeBlocks)
+        bitmap.Clear();
+    m_nonEmptyOrders = 0;
+    m_freeUnits = 0;
+
+    AddFree(0, m_maxOrder);
+}
+
+void BuddyOffsetAllocator::AddFree(size_t index, uint32_t order)
+{
+    m_freeBlocks[order].Set(index);
+    m_nonEmptyOrders |= 1ull << order;
+    m_freeUnits += ((size_t)1) << order;
+}
+
+void BuddyOffsetAllocator::RemoveFree(size_t index, uint32_t order)
+{
+    Bitmap& bitmap = m_freeBlocks[order];
+    bitmap.Reset(index);
+    if (bitmap.IsEmpty())
+        m_nonEmptyOrders &= ~(1ull << order);
+    m_freeUnits -= ((size_t)1) << order;
+}
+
+size_t BuddyOffsetAllocator::Allocate(uint32_t order)
+{
+    if (order > m_maxOrder)
+        return kInvalidOffset;
+
+    // Smallest order at or above the requested one that has a free block
+    uint64_t candidates = m_nonEmptyOrders >> order;
+    if (candidates == 0)
+        return kInvalidOffset;
+
+    uint32_t freeOrder = order + FindFirstSet(candidates);
+    size_t index = m_freeBlocks[freeOrder].FindFirst();
+    RemoveFree(index, freeOrder);
+
+    // Split down to the requested order, keeping the left halves and freeing the right ones
+    while (freeOrder > order)
+    {
+        --freeOrder;
+        index <<= 1;
+        AddFree(index + 1, freeOrder);
+    }
+
+    return index << order;
+}
+
+void BuddyOffsetAllocator::Deallocate(size_t offset, uint32_t order)
+{
+    ASSERT(order <= m_maxOrder);
+    ASSERT((offset & ((((size_t)1) << order) - 1)) == 0, "Offset is not aligned to its block size");
+    ASSERT(!IsFree(offset, order), "Block is already free");
+
+    size_t index = offset >> order;
+
+    // Merge with the buddy as long as it is free as a whole
+    while (order < m_maxOrder && m_freeBlocks[order].Test(index ^ 1))
+    {
+        RemoveFree(index ^ 1, order);
+        index >>= 1;
+        ++order;
+    }
+
+    AddFree(index, order);
+}
+
+bool BuddyOffsetAllocator::IsFree(size_t offset, uint32_t order) const
+{
+    // Free on its own or as part of a larger free block
+    for (size_t index = offset >> order; order <= m_maxOrder; ++order, index >>= 1)
+    {
+        if (m_freeBlocks[order].Test(index))
+            return true;
+    }
+    return false;
+}
+
+size_t BuddyOffsetAllocator::GetLargestFreeBlock() const
+{
+    for (uint32_t order = m_maxOrder + 1; order-- > 0;)
+    {
+        if (m_nonEmptyOrders & (1ull << order))
+            return ((size_t)1) << order;
+    }
+    return 0;
+}
+
+// Magazines are locked before the global allocator, never the other way around
+
+uint32_t ConcurrentBuddyOffsetAllocator::GetThreadSlot()
+{
+    static std::atomic<uint32_t> s_nextSlot(0);
+    thread_local uint32_t t_slot = s_nextSlot.fetch_add(1, std::memory_order_relaxed) % kMagazineSlots;
+    return t_slot;
+}
+
+void ConcurrentBuddyOffsetAllocator::Initialize(uint32_t maxOrder)
+{
+    m_allocator.Initialize(maxOrder);
+    Reset();
+}
+
+void ConcurrentBuddyOffsetAllocator::Reset()
+{
+    m_allocator.Reset();
+    for (Magazine& magazine : m_magazines)
+    {
+        for (uint32_t& count : magazine.Counts)
+            count = 0;
+        magazine.Allocations = 0;
+        magazine.Deallocations = 0;
+        magazine.Hits = 0;
+    }
+    m_allocations = 0;
+    m_deallocations = 0;
+    m_globalLocks = 0;
+    m_failures = 0;
+}
+
+size_t ConcurrentBuddyOffsetAllocator::AllocateGlobal(uint32_t order)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_globalLocks;
+    ++m_allocations;
+    size_t offset = m_allocator.Allocate(order);
+    if (offset == BuddyOffsetAllocator::kInvalidOffset)
+        ++m_failures;
+    return offset;
+}
+
+size_t ConcurrentBuddyOffsetAllocator::AllocateCached(uint32_t order)
+{
+    Magazine& magazine = m_magazines[GetThreadSlot()];
+    std::lock_guard<std::mutex> lock(magazine.Mutex);
+    ++magazine.Allocations;
+
+    uint32_t& count = magazine.Counts[order];
+    if (count > 0)
+    {
+        ++magazine.Hits;
+        return magazine.Offsets[order][--count];
+    }
+
+    // Refill half a magazine under one lock
+    {
+        std::lock_guard<std::mutex> globalLock(m_mutex);
+        ++m_globalLocks;
+        while (count < kBatchSize)
+        {
+            size_t offset = m_allocator.Allocate(order);
+            if (offset == BuddyOffsetAllocator::kInvalidOffset)
+                break;
+            magazine.Offsets[order][count++] = offset;
+        }
+        if (count == 0)
+        {
+            ++m_failures;
+            return BuddyOffsetAllocator::kInvalidOffset;
+        }
+    }
+
+    // Lowest offsets are handed out first, as without the magazine
+    std::reverse(magazine.Offsets[order], magazine.Offsets[order] + count);
+    return magazine.Offsets[order][--count];
+}
+
+size_t ConcurrentBuddyOffsetAllocator::Allocate(uint32_t order)
+{
+    size_t offset = order <= kMaxCachedOrder ? AllocateCached(order) : AllocateGlobal(order);
+    if (offset == BuddyOffsetAllocator::kInvalidOffset)
+    {
+        // The space may only be held by the magazines of other threads
+        FlushMagazines();
+        offset = AllocateGlobal(order);
+    }
+    return offset;
+}
+
+void ConcurrentBuddyOffsetAllocator::CacheBlock(Magazine& magazine, const Block& block, std::vector<Block>& returned)
+{
+    ++magazine.Deallocations;
+
+    size_t* offsets = magazine.Offsets[block.Order];
+    uint32_t& count = magazine.Counts[block.Order];
+    if (count == kMagazineCapacity)
+    {
+        // The oldest half goes back, the recently freed blocks stay for the next allocations
+        for (uint32_t i = 0; i < kBatchSize; ++i)
+            returned.push_back({ offsets[i], block.Order });
+        std::copy(offsets + kBatchSize, offsets + count, offsets);
+        count -= kBatchSize;
+    }
+    offsets[count++] = block.Offset;
+}
+
+void ConcurrentBuddyOffsetAllocator::Deallocate(size_t offset, uint32_t order)
+{
+    Block block = { offset, order };
+    DeallocateBatch(&block, 1);
+}
+
+void ConcurrentBuddyOffsetAllocator::DeallocateBatch(const Block* blocks, size_t count)
+{
+    // Blocks for the global allocator, those of uncached orders first
+    std::vector<Block> returned;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (blocks[i].Order > kMaxCachedOrder)
+        {
+            if (returned.empty())
+                returned.reserve(count);
+            returned.push_back(blocks[i]);
+        }
+    }
+    const size_t uncachedCount = returned.size();
+
+    if (uncachedCount < count)
+    {
+        Magazine& magazine = m_magazines[GetThreadSlot()];
+        std::lock_guard<std::mutex> lock(magazine.Mutex);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (blocks[i].Order <= kMaxCachedOrder)
+                CacheBlock(magazine, blocks[i], returned);
+        }
+    }
+
+    if (returned.empty())
+        return;
+
+    // Magazine deallocations were counted by the magazine
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_globalLocks;
+    m_deallocations += uncachedCount;
+    for (const Block& block : returned)
+        m_allocator.Deallocate(block.Offset, block.Order);
+}
+
+void ConcurrentBuddyOffsetAllocator::ReturnBlocks(const Block* blocks, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_globalLocks;
+    for (size_t i = 0; i < count; ++i)
+        m_allocator.Deallocate(blocks[i].Offset, blocks[i].Order);
+}
+
+void ConcurrentBuddyOffsetAllocator::FlushMagazines()
+{
+    Block returned[(kMaxCachedOrder + 1) * kMagazineCapacity];
+    for (Magazine& magazine : m_magazines)
+    {
+        size_t returnedCount = 0;
+        std::lock_guard<std::mutex> lock(magazine.Mutex);
+        for (uint32_t order = 0; order <= kMaxCachedOrder; ++order)
+        {
+            for (uint32_t i = 0; i < magazine.Counts[order]; ++i)
+                returned[returnedCount++] = { magazine.Offsets[order][i], order };
+            magazine.Counts[order] = 0;
+        }
+        if (returnedCount > 0)
+            ReturnBlocks(returned, returnedCount);
+    }
+}
+
+BuddyOffsetStats ConcurrentBuddyOffsetAllocator::GetStats()
+{
+    BuddyOffsetStats stats = {};
+    for (Magazine& magazine : m_magazines)
+    {
+        std::lock_guard<std::mutex> lock(magazine.Mutex);
+        stats.Allocations += magazine.Allocations;
+        stats.Deallocations += magazine.Deallocations;
+        stats.MagazineHits += magazine.Hits;
+        for (uint32_t order = 0; order <= kMaxCachedOrder; ++order)
+            stats.CachedUnits += ((size_t)magazine.Counts[order]) << order;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.Allocations += m_allocations;
+    stats.Deallocations += m_deallocations;
+    stats.GlobalLocks = m_globalLocks;
+    stats.Failures = m_failures;
+    stats.FreeUnits = m_allocator.GetFreeUnits();
+    stats.LargestFreeBlock = m_allocator.GetLargestFreeBlock();
+    return stats;
+}
@@ -0,0 +1,165 @@
+//
+// Offset bookkeeping of the BuddyAllocator, without any device objects so it can be tested and measured on its own.
+//
+// Offsets and sizes are in units of the minimum block size. Each order keeps a bitmap of its free blocks with a
+// summary level above every 64 words, so finding the lowest free block of an order is a handful of find-first-set
+// operations. The free bits double as the split/merge tree: a freed block merges as long as the bit of its buddy
+// (index ^ 1) at the same order is set.
+//
+// ConcurrentBuddyOffsetAllocator puts a lock around it and keeps recently freed small blocks in magazines, so that
+// threads only take the global lock to refill or return a magazine in batches.  There is a fixed set of magazines,
+// each behind its own mutex; a thread is given one of them on first use, round robin, and threads beyond
+// kMagazineSlots share.  Threads on different slots never contend outside the global lock.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+class BuddyOffsetAllocator
+{
+public:
+    static const size_t kInvalidOffset = ~(size_t)0;
+
+    BuddyOffsetAllocator() : m_maxOrder(0), m_nonEmptyOrders(0), m_freeUnits(0) {}
+
+    // 2^maxOrder units in total, at most 63
+    void Initialize(uint32_t maxOrder);
+
+    // Everything free as one block of the max order
+    void Reset();
+
+    // Lowest free offset of a block of 2^order units, kInvalidOffset if none is left
+    size_t Allocate(uint32_t order);
+
+    void Deallocate(size_t offset, uint32_t order);
+
+    bool IsFree(size_t offset, uint32_t order) const;
+
+    uint32_t GetMaxOrder() const { return m_maxOrder; }
+    size_t GetFreeUnits() const { return m_freeUnits; }
+    size_t GetTotalUnits() const { return ((size_t)1) << m_maxOrder; }
+
+    // Largest block that can still be allocated, 0 when full
+    size_t GetLargestFreeBlock() const;
+
+private:
+    // One bit per block of an order, plus summary levels where a bit is set when the word below it is not zero
+    struct Bitmap
+    {
+        std::vector<std::vector<uint64_t>> m_levels;
+
+        void Resize(size_t bitCount);
+        void Clear();
+        void Set(size_t index);
+        void Reset(size_t index);
+        bool Test(size_t index) const { return 0 != (m_levels[0][index >> 6] & (1ull << (index & 63))); }
+        bool IsEmpty() const { return 0 == m_levels.back()[0]; }
+        size_t FindFirst() const;
+    };
+
+    static inline uint32_t FindFirstSet(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctzll(value);
+#endif
+    }
+
+    void AddFree(size_t index, uint32_t order);
+    void RemoveFree(size_t index, uint32_t order);
+
+    uint32_t m_maxOrder;
+    std::vector<Bitmap> m_freeBlocks;
+    // bit per order that has a free block
+    uint64_t m_nonEmptyOrders;
+    size_t m_freeUnits;
+};
+
+struct BuddyOffsetStats
+{
+    uint64_t Allocations;
+    uint64_t Deallocations;
+    // allocations served from a magazine without the global lock
+    uint64_t MagazineHits;
+    uint64_t GlobalLocks;
+    uint64_t Failures;
+    // held in magazines, allocated as far as the global allocator is concerned
+    size_t CachedUnits;
+    size_t FreeUnits;
+    size_t LargestFreeBlock;
+};
+
+class ConcurrentBuddyOffsetAllocator
+{
+public:
+    // Orders up to this are cached per thread
+    static const uint32_t kMaxCachedOrder = 3;
+    static const uint32_t kMagazineCapacity = 32;
+    // blocks moved between a magazine and the global allocator at once
+    static const uint32_t kBatchSize = kMagazineCapacity / 2;
+    // magazines, threads beyond this share them
+    static const uint32_t kMagazineSlots = 16;
+
+    struct Block
+    {
+        size_t Offset;
+        uint32_t Order;
+    };
+
+    void Initialize(uint32_t maxOrder);
+
+    // Not thread-safe, drops the magazines
+    void Reset();
+
+    // Thread-safe, kInvalidOffset if none is left
+    size_t Allocate(uint32_t order);
+    void Deallocate(size_t offset, uint32_t order);
+    // Small blocks go to the magazine of the calling thread; larger ones, and the oldest half of a magazine that
+    // fills up, go back to the global allocator under one lock
+    void DeallocateBatch(const Block* blocks, size_t count);
+
+    // Gives every cached block back, before measuring fragmentation or when memory runs out
+    void FlushMagazines();
+
+    BuddyOffsetStats GetStats();
+    size_t GetTotalUnits() const { return m_allocator.GetTotalUnits(); }
+
+private:
+    struct alignas(64) Magazine
+    {
+        std::mutex Mutex;
+        size_t Offsets[kMaxCachedOrder + 1][kMagazineCapacity];
+        uint32_t Counts[kMaxCachedOrder + 1];
+        // counters of the threads using this slot, under Mutex
+        uint64_t Allocations;
+        uint64_t Deallocations;
+        uint64_t Hits;
+    };
+
+    static uint32_t GetThreadSlot();
+    size_t AllocateCached(uint32_t order);
+    size_t AllocateGlobal(uint32_t order);
+    // Caches the block in magazine, blocks that have to go to the global allocator are appended to returned
+    static void CacheBlock(Magazine& magazine, const Block& block, std::vector<Block>& returned);
+    void ReturnBlocks(const Block* blocks, size_t count);
+
+    std::mutex m_mutex;
+    BuddyOffsetAllocator m_allocator;
+    // under m_mutex, allocations and deallocations of orders that are not cached
+    uint64_t m_allocations = 0;
+    uint64_t m_deallocations = 0;
+    uint64_t m_globalLocks = 0;
+    uint64_t m_failures = 0;
+    Magazine m_magazines[kMagazineSlots];
+};
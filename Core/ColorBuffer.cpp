@@ -75,6 +75,11 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
         m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
         m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
+    else
+    {
+        // The views are rewritten in place, tables copied from them are out of date
+        DynamicDescriptorHeap::InvalidateTableCaches();
+    }
 
     ID3D12Resource* Resource = m_pResource.Get();
 
@@ -83,6 +88,8 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
 
     // Create the shader resource view
     Device->CreateShaderResourceView(Resource, &SRVDesc, m_SRVHandle);
+    if (m_PersistentSRVIndex != kNoPersistentSRV)
+        DynamicDescriptorHeap::SetPersistentDescriptor(m_PersistentSRVIndex, m_SRVHandle);
 
     if (m_FragmentCount > 1)
         return;
@@ -99,6 +106,14 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
     }
 }
 
+void ColorBuffer::SetPersistentSRV( uint32_t Index )
+{
+    ASSERT(Index < DynamicDescriptorHeap::kNumPersistentDescriptors);
+    m_PersistentSRVIndex = Index;
+    if (m_SRVHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+        DynamicDescriptorHeap::SetPersistentDescriptor(Index, m_SRVHandle);
+}
+
 void ColorBuffer::CreateFromSwapChain( const std::wstring& Name, ID3D12Resource* BaseResource )
 {
     AssociateWithResource(Graphics::g_Device, Name, BaseResource, D3D12_RESOURCE_STATE_PRESENT);
@@ -23,7 +23,7 @@ class ColorBuffer : public PixelBuffer
 {
 public:
     ColorBuffer( Color ClearColor = Color(0.0f, 0.0f, 0.0f, 0.0f)  )
-        : m_ClearColor(ClearColor), m_NumMipMaps(0), m_FragmentCount(1), m_SampleCount(1)
+        : m_ClearColor(ClearColor), m_NumMipMaps(0), m_FragmentCount(1), m_SampleCount(1), m_PersistentSRVIndex(kNoPersistentSRV)
     {
         m_RTVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
         m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
@@ -61,6 +61,10 @@ public:
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetRTV(void) const { return m_RTVHandle; }
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetUAV(void) const { return m_UAVHandle[0]; }
 
+    // Keeps the SRV in a slot of the persistent descriptor region, see DynamicDescriptorHeap::SetPersistentDescriptor.
+    // Set before Create, every Create writes the slot again along with the views.
+    void SetPersistentSRV( uint32_t Index );
+
     void SetClearColor( Color ClearColor ) { m_ClearColor = ClearColor; }
 
     void SetMsaaMode( uint32_t NumColorSamples, uint32_t NumCoverageSamples )
@@ -109,4 +113,7 @@ protected:
     uint32_t m_NumMipMaps; // number of texture sublevels
     uint32_t m_FragmentCount;
     uint32_t m_SampleCount;
+
+    static const uint32_t kNoPersistentSRV = ~0u;
+    uint32_t m_PersistentSRVIndex;
 };
@@ -20,6 +20,8 @@
 #include "EngineProfiling.h"
 #include "UploadBuffer.h"
 #include "ReadbackBuffer.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
 
 #pragma warning(push)
 #pragma warning(disable:4100) // unreferenced formal parameters in PIXCopyEventArguments() (WinPixEventRuntime.1.0.200127001)
@@ -96,6 +98,8 @@ ComputeContext& ComputeContext::Begin(const std::wstring& ID, bool Async)
 
 uint64_t CommandContext::Flush(bool WaitForCompletion)
 {
+    ASSERT(!m_DeferResourceStates, "Passes of a ParallelPassRecorder are submitted by the recorder");
+
     FlushResourceBarriers();
 
     ASSERT(m_CurrentAllocator != nullptr);
@@ -132,6 +136,7 @@ uint64_t CommandContext::Flush(bool WaitForCompletion)
 uint64_t CommandContext::Finish( bool WaitForCompletion )
 {
     ASSERT(m_Type == D3D12_COMMAND_LIST_TYPE_DIRECT || m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    ASSERT(!m_DeferResourceStates, "Passes of a ParallelPassRecorder are submitted by the recorder");
 
     FlushResourceBarriers();
 
@@ -140,10 +145,19 @@ uint64_t CommandContext::Finish( bool WaitForCompletion )
 
     ASSERT(m_CurrentAllocator != nullptr);
 
-    CommandQueue& Queue = g_CommandManager.GetQueue(m_Type);
+    uint64_t FenceValue = g_CommandManager.GetQueue(m_Type).ExecuteCommandList(m_CommandList);
+
+    if (WaitForCompletion)
+        g_CommandManager.WaitForFence(FenceValue);
+
+    Retire(FenceValue);
 
-    uint64_t FenceValue = Queue.ExecuteCommandList(m_CommandList);
-    Queue.DiscardAllocator(FenceValue, m_CurrentAllocator);
+    return FenceValue;
+}
+
+void CommandContext::Retire( uint64_t FenceValue )
+{
+    g_CommandManager.GetQueue(m_Type).DiscardAllocator(FenceValue, m_CurrentAllocator);
     m_CurrentAllocator = nullptr;
 
     m_CpuLinearAllocator.CleanupUsedPages(FenceValue);
@@ -151,19 +165,17 @@ uint64_t CommandContext::Finish( bool WaitForCompletion )
     m_DynamicViewDescriptorHeap.CleanupUsedHeaps(FenceValue);
     m_DynamicSamplerDescriptorHeap.CleanupUsedHeaps(FenceValue);
 
-    if (WaitForCompletion)
-        g_CommandManager.WaitForFence(FenceValue);
+    m_DeferResourceStates = false;
+    m_DeferredStates.Clear();
 
     g_ContextManager.FreeContext(this);
-
-    return FenceValue;
 }
 
 CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type) :
     m_Type(Type),
     m_DynamicViewDescriptorHeap(*this, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV),
     m_DynamicSamplerDescriptorHeap(*this, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER),
-    m_CpuLinearAllocator(kCpuWritable), 
+    m_CpuLinearAllocator(kCpuWritable, Type), 
     m_GpuLinearAllocator(kGpuExclusive)
 {
     m_OwningManager = nullptr;
@@ -175,6 +187,8 @@ CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type) :
     m_CurComputeRootSignature = nullptr;
     m_CurPipelineState = nullptr;
     m_NumBarriersToFlush = 0;
+
+    m_DeferResourceStates = false;
 }
 
 CommandContext::~CommandContext( void )
@@ -354,17 +368,53 @@ void GraphicsContext::SetScissor( const D3D12_RECT& rect )
     m_CommandList->RSSetScissorRects( 1, &rect );
 }
 
+D3D12_RESOURCE_STATES CommandContext::GetResourceState( const GpuResource& Resource ) const
+{
+    return (D3D12_RESOURCE_STATES)m_DeferredStates.GetState(&Resource, Resource.m_UsageState);
+}
+
 void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
 {
     D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
 
+    if (m_DeferResourceStates)
+    {
+        PassResourceStates::State PassState;
+        if (!m_DeferredStates.Use(&Resource, NewState, PassState))
+        {
+            ASSERT(m_Type != D3D12_COMMAND_LIST_TYPE_COMPUTE || (NewState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == NewState);
+            if (FlushImmediate)
+                FlushResourceBarriers();
+            return;
+        }
+        OldState = (D3D12_RESOURCE_STATES)PassState;
+    }
+
     if (m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE)
     {
         ASSERT((OldState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == OldState);
         ASSERT((NewState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == NewState);
     }
 
-    if (OldState != NewState)
+    if (m_DeferResourceStates)
+    {
+        // Split barriers are not tracked per pass, the transition happens here in full
+        if (OldState != NewState)
+        {
+            ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
+            D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+
+            BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            BarrierDesc.Transition.pResource = Resource.GetResource();
+            BarrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+            BarrierDesc.Transition.StateBefore = OldState;
+            BarrierDesc.Transition.StateAfter = NewState;
+        }
+        else if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+            InsertUAVBarrier(Resource, FlushImmediate);
+    }
+    else if (OldState != NewState)
     {
         ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
         D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
@@ -395,6 +445,11 @@ void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_ST
 
 void CommandContext::BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
 {
+    // The state the pass will find the resource in is not known yet, the TransitionResource that ends this
+    // transition does all of it
+    if (m_DeferResourceStates)
+        return;
+
     // If it's already transitioning, finish that transition
     if (Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)-1)
         TransitionResource(Resource, Resource.m_TransitioningState);
@@ -421,6 +476,29 @@ void CommandContext::BeginResourceTransition(GpuResource& Resource, D3D12_RESOUR
         FlushResourceBarriers();
 }
 
+void CommandContext::ResolveResourceStates( CommandContext& Pass )
+{
+    ASSERT(!m_DeferResourceStates);
+
+    Pass.m_DeferredStates.Resolve(
+        [this]( void* Tracked, PassResourceStates::State InitialState )
+        {
+            GpuResource& Resource = *static_cast<GpuResource*>(Tracked);
+
+            // A split transition started before the pass ends here
+            if (Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)-1 && Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)InitialState)
+                TransitionResource(Resource, Resource.m_TransitioningState);
+
+            TransitionResource(Resource, (D3D12_RESOURCE_STATES)InitialState);
+        },
+        []( void* Tracked, PassResourceStates::State FinalState )
+        {
+            static_cast<GpuResource*>(Tracked)->m_UsageState = (D3D12_RESOURCE_STATES)FinalState;
+        });
+
+    Pass.m_DeferResourceStates = false;
+}
+
 void CommandContext::InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate)
 {
     ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
@@ -471,8 +549,8 @@ void CommandContext::InitializeTexture( GpuResource& Dest, UINT NumSubresources,
     CommandContext& InitContext = CommandContext::Begin();
 
     // copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
-    DynAlloc mem = InitContext.ReserveUploadMemory(uploadBufferSize);
-    UpdateSubresources(InitContext.m_CommandList, Dest.GetResource(), mem.Buffer.GetResource(), 0, 0, NumSubresources, SubData);
+    DynAlloc mem = InitContext.ReserveUploadMemory(uploadBufferSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    UpdateSubresources(InitContext.m_CommandList, Dest.GetResource(), mem.Buffer.GetResource(), mem.Offset, 0, NumSubresources, SubData);
     InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ);
 
     // Execute the command list and wait for it to finish so we can release the upload buffer
@@ -571,7 +649,7 @@ void CommandContext::InitializeBuffer( GpuBuffer& Dest, const void* BufferData,
 
     // copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
     InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST, true);
-    InitContext.m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, mem.Buffer.GetResource(), 0, NumBytes);
+    InitContext.m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, mem.Buffer.GetResource(), mem.Offset, NumBytes);
     InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ, true);
 
     // Execute the command list and wait for it to finish so we can release the upload buffer
@@ -618,3 +696,107 @@ void CommandContext::PIXSetMarker(const wchar_t* label)
 	::PIXSetMarker(m_CommandList, 0, label);
 #endif
 }
+
+ParallelPassRecorder::ParallelPassRecorder( const std::wstring& ID, bool RecordInParallel ) :
+    m_ID(ID),
+    m_RecordInParallel(RecordInParallel)
+{
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+void ParallelPassRecorder::AddGraphicsPass( const std::wstring& Name, const std::function<void(GraphicsContext&)>& Record )
+{
+    Pass NewPass;
+    NewPass.Name = Name;
+    NewPass.Record = [Record](CommandContext& Context) { Record(Context.GetGraphicsContext()); };
+    NewPass.Seconds = 0.0;
+    m_Passes.push_back(NewPass);
+}
+
+void ParallelPassRecorder::AddComputePass( const std::wstring& Name, const std::function<void(ComputeContext&)>& Record )
+{
+    Pass NewPass;
+    NewPass.Name = Name;
+    NewPass.Record = [Record](CommandContext& Context) { Record(Context.GetComputeContext()); };
+    NewPass.Seconds = 0.0;
+    m_Passes.push_back(NewPass);
+}
+
+uint64_t ParallelPassRecorder::Execute( bool WaitForCompletion )
+{
+    const uint32_t PassCount = (uint32_t)m_Passes.size();
+    int64_t StartTick = SystemTime::GetCurrentTick();
+
+    // The list ahead of the passes takes the transitions into the first pass and opens the block of the batch
+    CommandContext* Prologue = g_ContextManager.AllocateContext(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    Prologue->SetID(L"");
+    if (m_ID.length() > 0)
+        EngineProfiling::BeginBlock(m_ID, Prologue);
+
+    std::vector<CommandContext*> Contexts(PassCount);
+    for (uint32_t i = 0; i < PassCount; ++i)
+    {
+        Contexts[i] = g_ContextManager.AllocateContext(D3D12_COMMAND_LIST_TYPE_DIRECT);
+        Contexts[i]->SetID(L"");
+        Contexts[i]->m_DeferResourceStates = true;
+    }
+
+    auto RecordPass = [this, &Contexts](uint32_t i)
+    {
+        int64_t PassStartTick = SystemTime::GetCurrentTick();
+        m_Passes[i].Record(*Contexts[i]);
+        Contexts[i]->FlushResourceBarriers();
+        m_Passes[i].Seconds = SystemTime::TimeBetweenTicks(PassStartTick, SystemTime::GetCurrentTick());
+    };
+
+    if (m_RecordInParallel)
+        JobSystem::ParallelFor(0, PassCount, 1, RecordPass);
+    else
+    {
+        for (uint32_t i = 0; i < PassCount; ++i)
+            RecordPass(i);
+    }
+
+    // Walk the passes in submission order.  Each one finds its resources in the states the passes before it left
+    // them in, the transitions into the states it expects go at the end of the list before it.
+    std::vector<ID3D12CommandList*> Lists;
+    Lists.reserve(PassCount + 1);
+    Lists.push_back(Prologue->m_CommandList);
+
+    m_Stats.PassSeconds = 0.0;
+    CommandContext* Previous = Prologue;
+    for (uint32_t i = 0; i < PassCount; ++i)
+    {
+        CommandContext& Context = *Contexts[i];
+        Previous->ResolveResourceStates(Context);
+        Previous->FlushResourceBarriers();
+
+        if (m_Passes[i].Name.length() > 0)
+        {
+            EngineProfiling::BeginBlock(m_Passes[i].Name, Previous);
+            EngineProfiling::EndBlock(&Context);
+        }
+
+        Lists.push_back(Context.m_CommandList);
+        m_Stats.PassSeconds += m_Passes[i].Seconds;
+        Previous = &Context;
+    }
+
+    if (m_ID.length() > 0)
+        EngineProfiling::EndBlock(Previous);
+
+    uint64_t FenceValue = g_CommandManager.GetGraphicsQueue().ExecuteCommandLists((UINT)Lists.size(), Lists.data());
+
+    Prologue->Retire(FenceValue);
+    for (CommandContext* Context : Contexts)
+        Context->Retire(FenceValue);
+
+    m_Stats.PassCount = PassCount;
+    m_Stats.RecordSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+    m_Passes.clear();
+
+    if (WaitForCompletion)
+        g_CommandManager.WaitForFence(FenceValue);
+
+    return FenceValue;
+}
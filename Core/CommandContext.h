@@ -24,8 +24,10 @@
 #include "DynamicDescriptorHeap.h"
 #include "LinearAllocator.h"
 #include "CommandSignature.h"
+#include "PassResourceStates.h"
 #include "GraphicsCore.h"
 #include <vector>
+#include <functional>
 
 class ColorBuffer;
 class DepthBuffer;
@@ -34,6 +36,7 @@ class GraphicsContext;
 class ComputeContext;
 class UploadBuffer;
 class ReadbackBuffer;
+class ParallelPassRecorder;
 
 struct DWParam
 {
@@ -84,12 +87,23 @@ struct NonCopyable
 class CommandContext : NonCopyable
 {
     friend ContextManager;
+    friend ParallelPassRecorder;
+    // Takes open descriptor heaps of the queue the context records for
+    friend class DynamicDescriptorHeap;
 private:
 
     CommandContext(D3D12_COMMAND_LIST_TYPE Type);
 
     void Reset( void );
 
+    // Hands the allocator, descriptor heaps and linear allocator pages back once FenceValue has been signaled and
+    // returns the context to the pool
+    void Retire( uint64_t FenceValue );
+
+    // Records the transitions that bring every resource Pass tracked into the state the pass first used it in, then
+    // publishes the states the pass left them in
+    void ResolveResourceStates( CommandContext& Pass );
+
 public:
 
     ~CommandContext(void);
@@ -131,9 +145,9 @@ public:
     // and returns row pitch in bytes.
     uint32_t ReadbackTexture(ReadbackBuffer& DstBuffer, PixelBuffer& SrcBuffer);
 
-    DynAlloc ReserveUploadMemory(size_t SizeInBytes)
+    DynAlloc ReserveUploadMemory(size_t SizeInBytes, size_t Alignment = DEFAULT_ALIGN)
     {
-        return m_CpuLinearAllocator.Allocate(SizeInBytes);
+        return m_CpuLinearAllocator.Allocate(SizeInBytes, Alignment);
     }
 
     static void InitializeTexture( GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[] );
@@ -162,6 +176,9 @@ public:
 
     void SetPredication(ID3D12Resource* Buffer, UINT64 BufferOffset, D3D12_PREDICATION_OP Op);
 
+    // State of Resource as seen by the commands recorded so far
+    D3D12_RESOURCE_STATES GetResourceState( const GpuResource& Resource ) const;
+
 protected:
 
     void BindDescriptorHeaps( void );
@@ -189,6 +206,10 @@ protected:
     void SetID(const std::wstring& ID) { m_ID = ID; }
 
     D3D12_COMMAND_LIST_TYPE m_Type;
+
+    // Set on the passes of a ParallelPassRecorder, which keep the states of their resources to themselves
+    bool m_DeferResourceStates;
+    PassResourceStates m_DeferredStates;
 };
 
 class GraphicsContext : public CommandContext
@@ -246,6 +267,8 @@ public:
     void SetDynamicDescriptors( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
     void SetDynamicSampler( UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle );
     void SetDynamicSamplers( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
+    // Binds the persistent region of the dynamic heap, see DynamicDescriptorHeap::SetPersistentDescriptor
+    void SetPersistentDescriptorTable( UINT RootIndex );
 
     void SetIndexBuffer( const D3D12_INDEX_BUFFER_VIEW& IBView );
     void SetVertexBuffer( UINT Slot, const D3D12_VERTEX_BUFFER_VIEW& VBView );
@@ -295,6 +318,8 @@ public:
     void SetDynamicDescriptors( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
     void SetDynamicSampler( UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle );
     void SetDynamicSamplers( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
+    // Binds the persistent region of the dynamic heap, see DynamicDescriptorHeap::SetPersistentDescriptor
+    void SetPersistentDescriptorTable( UINT RootIndex );
 
     void Dispatch( size_t GroupCountX = 1, size_t GroupCountY = 1, size_t GroupCountZ = 1 );
     void Dispatch1D( size_t ThreadCountX, size_t GroupSizeX = 64);
@@ -307,6 +332,49 @@ public:
 private:
 };
 
+// Records passes on the job system threads, one command list each, and submits them in the order they were added.
+// The transitions between passes are resolved on submission, see PassResourceStates.  Passes must not touch shared
+// CPU state, Finish their context or open profiling blocks of their own.
+struct ParallelPassStats
+{
+    uint32_t PassCount;
+    // Time from the start of recording to the submission of the last list
+    double RecordSeconds;
+    // Sum of the time each pass took to record
+    double PassSeconds;
+};
+
+class ParallelPassRecorder : NonCopyable
+{
+public:
+    // ID names a profiling block around the whole batch.  With RecordInParallel false the passes record one after
+    // the other on the calling thread, otherwise the same.
+    ParallelPassRecorder( const std::wstring& ID = L"", bool RecordInParallel = true );
+
+    void AddGraphicsPass( const std::wstring& Name, const std::function<void(GraphicsContext&)>& Record );
+
+    // Runs on the direct queue
+    void AddComputePass( const std::wstring& Name, const std::function<void(ComputeContext&)>& Record );
+
+    // Records and submits the passes added since the last call, returns the fence value of the batch
+    uint64_t Execute( bool WaitForCompletion = false );
+
+    const ParallelPassStats& GetStats( void ) const { return m_Stats; }
+
+private:
+    struct Pass
+    {
+        std::wstring Name;
+        std::function<void(CommandContext&)> Record;
+        double Seconds;
+    };
+
+    std::wstring m_ID;
+    bool m_RecordInParallel;
+    std::vector<Pass> m_Passes;
+    ParallelPassStats m_Stats;
+};
+
 inline void CommandContext::FlushResourceBarriers( void )
 {
     if (m_NumBarriersToFlush > 0)
@@ -526,25 +594,25 @@ inline void ComputeContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, con
 
 inline void GraphicsContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset)
 {
-    ASSERT((SRV.m_UsageState & (D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)) != 0);
+    ASSERT((GetResourceState(SRV) & (D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)) != 0);
     m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void ComputeContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset)
 {
-    ASSERT((SRV.m_UsageState & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0);
+    ASSERT((GetResourceState(SRV) & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0);
     m_CommandList->SetComputeRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void GraphicsContext::SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV, UINT64 Offset)
 {
-    ASSERT((UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
+    ASSERT((GetResourceState(UAV) & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
     m_CommandList->SetGraphicsRootUnorderedAccessView(RootIndex, UAV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void ComputeContext::SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV, UINT64 Offset)
 {
-    ASSERT((UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
+    ASSERT((GetResourceState(UAV) & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
     m_CommandList->SetComputeRootUnorderedAccessView(RootIndex, UAV.GetGpuVirtualAddress() + Offset);
 }
 
@@ -627,6 +695,16 @@ inline void ComputeContext::SetDynamicDescriptors( UINT RootIndex, UINT Offset,
     m_DynamicViewDescriptorHeap.SetComputeDescriptorHandles(RootIndex, Offset, Count, Handles);
 }
 
+inline void GraphicsContext::SetPersistentDescriptorTable( UINT RootIndex )
+{
+    m_DynamicViewDescriptorHeap.SetGraphicsPersistentTable(RootIndex);
+}
+
+inline void ComputeContext::SetPersistentDescriptorTable( UINT RootIndex )
+{
+    m_DynamicViewDescriptorHeap.SetComputePersistentTable(RootIndex);
+}
+
 inline void GraphicsContext::SetDynamicSampler( UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle )
 {
     SetDynamicSamplers(RootIndex, Offset, 1, &Handle);
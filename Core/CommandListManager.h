@@ -23,6 +23,7 @@ class CommandQueue
 {
     friend class CommandListManager;
     friend class CommandContext;
+    friend class ParallelPassRecorder;
 
 public:
     CommandQueue(D3D12_COMMAND_LIST_TYPE Type);
@@ -50,6 +51,9 @@ public:
 private:
 
     uint64_t ExecuteCommandList(ID3D12CommandList* List);
+
+    // Closes the lists and executes them in order behind a single fence value
+    uint64_t ExecuteCommandLists(UINT Count, ID3D12CommandList** Lists);
     ID3D12CommandAllocator* RequestAllocator(void);
     void DiscardAllocator(uint64_t FenceValueForReset, ID3D12CommandAllocator* Allocator);
 
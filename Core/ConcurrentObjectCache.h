@@ -0,0 +1,146 @@
+//
+// Description:  Concurrent hash table of device objects keyed by Utility::HashState, for the PSO and root signature caches.
+//
+// Open addressing with linear probing over a fixed array of slots.  A slot is claimed by a compare exchange of its key
+// and never given back, so lookups only read atomics and never lock.  The thread that claims a slot creates the object
+// outside of any lock, threads asking for the same key meanwhile sleep on a condition variable until it is published.
+// Creating different objects on many threads at once only contends on the slot keys.
+//
+// The table does not grow, Capacity has to stay about twice the number of distinct objects.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+#include "Util/Assertions.h"
+
+template <typename T>
+class ConcurrentObjectCache
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit ConcurrentObjectCache( uint32_t Capacity = 4096 ) : m_Count(0)
+    {
+        m_Capacity = 1;
+        while (m_Capacity < Capacity)
+            m_Capacity <<= 1;
+        m_Slots.reset(new Slot[m_Capacity]);
+        for (uint32_t i = 0; i < m_Capacity; ++i)
+        {
+            m_Slots[i].Key.store(kEmptyKey, std::memory_order_relaxed);
+            m_Slots[i].Value.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ConcurrentObjectCache() { Clear(); }
+
+    // Lock-free, nullptr while the object is missing or still being created
+    T* Find( size_t Hash ) const
+    {
+        const size_t Key = ToKey(Hash);
+        for (uint32_t Index = (uint32_t)Key & (m_Capacity - 1), Probes = 0; Probes < m_Capacity; Index = (Index + 1) & (m_Capacity - 1), ++Probes)
+        {
+            size_t SlotKey = m_Slots[Index].Key.load(std::memory_order_acquire);
+            if (SlotKey == Key)
+                return m_Slots[Index].Value.load(std::memory_order_acquire);
+            if (SlotKey == kEmptyKey)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    // The object for Hash.  Only the first thread to ask for it calls Create, which returns a reference the cache takes
+    // over; every other thread gets the same object once it is published.
+    template <typename CreateFunc>
+    T* GetOrCreate( size_t Hash, CreateFunc Create, bool* Created = nullptr )
+    {
+        const size_t Key = ToKey(Hash);
+        for (uint32_t Index = (uint32_t)Key & (m_Capacity - 1), Probes = 0; Probes < m_Capacity; Index = (Index + 1) & (m_Capacity - 1), ++Probes)
+        {
+            Slot& CurSlot = m_Slots[Index];
+            size_t SlotKey = CurSlot.Key.load(std::memory_order_acquire);
+
+            if (SlotKey == kEmptyKey)
+            {
+                if (CurSlot.Key.compare_exchange_strong(SlotKey, Key, std::memory_order_acq_rel))
+                {
+                    m_Count.fetch_add(1, std::memory_order_relaxed);
+
+                    T* Object = Create();
+                    ASSERT(Object != nullptr, "Threads waiting for this object would never wake up");
+                    CurSlot.Value.store(Object, std::memory_order_release);
+
+                    // Taking the lock orders the store before any waiter that checked Value and is about to sleep
+                    {
+                        std::lock_guard<std::mutex> Lock(m_WaitMutex);
+                    }
+                    m_Published.notify_all();
+
+                    if (Created != nullptr)
+                        *Created = true;
+                    return Object;
+                }
+                // Lost the race, SlotKey now holds the winner's key
+            }
+
+            if (SlotKey == Key)
+            {
+                T* Object = CurSlot.Value.load(std::memory_order_acquire);
+                if (Object == nullptr)
+                {
+                    std::unique_lock<std::mutex> Lock(m_WaitMutex);
+                    m_Published.wait(Lock, [&CurSlot]() { return CurSlot.Value.load(std::memory_order_acquire) != nullptr; });
+                    Object = CurSlot.Value.load(std::memory_order_acquire);
+                }
+
+                if (Created != nullptr)
+                    *Created = false;
+                return Object;
+            }
+        }
+
+        ASSERT(false, "Object cache is full");
+        return nullptr;
+    }
+
+    // Not thread-safe, releases every object
+    void Clear( void )
+    {
+        for (uint32_t i = 0; i < m_Capacity; ++i)
+        {
+            T* Object = m_Slots[i].Value.exchange(nullptr, std::memory_order_relaxed);
+            if (Object != nullptr)
+                Object->Release();
+            m_Slots[i].Key.store(kEmptyKey, std::memory_order_relaxed);
+        }
+        m_Count.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t GetCount( void ) const { return m_Count.load(std::memory_order_relaxed); }
+    uint32_t GetCapacity( void ) const { return m_Capacity; }
+
+private:
+    static const size_t kEmptyKey = 0;
+
+    // A hash of 0 would look like an empty slot, it shares a key with 1 instead
+    static size_t ToKey( size_t Hash ) { return Hash == kEmptyKey ? 1 : Hash; }
+
+    struct Slot
+    {
+        std::atomic<size_t> Key;
+        std::atomic<T*> Value;
+    };
+
+    uint32_t m_Capacity;
+    std::unique_ptr<Slot[]> m_Slots;
+    std::atomic<uint32_t> m_Count;
+
+    std::mutex m_WaitMutex;
+    std::condition_variable m_Published;
+};
@@ -16,6 +16,7 @@
 #include "GraphicsCore.h"
 #include "EsramAllocator.h"
 #include "DescriptorHeap.h"
+#include "DynamicDescriptorHeap.h"
 
 using namespace Graphics;
 
@@ -96,6 +97,8 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 
     if (m_hDepthSRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_hDepthSRV = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
 
     // Create the shader resource view
     D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
@@ -17,6 +17,7 @@
 #include "GraphicsCore.h"
 #include "CommandListManager.h"
 #include "RootSignature.h"
+#include "Hash.h"
 
 using namespace Graphics;
 
@@ -28,6 +29,13 @@ std::mutex DynamicDescriptorHeap::sm_Mutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DynamicDescriptorHeap::sm_DescriptorHeapPool[2];
 std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> DynamicDescriptorHeap::sm_RetiredDescriptorHeaps[2];
 std::queue<ID3D12DescriptorHeap*> DynamicDescriptorHeap::sm_AvailableDescriptorHeaps[2];
+DescriptorTableCacheStats DynamicDescriptorHeap::sm_TableCacheStats[2] = {};
+std::atomic<uint64_t> DynamicDescriptorHeap::sm_TableCacheEpoch(0);
+std::vector<DynamicDescriptorHeap::OpenHeap> DynamicDescriptorHeap::sm_OpenHeaps[2][kNumQueueTypes];
+Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> DynamicDescriptorHeap::sm_PersistentStagingHeap;
+uint32_t DynamicDescriptorHeap::sm_NumPersistentDescriptors = 0;
+std::atomic<uint64_t> DynamicDescriptorHeap::sm_PersistentVersion(0);
+std::unordered_map<ID3D12DescriptorHeap*, uint64_t> DynamicDescriptorHeap::sm_PersistentHeapVersions;
 
 ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
 {
@@ -41,24 +49,63 @@ ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap(D3D12_DESCRIP
         sm_RetiredDescriptorHeaps[idx].pop();
     }
 
+    ID3D12DescriptorHeap* HeapPtr;
     if (!sm_AvailableDescriptorHeaps[idx].empty())
     {
-        ID3D12DescriptorHeap* HeapPtr = sm_AvailableDescriptorHeaps[idx].front();
+        HeapPtr = sm_AvailableDescriptorHeaps[idx].front();
         sm_AvailableDescriptorHeaps[idx].pop();
-        return HeapPtr;
     }
     else
     {
         D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
         HeapDesc.Type = HeapType;
-        HeapDesc.NumDescriptors = kNumDescriptorsPerHeap;
+        HeapDesc.NumDescriptors = kNumDescriptorsPerHeap + (idx == 0 ? kNumPersistentDescriptors : 0);
         HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
         HeapDesc.NodeMask = 1;
-        Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> HeapPtr;
-        ASSERT_SUCCEEDED(g_Device->CreateDescriptorHeap(&HeapDesc, MY_IID_PPV_ARGS(&HeapPtr)));
-        sm_DescriptorHeapPool[idx].emplace_back(HeapPtr);
-        return HeapPtr.Get();
+        Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> NewHeap;
+        ASSERT_SUCCEEDED(g_Device->CreateDescriptorHeap(&HeapDesc, MY_IID_PPV_ARGS(&NewHeap)));
+        sm_DescriptorHeapPool[idx].emplace_back(NewHeap);
+        HeapPtr = NewHeap.Get();
     }
+
+    // The GPU is done with the heap, its persistent region can be brought up to date
+    if (idx == 0 && sm_NumPersistentDescriptors > 0)
+    {
+        uint64_t& HeapVersion = sm_PersistentHeapVersions[HeapPtr];
+        if (HeapVersion != sm_PersistentVersion)
+        {
+            g_Device->CopyDescriptorsSimple(sm_NumPersistentDescriptors, HeapPtr->GetCPUDescriptorHandleForHeapStart(),
+                sm_PersistentStagingHeap->GetCPUDescriptorHandleForHeapStart(), HeapType);
+            HeapVersion = sm_PersistentVersion;
+        }
+    }
+
+    return HeapPtr;
+}
+
+void DynamicDescriptorHeap::SetPersistentDescriptor( uint32_t Index, D3D12_CPU_DESCRIPTOR_HANDLE Handle )
+{
+    ASSERT(Index < kNumPersistentDescriptors);
+
+    std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+
+    if (sm_PersistentStagingHeap == nullptr)
+    {
+        D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+        HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        HeapDesc.NumDescriptors = kNumPersistentDescriptors;
+        HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+        HeapDesc.NodeMask = 1;
+        ASSERT_SUCCEEDED(g_Device->CreateDescriptorHeap(&HeapDesc, MY_IID_PPV_ARGS(&sm_PersistentStagingHeap)));
+        sm_PersistentStagingHeap->SetName(L"Persistent Descriptor Staging Heap");
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE Dest = sm_PersistentStagingHeap->GetCPUDescriptorHandleForHeapStart();
+    Dest.ptr += Index * g_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    g_Device->CopyDescriptorsSimple(1, Dest, Handle, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    sm_NumPersistentDescriptors = std::max(sm_NumPersistentDescriptors, Index + 1);
+    ++sm_PersistentVersion;
 }
 
 void DynamicDescriptorHeap::DiscardDescriptorHeaps( D3D12_DESCRIPTOR_HEAP_TYPE HeapType, uint64_t FenceValue, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps )
@@ -71,17 +118,17 @@ void DynamicDescriptorHeap::DiscardDescriptorHeaps( D3D12_DESCRIPTOR_HEAP_TYPE H
 
 void DynamicDescriptorHeap::RetireCurrentHeap( void )
 {
-    // Don't retire unused heaps.
-    if (m_CurrentOffset == 0)
+    // Don't retire unused heaps.  A heap that only had its persistent region bound was used.
+    if (m_CurrentHeapPtr == nullptr)
     {
-        ASSERT(m_CurrentHeapPtr == nullptr);
+        ASSERT(m_CurrentOffset == 0);
         return;
     }
 
-    ASSERT(m_CurrentHeapPtr != nullptr);
     m_RetiredHeaps.push_back(m_CurrentHeapPtr);
     m_CurrentHeapPtr = nullptr;
     m_CurrentOffset = 0;
+    m_CommittedTables.Clear();
 }
 
 void DynamicDescriptorHeap::RetireUsedHeaps( uint64_t fenceValue )
@@ -90,12 +137,72 @@ void DynamicDescriptorHeap::RetireUsedHeaps( uint64_t fenceValue )
     m_RetiredHeaps.clear();
 }
 
+void DynamicDescriptorHeap::ParkCurrentHeap( uint64_t FenceValue )
+{
+    if (m_CurrentHeapPtr == nullptr)
+        return;
+
+    if (!HasSpace(1))
+    {
+        RetireCurrentHeap();
+        return;
+    }
+
+    OpenHeap Parked;
+    Parked.Heap = m_CurrentHeapPtr;
+    Parked.Offset = m_CurrentOffset;
+    Parked.FenceValue = FenceValue;
+    Parked.Tables = std::move(m_CommittedTables);
+    Parked.TableCacheEpoch = m_TableCacheEpoch;
+
+    m_CurrentHeapPtr = nullptr;
+    m_CurrentOffset = 0;
+    m_CommittedTables = CommittedTableCache();
+
+    uint32_t idx = m_DescriptorType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
+    std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+    sm_OpenHeaps[idx][FenceValue >> 56].push_back(std::move(Parked));
+}
+
+bool DynamicDescriptorHeap::TakeOpenHeap( void )
+{
+    uint32_t idx = m_DescriptorType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
+    std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+
+    // The most recently used heap is the most likely to hold the tables this context binds
+    std::vector<OpenHeap>& OpenHeaps = sm_OpenHeaps[idx][m_OwningContext.m_Type];
+    while (!OpenHeaps.empty())
+    {
+        OpenHeap& Candidate = OpenHeaps.back();
+
+        // The GPU may still read the heap, a persistent region that changed since cannot be copied into it
+        if (idx == 0 && sm_PersistentHeapVersions[Candidate.Heap] != sm_PersistentVersion)
+        {
+            sm_RetiredDescriptorHeaps[idx].push(std::make_pair(Candidate.FenceValue, Candidate.Heap));
+            OpenHeaps.pop_back();
+            continue;
+        }
+
+        m_CurrentHeapPtr = Candidate.Heap;
+        m_CurrentOffset = Candidate.Offset;
+        m_CommittedTables = std::move(Candidate.Tables);
+        m_TableCacheEpoch = Candidate.TableCacheEpoch;
+        OpenHeaps.pop_back();
+        return true;
+    }
+    return false;
+}
+
 DynamicDescriptorHeap::DynamicDescriptorHeap(CommandContext& OwningContext, D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
     : m_OwningContext(OwningContext), m_DescriptorType(HeapType)
 {
     m_CurrentHeapPtr = nullptr;
     m_CurrentOffset = 0;
+    m_FirstDynamicOffset = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV ? kNumPersistentDescriptors : 0;
+    m_HeapPersistentVersion = 0;
     m_DescriptorSize = Graphics::g_Device->GetDescriptorHandleIncrementSize(HeapType);
+    m_TableCacheStats = {};
+    m_TableCacheEpoch = 0;
 }
 
 DynamicDescriptorHeap::~DynamicDescriptorHeap()
@@ -104,10 +211,95 @@ DynamicDescriptorHeap::~DynamicDescriptorHeap()
 
 void DynamicDescriptorHeap::CleanupUsedHeaps( uint64_t fenceValue )
 {
-    RetireCurrentHeap();
+    ParkCurrentHeap(fenceValue);
     RetireUsedHeaps(fenceValue);
     m_GraphicsHandleCache.ClearCache();
     m_ComputeHandleCache.ClearCache();
+
+    {
+        uint32_t idx = m_DescriptorType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
+        std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+        DescriptorTableCacheStats& Stats = sm_TableCacheStats[idx];
+        Stats.TableHits += m_TableCacheStats.TableHits;
+        Stats.TableMisses += m_TableCacheStats.TableMisses;
+        Stats.DescriptorsReused += m_TableCacheStats.DescriptorsReused;
+        Stats.DescriptorsCopied += m_TableCacheStats.DescriptorsCopied;
+    }
+    m_TableCacheStats = {};
+}
+
+DescriptorTableCacheStats DynamicDescriptorHeap::GetTableCacheStats( D3D12_DESCRIPTOR_HEAP_TYPE HeapType )
+{
+    uint32_t idx = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
+    std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+    return sm_TableCacheStats[idx];
+}
+
+//
+// CommittedTableCache Implementation
+//
+
+bool DynamicDescriptorHeap::CommittedTableCache::Find( size_t Hash, uint32_t AssignedHandles,
+    const D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t KeyCount, D3D12_GPU_DESCRIPTOR_HANDLE& Table ) const
+{
+    if (m_Entries.empty())
+        return false;
+
+    for (uint32_t SlotIdx = (uint32_t)Hash & (kSlotCount - 1); m_Slots[SlotIdx].Generation == m_Generation; SlotIdx = (SlotIdx + 1) & (kSlotCount - 1))
+    {
+        const Slot& CurSlot = m_Slots[SlotIdx];
+        if (CurSlot.Hash != Hash)
+            continue;
+
+        const Entry& CurEntry = m_Entries[CurSlot.Entry];
+        if (CurEntry.AssignedHandles == AssignedHandles && CurEntry.KeyCount == KeyCount &&
+            memcmp(m_Keys.data() + CurEntry.KeyStart, Key, KeyCount * sizeof(D3D12_CPU_DESCRIPTOR_HANDLE)) == 0)
+        {
+            Table = CurEntry.Table;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DynamicDescriptorHeap::CommittedTableCache::Insert( size_t Hash, uint32_t AssignedHandles,
+    const D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t KeyCount, D3D12_GPU_DESCRIPTOR_HANDLE Table )
+{
+    ASSERT(m_Entries.size() < kSlotCount / 2, "More tables than descriptors in the heap");
+
+    if (m_Slots.empty())
+        m_Slots.resize(kSlotCount, Slot{ 0, 0, 0 });
+
+    uint32_t SlotIdx = (uint32_t)Hash & (kSlotCount - 1);
+    while (m_Slots[SlotIdx].Generation == m_Generation)
+        SlotIdx = (SlotIdx + 1) & (kSlotCount - 1);
+
+    Slot& NewSlot = m_Slots[SlotIdx];
+    NewSlot.Hash = Hash;
+    NewSlot.Generation = m_Generation;
+    NewSlot.Entry = (uint32_t)m_Entries.size();
+
+    Entry NewEntry;
+    NewEntry.AssignedHandles = AssignedHandles;
+    NewEntry.KeyStart = (uint32_t)m_Keys.size();
+    NewEntry.KeyCount = KeyCount;
+    NewEntry.Table = Table;
+    m_Entries.push_back(NewEntry);
+    m_Keys.insert(m_Keys.end(), Key, Key + KeyCount);
+}
+
+void DynamicDescriptorHeap::CommittedTableCache::Clear( void )
+{
+    m_Entries.clear();
+    m_Keys.clear();
+
+    // Slots of older generations are empty, only a wrap around has to reset them
+    if (++m_Generation == 0)
+    {
+        for (Slot& CurSlot : m_Slots)
+            CurSlot.Generation = 0;
+        m_Generation = 1;
+    }
 }
 
 inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
@@ -115,7 +307,13 @@ inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
     if (m_CurrentHeapPtr == nullptr)
     {
         ASSERT(m_CurrentOffset == 0);
-        m_CurrentHeapPtr = RequestDescriptorHeap(m_DescriptorType);
+        // Loaded first, a change in between only makes the next commit switch heaps once more
+        m_HeapPersistentVersion = sm_PersistentVersion.load(std::memory_order_relaxed);
+        if (!TakeOpenHeap())
+        {
+            m_CurrentHeapPtr = RequestDescriptorHeap(m_DescriptorType);
+            m_CurrentOffset = m_FirstDynamicOffset;
+        }
         m_FirstDescriptor = DescriptorHandle(
             m_CurrentHeapPtr->GetCPUDescriptorHandleForHeapStart(),
             m_CurrentHeapPtr->GetGPUDescriptorHandleForHeapStart());
@@ -143,9 +341,49 @@ uint32_t DynamicDescriptorHeap::DescriptorHandleCache::ComputeStagedSize()
     return NeededSpace;
 }
 
+size_t DynamicDescriptorHeap::DescriptorHandleCache::GatherTableKey( uint32_t RootIndex, D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t& KeyCount ) const
+{
+    const DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
+
+    // Unset handles are left out, whatever the heap holds there is not meant to be read
+    KeyCount = 0;
+    unsigned long HandleIdx;
+    uint32_t SetHandles = RootDescTable.AssignedHandlesBitMap;
+    while (_BitScanForward(&HandleIdx, SetHandles))
+    {
+        SetHandles ^= (1 << HandleIdx);
+        Key[KeyCount++] = RootDescTable.TableStart[HandleIdx];
+    }
+
+    return Utility::HashState(Key, KeyCount, RootDescTable.AssignedHandlesBitMap);
+}
+
+void DynamicDescriptorHeap::DescriptorHandleCache::BindCommittedTables( const CommittedTableCache& TableCache, DescriptorTableCacheStats& Stats,
+    ID3D12GraphicsCommandList* CmdList, void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE Key[32];
+    uint32_t KeyCount;
+    unsigned long RootIndex;
+    uint32_t StaleParams = m_StaleRootParamsBitMap;
+    while (_BitScanForward(&RootIndex, StaleParams))
+    {
+        StaleParams ^= (1 << RootIndex);
+
+        size_t Hash = GatherTableKey(RootIndex, Key, KeyCount);
+        D3D12_GPU_DESCRIPTOR_HANDLE Table;
+        if (TableCache.Find(Hash, m_RootDescriptorTable[RootIndex].AssignedHandlesBitMap, Key, KeyCount, Table))
+        {
+            (CmdList->*SetFunc)(RootIndex, Table);
+            m_StaleRootParamsBitMap ^= (1 << RootIndex);
+            ++Stats.TableHits;
+            Stats.DescriptorsReused += KeyCount;
+        }
+    }
+}
+
 void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
-    D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize,
-    DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
+    D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize, DescriptorHandle DestHandleStart,
+    CommittedTableCache& TableCache, DescriptorTableCacheStats& Stats, ID3D12GraphicsCommandList* CmdList,
     void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 {
     uint32_t StaleParamCount = 0;
@@ -185,6 +423,9 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
     D3D12_CPU_DESCRIPTOR_HANDLE pSrcDescriptorRangeStarts[kMaxDescriptorsPerCopy];
     UINT pSrcDescriptorRangeSizes[kMaxDescriptorsPerCopy];
 
+    D3D12_CPU_DESCRIPTOR_HANDLE Key[32];
+    uint32_t KeyCount;
+
     for (uint32_t i = 0; i < StaleParamCount; ++i)
     {
         RootIndex = RootIndices[i];
@@ -192,6 +433,11 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 
         DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
 
+        size_t Hash = GatherTableKey(RootIndex, Key, KeyCount);
+        TableCache.Insert(Hash, RootDescTable.AssignedHandlesBitMap, Key, KeyCount, DestHandleStart);
+        ++Stats.TableMisses;
+        Stats.DescriptorsCopied += KeyCount;
+
         D3D12_CPU_DESCRIPTOR_HANDLE* SrcHandles = RootDescTable.TableStart;
         uint64_t SetHandles = (uint64_t)RootDescTable.AssignedHandlesBitMap;
         D3D12_CPU_DESCRIPTOR_HANDLE CurDest = DestHandleStart;
@@ -249,17 +495,51 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 void DynamicDescriptorHeap::CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList,
     void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 {
-    uint32_t NeededSize = HandleCache.ComputeStagedSize();
-    if (!HasSpace(NeededSize))
+    // The persistent region of the current heap cannot be updated while the GPU may read it.  A new heap has it up to
+    // date, everything bound so far is bound again.
+    if (IsPersistentRegionOutdated())
     {
         RetireCurrentHeap();
         UnbindAllValid();
-        NeededSize = HandleCache.ComputeStagedSize();
     }
 
-    // This can trigger the creation of a new heap
+    // Picks up an open heap of this queue first, the tables copied into it by earlier command lists are bound where
+    // they are
     m_OwningContext.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
-    HandleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(NeededSize), CmdList, SetFunc);
+
+    // A descriptor that was rewritten in place may be in any of the cached tables
+    uint64_t TableCacheEpoch = sm_TableCacheEpoch.load(std::memory_order_acquire);
+    if (m_TableCacheEpoch != TableCacheEpoch)
+    {
+        m_CommittedTables.Clear();
+        m_TableCacheEpoch = TableCacheEpoch;
+    }
+    HandleCache.BindCommittedTables(m_CommittedTables, m_TableCacheStats, CmdList, SetFunc);
+
+    if (HandleCache.m_StaleRootParamsBitMap != 0)
+    {
+        // An open heap may not have enough room left either, a new heap always has
+        uint32_t NeededSize = HandleCache.ComputeStagedSize();
+        while (!HasSpace(NeededSize))
+        {
+            RetireCurrentHeap();
+            UnbindAllValid();
+            NeededSize = HandleCache.ComputeStagedSize();
+            GetHeapPointer();
+        }
+
+        m_OwningContext.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
+        HandleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(NeededSize),
+            m_CommittedTables, m_TableCacheStats, CmdList, SetFunc);
+    }
+
+    // The persistent region is at the start of every heap
+    if (HandleCache.m_IsPersistentTableStale)
+    {
+        m_OwningContext.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
+        (CmdList->*SetFunc)(HandleCache.m_PersistentRootIndex, m_CurrentHeapPtr->GetGPUDescriptorHandleForHeapStart());
+        HandleCache.m_IsPersistentTableStale = false;
+    }
 }
 
 void DynamicDescriptorHeap::UnbindAllValid( void )
@@ -289,6 +569,7 @@ D3D12_GPU_DESCRIPTOR_HANDLE DynamicDescriptorHeap::UploadDirect( D3D12_CPU_DESCR
 void DynamicDescriptorHeap::DescriptorHandleCache::UnbindAllValid()
 {
     m_StaleRootParamsBitMap = 0;
+    m_IsPersistentTableStale = m_PersistentRootIndex != kNoPersistentTable;
 
     unsigned long TableParams = m_RootDescriptorTablesBitMap;
     unsigned long RootIndex;
@@ -320,6 +601,8 @@ void DynamicDescriptorHeap::DescriptorHandleCache::ParseRootSignature( D3D12_DES
     ASSERT(RootSig.m_NumParameters <= 16, "Maybe we need to support something greater");
 
     m_StaleRootParamsBitMap = 0;
+    m_PersistentRootIndex = kNoPersistentTable;
+    m_IsPersistentTableStale = false;
     m_RootDescriptorTablesBitMap = (Type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ?
         RootSig.m_SamplerTableBitMap : RootSig.m_DescriptorTableBitMap);
 
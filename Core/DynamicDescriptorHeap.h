@@ -17,15 +17,42 @@
 #include "RootSignature.h"
 #include <vector>
 #include <queue>
+#include <unordered_map>
+#include <atomic>
 
 namespace Graphics
 {
     extern ID3D12Device* g_Device;
 }
 
+// Tables of the descriptor table cache, summed over every context once their command lists are finished
+struct DescriptorTableCacheStats
+{
+    // stale tables found in the current heap and bound again without a copy
+    uint64_t TableHits;
+    uint64_t TableMisses;
+    uint64_t DescriptorsReused;
+    uint64_t DescriptorsCopied;
+};
+
 // This class is a linear allocation system for dynamically generated descriptor tables.  It internally caches
 // CPU descriptor handles so that when not enough space is available in the current heap, necessary descriptors
 // can be re-copied to the new heap.
+//
+// A heap that still has room when its command list is finished is not retired.  It waits in a pool per queue with
+// the fence of that list and the next context on the same queue carries on appending to it, so descriptors other
+// command lists still read are never overwritten.  Only a full heap is retired, with the fence of the last list
+// that used it.
+//
+// Tables that were already copied into a heap are looked up by the CPU handles they were copied from and bound
+// again where they are, in any command list that uses the heap until it is retired.  Whatever rewrites a CPU
+// descriptor in place, such as recreating the views of a resized buffer, has to call InvalidateTableCaches.
+//
+// CBV_SRV_UAV heaps start with a persistent region of kNumPersistentDescriptors for descriptors that never change.
+// They are set once with SetPersistentDescriptor and copied into each heap when it is handed out, so a root
+// parameter bound to the region with SetGraphicsPersistentTable only has to be set again when the heap changes.
+// A heap the GPU may still read is never written, a context whose heap predates a change switches to a new heap
+// at its next commit.
 class DynamicDescriptorHeap
 {
 public:
@@ -34,12 +61,31 @@ public:
 
     static void DestroyAll(void)
     {
+        for (auto& OpenHeaps : sm_OpenHeaps)
+        {
+            for (auto& QueueHeaps : OpenHeaps)
+                QueueHeaps.clear();
+        }
         sm_DescriptorHeapPool[0].clear();
         sm_DescriptorHeapPool[1].clear();
+        sm_PersistentHeapVersions.clear();
+        sm_PersistentStagingHeap = nullptr;
     }
 
+    static const uint32_t kNumPersistentDescriptors = 64;
+
+    // The descriptor is copied, Handle can be reused afterwards.  Draws and dispatches committed from now on see
+    // it, in every context.  It has to be set again if the resource is recreated, ColorBuffer::SetPersistentSRV
+    // does that.
+    static void SetPersistentDescriptor( uint32_t Index, D3D12_CPU_DESCRIPTOR_HANDLE Handle );
+
     void CleanupUsedHeaps( uint64_t fenceValue );
 
+    // Forgets every table copied so far, call after rewriting a CPU descriptor that may have been bound before
+    static void InvalidateTableCaches( void ) { sm_TableCacheEpoch.fetch_add(1, std::memory_order_release); }
+
+    static DescriptorTableCacheStats GetTableCacheStats( D3D12_DESCRIPTOR_HEAP_TYPE HeapType );
+
     // Copy multiple handles into the cache area reserved for the specified root parameter.
     void SetGraphicsDescriptorHandles( UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] )
     {
@@ -51,6 +97,18 @@ public:
         m_ComputeHandleCache.StageDescriptorHandles(RootIndex, Offset, NumHandles, Handles);
     }
 
+    // Binds the persistent region to a descriptor table of the root signature at the next commit, and again
+    // whenever the heap changes.  Cleared by the next root signature.
+    void SetGraphicsPersistentTable( UINT RootIndex )
+    {
+        m_GraphicsHandleCache.SetPersistentTable(RootIndex);
+    }
+
+    void SetComputePersistentTable( UINT RootIndex )
+    {
+        m_ComputeHandleCache.SetPersistentTable(RootIndex);
+    }
+
     // Bypass the cache and upload directly to the shader-visible heap
     D3D12_GPU_DESCRIPTOR_HANDLE UploadDirect( D3D12_CPU_DESCRIPTOR_HANDLE Handles );
 
@@ -68,13 +126,15 @@ public:
     // Upload any new descriptors in the cache to the shader-visible heap.
     inline void CommitGraphicsRootDescriptorTables( ID3D12GraphicsCommandList* CmdList )
     {
-        if (m_GraphicsHandleCache.m_StaleRootParamsBitMap != 0)
+        if (m_GraphicsHandleCache.m_StaleRootParamsBitMap != 0 || m_GraphicsHandleCache.m_IsPersistentTableStale ||
+            IsPersistentRegionOutdated())
             CopyAndBindStagedTables(m_GraphicsHandleCache, CmdList, &ID3D12GraphicsCommandList::SetGraphicsRootDescriptorTable);
     }
 
     inline void CommitComputeRootDescriptorTables( ID3D12GraphicsCommandList* CmdList )
     {
-        if (m_ComputeHandleCache.m_StaleRootParamsBitMap != 0)
+        if (m_ComputeHandleCache.m_StaleRootParamsBitMap != 0 || m_ComputeHandleCache.m_IsPersistentTableStale ||
+            IsPersistentRegionOutdated())
             CopyAndBindStagedTables(m_ComputeHandleCache, CmdList, &ID3D12GraphicsCommandList::SetComputeRootDescriptorTable);
     }
 
@@ -86,6 +146,16 @@ private:
     static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool[2];
     static std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> sm_RetiredDescriptorHeaps[2];
     static std::queue<ID3D12DescriptorHeap*> sm_AvailableDescriptorHeaps[2];
+    static DescriptorTableCacheStats sm_TableCacheStats[2];
+    // Bumped by InvalidateTableCaches, a table cache filled under an older epoch is emptied before its next lookup
+    static std::atomic<uint64_t> sm_TableCacheEpoch;
+    // Not shader visible, the source of the persistent region of every heap
+    static Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> sm_PersistentStagingHeap;
+    static uint32_t sm_NumPersistentDescriptors;
+    // Bumped by SetPersistentDescriptor, read without the lock when committing
+    static std::atomic<uint64_t> sm_PersistentVersion;
+    // Version of the persistent region each CBV_SRV_UAV heap holds
+    static std::unordered_map<ID3D12DescriptorHeap*, uint64_t> sm_PersistentHeapVersions;
 
     // Static methods
     static ID3D12DescriptorHeap* RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
@@ -97,9 +167,72 @@ private:
     const D3D12_DESCRIPTOR_HEAP_TYPE m_DescriptorType;
     uint32_t m_DescriptorSize;
     uint32_t m_CurrentOffset;
+    // Where dynamic descriptors start, after the persistent region
+    uint32_t m_FirstDynamicOffset;
+    // sm_PersistentVersion when the current heap was acquired, its persistent region is at least that recent
+    uint64_t m_HeapPersistentVersion;
     DescriptorHandle m_FirstDescriptor;
     std::vector<ID3D12DescriptorHeap*> m_RetiredHeaps;
 
+    // Descriptor tables copied into the current heap, keyed by a hash of the handles they were copied from.
+    // Open addressing over a generation stamped slot array, so that emptying it touches nothing.
+    struct CommittedTableCache
+    {
+        CommittedTableCache() : m_Generation(1) {}
+
+        bool Find( size_t Hash, uint32_t AssignedHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t KeyCount, D3D12_GPU_DESCRIPTOR_HANDLE& Table ) const;
+        void Insert( size_t Hash, uint32_t AssignedHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t KeyCount, D3D12_GPU_DESCRIPTOR_HANDLE Table );
+        void Clear( void );
+
+        // Every table takes at least one descriptor of the heap, the slots never fill beyond half
+        static const uint32_t kSlotCount = 2 * kNumDescriptorsPerHeap;
+
+        struct Slot
+        {
+            size_t Hash;
+            uint32_t Generation;
+            uint32_t Entry;
+        };
+
+        struct Entry
+        {
+            uint32_t AssignedHandles;
+            uint32_t KeyStart;
+            uint32_t KeyCount;
+            D3D12_GPU_DESCRIPTOR_HANDLE Table;
+        };
+
+        std::vector<Slot> m_Slots;
+        std::vector<Entry> m_Entries;
+        std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_Keys;
+        uint32_t m_Generation;
+    };
+
+    CommittedTableCache m_CommittedTables;
+    uint64_t m_TableCacheEpoch;
+
+    // A heap with room left, waiting for the next context of its queue together with the tables copied into it
+    struct OpenHeap
+    {
+        ID3D12DescriptorHeap* Heap;
+        uint32_t Offset;
+        // of the last command list that used the heap
+        uint64_t FenceValue;
+        CommittedTableCache Tables;
+        uint64_t TableCacheEpoch;
+    };
+
+    // Per heap type and command list type, the fence values of one queue only grow
+    static const uint32_t kNumQueueTypes = D3D12_COMMAND_LIST_TYPE_COPY + 1;
+    static std::vector<OpenHeap> sm_OpenHeaps[2][kNumQueueTypes];
+
+    // Hands the current heap to the pool of open heaps, or retires it if it is full
+    void ParkCurrentHeap( uint64_t FenceValue );
+    // Makes an open heap of the queue of the owning context current, false if there is none
+    bool TakeOpenHeap( void );
+    // flushed into sm_TableCacheStats when the command list is finished
+    DescriptorTableCacheStats m_TableCacheStats;
+
     // Describes a descriptor table entry:  a region of the handle cache and which handles have been set
     struct DescriptorTableCache
     {
@@ -121,18 +254,37 @@ private:
             m_RootDescriptorTablesBitMap = 0;
             m_StaleRootParamsBitMap = 0;
             m_MaxCachedDescriptors = 0;
+            m_PersistentRootIndex = kNoPersistentTable;
+            m_IsPersistentTableStale = false;
+        }
+
+        void SetPersistentTable( UINT RootIndex )
+        {
+            ASSERT(((1 << RootIndex) & m_RootDescriptorTablesBitMap) != 0, "Root parameter is not a CBV_SRV_UAV descriptor table");
+            m_PersistentRootIndex = RootIndex;
+            m_IsPersistentTableStale = true;
         }
 
+        static const uint32_t kNoPersistentTable = ~0u;
+
         uint32_t m_RootDescriptorTablesBitMap;
         uint32_t m_StaleRootParamsBitMap;
         uint32_t m_MaxCachedDescriptors;
+        uint32_t m_PersistentRootIndex;
+        bool m_IsPersistentTableStale;
 
         static const uint32_t kMaxNumDescriptors = 256;
         static const uint32_t kMaxNumDescriptorTables = 16;
 
         uint32_t ComputeStagedSize();
-        void CopyAndBindStaleTables( D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize, DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
+        // Binds the stale tables found in TableCache and marks them as no longer stale
+        void BindCommittedTables( const CommittedTableCache& TableCache, DescriptorTableCacheStats& Stats, ID3D12GraphicsCommandList* CmdList,
+            void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
+        void CopyAndBindStaleTables( D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize, DescriptorHandle DestHandleStart,
+            CommittedTableCache& TableCache, DescriptorTableCacheStats& Stats, ID3D12GraphicsCommandList* CmdList,
             void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
+        // The handles that are set in a table, and a hash of them and of where they are set
+        size_t GatherTableKey( uint32_t RootIndex, D3D12_CPU_DESCRIPTOR_HANDLE Key[], uint32_t& KeyCount ) const;
 
         DescriptorTableCache m_RootDescriptorTable[kMaxNumDescriptorTables];
         D3D12_CPU_DESCRIPTOR_HANDLE m_HandleCache[kMaxNumDescriptors];
@@ -147,7 +299,14 @@ private:
 
     bool HasSpace( uint32_t Count )
     {
-        return (m_CurrentHeapPtr != nullptr && m_CurrentOffset + Count <= kNumDescriptorsPerHeap);
+        return (m_CurrentHeapPtr != nullptr && m_CurrentOffset + Count <= m_FirstDynamicOffset + kNumDescriptorsPerHeap);
+    }
+
+    // Only CBV_SRV_UAV heaps have a persistent region
+    bool IsPersistentRegionOutdated( void ) const
+    {
+        return m_FirstDynamicOffset != 0 && m_CurrentHeapPtr != nullptr &&
+            m_HeapPersistentVersion != sm_PersistentVersion.load(std::memory_order_relaxed);
     }
 
     void RetireCurrentHeap(void);
@@ -0,0 +1,65 @@
+//
+// Description:  Objects the GPU may still be using, released once the last frame that used them has completed.
+//
+// Retire only queues an object.  The fence it waits for is the one passed to the next OnFrameSubmitted, the fence of
+// the last command list of the frame on the graphics queue, so that work recorded later in the same frame and work
+// on other queues the frame waited for are covered as well.  Like the retired pages of LinearAllocator the fences
+// only grow, Release stops at the first one that has not completed.
+//
+// The fence is queried through a callback so that the queue can be driven without a device.
+//
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+template <typename T>
+class FencedReleaseQueue
+{
+public:
+    void Retire( T Object )
+    {
+        m_Pending.push_back(std::move(Object));
+    }
+
+    // Everything retired since the last call waits for FenceValue
+    void OnFrameSubmitted( uint64_t FenceValue )
+    {
+        for (T& Object : m_Pending)
+            m_Retired.push(std::make_pair(FenceValue, std::move(Object)));
+        m_Pending.clear();
+    }
+
+    // Returns how many objects were released
+    template <typename IsFenceCompleteFunc>
+    size_t Release( IsFenceCompleteFunc IsFenceComplete )
+    {
+        size_t Released = 0;
+        while (!m_Retired.empty() && IsFenceComplete(m_Retired.front().first))
+        {
+            m_Retired.pop();
+            ++Released;
+        }
+        return Released;
+    }
+
+    // Only once the GPU is idle
+    void ReleaseAll( void )
+    {
+        m_Pending.clear();
+        while (!m_Retired.empty())
+            m_Retired.pop();
+    }
+
+    // Retired but not yet assigned to a frame
+    size_t GetPendingCount( void ) const { return m_Pending.size(); }
+    size_t GetRetiredCount( void ) const { return m_Pending.size() + m_Retired.size(); }
+
+private:
+    std::vector<T> m_Pending;
+    std::queue<std::pair<uint64_t, T>> m_Retired;
+};
@@ -0,0 +1,528 @@
+//
+// Description:  Frame graph compilation, see FrameGraph.h
+//
+
+#include "FrameGraph.h"
+#include "Util/Assertions.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdarg>
+
+using namespace std;
+
+namespace
+{
+    uint64_t AlignUp( uint64_t Value, uint64_t Alignment )
+    {
+        return (Value + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    bool LifetimesOverlap( const FrameGraph::ResourceInfo& A, const FrameGraph::ResourceInfo& B )
+    {
+        return A.FirstPass <= B.LastPass && B.FirstPass <= A.LastPass;
+    }
+
+    void AppendFormat( string& Out, const char* Format, ... )
+    {
+        char Buffer[512];
+        va_list Args;
+        va_start(Args, Format);
+        vsnprintf(Buffer, sizeof(Buffer), Format, Args);
+        va_end(Args);
+        Out += Buffer;
+    }
+}
+
+const uint32_t FrameGraph::kInvalidHandle;
+
+FrameGraph::FrameGraph( void ) : m_FinalBarrier(0), m_Stats()
+{
+}
+
+void FrameGraph::Clear( void )
+{
+    m_Passes.clear();
+    m_Resources.clear();
+    m_PassIsLive.clear();
+    m_CompiledPasses.clear();
+    m_Barriers.clear();
+    m_FinalBarrier = 0;
+    m_ResourceInfo.clear();
+    m_UseStart.clear();
+    m_Uses.clear();
+    m_AliasedResource.clear();
+    m_Stats = CompileStats();
+}
+
+FrameGraph::ResourceHandle FrameGraph::ImportResource( const string& Name, uint32_t State )
+{
+    Resource NewResource = { Name, false, State, State, false, 0, 0 };
+    m_Resources.push_back(NewResource);
+    return (ResourceHandle)m_Resources.size() - 1;
+}
+
+void FrameGraph::SetImportedState( ResourceHandle Handle, uint32_t State )
+{
+    ASSERT(Handle < m_Resources.size() && !m_Resources[Handle].IsTransient);
+    m_Resources[Handle].ImportedState = State;
+}
+
+void FrameGraph::SetFinalState( ResourceHandle Handle, uint32_t State )
+{
+    ASSERT(Handle < m_Resources.size() && !m_Resources[Handle].IsTransient, "Transient resources do not outlive the graph");
+    m_Resources[Handle].FinalState = State;
+    m_Resources[Handle].HasFinalState = true;
+}
+
+FrameGraph::ResourceHandle FrameGraph::CreateTransientResource( const string& Name, uint64_t Size, uint64_t Alignment )
+{
+    ASSERT(Size > 0 && Alignment > 0 && (Alignment & (Alignment - 1)) == 0);
+    Resource NewResource = { Name, true, kCommon, kCommon, false, Size, Alignment };
+    m_Resources.push_back(NewResource);
+    return (ResourceHandle)m_Resources.size() - 1;
+}
+
+FrameGraph::PassHandle FrameGraph::AddPass( const string& Name, bool HasSideEffects )
+{
+    Pass NewPass;
+    NewPass.Name = Name;
+    NewPass.HasSideEffects = HasSideEffects;
+    m_Passes.push_back(NewPass);
+    return (PassHandle)m_Passes.size() - 1;
+}
+
+void FrameGraph::Read( PassHandle Pass, ResourceHandle Resource, uint32_t State )
+{
+    ASSERT(State != kCommon && (State & kWriteStates & ~kUnorderedAccess) == 0, "Not a state to read in");
+    AddAccess(Pass, Resource, State, false);
+}
+
+void FrameGraph::Write( PassHandle Pass, ResourceHandle Resource, uint32_t State )
+{
+    ASSERT((State & kWriteStates) != 0 && (State & ~kWriteStates) == 0, "Not a state to write in");
+    AddAccess(Pass, Resource, State, true);
+}
+
+void FrameGraph::AddAccess( PassHandle PassIndex, ResourceHandle Resource, uint32_t State, bool IsWrite )
+{
+    ASSERT(PassIndex < m_Passes.size() && Resource < m_Resources.size());
+
+    vector<Access>& Accesses = m_Passes[PassIndex].Accesses;
+    for (Access& Existing : Accesses)
+    {
+        if (Existing.Resource != Resource)
+            continue;
+
+        if (IsReadOnlyState(Existing.State) && IsReadOnlyState(State))
+            Existing.State |= State;
+        else
+            ASSERT(Existing.State == State, "A pass uses a resource in two states that cannot be combined");
+
+        Existing.IsRead = Existing.IsRead || !IsWrite;
+        Existing.IsWrite = Existing.IsWrite || IsWrite;
+        return;
+    }
+
+    Access NewAccess = { Resource, State, !IsWrite, IsWrite };
+    Accesses.push_back(NewAccess);
+}
+
+void FrameGraph::Compile( void )
+{
+    m_Stats = CompileStats();
+
+    CullPasses();
+    GatherUses();
+    PlaceTransientResources();
+    BuildBarriers();
+
+    m_Stats.PassCount = (uint32_t)m_CompiledPasses.size();
+    m_Stats.CulledPassCount = (uint32_t)(m_Passes.size() - m_CompiledPasses.size());
+}
+
+void FrameGraph::CullPasses( void )
+{
+    // Walk backwards: a pass survives if it has side effects, writes outside the graph or writes something a
+    // surviving pass after it reads
+    vector<bool> Needed(m_Resources.size(), false);
+    m_PassIsLive.assign(m_Passes.size(), false);
+
+    for (size_t p = m_Passes.size(); p-- > 0; )
+    {
+        const Pass& CurrentPass = m_Passes[p];
+
+        bool IsLive = CurrentPass.HasSideEffects;
+        for (const Access& Use : CurrentPass.Accesses)
+            IsLive = IsLive || (Use.IsWrite && (!m_Resources[Use.Resource].IsTransient || Needed[Use.Resource]));
+
+        if (!IsLive)
+            continue;
+
+        m_PassIsLive[p] = true;
+        for (const Access& Use : CurrentPass.Accesses)
+        {
+            if (Use.IsRead)
+                Needed[Use.Resource] = true;
+        }
+    }
+
+    m_CompiledPasses.clear();
+    for (uint32_t p = 0; p < (uint32_t)m_Passes.size(); ++p)
+    {
+        if (m_PassIsLive[p])
+        {
+            CompiledPass NewPass = { p, 0, 0 };
+            m_CompiledPasses.push_back(NewPass);
+        }
+    }
+}
+
+void FrameGraph::GatherUses( void )
+{
+    const uint32_t ResourceCount = (uint32_t)m_Resources.size();
+    const uint32_t FinalPosition = (uint32_t)m_CompiledPasses.size();
+
+    // Counting sort of the uses by resource, positions come out in order
+    m_UseStart.assign(ResourceCount + 1, 0);
+    for (const CompiledPass& Compiled : m_CompiledPasses)
+    {
+        for (const Access& Use : m_Passes[Compiled.Pass].Accesses)
+            ++m_UseStart[Use.Resource + 1];
+    }
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+    {
+        if (m_Resources[r].HasFinalState)
+            ++m_UseStart[r + 1];
+    }
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+        m_UseStart[r + 1] += m_UseStart[r];
+
+    vector<uint32_t> Cursor(m_UseStart.begin(), m_UseStart.end() - 1);
+    m_Uses.resize(m_UseStart[ResourceCount]);
+    for (uint32_t i = 0; i < FinalPosition; ++i)
+    {
+        for (const Access& PassUse : m_Passes[m_CompiledPasses[i].Pass].Accesses)
+        {
+            Use& NewUse = m_Uses[Cursor[PassUse.Resource]++];
+            NewUse.Position = i;
+            NewUse.State = PassUse.State;
+            NewUse.IsWrite = PassUse.IsWrite;
+        }
+    }
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+    {
+        if (m_Resources[r].HasFinalState)
+        {
+            Use& NewUse = m_Uses[Cursor[r]++];
+            NewUse.Position = FinalPosition;
+            NewUse.State = m_Resources[r].FinalState;
+            NewUse.IsWrite = false;
+        }
+    }
+
+    m_ResourceInfo.resize(ResourceCount);
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+    {
+        ResourceInfo& Info = m_ResourceInfo[r];
+        Info.FirstPass = kInvalidHandle;
+        Info.LastPass = kInvalidHandle;
+        Info.FirstState = m_Resources[r].ImportedState;
+        Info.FinalState = m_Resources[r].ImportedState;
+        Info.HeapOffset = 0;
+
+        for (uint32_t u = m_UseStart[r]; u < m_UseStart[r + 1]; ++u)
+        {
+            if (m_Uses[u].Position == FinalPosition)
+                break;
+            if (Info.FirstPass == kInvalidHandle)
+                Info.FirstPass = m_Uses[u].Position;
+            Info.LastPass = m_Uses[u].Position;
+        }
+    }
+}
+
+void FrameGraph::PlaceTransientResources( void )
+{
+    vector<ResourceHandle> Placed;
+    for (ResourceHandle r = 0; r < (ResourceHandle)m_Resources.size(); ++r)
+    {
+        if (m_Resources[r].IsTransient && m_ResourceInfo[r].FirstPass != kInvalidHandle)
+            Placed.push_back(r);
+    }
+
+    // Largest first, each at the lowest offset no resource alive at the same time occupies
+    sort(Placed.begin(), Placed.end(), [this](ResourceHandle A, ResourceHandle B)
+    {
+        return m_Resources[A].Size != m_Resources[B].Size ? m_Resources[A].Size > m_Resources[B].Size : A < B;
+    });
+
+    vector<pair<uint64_t, uint64_t>> Occupied;
+    for (size_t i = 0; i < Placed.size(); ++i)
+    {
+        const Resource& Current = m_Resources[Placed[i]];
+        ResourceInfo& Info = m_ResourceInfo[Placed[i]];
+
+        Occupied.clear();
+        for (size_t j = 0; j < i; ++j)
+        {
+            const ResourceInfo& Other = m_ResourceInfo[Placed[j]];
+            if (LifetimesOverlap(Info, Other))
+                Occupied.push_back(make_pair(Other.HeapOffset, Other.HeapOffset + m_Resources[Placed[j]].Size));
+        }
+        sort(Occupied.begin(), Occupied.end());
+
+        uint64_t Offset = 0;
+        for (const pair<uint64_t, uint64_t>& Range : Occupied)
+        {
+            if (Offset + Current.Size <= Range.first)
+                break;
+            if (Range.second > Offset)
+                Offset = AlignUp(Range.second, Current.Alignment);
+        }
+
+        Info.HeapOffset = Offset;
+        m_Stats.TransientBytes += Current.Size;
+        m_Stats.TransientHeapSize = max(m_Stats.TransientHeapSize, Offset + Current.Size);
+    }
+
+    // The resource that used the memory last before each one, the aliasing barrier hands the memory over from it
+    m_AliasedResource.assign(m_Resources.size(), kInvalidHandle);
+    for (ResourceHandle r : Placed)
+    {
+        const ResourceInfo& Info = m_ResourceInfo[r];
+        uint32_t LatestEnd = 0;
+        for (ResourceHandle Other : Placed)
+        {
+            const ResourceInfo& OtherInfo = m_ResourceInfo[Other];
+            const bool SharesMemory = OtherInfo.HeapOffset < Info.HeapOffset + m_Resources[r].Size &&
+                Info.HeapOffset < OtherInfo.HeapOffset + m_Resources[Other].Size;
+            if (Other != r && SharesMemory && OtherInfo.LastPass < Info.FirstPass &&
+                (m_AliasedResource[r] == kInvalidHandle || OtherInfo.LastPass >= LatestEnd))
+            {
+                m_AliasedResource[r] = Other;
+                LatestEnd = OtherInfo.LastPass;
+            }
+        }
+    }
+}
+
+void FrameGraph::AddBarrier( Barrier::BarrierType Type, ResourceHandle Resource, uint32_t StateBefore, uint32_t StateAfter,
+    ResourceHandle PreviousResource )
+{
+    Barrier NewBarrier = { Type, Resource, PreviousResource, StateBefore, StateAfter };
+    m_Barriers.push_back(NewBarrier);
+
+    switch (Type)
+    {
+    case Barrier::kTransition: ++m_Stats.TransitionCount; break;
+    case Barrier::kUAV: ++m_Stats.UAVBarrierCount; break;
+    case Barrier::kAliasing: ++m_Stats.AliasingBarrierCount; break;
+    }
+}
+
+void FrameGraph::BuildBarriers( void )
+{
+    const uint32_t ResourceCount = (uint32_t)m_Resources.size();
+
+    vector<uint32_t> State(ResourceCount);
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+        State[r] = m_Resources[r].ImportedState;
+    vector<uint32_t> Cursor(m_UseStart.begin(), m_UseStart.end() - 1);
+
+    // Brings Resource into the state of its use u, returns false if it was in that state already
+    auto Prepare = [&](ResourceHandle r, uint32_t u)
+    {
+        const Use& Current = m_Uses[u];
+        const uint32_t PreviousState = u > m_UseStart[r] ? m_Uses[u - 1].State : m_Resources[r].ImportedState;
+
+        if (!Current.IsWrite && IsReadOnlyState(Current.State))
+        {
+            if (IsReadOnlyState(State[r]) && (State[r] & Current.State) == Current.State)
+            {
+                if (PreviousState != Current.State)
+                    ++m_Stats.MergedTransitionCount;
+                return;
+            }
+
+            // Go straight to every state the reads up to the next write need
+            uint32_t Merged = Current.State;
+            for (uint32_t v = u + 1; v < m_UseStart[r + 1] && !m_Uses[v].IsWrite && IsReadOnlyState(m_Uses[v].State); ++v)
+                Merged |= m_Uses[v].State;
+
+            AddBarrier(Barrier::kTransition, r, State[r], Merged);
+            State[r] = Merged;
+        }
+        else if (State[r] != Current.State)
+        {
+            AddBarrier(Barrier::kTransition, r, State[r], Current.State);
+            State[r] = Current.State;
+        }
+        else if (Current.State == kUnorderedAccess && (Current.IsWrite || u == m_UseStart[r] || m_Uses[u - 1].IsWrite))
+        {
+            // What wrote the resource before the graph is not known, so a first use gets a UAV barrier as well
+            AddBarrier(Barrier::kUAV, r, State[r], State[r]);
+        }
+    };
+
+    m_Barriers.clear();
+    for (CompiledPass& Compiled : m_CompiledPasses)
+    {
+        Compiled.FirstBarrier = (uint32_t)m_Barriers.size();
+
+        for (const Access& PassUse : m_Passes[Compiled.Pass].Accesses)
+        {
+            const ResourceHandle r = PassUse.Resource;
+            const uint32_t u = Cursor[r]++;
+
+            if (u == m_UseStart[r] && m_Resources[r].IsTransient)
+            {
+                ASSERT(PassUse.IsWrite && !PassUse.IsRead, "A transient resource is read before anything wrote it");
+                if (m_AliasedResource[r] != kInvalidHandle)
+                    AddBarrier(Barrier::kAliasing, r, kCommon, kCommon, m_AliasedResource[r]);
+                State[r] = PassUse.State;
+            }
+            else
+                Prepare(r, u);
+
+            if (u == m_UseStart[r])
+                m_ResourceInfo[r].FirstState = State[r];
+        }
+
+        Compiled.BarrierCount = (uint32_t)m_Barriers.size() - Compiled.FirstBarrier;
+        if (Compiled.BarrierCount > 0)
+            ++m_Stats.BarrierBatchCount;
+    }
+
+    m_FinalBarrier = (uint32_t)m_Barriers.size();
+    for (uint32_t r = 0; r < ResourceCount; ++r)
+    {
+        if (m_Resources[r].HasFinalState)
+            Prepare(r, Cursor[r]++);
+        m_ResourceInfo[r].FinalState = State[r];
+    }
+    if (m_Barriers.size() > m_FinalBarrier)
+        ++m_Stats.BarrierBatchCount;
+}
+
+void FrameGraph::StateToString( uint32_t State, string& Out )
+{
+    static const struct { uint32_t Flag; const char* Name; } kStateNames[] =
+    {
+        { kVertexAndConstantBuffer, "VERTEX_AND_CONSTANT_BUFFER" },
+        { kIndexBuffer, "INDEX_BUFFER" },
+        { kRenderTarget, "RENDER_TARGET" },
+        { kUnorderedAccess, "UNORDERED_ACCESS" },
+        { kDepthWrite, "DEPTH_WRITE" },
+        { kDepthRead, "DEPTH_READ" },
+        { kNonPixelShaderResource, "NON_PIXEL_SHADER_RESOURCE" },
+        { kPixelShaderResource, "PIXEL_SHADER_RESOURCE" },
+        { kStreamOut, "STREAM_OUT" },
+        { kIndirectArgument, "INDIRECT_ARGUMENT" },
+        { kCopyDest, "COPY_DEST" },
+        { kCopySource, "COPY_SOURCE" },
+        { kResolveDest, "RESOLVE_DEST" },
+        { kResolveSource, "RESOLVE_SOURCE" },
+    };
+
+    if (State == kCommon)
+    {
+        Out += "COMMON";
+        return;
+    }
+
+    bool First = true;
+    for (const auto& Entry : kStateNames)
+    {
+        if ((State & Entry.Flag) == 0)
+            continue;
+        if (!First)
+            Out += "|";
+        Out += Entry.Name;
+        First = false;
+    }
+}
+
+void FrameGraph::Dump( string& Out ) const
+{
+    AppendFormat(Out, "Frame graph: %u of %u passes, %u culled, %u transitions (%u merged away), %u UAV and %u aliasing barriers in %u batches\n",
+        m_Stats.PassCount, (uint32_t)m_Passes.size(), m_Stats.CulledPassCount, m_Stats.TransitionCount, m_Stats.MergedTransitionCount,
+        m_Stats.UAVBarrierCount, m_Stats.AliasingBarrierCount, m_Stats.BarrierBatchCount);
+    AppendFormat(Out, "Transient memory: %.1f KB in a %.1f KB heap\n", m_Stats.TransientBytes / 1024.0, m_Stats.TransientHeapSize / 1024.0);
+
+    auto DumpBarriers = [this, &Out](uint32_t First, uint32_t Count)
+    {
+        for (uint32_t b = First; b < First + Count; ++b)
+        {
+            const Barrier& Current = m_Barriers[b];
+            const char* Name = m_Resources[Current.Resource].Name.c_str();
+            if (Current.Type == Barrier::kTransition)
+            {
+                AppendFormat(Out, "      barrier     %s ", Name);
+                StateToString(Current.StateBefore, Out);
+                Out += " -> ";
+                StateToString(Current.StateAfter, Out);
+                Out += "\n";
+            }
+            else if (Current.Type == Barrier::kUAV)
+                AppendFormat(Out, "      UAV barrier %s\n", Name);
+            else
+                AppendFormat(Out, "      aliasing    %s takes over from %s\n", Name, m_Resources[Current.PreviousResource].Name.c_str());
+        }
+    };
+
+    uint32_t Position = 0;
+    for (uint32_t p = 0; p < (uint32_t)m_Passes.size(); ++p)
+    {
+        const Pass& CurrentPass = m_Passes[p];
+        if (p >= m_PassIsLive.size() || !m_PassIsLive[p])
+        {
+            AppendFormat(Out, "  --  %s (culled)\n", CurrentPass.Name.c_str());
+            continue;
+        }
+
+        const CompiledPass& Compiled = m_CompiledPasses[Position];
+        AppendFormat(Out, "  %2u  %s%s\n", Position++, CurrentPass.Name.c_str(), CurrentPass.HasSideEffects ? " (side effects)" : "");
+        DumpBarriers(Compiled.FirstBarrier, Compiled.BarrierCount);
+
+        for (const Access& Use : CurrentPass.Accesses)
+        {
+            AppendFormat(Out, "      %-11s %s ", Use.IsWrite ? (Use.IsRead ? "read/write" : "write") : "read", m_Resources[Use.Resource].Name.c_str());
+            StateToString(Use.State, Out);
+            Out += "\n";
+        }
+    }
+
+    if (m_Barriers.size() > m_FinalBarrier)
+    {
+        Out += "  final\n";
+        DumpBarriers(m_FinalBarrier, (uint32_t)m_Barriers.size() - m_FinalBarrier);
+    }
+
+    Out += "Resources\n";
+    for (uint32_t r = 0; r < (uint32_t)m_Resources.size(); ++r)
+    {
+        const Resource& Current = m_Resources[r];
+        const ResourceInfo& Info = m_ResourceInfo[r];
+
+        AppendFormat(Out, "  %-24s %s", Current.Name.c_str(), Current.IsTransient ? "transient" : "imported ");
+        if (Info.FirstPass == kInvalidHandle)
+            Out += " unused";
+        else
+            AppendFormat(Out, " passes %u-%u", Info.FirstPass, Info.LastPass);
+
+        if (Current.IsTransient && Info.FirstPass != kInvalidHandle)
+        {
+            AppendFormat(Out, ", %.1f KB at %llu", Current.Size / 1024.0, (unsigned long long)Info.HeapOffset);
+            if (m_AliasedResource[r] != kInvalidHandle)
+                AppendFormat(Out, ", aliases %s", m_Resources[m_AliasedResource[r]].Name.c_str());
+        }
+        else if (!Current.IsTransient)
+        {
+            Out += ", ";
+            StateToString(Current.ImportedState, Out);
+            Out += " -> ";
+            StateToString(Info.FinalState, Out);
+        }
+        Out += "\n";
+    }
+}
@@ -0,0 +1,215 @@
+//
+// Description:  Frame graph, passes declare the resources they read and write and Compile works out the barriers.
+//
+// Compile drops the passes that nothing depends on, then walks the remaining passes in the order they were added
+// and gives each one a single batch of barriers to issue before it runs:
+//
+//   - no barrier when the resource is already in a state that covers the use,
+//   - one transition to the union of the read states when a resource is read by several passes in a row,
+//   - a UAV barrier between unordered accesses that stay in the unordered access state,
+//   - an aliasing barrier when a transient resource takes over memory another transient resource used before.
+//
+// Transient resources only need memory from their first to their last use.  Compile places them in one heap so that
+// resources whose lifetimes do not overlap share memory.  The first use of a transient resource must write all of
+// it, the contents of aliased memory are undefined.
+//
+// States are D3D12_RESOURCE_STATES values.  Nothing here touches the device, FrameGraphExecutor records a compiled
+// graph into a CommandContext.
+//
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class FrameGraph
+{
+public:
+    typedef uint32_t ResourceHandle;
+    typedef uint32_t PassHandle;
+
+    static const uint32_t kInvalidHandle = ~0u;
+
+    // The D3D12_RESOURCE_STATES flags of the same names
+    enum : uint32_t
+    {
+        kCommon = 0,
+        kVertexAndConstantBuffer = 0x1,
+        kIndexBuffer = 0x2,
+        kRenderTarget = 0x4,
+        kUnorderedAccess = 0x8,
+        kDepthWrite = 0x10,
+        kDepthRead = 0x20,
+        kNonPixelShaderResource = 0x40,
+        kPixelShaderResource = 0x80,
+        kStreamOut = 0x100,
+        kIndirectArgument = 0x200,
+        kCopyDest = 0x400,
+        kCopySource = 0x800,
+        kResolveDest = 0x1000,
+        kResolveSource = 0x2000,
+
+        kShaderResource = kNonPixelShaderResource | kPixelShaderResource,
+        kWriteStates = kRenderTarget | kUnorderedAccess | kDepthWrite | kStreamOut | kCopyDest | kResolveDest
+    };
+
+    // Read-only states can be combined, a write state stands alone
+    static bool IsReadOnlyState( uint32_t State ) { return State != kCommon && (State & kWriteStates) == 0; }
+
+    struct Barrier
+    {
+        enum BarrierType : uint32_t
+        {
+            kTransition,
+            kUAV,
+            kAliasing
+        };
+
+        BarrierType Type;
+        ResourceHandle Resource;
+        // Aliasing barriers only, the transient resource that used the memory last
+        ResourceHandle PreviousResource;
+        uint32_t StateBefore;
+        uint32_t StateAfter;
+    };
+
+    struct CompiledPass
+    {
+        PassHandle Pass;
+        uint32_t FirstBarrier;
+        uint32_t BarrierCount;
+    };
+
+    struct ResourceInfo
+    {
+        // Positions in the compiled pass list, kInvalidHandle for a resource no surviving pass uses
+        uint32_t FirstPass;
+        uint32_t LastPass;
+        // State of the resource at its first use and after the graph has run
+        uint32_t FirstState;
+        uint32_t FinalState;
+        // Transient resources only
+        uint64_t HeapOffset;
+    };
+
+    struct CompileStats
+    {
+        uint32_t PassCount;
+        uint32_t CulledPassCount;
+        uint32_t TransitionCount;
+        uint32_t UAVBarrierCount;
+        uint32_t AliasingBarrierCount;
+        // Passes that issue barriers, each in one batch
+        uint32_t BarrierBatchCount;
+        // Transitions a pass by pass walk would have made that merging reads saved
+        uint32_t MergedTransitionCount;
+        uint64_t TransientBytes;
+        uint64_t TransientHeapSize;
+    };
+
+    FrameGraph( void );
+
+    // Removes every pass and resource
+    void Clear( void );
+
+    // A resource that lives outside the graph, in State when the graph starts
+    ResourceHandle ImportResource( const std::string& Name, uint32_t State );
+
+    // Changes the state an imported resource starts in, the graph has to be compiled again
+    void SetImportedState( ResourceHandle Resource, uint32_t State );
+
+    // State an imported resource is left in once the graph has run.  Without one it stays in the state of its last
+    // use.
+    void SetFinalState( ResourceHandle Resource, uint32_t State );
+
+    // Memory of Size bytes only needed between the first and the last pass that uses it
+    ResourceHandle CreateTransientResource( const std::string& Name, uint64_t Size, uint64_t Alignment );
+
+    // A pass with side effects is never culled, neither is a pass that writes an imported resource
+    PassHandle AddPass( const std::string& Name, bool HasSideEffects = false );
+
+    // Reading and writing the same resource in one pass needs the same state for both, such as unordered access
+    void Read( PassHandle Pass, ResourceHandle Resource, uint32_t State );
+    void Write( PassHandle Pass, ResourceHandle Resource, uint32_t State );
+
+    void Compile( void );
+
+    // Valid after Compile
+    const std::vector<CompiledPass>& GetCompiledPasses( void ) const { return m_CompiledPasses; }
+    const std::vector<Barrier>& GetBarriers( void ) const { return m_Barriers; }
+    // Issued after the last pass to move imported resources into their final states
+    uint32_t GetFinalBarrier( void ) const { return m_FinalBarrier; }
+    const ResourceInfo& GetResourceInfo( ResourceHandle Resource ) const { return m_ResourceInfo[Resource]; }
+    const CompileStats& GetStats( void ) const { return m_Stats; }
+
+    uint32_t GetPassCount( void ) const { return (uint32_t)m_Passes.size(); }
+    uint32_t GetResourceCount( void ) const { return (uint32_t)m_Resources.size(); }
+    const std::string& GetPassName( PassHandle Pass ) const { return m_Passes[Pass].Name; }
+    const std::string& GetResourceName( ResourceHandle Resource ) const { return m_Resources[Resource].Name; }
+    bool IsTransient( ResourceHandle Resource ) const { return m_Resources[Resource].IsTransient; }
+
+    // Passes with their barriers, reads and writes, culled passes and where every resource lives
+    void Dump( std::string& Out ) const;
+
+    static void StateToString( uint32_t State, std::string& Out );
+
+private:
+    struct Access
+    {
+        ResourceHandle Resource;
+        uint32_t State;
+        bool IsRead;
+        bool IsWrite;
+    };
+
+    struct Pass
+    {
+        std::string Name;
+        bool HasSideEffects;
+        std::vector<Access> Accesses;
+    };
+
+    struct Resource
+    {
+        std::string Name;
+        bool IsTransient;
+        uint32_t ImportedState;
+        uint32_t FinalState;
+        bool HasFinalState;
+        uint64_t Size;
+        uint64_t Alignment;
+    };
+
+    // One use of a resource by a surviving pass, in pass order.  The final state of an imported resource is a use
+    // at the position after the last pass.
+    struct Use
+    {
+        uint32_t Position;
+        uint32_t State;
+        bool IsWrite;
+    };
+
+    void AddAccess( PassHandle Pass, ResourceHandle Resource, uint32_t State, bool IsWrite );
+    void CullPasses( void );
+    void GatherUses( void );
+    void PlaceTransientResources( void );
+    void BuildBarriers( void );
+    void AddBarrier( Barrier::BarrierType Type, ResourceHandle Resource, uint32_t StateBefore, uint32_t StateAfter,
+        ResourceHandle PreviousResource = kInvalidHandle );
+
+    std::vector<Pass> m_Passes;
+    std::vector<Resource> m_Resources;
+
+    std::vector<bool> m_PassIsLive;
+    std::vector<CompiledPass> m_CompiledPasses;
+    std::vector<Barrier> m_Barriers;
+    uint32_t m_FinalBarrier;
+    std::vector<ResourceInfo> m_ResourceInfo;
+    // Uses of resource r are m_Uses[m_UseStart[r], m_UseStart[r + 1])
+    std::vector<uint32_t> m_UseStart;
+    std::vector<Use> m_Uses;
+    // The transient resource that used the memory of each transient resource before it
+    std::vector<ResourceHandle> m_AliasedResource;
+    CompileStats m_Stats;
+};
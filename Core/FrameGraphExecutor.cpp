@@ -0,0 +1,169 @@
+//
+// Description:  Records a FrameGraph into a CommandContext, see FrameGraphExecutor.h
+//
+
+#include "pch.h"
+#include "FrameGraphExecutor.h"
+#include "CommandContext.h"
+#include "GraphicsCore.h"
+#include "GpuBuffer.h"
+#include "Utility.h"
+#include <algorithm>
+
+using namespace std;
+
+static_assert(FrameGraph::kRenderTarget == (uint32_t)D3D12_RESOURCE_STATE_RENDER_TARGET &&
+    FrameGraph::kUnorderedAccess == (uint32_t)D3D12_RESOURCE_STATE_UNORDERED_ACCESS &&
+    FrameGraph::kDepthWrite == (uint32_t)D3D12_RESOURCE_STATE_DEPTH_WRITE &&
+    FrameGraph::kNonPixelShaderResource == (uint32_t)D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE &&
+    FrameGraph::kPixelShaderResource == (uint32_t)D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE &&
+    FrameGraph::kCopyDest == (uint32_t)D3D12_RESOURCE_STATE_COPY_DEST &&
+    FrameGraph::kCopySource == (uint32_t)D3D12_RESOURCE_STATE_COPY_SOURCE &&
+    FrameGraph::kResolveSource == (uint32_t)D3D12_RESOURCE_STATE_RESOLVE_SOURCE,
+    "FrameGraph states are D3D12_RESOURCE_STATES values");
+
+FrameGraph::ResourceHandle FrameGraphExecutor::Import( GpuResource& Resource, const std::string& Name )
+{
+    m_Resources.push_back(&Resource);
+    m_HasFinalState.push_back(false);
+    m_TransientBuffers.push_back(TransientBuffer());
+    return m_Graph.ImportResource(Name, FrameGraph::kCommon);
+}
+
+FrameGraph::ResourceHandle FrameGraphExecutor::CreateTransientBuffer( GpuBuffer& Buffer, const std::string& Name,
+    uint32_t NumElements, uint32_t ElementSize )
+{
+    // Placed buffers take whole 64 KB blocks of the heap
+    const uint64_t Size = Math::AlignUp((uint64_t)NumElements * ElementSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    TransientBuffer NewBuffer = { Name, NumElements, ElementSize, nullptr, 0 };
+    m_Resources.push_back(&Buffer);
+    m_HasFinalState.push_back(false);
+    m_TransientBuffers.push_back(NewBuffer);
+    return m_Graph.CreateTransientResource(Name, Size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+}
+
+void FrameGraphExecutor::SetFinalState( FrameGraph::ResourceHandle Resource, uint32_t State )
+{
+    m_Graph.SetFinalState(Resource, State);
+    m_HasFinalState[Resource] = true;
+}
+
+FrameGraph::PassHandle FrameGraphExecutor::AddPass( const std::string& Name, const std::function<void(CommandContext&)>& Record,
+    bool HasSideEffects )
+{
+    m_Passes.push_back(Record);
+    return m_Graph.AddPass(Name, HasSideEffects);
+}
+
+void FrameGraphExecutor::Clear( void )
+{
+    m_Graph.Clear();
+    m_Resources.clear();
+    m_HasFinalState.clear();
+    m_TransientBuffers.clear();
+    m_Passes.clear();
+}
+
+void FrameGraphExecutor::PlaceTransientBuffers( void )
+{
+    const uint64_t HeapSize = m_Graph.GetStats().TransientHeapSize;
+    if (HeapSize > m_TransientHeapSize)
+    {
+        if (m_TransientHeap != nullptr)
+            m_RetiredHeaps.push_back(m_TransientHeap);
+
+        D3D12_HEAP_DESC Desc = {};
+        Desc.SizeInBytes = HeapSize;
+        Desc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        Desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        Desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+        ASSERT_SUCCEEDED(Graphics::g_Device->CreateHeap(&Desc, MY_IID_PPV_ARGS(&m_TransientHeap)));
+        m_TransientHeapSize = HeapSize;
+    }
+
+    for (FrameGraph::ResourceHandle r = 0; r < (uint32_t)m_Resources.size(); ++r)
+    {
+        const FrameGraph::ResourceInfo& Info = m_Graph.GetResourceInfo(r);
+        if (!m_Graph.IsTransient(r) || Info.FirstPass == FrameGraph::kInvalidHandle)
+            continue;
+
+        TransientBuffer& Transient = m_TransientBuffers[r];
+        if (Transient.PlacedHeap == m_TransientHeap.Get() && Transient.PlacedOffset == Info.HeapOffset)
+            continue;
+
+        static_cast<GpuBuffer*>(m_Resources[r])->CreatePlaced(Utility::UTF8ToWideString(Transient.Name), m_TransientHeap.Get(),
+            (uint32_t)Info.HeapOffset, Transient.NumElements, Transient.ElementSize);
+        Transient.PlacedHeap = m_TransientHeap.Get();
+        Transient.PlacedOffset = Info.HeapOffset;
+    }
+}
+
+void FrameGraphExecutor::Execute( CommandContext& Context )
+{
+    const uint32_t ResourceCount = (uint32_t)m_Resources.size();
+    for (FrameGraph::ResourceHandle r = 0; r < ResourceCount; ++r)
+    {
+        if (!m_Graph.IsTransient(r))
+            m_Graph.SetImportedState(r, Context.GetResourceState(*m_Resources[r]));
+    }
+
+    m_Graph.Compile();
+    PlaceTransientBuffers();
+
+    // Resources by the pass that uses them first
+    vector<FrameGraph::ResourceHandle> FirstUses(ResourceCount);
+    for (FrameGraph::ResourceHandle r = 0; r < ResourceCount; ++r)
+        FirstUses[r] = r;
+    sort(FirstUses.begin(), FirstUses.end(), [this](FrameGraph::ResourceHandle A, FrameGraph::ResourceHandle B)
+    {
+        return m_Graph.GetResourceInfo(A).FirstPass < m_Graph.GetResourceInfo(B).FirstPass;
+    });
+
+    // UAV barriers go through TransitionResource as well: between unordered accesses it makes the same UAV barrier,
+    // and a context that defers resource states has to see every first use.  An aliasing barrier leaves the
+    // transient resource untouched, the transition into the state of its first use follows it.
+    const vector<FrameGraph::Barrier>& Barriers = m_Graph.GetBarriers();
+    vector<bool> Touched(ResourceCount, false);
+    auto IssueBarriers = [&](uint32_t First, uint32_t Count)
+    {
+        for (uint32_t b = First; b < First + Count; ++b)
+        {
+            const FrameGraph::Barrier& Current = Barriers[b];
+            if (Current.Type == FrameGraph::Barrier::kAliasing)
+            {
+                Context.InsertAliasBarrier(*m_Resources[Current.PreviousResource], *m_Resources[Current.Resource]);
+                continue;
+            }
+            Context.TransitionResource(*m_Resources[Current.Resource], (D3D12_RESOURCE_STATES)Current.StateAfter);
+            Touched[Current.Resource] = true;
+        }
+    };
+
+    const vector<FrameGraph::CompiledPass>& Passes = m_Graph.GetCompiledPasses();
+    uint32_t NextFirstUse = 0;
+    for (uint32_t i = 0; i < (uint32_t)Passes.size(); ++i)
+    {
+        IssueBarriers(Passes[i].FirstBarrier, Passes[i].BarrierCount);
+
+        // A resource already in the state of its first use needs no barrier, but a deferring context still has to
+        // learn the state
+        for (; NextFirstUse < ResourceCount && m_Graph.GetResourceInfo(FirstUses[NextFirstUse]).FirstPass == i; ++NextFirstUse)
+        {
+            const FrameGraph::ResourceHandle r = FirstUses[NextFirstUse];
+            if (!Touched[r])
+                Context.TransitionResource(*m_Resources[r], (D3D12_RESOURCE_STATES)m_Graph.GetResourceInfo(r).FirstState);
+        }
+
+        Context.FlushResourceBarriers();
+        m_Passes[Passes[i].Pass](Context);
+    }
+
+    IssueBarriers(m_Graph.GetFinalBarrier(), (uint32_t)Barriers.size() - m_Graph.GetFinalBarrier());
+    for (FrameGraph::ResourceHandle r = 0; r < ResourceCount; ++r)
+    {
+        if (m_HasFinalState[r] && m_Graph.GetResourceInfo(r).FirstPass == FrameGraph::kInvalidHandle && !Touched[r])
+            Context.TransitionResource(*m_Resources[r], (D3D12_RESOURCE_STATES)m_Graph.GetResourceInfo(r).FinalState);
+    }
+    Context.FlushResourceBarriers();
+}
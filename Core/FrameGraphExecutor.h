@@ -0,0 +1,74 @@
+//
+// Description:  Records a FrameGraph over GpuResources into a CommandContext.
+//
+// The graph is compiled against the states the context sees the resources in when Execute is called, so the same
+// executor can run again after something else moved them.  Barriers go through the context, which keeps the states
+// of the resources up to date and works inside a ParallelPassRecorder pass as well.
+//
+// Transient buffers are placed in a heap the executor owns, at the offsets Compile gave them, so buffers that are
+// never alive at the same time share memory.  A buffer is placed again only when its offset changes.  The heap
+// lives as long as the executor, keep the executor and the buffers until the GPU is done with the graph.  Textures
+// would need render target and depth heaps of their own, only buffers are transient.
+//
+
+#pragma once
+
+#include "FrameGraph.h"
+#include <functional>
+
+class CommandContext;
+class GpuResource;
+class GpuBuffer;
+
+class FrameGraphExecutor
+{
+public:
+    FrameGraph::ResourceHandle Import( GpuResource& Resource, const std::string& Name );
+
+    // Buffer gets memory only from its first to its last pass, its first use has to write all of it.  Buffers of
+    // passes that are culled are not created.
+    FrameGraph::ResourceHandle CreateTransientBuffer( GpuBuffer& Buffer, const std::string& Name, uint32_t NumElements,
+        uint32_t ElementSize );
+
+    // State Resource is left in after Execute
+    void SetFinalState( FrameGraph::ResourceHandle Resource, uint32_t State );
+
+    FrameGraph::PassHandle AddPass( const std::string& Name, const std::function<void(CommandContext&)>& Record,
+        bool HasSideEffects = false );
+
+    void Read( FrameGraph::PassHandle Pass, FrameGraph::ResourceHandle Resource, uint32_t State ) { m_Graph.Read(Pass, Resource, State); }
+    void Write( FrameGraph::PassHandle Pass, FrameGraph::ResourceHandle Resource, uint32_t State ) { m_Graph.Write(Pass, Resource, State); }
+
+    // Compiles the graph and records every pass that survives culling, each after its batch of barriers
+    void Execute( CommandContext& Context );
+
+    // Keeps the transient heap, the next graph places its buffers in it again
+    void Clear( void );
+
+    const FrameGraph& GetGraph( void ) const { return m_Graph; }
+
+private:
+    struct TransientBuffer
+    {
+        std::string Name;
+        uint32_t NumElements;
+        uint32_t ElementSize;
+        // Where the buffer was created last, nullptr before its first placement
+        ID3D12Heap* PlacedHeap;
+        uint64_t PlacedOffset;
+    };
+
+    void PlaceTransientBuffers( void );
+
+    FrameGraph m_Graph;
+    std::vector<GpuResource*> m_Resources;
+    std::vector<bool> m_HasFinalState;
+    // Indexed by resource handle, only meaningful for transient resources
+    std::vector<TransientBuffer> m_TransientBuffers;
+    std::vector<std::function<void(CommandContext&)>> m_Passes;
+
+    Microsoft::WRL::ComPtr<ID3D12Heap> m_TransientHeap;
+    uint64_t m_TransientHeapSize = 0;
+    // Heaps that were outgrown, buffers recorded earlier may still live in them
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> m_RetiredHeaps;
+};
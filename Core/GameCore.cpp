@@ -21,6 +21,7 @@
 #include "PostEffects.h"
 #include "Display.h"
 #include "Util/CommandLineArg.h"
+#include "Util/JobSystem.h"
 #include <shellapi.h>
 
 #pragma comment(lib, "runtimeobject.lib") 
@@ -36,6 +37,7 @@ namespace GameCore
         int argc = 0;
         LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
         CommandLineArgs::Initialize(argc, argv);
+        JobSystem::Initialize();
 
         Graphics::Initialize();
         SystemTime::Initialize();
@@ -52,6 +54,7 @@ namespace GameCore
         game.Cleanup();
 
         GameInput::Shutdown();
+        JobSystem::Shutdown();
     }
 
     bool UpdateApplication( IGameApp& game )
@@ -173,6 +173,8 @@ void ByteAddressBuffer::CreateDerivedViews(void)
 
     if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
     g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -198,6 +200,8 @@ void StructuredBuffer::CreateDerivedViews(void)
 
     if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
     g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -226,6 +230,8 @@ void TypedBuffer::CreateDerivedViews(void)
 
     if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
     g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -26,6 +26,7 @@
 #include "CommandContext.h"
 #include "CommandListManager.h"
 #include "RootSignature.h"
+#include "PipelineLibrary.h"
 #include "CommandSignature.h"
 #include "ParticleEffectManager.h"
 #include "GraphRenderer.h"
@@ -371,6 +372,9 @@ void Graphics::Initialize(void)
 
     g_CommandManager.Create(g_Device);
 
+    // Before any pipeline is finalized
+    PipelineLibrary::Initialize(L"PipelineCache");
+
     // Common state was moved to GraphicsCommon.*
     InitializeCommonState();
 
@@ -392,6 +396,7 @@ void Graphics::Shutdown( void )
     CommandContext::DestroyAllContexts();
     g_CommandManager.Shutdown();
     GpuTimeManager::Shutdown();
+    PipelineLibrary::Shutdown();
     PSO::DestroyAll();
     RootSignature::DestroyAll();
     DescriptorAllocator::DestroyAll();
@@ -31,6 +31,16 @@ LinearAllocatorPageManager::LinearAllocatorPageManager()
 }
 
 LinearAllocatorPageManager LinearAllocator::sm_PageManager[2];
+UploadRingPageManager LinearAllocator::sm_UploadRings[D3D12_COMMAND_LIST_TYPE_COPY + 1];
+
+namespace
+{
+    // The direct queue uploads most per frame
+    const uint32_t kDirectRingChunkCount = 64;
+    const uint32_t kRingChunkCount = 16;
+    const size_t kDirectLargeRegionSize = 32 << 20;
+    const size_t kLargeRegionSize = 16 << 20;
+}
 
 LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
 {
@@ -127,24 +137,166 @@ LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage( size_t PageSize
     return new LinearAllocationPage(pBuffer, DefaultUsage);
 }
 
-void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
+void UploadRingPageManager::Create( D3D12_COMMAND_LIST_TYPE QueueType, LinearAllocatorPageManager& PageManager )
 {
-    if (m_CurPage == nullptr)
+    if (m_IsCreated.load(memory_order_acquire))
         return;
 
-    m_RetiredPages.push_back(m_CurPage);
+    lock_guard<mutex> LockGuard(m_CreateMutex);
+    if (m_IsCreated.load(memory_order_relaxed))
+        return;
+
+    bool IsDirect = QueueType == D3D12_COMMAND_LIST_TYPE_DIRECT;
+    size_t LargeRegionSize = IsDirect ? kDirectLargeRegionSize : kLargeRegionSize;
+
+    m_Ring.Initialize(kUploadRingChunkSize, IsDirect ? kDirectRingChunkCount : kRingChunkCount,
+        [](uint64_t FenceValue) { return g_CommandManager.IsFenceComplete(FenceValue); });
+    m_LargeRegionOffset = m_Ring.GetSize();
+    m_LargeBlocks.Initialize(Math::Log2(LargeRegionSize / kUploadRingLargeBlockSize));
+    m_Page.reset(PageManager.CreateNewPage(m_LargeRegionOffset + LargeRegionSize));
+    m_IsCreated.store(true, memory_order_release);
+}
+
+void UploadRingPageManager::Destroy( void )
+{
+    // Called with the GPU idle, the next Create starts with every chunk and large block free
+    lock_guard<mutex> LockGuard(m_CreateMutex);
+    m_IsCreated.store(false, memory_order_relaxed);
+    m_Page.reset();
+    {
+        lock_guard<mutex> LargeLockGuard(m_LargeMutex);
+        m_RetiredLargeBlocks = decltype(m_RetiredLargeBlocks)();
+    }
+}
+
+void UploadRingPageManager::DiscardChunks( uint64_t FenceID, const vector<size_t>& Chunks )
+{
+    for (size_t Chunk : Chunks)
+        m_Ring.RetireChunk(Chunk, FenceID);
+}
+
+void UploadRingPageManager::ReleaseCompletedLarge( void )
+{
+    vector<ConcurrentBuddyOffsetAllocator::Block> CompletedBlocks;
+    {
+        lock_guard<mutex> LockGuard(m_LargeMutex);
+        while (!m_RetiredLargeBlocks.empty() && g_CommandManager.IsFenceComplete(m_RetiredLargeBlocks.front().first))
+        {
+            CompletedBlocks.push_back(m_RetiredLargeBlocks.front().second);
+            m_RetiredLargeBlocks.pop();
+        }
+    }
+
+    if (!CompletedBlocks.empty())
+        m_LargeBlocks.DeallocateBatch(CompletedBlocks.data(), CompletedBlocks.size());
+}
+
+bool UploadRingPageManager::AllocateLarge( size_t SizeInBytes, ConcurrentBuddyOffsetAllocator::Block& Block, size_t& Offset )
+{
+    ReleaseCompletedLarge();
+
+    size_t Units = Math::DivideByMultiple(SizeInBytes, (size_t)kUploadRingLargeBlockSize);
+    Block.Order = Math::Log2(Units); // Log2 rounds up fractions to next whole value
+    Block.Offset = m_LargeBlocks.Allocate(Block.Order);
+    if (Block.Offset == BuddyOffsetAllocator::kInvalidOffset)
+        return false;
+
+    Offset = m_LargeRegionOffset + Block.Offset * kUploadRingLargeBlockSize;
+    return true;
+}
+
+void UploadRingPageManager::FreeLarge( uint64_t FenceID, const vector<ConcurrentBuddyOffsetAllocator::Block>& Blocks )
+{
+    lock_guard<mutex> LockGuard(m_LargeMutex);
+    for (auto iter = Blocks.begin(); iter != Blocks.end(); ++iter)
+        m_RetiredLargeBlocks.push(make_pair(FenceID, *iter));
+}
+
+UploadRingPageManager& LinearAllocator::GetUploadRing( void )
+{
+    ASSERT(m_AllocationType == kCpuWritable);
+    UploadRingPageManager& Ring = sm_UploadRings[m_QueueType];
+    Ring.Create(m_QueueType, sm_PageManager[kCpuWritable]);
+    return Ring;
+}
+
+void LinearAllocator::RequestNewPage( void )
+{
+    size_t ChunkOffset;
+    m_IsRingChunk = m_AllocationType == kCpuWritable && GetUploadRing().RequestChunk(ChunkOffset);
+    if (m_IsRingChunk)
+    {
+        m_CurPage = GetUploadRing().GetPage();
+        m_CurOffset = ChunkOffset;
+        m_CurPageEnd = ChunkOffset + kUploadRingChunkSize;
+    }
+    else
+    {
+        // GPU memory, and CPU memory while every chunk of the ring is in flight
+        m_CurPage = sm_PageManager[m_AllocationType].RequestPage();
+        m_CurOffset = 0;
+        m_CurPageEnd = m_AllocationType == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize;
+    }
+}
+
+void LinearAllocator::RetireCurrentPage( void )
+{
+    ASSERT(m_CurPage != nullptr);
+    if (m_IsRingChunk)
+        m_RetiredChunks.push_back(m_CurPageEnd - kUploadRingChunkSize);
+    else
+        m_RetiredPages.push_back(m_CurPage);
     m_CurPage = nullptr;
+}
+
+void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
+{
+    if (m_CurPage != nullptr)
+        RetireCurrentPage();
     m_CurOffset = 0;
 
-    sm_PageManager[m_AllocationType].DiscardPages(FenceID, m_RetiredPages);
-    m_RetiredPages.clear();
+    if (!m_RetiredChunks.empty())
+    {
+        GetUploadRing().DiscardChunks(FenceID, m_RetiredChunks);
+        m_RetiredChunks.clear();
+    }
 
-    sm_PageManager[m_AllocationType].FreeLargePages(FenceID, m_LargePageList);
-    m_LargePageList.clear();
+    if (!m_RetiredPages.empty())
+    {
+        sm_PageManager[m_AllocationType].DiscardPages(FenceID, m_RetiredPages);
+        m_RetiredPages.clear();
+    }
+
+    if (!m_LargeBlocks.empty())
+    {
+        GetUploadRing().FreeLarge(FenceID, m_LargeBlocks);
+        m_LargeBlocks.clear();
+    }
+
+    if (!m_LargePageList.empty())
+    {
+        sm_PageManager[m_AllocationType].FreeLargePages(FenceID, m_LargePageList);
+        m_LargePageList.clear();
+    }
 }
 
 DynAlloc LinearAllocator::AllocateLargePage(size_t SizeInBytes)
 {
+    ConcurrentBuddyOffsetAllocator::Block Block;
+    size_t Offset;
+    if (m_AllocationType == kCpuWritable && GetUploadRing().AllocateLarge(SizeInBytes, Block, Offset))
+    {
+        m_LargeBlocks.push_back(Block);
+        LinearAllocationPage* Page = GetUploadRing().GetPage();
+
+        DynAlloc ret(*Page, Offset, SizeInBytes);
+        ret.DataPtr = (uint8_t*)Page->m_CpuVirtualAddress + Offset;
+        ret.GpuAddress = Page->m_GpuVirtualAddress + Offset;
+
+        return ret;
+    }
+
+    // Too large for the region or it is full, a page of its own
     LinearAllocationPage* OneOff = sm_PageManager[m_AllocationType].CreateNewPage(SizeInBytes);
     m_LargePageList.push_back(OneOff);
 
@@ -170,18 +322,12 @@ DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
 
     m_CurOffset = Math::AlignUp(m_CurOffset, Alignment);
 
-    if (m_CurOffset + AlignedSize > m_PageSize)
-    {
-        ASSERT(m_CurPage != nullptr);
-        m_RetiredPages.push_back(m_CurPage);
-        m_CurPage = nullptr;
-    }
+    if (m_CurPage != nullptr && m_CurOffset + AlignedSize > m_CurPageEnd)
+        RetireCurrentPage();
 
+    // Pages and chunks start aligned to any power of two up to their size
     if (m_CurPage == nullptr)
-    {
-        m_CurPage = sm_PageManager[m_AllocationType].RequestPage();
-        m_CurOffset = 0;
-    }
+        RequestNewPage();
 
     DynAlloc ret(*m_CurPage, m_CurOffset, AlignedSize);
     ret.DataPtr = (uint8_t*)m_CurPage->m_CpuVirtualAddress + m_CurOffset;
@@ -19,13 +19,19 @@
 // When a command context is finished, it will receive a fence ID that indicates when it's safe to reclaim
 // used resources.  The CleanupUsedPages() method must be invoked at this time so that the used pages can be
 // scheduled for reuse after the fence has cleared.
+//
+// CPU-writable allocators take their pages as chunks of a lock-free upload ring per queue instead, and their
+// large allocations from a region after the ring.  The page manager is only used when those run out.
 
 #pragma once
 
 #include "GpuResource.h"
+#include "UploadRing.h"
+#include "BuddyOffsetAllocator.h"
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <atomic>
 
 // Constant blocks must be multiples of 16 constants @ 16 bytes each
 #define DEFAULT_ALIGN 256
@@ -93,7 +99,9 @@ enum LinearAllocatorType
 enum
 {
     kGpuAllocatorPageSize = 0x10000,	// 64K
-    kCpuAllocatorPageSize = 0x200000	// 2MB
+    kCpuAllocatorPageSize = 0x200000,	// 2MB
+    kUploadRingChunkSize = 0x80000,		// 512K, larger CPU-writable allocations are large ones
+    kUploadRingLargeBlockSize = 0x10000	// 64K
 };
 
 class LinearAllocatorPageManager
@@ -125,14 +133,54 @@ private:
     std::mutex m_Mutex;
 };
 
+// Upload memory of one queue in a single persistently mapped buffer, created on first use: the chunks of an
+// UploadRing for the contexts of that queue, followed by a region for large allocations sub-allocated in
+// kUploadRingLargeBlockSize units and freed once their fence has completed.
+class UploadRingPageManager
+{
+public:
+
+    UploadRingPageManager() : m_IsCreated(false), m_LargeRegionOffset(0) {}
+
+    // Creates the buffer unless it exists, again after Destroy
+    void Create( D3D12_COMMAND_LIST_TYPE QueueType, LinearAllocatorPageManager& PageManager );
+
+    // Lock-free, false when every chunk is in flight
+    bool RequestChunk( size_t& Offset ) { Offset = m_Ring.AcquireChunk(); return Offset != UploadRing::kInvalidOffset; }
+    void DiscardChunks( uint64_t FenceID, const std::vector<size_t>& Chunks );
+
+    // False when the large region is full
+    bool AllocateLarge( size_t SizeInBytes, ConcurrentBuddyOffsetAllocator::Block& Block, size_t& Offset );
+    void FreeLarge( uint64_t FenceID, const std::vector<ConcurrentBuddyOffsetAllocator::Block>& Blocks );
+
+    LinearAllocationPage* GetPage( void ) { return m_Page.get(); }
+
+    void Destroy( void );
+
+private:
+
+    void ReleaseCompletedLarge( void );
+
+    // Set under m_CreateMutex, read without it on every allocation
+    std::atomic<bool> m_IsCreated;
+    std::mutex m_CreateMutex;
+    std::unique_ptr<LinearAllocationPage> m_Page;
+    UploadRing m_Ring;
+    size_t m_LargeRegionOffset;
+    ConcurrentBuddyOffsetAllocator m_LargeBlocks;
+    std::mutex m_LargeMutex;
+    std::queue<std::pair<uint64_t, ConcurrentBuddyOffsetAllocator::Block> > m_RetiredLargeBlocks;
+};
+
 class LinearAllocator
 {
 public:
 
-    LinearAllocator(LinearAllocatorType Type) : m_AllocationType(Type), m_PageSize(0), m_CurOffset(~(size_t)0), m_CurPage(nullptr)
+    LinearAllocator(LinearAllocatorType Type, D3D12_COMMAND_LIST_TYPE QueueType = D3D12_COMMAND_LIST_TYPE_DIRECT)
+        : m_AllocationType(Type), m_QueueType(QueueType), m_PageSize(0), m_CurOffset(~(size_t)0), m_CurPageEnd(0), m_CurPage(nullptr), m_IsRingChunk(false)
     {
         ASSERT(Type > kInvalidAllocator && Type < kNumAllocatorTypes);
-        m_PageSize = (Type == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize);
+        m_PageSize = (Type == kGpuExclusive ? kGpuAllocatorPageSize : kUploadRingChunkSize);
     }
 
     DynAlloc Allocate( size_t SizeInBytes, size_t Alignment = DEFAULT_ALIGN );
@@ -143,18 +191,31 @@ public:
     {
         sm_PageManager[0].Destroy();
         sm_PageManager[1].Destroy();
+        for (auto& UploadRing : sm_UploadRings)
+            UploadRing.Destroy();
     }
 
 private:
 
     DynAlloc AllocateLargePage( size_t SizeInBytes );
+    void RequestNewPage( void );
+    void RetireCurrentPage( void );
+    UploadRingPageManager& GetUploadRing( void );
 
     static LinearAllocatorPageManager sm_PageManager[2];
+    // Indexed by D3D12_COMMAND_LIST_TYPE, bundles have none
+    static UploadRingPageManager sm_UploadRings[D3D12_COMMAND_LIST_TYPE_COPY + 1];
 
     LinearAllocatorType m_AllocationType;
+    D3D12_COMMAND_LIST_TYPE m_QueueType;
     size_t m_PageSize;
     size_t m_CurOffset;
+    // The current page or ring chunk ends here
+    size_t m_CurPageEnd;
     LinearAllocationPage* m_CurPage;
+    bool m_IsRingChunk;
     std::vector<LinearAllocationPage*> m_RetiredPages;
     std::vector<LinearAllocationPage*> m_LargePageList;
+    std::vector<size_t> m_RetiredChunks;
+    std::vector<ConcurrentBuddyOffsetAllocator::Block> m_LargeBlocks;
 };
@@ -0,0 +1,76 @@
+//
+// Description:  Resource states of a command list recorded before the states it executes with are known.
+//
+// A pass of ParallelPassRecorder keeps the states of the resources it uses to itself.  The first use of a resource
+// records no barrier, the transition into that state goes at the end of the preceding command list when the passes
+// are submitted in order, and the resource is then left in the state the pass ends with.
+//
+// Resources and states are opaque here so that the bookkeeping does not touch the device.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+class PassResourceStates
+{
+public:
+    typedef uint32_t State;
+
+    // False on the first use of Resource, nothing is recorded for it in the pass.  Otherwise OldState is the state
+    // the pass left it in and the caller records the transition.
+    bool Use( void* Resource, State NewState, State& OldState )
+    {
+        for (Tracked& Entry : m_Tracked)
+        {
+            if (Entry.Resource == Resource)
+            {
+                OldState = Entry.CurrentState;
+                Entry.CurrentState = NewState;
+                return true;
+            }
+        }
+        Tracked FirstUse = { Resource, NewState, NewState };
+        m_Tracked.push_back(FirstUse);
+        return false;
+    }
+
+    // The state the pass left Resource in, Untracked if the pass has not used it
+    State GetState( const void* Resource, State Untracked ) const
+    {
+        for (const Tracked& Entry : m_Tracked)
+        {
+            if (Entry.Resource == Resource)
+                return Entry.CurrentState;
+        }
+        return Untracked;
+    }
+
+    // Called on submission, in submission order, with the preceding command list still open.  Transition(Resource,
+    // InitialState) records the barrier into the state the pass first used the resource in, then
+    // Publish(Resource, FinalState) hands on the state the pass left it in.
+    template <typename TransitionFunc, typename PublishFunc>
+    void Resolve( TransitionFunc Transition, PublishFunc Publish )
+    {
+        for (const Tracked& Entry : m_Tracked)
+        {
+            Transition(Entry.Resource, Entry.InitialState);
+            Publish(Entry.Resource, Entry.CurrentState);
+        }
+        m_Tracked.clear();
+    }
+
+    bool IsEmpty( void ) const { return m_Tracked.empty(); }
+    void Clear( void ) { m_Tracked.clear(); }
+
+private:
+    struct Tracked
+    {
+        void* Resource;
+        State InitialState;
+        State CurrentState;
+    };
+
+    std::vector<Tracked> m_Tracked;
+};
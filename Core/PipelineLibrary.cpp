@@ -0,0 +1,372 @@
+//
+// Description:  On-disk cache of compiled pipeline state objects, see PipelineLibrary.h
+//
+
+#include "pch.h"
+#include "PipelineLibrary.h"
+#include "GraphicsCore.h"
+#include "FileUtility.h"
+#include "SystemTime.h"
+#include "Hash.h"
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+
+using namespace std;
+using namespace Graphics;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // "PLIX"
+    const uint32_t kIndexMagic = 0x58494C50;
+    const uint32_t kIndexVersion = 1;
+
+    struct IndexHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t Reserved;
+        uint64_t LibrarySize;
+        uint64_t LibraryChecksum;
+    };
+
+    uint64_t HashBytes( const void* Data, size_t Size, uint64_t Hash )
+    {
+        // HashRange reads whole words, anything not word aligned is hashed a byte at a time
+        const uint8_t* Bytes = (const uint8_t*)Data;
+        size_t WordBytes = 0;
+        if (((uintptr_t)Data & 3) == 0)
+        {
+            WordBytes = Size & ~(size_t)3;
+            Hash = Utility::HashRange((const uint32_t*)Data, (const uint32_t*)(Bytes + WordBytes), (size_t)Hash);
+        }
+
+        for (size_t i = WordBytes; i < Size; ++i)
+            Hash = 16777619U * Hash ^ Bytes[i];
+        return Hash;
+    }
+
+    uint64_t HashString( const char* String, uint64_t Hash )
+    {
+        return String == nullptr ? Hash : HashBytes(String, strlen(String) + 1, Hash);
+    }
+
+    uint64_t HashBytecode( const D3D12_SHADER_BYTECODE& Bytecode, uint64_t Hash )
+    {
+        Hash = HashBytes(&Bytecode.BytecodeLength, sizeof(Bytecode.BytecodeLength), Hash);
+        return Bytecode.pShaderBytecode == nullptr ? Hash : HashBytes(Bytecode.pShaderBytecode, Bytecode.BytecodeLength, Hash);
+    }
+}
+
+uint64_t PipelineCacheIndex::Checksum( const void* Data, size_t Size )
+{
+    return HashBytes(Data, Size, Size);
+}
+
+bool PipelineCacheIndex::Contains( uint64_t Hash, PipelineType Type ) const
+{
+    auto Iter = lower_bound(m_Entries.begin(), m_Entries.end(), make_pair(Hash, (uint32_t)Type),
+        []( const Entry& Lhs, const pair<uint64_t, uint32_t>& Rhs ) { return Lhs.Hash != Rhs.first ? Lhs.Hash < Rhs.first : Lhs.Type < Rhs.second; });
+    return Iter != m_Entries.end() && Iter->Hash == Hash && Iter->Type == (uint32_t)Type;
+}
+
+bool PipelineCacheIndex::Insert( uint64_t Hash, PipelineType Type )
+{
+    auto Iter = lower_bound(m_Entries.begin(), m_Entries.end(), make_pair(Hash, (uint32_t)Type),
+        []( const Entry& Lhs, const pair<uint64_t, uint32_t>& Rhs ) { return Lhs.Hash != Rhs.first ? Lhs.Hash < Rhs.first : Lhs.Type < Rhs.second; });
+    if (Iter != m_Entries.end() && Iter->Hash == Hash && Iter->Type == (uint32_t)Type)
+        return false;
+
+    Entry NewEntry = { Hash, (uint32_t)Type, 0 };
+    m_Entries.insert(Iter, NewEntry);
+    return true;
+}
+
+void PipelineCacheIndex::Serialize( vector<uint8_t>& Out, const void* Library, size_t LibrarySize ) const
+{
+    IndexHeader Header;
+    Header.Magic = kIndexMagic;
+    Header.Version = kIndexVersion;
+    Header.EntryCount = (uint32_t)m_Entries.size();
+    Header.Reserved = 0;
+    Header.LibrarySize = LibrarySize;
+    Header.LibraryChecksum = Checksum(Library, LibrarySize);
+
+    Out.resize(sizeof(IndexHeader) + m_Entries.size() * sizeof(Entry));
+    memcpy(Out.data(), &Header, sizeof(IndexHeader));
+    if (!m_Entries.empty())
+        memcpy(Out.data() + sizeof(IndexHeader), m_Entries.data(), m_Entries.size() * sizeof(Entry));
+}
+
+bool PipelineCacheIndex::Deserialize( const void* Data, size_t Size, const void* Library, size_t LibrarySize )
+{
+    m_Entries.clear();
+
+    IndexHeader Header;
+    if (Size < sizeof(IndexHeader))
+        return false;
+    memcpy(&Header, Data, sizeof(IndexHeader));
+
+    if (Header.Magic != kIndexMagic || Header.Version != kIndexVersion)
+        return false;
+    if (Size != sizeof(IndexHeader) + (size_t)Header.EntryCount * sizeof(Entry))
+        return false;
+    if (Header.LibrarySize != LibrarySize || Header.LibraryChecksum != Checksum(Library, LibrarySize))
+        return false;
+
+    m_Entries.resize(Header.EntryCount);
+    if (Header.EntryCount > 0)
+        memcpy(m_Entries.data(), (const uint8_t*)Data + sizeof(IndexHeader), Header.EntryCount * sizeof(Entry));
+
+    // Written by Serialize, but a file that lies about its order would make lookups miss silently
+    for (size_t i = 1; i < m_Entries.size(); ++i)
+    {
+        const Entry& Prev = m_Entries[i - 1];
+        const Entry& Cur = m_Entries[i];
+        if (Prev.Hash > Cur.Hash || (Prev.Hash == Cur.Hash && Prev.Type >= Cur.Type))
+        {
+            m_Entries.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace
+{
+    mutex s_Mutex;
+    wstring s_FilePath;
+    ComPtr<ID3D12PipelineLibrary> s_Library;
+    // The library reads out of the blob it was created from for as long as it lives
+    Utility::ByteArray s_LibraryBlob;
+    PipelineCacheIndex s_Index;
+    bool s_IsDirty = false;
+    PipelineLibraryStats s_Stats;
+
+    void PipelineName( wchar_t (&Name)[20], uint64_t Hash, PipelineCacheIndex::PipelineType Type )
+    {
+        swprintf_s(Name, L"%c%016llx", Type == PipelineCacheIndex::kGraphics ? L'G' : L'C', Hash);
+    }
+
+    // Loads the pipeline if the index knows it, nullptr otherwise
+    ID3D12PipelineState* LoadPipeline( uint64_t Hash, PipelineCacheIndex::PipelineType Type, const void* Desc )
+    {
+        lock_guard<mutex> LockGuard(s_Mutex);
+        if (s_Library == nullptr || !s_Index.Contains(Hash, Type))
+            return nullptr;
+
+        wchar_t Name[20];
+        PipelineName(Name, Hash, Type);
+
+        // Loading the same name on two threads at once is not allowed, the lock covers that
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        ID3D12PipelineState* PSO = nullptr;
+        HRESULT hr = Type == PipelineCacheIndex::kGraphics ?
+            s_Library->LoadGraphicsPipeline(Name, (const D3D12_GRAPHICS_PIPELINE_STATE_DESC*)Desc, MY_IID_PPV_ARGS(&PSO)) :
+            s_Library->LoadComputePipeline(Name, (const D3D12_COMPUTE_PIPELINE_STATE_DESC*)Desc, MY_IID_PPV_ARGS(&PSO));
+        if (FAILED(hr))
+            return nullptr;
+
+        ++s_Stats.Loaded;
+        s_Stats.LoadSeconds += SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        return PSO;
+    }
+
+    void StorePipeline( uint64_t Hash, PipelineCacheIndex::PipelineType Type, ID3D12PipelineState* PSO, double CompileSeconds )
+    {
+        lock_guard<mutex> LockGuard(s_Mutex);
+        ++s_Stats.Compiled;
+        s_Stats.CompileSeconds += CompileSeconds;
+        if (s_Library == nullptr || s_Index.Contains(Hash, Type))
+            return;
+
+        wchar_t Name[20];
+        PipelineName(Name, Hash, Type);
+
+        // Fails on a hash collision with a pipeline that is already stored, the new one just is not cached
+        if (SUCCEEDED(s_Library->StorePipeline(Name, PSO)))
+        {
+            s_Index.Insert(Hash, Type);
+            s_IsDirty = true;
+        }
+    }
+}
+
+void PipelineLibrary::Initialize( const wstring& FilePath )
+{
+    lock_guard<mutex> LockGuard(s_Mutex);
+    s_FilePath = FilePath;
+    s_IsDirty = false;
+    ZeroMemory(&s_Stats, sizeof(s_Stats));
+
+    ComPtr<ID3D12Device1> Device1;
+    if (FAILED(g_Device->QueryInterface(MY_IID_PPV_ARGS(&Device1))))
+    {
+        Utility::Print("Pipeline libraries are not supported, every pipeline is compiled at startup\n");
+        return;
+    }
+
+    // Drivers without library support fail CreatePipelineLibrary with DXGI_ERROR_UNSUPPORTED
+    D3D12_FEATURE_DATA_SHADER_CACHE ShaderCache = {};
+    if (FAILED(g_Device->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &ShaderCache, sizeof(ShaderCache))) ||
+        (ShaderCache.SupportFlags & D3D12_SHADER_CACHE_SUPPORT_LIBRARY) == 0)
+    {
+        Utility::Print("The driver does not support pipeline libraries, every pipeline is compiled at startup\n");
+        return;
+    }
+
+    Utility::ByteArray Library = Utility::ReadFileSync(FilePath + L".lib");
+    Utility::ByteArray Index = Utility::ReadFileSync(FilePath + L".idx");
+    if (!Library->empty() && s_Index.Deserialize(Index->data(), Index->size(), Library->data(), Library->size()))
+    {
+        // A library from another adapter or driver is refused here, then the cache starts over
+        HRESULT hr = Device1->CreatePipelineLibrary(Library->data(), Library->size(), MY_IID_PPV_ARGS(&s_Library));
+        if (SUCCEEDED(hr))
+        {
+            s_LibraryBlob = Library;
+            s_Stats.WarmStart = true;
+        }
+        else
+        {
+            Utility::Printf(L"Discarding pipeline library %s.lib, error 0x%08x\n", FilePath.c_str(), hr);
+            s_Index.Clear();
+        }
+    }
+    else
+        s_Index.Clear();
+
+    if (s_Library == nullptr)
+    {
+        s_LibraryBlob = nullptr;
+        HRESULT hr = Device1->CreatePipelineLibrary(nullptr, 0, MY_IID_PPV_ARGS(&s_Library));
+        if (FAILED(hr))
+        {
+            // Without a library Store and Load do nothing, every pipeline is compiled
+            Utility::Printf("Pipeline library could not be created, error 0x%08x\n", hr);
+            s_Library = nullptr;
+            s_Index.Clear();
+            return;
+        }
+    }
+    s_Library->SetName(L"PipelineLibrary");
+}
+
+void PipelineLibrary::Shutdown( void )
+{
+    lock_guard<mutex> LockGuard(s_Mutex);
+    if (s_Library != nullptr && s_IsDirty)
+    {
+        vector<uint8_t> Library(s_Library->GetSerializedSize());
+        if (SUCCEEDED(s_Library->Serialize(Library.data(), Library.size())))
+        {
+            vector<uint8_t> Index;
+            s_Index.Serialize(Index, Library.data(), Library.size());
+
+            // The index is written last and names the library it belongs to, a torn write leaves a mismatch behind
+            ofstream LibraryFile(s_FilePath + L".lib", ios::out | ios::binary);
+            LibraryFile.write((const char*)Library.data(), Library.size());
+            LibraryFile.close();
+
+            ofstream IndexFile(s_FilePath + L".idx", ios::out | ios::binary);
+            IndexFile.write((const char*)Index.data(), Index.size());
+            IndexFile.close();
+        }
+    }
+
+    s_Library = nullptr;
+    s_LibraryBlob = nullptr;
+    s_Index.Clear();
+    s_IsDirty = false;
+}
+
+uint64_t PipelineLibrary::HashGraphicsDesc( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash )
+{
+    // Copied byte for byte so that padding hashes the way it was zeroed
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC Key;
+    memcpy(&Key, &Desc, sizeof(Key));
+    Key.pRootSignature = nullptr;
+    Key.VS.pShaderBytecode = nullptr;
+    Key.PS.pShaderBytecode = nullptr;
+    Key.DS.pShaderBytecode = nullptr;
+    Key.HS.pShaderBytecode = nullptr;
+    Key.GS.pShaderBytecode = nullptr;
+    Key.StreamOutput.pSODeclaration = nullptr;
+    Key.StreamOutput.pBufferStrides = nullptr;
+    Key.InputLayout.pInputElementDescs = nullptr;
+    Key.CachedPSO.pCachedBlob = nullptr;
+    Key.CachedPSO.CachedBlobSizeInBytes = 0;
+
+    uint64_t Hash = Utility::HashState(&Key, 1, (size_t)RootSignatureHash);
+    Hash = HashBytecode(Desc.VS, Hash);
+    Hash = HashBytecode(Desc.PS, Hash);
+    Hash = HashBytecode(Desc.DS, Hash);
+    Hash = HashBytecode(Desc.HS, Hash);
+    Hash = HashBytecode(Desc.GS, Hash);
+
+    for (UINT i = 0; i < Desc.InputLayout.NumElements; ++i)
+    {
+        D3D12_INPUT_ELEMENT_DESC Element = Desc.InputLayout.pInputElementDescs[i];
+        Hash = HashString(Element.SemanticName, Hash);
+        Element.SemanticName = nullptr;
+        Hash = Utility::HashState(&Element, 1, (size_t)Hash);
+    }
+
+    for (UINT i = 0; i < Desc.StreamOutput.NumEntries; ++i)
+    {
+        D3D12_SO_DECLARATION_ENTRY Entry = Desc.StreamOutput.pSODeclaration[i];
+        Hash = HashString(Entry.SemanticName, Hash);
+        Entry.SemanticName = nullptr;
+        Hash = HashBytes(&Entry.SemanticIndex, sizeof(Entry) - offsetof(D3D12_SO_DECLARATION_ENTRY, SemanticIndex), Hash);
+    }
+    if (Desc.StreamOutput.NumStrides > 0)
+        Hash = HashBytes(Desc.StreamOutput.pBufferStrides, Desc.StreamOutput.NumStrides * sizeof(UINT), Hash);
+
+    return Hash;
+}
+
+uint64_t PipelineLibrary::HashComputeDesc( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash )
+{
+    D3D12_COMPUTE_PIPELINE_STATE_DESC Key;
+    memcpy(&Key, &Desc, sizeof(Key));
+    Key.pRootSignature = nullptr;
+    Key.CS.pShaderBytecode = nullptr;
+    Key.CachedPSO.pCachedBlob = nullptr;
+    Key.CachedPSO.CachedBlobSizeInBytes = 0;
+
+    uint64_t Hash = Utility::HashState(&Key, 1, (size_t)RootSignatureHash);
+    return HashBytecode(Desc.CS, Hash);
+}
+
+ID3D12PipelineState* PipelineLibrary::CreateGraphicsPipeline( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash )
+{
+    const uint64_t Hash = HashGraphicsDesc(Desc, RootSignatureHash);
+    ID3D12PipelineState* PSO = LoadPipeline(Hash, PipelineCacheIndex::kGraphics, &Desc);
+    if (PSO != nullptr)
+        return PSO;
+
+    int64_t StartTick = SystemTime::GetCurrentTick();
+    ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&Desc, MY_IID_PPV_ARGS(&PSO)) );
+    StorePipeline(Hash, PipelineCacheIndex::kGraphics, PSO, SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick()));
+    return PSO;
+}
+
+ID3D12PipelineState* PipelineLibrary::CreateComputePipeline( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash )
+{
+    const uint64_t Hash = HashComputeDesc(Desc, RootSignatureHash);
+    ID3D12PipelineState* PSO = LoadPipeline(Hash, PipelineCacheIndex::kCompute, &Desc);
+    if (PSO != nullptr)
+        return PSO;
+
+    int64_t StartTick = SystemTime::GetCurrentTick();
+    ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&Desc, MY_IID_PPV_ARGS(&PSO)) );
+    StorePipeline(Hash, PipelineCacheIndex::kCompute, PSO, SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick()));
+    return PSO;
+}
+
+PipelineLibraryStats PipelineLibrary::GetStats( void )
+{
+    lock_guard<mutex> LockGuard(s_Mutex);
+    return s_Stats;
+}
@@ -0,0 +1,86 @@
+//
+// Description:  On-disk cache of compiled pipeline state objects.
+//
+// An ID3D12PipelineLibrary holds the compiled pipelines and is written to disk on shutdown; the next launch loads
+// pipelines out of it instead of compiling the shaders again.  Next to the library blob lives an index of the
+// pipelines it contains, keyed by a hash of the pipeline desc that does not depend on where the shader bytecode,
+// root signature and input layout happen to be in memory.  The index is checked before asking the library, so a
+// pipeline that was never stored costs a binary search instead of a failed load, and it carries the size and
+// checksum of the library so that a library file from another build or a torn write is never handed to the driver.
+//
+// PipelineCacheIndex does not touch the device.
+//
+
+#pragma once
+
+#include "pch.h"
+#include <vector>
+#include <string>
+
+class PipelineCacheIndex
+{
+public:
+    enum PipelineType : uint32_t
+    {
+        kGraphics = 0,
+        kCompute = 1
+    };
+
+    void Clear( void ) { m_Entries.clear(); }
+
+    bool Contains( uint64_t Hash, PipelineType Type ) const;
+
+    // False when the pipeline is already in the index
+    bool Insert( uint64_t Hash, PipelineType Type );
+
+    uint32_t GetCount( void ) const { return (uint32_t)m_Entries.size(); }
+
+    // Header and entries of an index describing Library
+    void Serialize( std::vector<uint8_t>& Out, const void* Library, size_t LibrarySize ) const;
+
+    // Fails and leaves the index empty if the data is truncated, has another version or describes another library
+    bool Deserialize( const void* Data, size_t Size, const void* Library, size_t LibrarySize );
+
+    static uint64_t Checksum( const void* Data, size_t Size );
+
+private:
+    struct Entry
+    {
+        uint64_t Hash;
+        uint32_t Type;
+        uint32_t Reserved;
+    };
+
+    // Sorted by hash, then type
+    std::vector<Entry> m_Entries;
+};
+
+struct PipelineLibraryStats
+{
+    // The library and its index were read from disk at startup
+    bool WarmStart;
+    uint32_t Loaded;
+    uint32_t Compiled;
+    double LoadSeconds;
+    double CompileSeconds;
+};
+
+namespace PipelineLibrary
+{
+    // Reads FilePath.lib and FilePath.idx if they are there, call once the device exists
+    void Initialize( const std::wstring& FilePath );
+
+    // Writes the library back if pipelines were added to it, call before the pipelines are destroyed
+    void Shutdown( void );
+
+    // Hashes of the pipeline desc that stay the same from one launch to the next.  The shader bytecode, input
+    // layout and stream output are hashed by content, the root signature by the hash RootSignature::Finalize made.
+    uint64_t HashGraphicsDesc( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash );
+    uint64_t HashComputeDesc( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash );
+
+    // Loads the pipeline from the library or compiles and stores it, the caller owns the returned reference
+    ID3D12PipelineState* CreateGraphicsPipeline( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash );
+    ID3D12PipelineState* CreateComputePipeline( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, uint64_t RootSignatureHash );
+
+    PipelineLibraryStats GetStats( void );
+}
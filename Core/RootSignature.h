@@ -162,12 +162,16 @@ public:
 
     ID3D12RootSignature* GetSignature() const { return m_Signature; }
 
+    // Hash of the description, the same from one launch to the next
+    size_t GetHash() const { ASSERT(m_Finalized); return m_Hash; }
+
 protected:
 
     BOOL m_Finalized;
     UINT m_NumParameters;
     UINT m_NumSamplers;
     UINT m_NumInitializedStaticSamplers;
+    size_t m_Hash;
     uint32_t m_DescriptorTableBitMap;		// One bit is set for root parameters that are non-sampler descriptor tables
     uint32_t m_SamplerTableBitMap;			// One bit is set for root parameters that are sampler descriptor tables
     uint32_t m_DescriptorTableSize[16];		// Non-sampler descriptor tables need to know their descriptor count
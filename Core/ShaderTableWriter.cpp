@@ -0,0 +1,97 @@
+//
+// Description:  Shader tables written in place, see ShaderTableWriter.h
+//
+
+#include "ShaderTableWriter.h"
+#include "Util/Assertions.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    inline size_t AlignUp( size_t Value, size_t Alignment )
+    {
+        return (Value + Alignment - 1) & ~(Alignment - 1);
+    }
+}
+
+void ShaderTableWriter::Record::Write( const void* Data, uint32_t Size )
+{
+    ASSERT(m_Size + Size <= m_Capacity, "Local root arguments exceed the stride of the table");
+    memcpy(m_Data + m_Size, Data, Size);
+    m_Size += Size;
+}
+
+uint32_t ShaderTableWriter::GetRecordStride( uint32_t LocalRootArgumentsSize )
+{
+    return (uint32_t)AlignUp(kShaderIdentifierSize + LocalRootArgumentsSize, kRecordAlignment);
+}
+
+void ShaderTableWriter::Reset( void* Buffer, size_t BufferSize )
+{
+    ASSERT(Buffer != nullptr || BufferSize == 0);
+    if (Buffer != nullptr)
+    {
+        m_Buffer = static_cast<uint8_t*>(Buffer);
+        m_BufferSize = BufferSize;
+    }
+    else
+    {
+        m_Buffer = m_Storage.data();
+        m_BufferSize = m_Storage.size();
+    }
+    m_Size = 0;
+    m_Tables.clear();
+}
+
+uint32_t ShaderTableWriter::BeginTable( uint32_t LocalRootArgumentsSize )
+{
+    size_t Offset = AlignUp(m_Size, kTableAlignment);
+    if (Offset > m_Size)
+        memset(Reserve(Offset) + m_Size, 0, Offset - m_Size);
+    m_Size = Offset;
+
+    TableRange Table = { Offset, 0, GetRecordStride(LocalRootArgumentsSize), 0 };
+    m_Tables.push_back(Table);
+    return (uint32_t)m_Tables.size() - 1;
+}
+
+ShaderTableWriter::Record ShaderTableWriter::AddRecord( const void* ShaderIdentifier )
+{
+    ASSERT(!m_Tables.empty(), "BeginTable first");
+    TableRange& Table = m_Tables.back();
+
+    uint8_t* Data = Reserve(m_Size + Table.Stride) + m_Size;
+    memcpy(Data, ShaderIdentifier, kShaderIdentifierSize);
+    memset(Data + kShaderIdentifierSize, 0, Table.Stride - kShaderIdentifierSize);
+
+    m_Size += Table.Stride;
+    Table.Size += Table.Stride;
+    ++Table.RecordCount;
+
+    return Record(Data + kShaderIdentifierSize, 0, Table.Stride - kShaderIdentifierSize);
+}
+
+void ShaderTableWriter::CopyTo( void* Dest, size_t DestSize ) const
+{
+    ASSERT(DestSize >= m_Size);
+    if (Dest != m_Buffer)
+        memcpy(Dest, m_Buffer, m_Size);
+}
+
+uint8_t* ShaderTableWriter::Reserve( size_t End )
+{
+    if (End <= m_BufferSize)
+        return m_Buffer;
+
+    // A caller's buffer is never grown
+    ASSERT(m_Buffer == m_Storage.data(), "Shader tables exceed the buffer they are written into");
+
+    m_Storage.resize(max(End, 2 * m_Storage.size()));
+    m_Buffer = m_Storage.data();
+    m_BufferSize = m_Storage.size();
+    return m_Buffer;
+}
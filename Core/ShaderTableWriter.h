@@ -0,0 +1,87 @@
+//
+// Description:  Writes the shader tables of a raytracing dispatch in place, one fixed-stride record after the other.
+//
+// Every record is the shader identifier followed by its local root arguments, padded to the stride of its table.
+// Tables start at kTableAlignment boundaries, so that ray generation, miss and hit group tables can share one buffer
+// and each of them goes into D3D12_DISPATCH_RAYS_DESC as StartAddress + Offset.  Records are written straight into the
+// buffer given to Reset, which may be mapped upload memory, or into storage of the writer's own that is kept across
+// Reset, so rebuilding tables of the same size copies every field once and allocates nothing.
+//
+// The alignments repeat the d3d12.h constants so that the layout can be tested without the device headers.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class ShaderTableWriter
+{
+public:
+    static const uint32_t kShaderIdentifierSize = 32;   // D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES
+    static const uint32_t kRecordAlignment = 32;        // D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+    static const uint32_t kTableAlignment = 64;         // D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT
+
+    struct TableRange
+    {
+        size_t Offset;
+        size_t Size;
+        uint32_t Stride;
+        uint32_t RecordCount;
+    };
+
+    // Appends the local root arguments of one record, valid until the next AddRecord
+    class Record
+    {
+    public:
+        void Write( const void* Data, uint32_t Size );
+
+        template <typename T>
+        void Write( const T& Field ) { Write(&Field, (uint32_t)sizeof(T)); }
+
+        uint32_t GetSize( void ) const { return m_Size; }
+
+    private:
+        friend class ShaderTableWriter;
+        Record( uint8_t* Data, uint32_t Size, uint32_t Capacity ) : m_Data(Data), m_Size(Size), m_Capacity(Capacity) {}
+
+        uint8_t* m_Data;
+        uint32_t m_Size;
+        uint32_t m_Capacity;
+    };
+
+    ShaderTableWriter() : m_Buffer(nullptr), m_BufferSize(0), m_Size(0) {}
+
+    // Identifier plus LocalRootArgumentsSize, rounded up to kRecordAlignment
+    static uint32_t GetRecordStride( uint32_t LocalRootArgumentsSize );
+
+    // Drops the tables written so far.  With a null Buffer the records go into the writer's own storage.
+    void Reset( void* Buffer = nullptr, size_t BufferSize = 0 );
+
+    // Starts the next table, for records with at most LocalRootArgumentsSize bytes of local root arguments.  Returns
+    // the index of the table.
+    uint32_t BeginTable( uint32_t LocalRootArgumentsSize );
+
+    // Zero fills the record and writes the identifier, the arguments follow through the returned writer
+    Record AddRecord( const void* ShaderIdentifier );
+
+    uint32_t GetTableCount( void ) const { return (uint32_t)m_Tables.size(); }
+    const TableRange& GetTable( uint32_t Index ) const { return m_Tables[Index]; }
+
+    // Bytes up to the end of the last record
+    size_t GetSize( void ) const { return m_Size; }
+    const uint8_t* GetData( void ) const { return m_Buffer; }
+
+    // Only needed when the records were not written into the destination in the first place
+    void CopyTo( void* Dest, size_t DestSize ) const;
+
+private:
+    uint8_t* Reserve( size_t End );
+
+    uint8_t* m_Buffer;
+    size_t m_BufferSize;
+    size_t m_Size;
+    std::vector<uint8_t> m_Storage;
+    std::vector<TableRange> m_Tables;
+};
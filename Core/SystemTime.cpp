@@ -11,25 +11,41 @@
 // Author:  James Stanard 
 //
 
-#include "pch.h"
 #include "SystemTime.h"
+#include "Util/Assertions.h"
+
+// No pch.h, the tests build this file on any platform
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <Windows.h>
+#else
+    #include <chrono>
+#endif
 
 double SystemTime::sm_CpuTickDelta = 0.0;
 
 // Query the performance counter frequency
 void SystemTime::Initialize( void )
 {
+#ifdef _WIN32
     LARGE_INTEGER frequency;
     ASSERT(TRUE == QueryPerformanceFrequency(&frequency), "Unable to query performance counter frequency");
     sm_CpuTickDelta = 1.0 / static_cast<double>(frequency.QuadPart);
+#else
+    sm_CpuTickDelta = static_cast<double>(std::chrono::steady_clock::period::num) / std::chrono::steady_clock::period::den;
+#endif
 }
 
 // Query the current value of the performance counter
 int64_t SystemTime::GetCurrentTick( void )
 {
+#ifdef _WIN32
     LARGE_INTEGER currentTick;
     ASSERT(TRUE == QueryPerformanceCounter(&currentTick), "Unable to query performance counter value");
     return static_cast<int64_t>(currentTick.QuadPart);
+#else
+    return static_cast<int64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
 }
 
 void SystemTime::BusyLoopSleep( float SleepTime )
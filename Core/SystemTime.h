@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 class SystemTime
 {
 public:
@@ -76,6 +76,8 @@ void Texture::Create2D( size_t RowPitchBytes, size_t Width, size_t Height, DXGI_
 
     if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
     g_Device->CreateShaderResourceView(m_pResource.Get(), nullptr, m_hCpuDescriptorHandle);
 }
 
@@ -122,6 +124,8 @@ void Texture::CreateCube( size_t RowPitchBytes, size_t Width, size_t Height, DXG
 
     if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
 
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
     srvDesc.Format = Format;
@@ -190,6 +194,8 @@ bool Texture::CreateDDSFromMemory( const void* filePtr, size_t fileSize, bool sR
 {
     if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    else
+        DynamicDescriptorHeap::InvalidateTableCaches();
 
     HRESULT hr = CreateDDSTextureFromMemory( Graphics::g_Device,
         (const uint8_t*)filePtr, fileSize, 0, sRGB, &m_pResource, m_hCpuDescriptorHandle );
@@ -0,0 +1,194 @@
+//
+// Description:  Instance bookkeeping of a persistent top level acceleration structure, see TlasInstanceTracker.h
+//
+
+#include "TlasInstanceTracker.h"
+#include "Util/Assertions.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // Everything but the transform
+    bool IsSameInstance( const TlasInstanceDesc& A, const TlasInstanceDesc& B )
+    {
+        const size_t Offset = sizeof(A.Transform);
+        return memcmp(reinterpret_cast<const uint8_t*>(&A) + Offset, reinterpret_cast<const uint8_t*>(&B) + Offset, sizeof(A) - Offset) == 0;
+    }
+}
+
+const uint32_t TlasInstanceTracker::kInvalidHandle;
+const uint32_t TlasInstanceTracker::kMaxRefitsBeforeRebuild;
+
+bool GrowOnlySize::Reserve( uint64_t Required, uint64_t Alignment )
+{
+    if (Required <= Capacity)
+        return false;
+
+    ASSERT((Alignment & (Alignment - 1)) == 0);
+    Capacity = (Required + Required / 2 + Alignment - 1) & ~(Alignment - 1);
+    return true;
+}
+
+TlasInstanceTracker::TlasInstanceTracker( uint32_t RegionCount ) :
+    m_Version(0),
+    m_StructureVersion(0),
+    m_RegionVersions(RegionCount, 0),
+    m_IsStructureDirty(false),
+    m_IsTransformDirty(false),
+    m_RefitsSinceRebuild(0)
+{
+    ASSERT(RegionCount > 0);
+}
+
+uint32_t TlasInstanceTracker::GetIndex( uint32_t Handle ) const
+{
+    ASSERT(Handle < m_HandleToIndex.size() && m_HandleToIndex[Handle] != kInvalidHandle);
+    return m_HandleToIndex[Handle];
+}
+
+uint32_t TlasInstanceTracker::AddInstance( const TlasInstanceDesc& Desc )
+{
+    uint32_t Handle = (uint32_t)m_HandleToIndex.size();
+    if (!m_FreeHandles.empty())
+    {
+        Handle = m_FreeHandles.back();
+        m_FreeHandles.pop_back();
+    }
+    else
+        m_HandleToIndex.push_back(kInvalidHandle);
+
+    m_HandleToIndex[Handle] = (uint32_t)m_Instances.size();
+    m_Instances.push_back(Desc);
+    m_InstanceVersions.push_back(++m_Version);
+    m_IndexToHandle.push_back(Handle);
+    m_StructureVersion = m_Version;
+    m_IsStructureDirty = true;
+    return Handle;
+}
+
+void TlasInstanceTracker::RemoveInstance( uint32_t Handle )
+{
+    const uint32_t Index = GetIndex(Handle);
+    const uint32_t Last = (uint32_t)m_Instances.size() - 1;
+
+    // The last instance fills the gap, the order changes so the tree is rebuilt
+    m_Instances[Index] = m_Instances[Last];
+    m_InstanceVersions[Index] = m_InstanceVersions[Last];
+    m_IndexToHandle[Index] = m_IndexToHandle[Last];
+    m_HandleToIndex[m_IndexToHandle[Index]] = Index;
+    m_Instances.pop_back();
+    m_InstanceVersions.pop_back();
+    m_IndexToHandle.pop_back();
+
+    m_HandleToIndex[Handle] = kInvalidHandle;
+    m_FreeHandles.push_back(Handle);
+    m_StructureVersion = ++m_Version;
+    m_IsStructureDirty = true;
+}
+
+void TlasInstanceTracker::SetTransform( uint32_t Handle, const float Transform[3][4] )
+{
+    const uint32_t Index = GetIndex(Handle);
+    memcpy(m_Instances[Index].Transform, Transform, sizeof(m_Instances[Index].Transform));
+    m_InstanceVersions[Index] = ++m_Version;
+    m_IsTransformDirty = true;
+}
+
+void TlasInstanceTracker::SetInstance( uint32_t Handle, const TlasInstanceDesc& Desc )
+{
+    const uint32_t Index = GetIndex(Handle);
+    const bool IsStructural = !IsSameInstance(m_Instances[Index], Desc);
+
+    m_Instances[Index] = Desc;
+    m_InstanceVersions[Index] = ++m_Version;
+    if (IsStructural)
+    {
+        m_StructureVersion = m_Version;
+        m_IsStructureDirty = true;
+    }
+    else
+        m_IsTransformDirty = true;
+}
+
+uint32_t TlasInstanceTracker::ReplaceBottomLevel( uint64_t OldAddress, uint64_t NewAddress )
+{
+    uint32_t Replaced = 0;
+    for (uint32_t i = 0; i < m_Instances.size(); ++i)
+    {
+        if (m_Instances[i].AccelerationStructure == OldAddress)
+        {
+            m_Instances[i].AccelerationStructure = NewAddress;
+            m_InstanceVersions[i] = ++m_Version;
+            ++Replaced;
+        }
+    }
+    if (Replaced > 0)
+    {
+        m_StructureVersion = m_Version;
+        m_IsStructureDirty = true;
+    }
+    return Replaced;
+}
+
+void TlasInstanceTracker::Clear( void )
+{
+    m_Instances.clear();
+    m_InstanceVersions.clear();
+    m_IndexToHandle.clear();
+    m_HandleToIndex.clear();
+    m_FreeHandles.clear();
+    m_StructureVersion = ++m_Version;
+    m_IsStructureDirty = true;
+}
+
+TlasBuildKind TlasInstanceTracker::GetPendingBuild( void ) const
+{
+    if (m_IsStructureDirty)
+        return TlasBuildKind::Rebuild;
+    if (m_IsTransformDirty)
+        return m_RefitsSinceRebuild < kMaxRefitsBeforeRebuild ? TlasBuildKind::Refit : TlasBuildKind::Rebuild;
+    return TlasBuildKind::None;
+}
+
+bool TlasInstanceTracker::ReserveInstanceRing( void )
+{
+    if (!m_RingSize.Reserve(max<uint64_t>(m_Instances.size(), 1), 64))
+        return false;
+
+    // The new ring holds nothing yet
+    fill(m_RegionVersions.begin(), m_RegionVersions.end(), 0);
+    return true;
+}
+
+uint32_t TlasInstanceTracker::WriteInstances( TlasInstanceDesc* Region, uint32_t RegionIndex )
+{
+    ASSERT(RegionIndex < m_RegionVersions.size());
+    ASSERT(m_Instances.size() <= m_RingSize.Capacity, "ReserveInstanceRing first");
+
+    const uint64_t RegionVersion = m_RegionVersions[RegionIndex];
+    const bool IsFullWrite = RegionVersion < m_StructureVersion || RegionVersion == 0;
+
+    uint32_t Written = 0;
+    for (uint32_t i = 0; i < m_Instances.size(); ++i)
+    {
+        if (IsFullWrite || m_InstanceVersions[i] > RegionVersion)
+        {
+            // The ring is write combined, whole descs only and never read back
+            Region[i] = m_Instances[i];
+            ++Written;
+        }
+    }
+    m_RegionVersions[RegionIndex] = m_Version;
+    return Written;
+}
+
+void TlasInstanceTracker::OnBuilt( TlasBuildKind Kind )
+{
+    m_RefitsSinceRebuild = Kind == TlasBuildKind::Refit ? m_RefitsSinceRebuild + 1 : 0;
+    m_IsStructureDirty = false;
+    m_IsTransformDirty = false;
+}
@@ -0,0 +1,99 @@
+//
+// Description:  CPU side of a top level acceleration structure that is kept across frames.
+//
+// Instances get stable handles and are kept densely in build order.  Every change is stamped with a version, which
+// decides what the next build has to be: nothing, a refit when only transforms changed, or a rebuild when instances
+// were added, removed, reordered or point at other bottom levels.  Refits degrade the tree, so it is rebuilt after
+// kMaxRefitsBeforeRebuild of them in a row.
+//
+// The instance descs go through a persistently mapped ring of one region per frame in flight.  A region remembers the
+// version it was last written with and receives only the instances that changed since, or all of them after a
+// structural change.  The ring and the scratch and result buffers only grow, see GrowOnlySize.
+//
+// Nothing here touches the device, RTHelper::tlas records the builds.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Same layout as D3D12_RAYTRACING_INSTANCE_DESC
+struct TlasInstanceDesc
+{
+    float Transform[3][4];
+    uint32_t InstanceID : 24;
+    uint32_t InstanceMask : 8;
+    uint32_t InstanceContributionToHitGroupIndex : 24;
+    uint32_t Flags : 8;
+    uint64_t AccelerationStructure;
+};
+
+// Size of a buffer that is only ever recreated larger, with headroom so that a slowly growing build does not
+// recreate it every time
+struct GrowOnlySize
+{
+    GrowOnlySize() : Capacity(0) {}
+
+    // True when the buffer has to be recreated with the new Capacity
+    bool Reserve( uint64_t Required, uint64_t Alignment = 256 );
+
+    uint64_t Capacity;
+};
+
+enum class TlasBuildKind { None, Refit, Rebuild };
+
+class TlasInstanceTracker
+{
+public:
+    static const uint32_t kInvalidHandle = ~0u;
+    static const uint32_t kMaxRefitsBeforeRebuild = 64;
+
+    explicit TlasInstanceTracker( uint32_t RegionCount = 3 );
+
+    uint32_t AddInstance( const TlasInstanceDesc& Desc );
+    void RemoveInstance( uint32_t Handle );
+    // Only the transform changes, a refit is enough
+    void SetTransform( uint32_t Handle, const float Transform[3][4] );
+    void SetInstance( uint32_t Handle, const TlasInstanceDesc& Desc );
+    // A bottom level moved, e.g. when it was compacted.  Every instance of it is pointed at NewAddress and the next
+    // build is a rebuild, the old bottom level may only be released after it.  Returns how many instances changed.
+    uint32_t ReplaceBottomLevel( uint64_t OldAddress, uint64_t NewAddress );
+    void Clear( void );
+
+    TlasBuildKind GetPendingBuild( void ) const;
+
+    // True when the instance ring has to be recreated with GetRegionCapacity() descs per region.  Every region is
+    // written in full afterwards.
+    bool ReserveInstanceRing( void );
+    uint32_t GetRegionCapacity( void ) const { return (uint32_t)m_RingSize.Capacity; }
+
+    // Writes the instances the region has not seen yet into its mapped descs, returns how many were written
+    uint32_t WriteInstances( TlasInstanceDesc* Region, uint32_t RegionIndex );
+
+    void OnBuilt( TlasBuildKind Kind );
+
+    uint32_t GetInstanceCount( void ) const { return (uint32_t)m_Instances.size(); }
+    const TlasInstanceDesc& GetInstance( uint32_t Handle ) const { return m_Instances[m_HandleToIndex[Handle]]; }
+    uint32_t GetRegionCount( void ) const { return (uint32_t)m_RegionVersions.size(); }
+
+private:
+    uint32_t GetIndex( uint32_t Handle ) const;
+
+    // Dense in build order
+    std::vector<TlasInstanceDesc> m_Instances;
+    std::vector<uint64_t> m_InstanceVersions;
+    std::vector<uint32_t> m_IndexToHandle;
+    // kInvalidHandle for free handles
+    std::vector<uint32_t> m_HandleToIndex;
+    std::vector<uint32_t> m_FreeHandles;
+
+    uint64_t m_Version;
+    // Version of the last change to the instance set, their order or their bottom levels
+    uint64_t m_StructureVersion;
+    std::vector<uint64_t> m_RegionVersions;
+    bool m_IsStructureDirty;
+    bool m_IsTransformDirty;
+    uint32_t m_RefitsSinceRebuild;
+    GrowOnlySize m_RingSize;
+};
@@ -0,0 +1,66 @@
+//
+// Description:  Lock-free ring of upload chunks, see UploadRing.h
+//
+
+#include "UploadRing.h"
+#include "Util/Assertions.h"
+
+using namespace std;
+
+void UploadRing::Initialize( size_t ChunkSize, uint32_t ChunkCount, const function<bool(uint64_t)>& IsFenceComplete )
+{
+    ASSERT(ChunkCount > 0);
+    m_IsFenceComplete = IsFenceComplete;
+    m_ChunkSize = ChunkSize;
+    m_ChunkCount = ChunkCount;
+    m_Head = 0;
+    m_ChunkStates.reset(new atomic<uint64_t>[ChunkCount]);
+    for (uint32_t i = 0; i < ChunkCount; ++i)
+        m_ChunkStates[i].store(0, memory_order_relaxed);
+    m_Acquisitions = 0;
+    m_Skips = 0;
+    m_Failures = 0;
+}
+
+size_t UploadRing::AcquireChunk( void )
+{
+    // At most one lap, the chunks behind the head were retired last and are the least likely to be ready
+    for (uint32_t Attempt = 0; Attempt < m_ChunkCount; ++Attempt)
+    {
+        uint32_t Index = uint32_t(m_Head.fetch_add(1, memory_order_relaxed) % m_ChunkCount);
+        atomic<uint64_t>& State = m_ChunkStates[Index];
+
+        uint64_t FenceValue = State.load(memory_order_acquire);
+        if (FenceValue != kInUse && (FenceValue == 0 || m_IsFenceComplete(FenceValue)) &&
+            State.compare_exchange_strong(FenceValue, kInUse, memory_order_acq_rel))
+        {
+            m_Acquisitions.fetch_add(1, memory_order_relaxed);
+            return Index * m_ChunkSize;
+        }
+        m_Skips.fetch_add(1, memory_order_relaxed);
+    }
+
+    m_Failures.fetch_add(1, memory_order_relaxed);
+    return kInvalidOffset;
+}
+
+void UploadRing::RetireChunk( size_t Offset, uint64_t FenceValue )
+{
+    ASSERT(Offset % m_ChunkSize == 0 && Offset < GetSize());
+    ASSERT(FenceValue != kInUse);
+    atomic<uint64_t>& State = m_ChunkStates[Offset / m_ChunkSize];
+    ASSERT(State.load(memory_order_relaxed) == kInUse, "Chunk was not acquired");
+    State.store(FenceValue, memory_order_release);
+}
+
+UploadRingStats UploadRing::GetStats( void ) const
+{
+    UploadRingStats Stats;
+    Stats.Acquisitions = m_Acquisitions.load(memory_order_relaxed);
+    Stats.Skips = m_Skips.load(memory_order_relaxed);
+    Stats.Failures = m_Failures.load(memory_order_relaxed);
+    Stats.ChunksInUse = 0;
+    for (uint32_t i = 0; i < m_ChunkCount; ++i)
+        Stats.ChunksInUse += m_ChunkStates[i].load(memory_order_relaxed) == kInUse ? 1 : 0;
+    return Stats;
+}
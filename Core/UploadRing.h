@@ -0,0 +1,65 @@
+//
+// Description:  Lock-free ring of fixed size chunks inside one persistently mapped upload buffer.
+//
+// Every command context bump allocates inside the chunk it owns, without any synchronization, and only touches
+// shared state when it needs a new chunk: one fetch_add on the ring head and one compare exchange on the state of
+// the chunk found there. Chunks are retired with the fence of the command list that used them and come back into
+// use once that fence has completed, so the ring wraps around behind the GPU. A chunk that is still in flight when
+// the head comes around is skipped.
+//
+// Nothing here touches the device, the fence is queried through a callback so that the ring can be driven by a
+// simulated GPU on the CPU.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+struct UploadRingStats
+{
+    uint64_t Acquisitions;
+    // chunks passed over because they were still in flight
+    uint64_t Skips;
+    // every chunk was in flight, the caller fell back to a page of its own
+    uint64_t Failures;
+    uint32_t ChunksInUse;
+};
+
+class UploadRing
+{
+public:
+    static const size_t kInvalidOffset = ~(size_t)0;
+
+    UploadRing() : m_ChunkSize(0), m_ChunkCount(0), m_Head(0), m_Acquisitions(0), m_Skips(0), m_Failures(0) {}
+
+    void Initialize( size_t ChunkSize, uint32_t ChunkCount, const std::function<bool(uint64_t)>& IsFenceComplete );
+
+    // Offset of a chunk owned by the caller until it is retired, kInvalidOffset when all of them are in flight
+    size_t AcquireChunk( void );
+
+    // The chunk can be reused once FenceValue has completed, 0 makes it available right away
+    void RetireChunk( size_t Offset, uint64_t FenceValue );
+
+    size_t GetChunkSize( void ) const { return m_ChunkSize; }
+    size_t GetSize( void ) const { return m_ChunkSize * m_ChunkCount; }
+
+    UploadRingStats GetStats( void ) const;
+
+private:
+    // State of a chunk that is owned by a thread, any other value is the fence it waits for
+    static const uint64_t kInUse = ~0ull;
+
+    std::function<bool(uint64_t)> m_IsFenceComplete;
+    size_t m_ChunkSize;
+    uint32_t m_ChunkCount;
+    std::atomic<uint64_t> m_Head;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_ChunkStates;
+
+    std::atomic<uint64_t> m_Acquisitions;
+    std::atomic<uint64_t> m_Skips;
+    std::atomic<uint64_t> m_Failures;
+};
@@ -0,0 +1,29 @@
+//
+// Description:  ASSERT for the device-free parts of Core, which build without pch.h so that Tests/CMakeLists.txt can
+//               compile them on any platform.  Utility.h defines the full version and takes precedence wherever it
+//               is included first.
+//
+
+#pragma once
+
+#ifndef ASSERT
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef RELEASE
+    #define ASSERT( isTrue, ... ) (void)(isTrue)
+#else
+    #ifdef _MSC_VER
+        #define ASSERT_BREAK() __debugbreak()
+    #else
+        #define ASSERT_BREAK() abort()
+    #endif
+    #define ASSERT( isFalse, ... ) \
+        if (!(bool)(isFalse)) { \
+            fprintf(stderr, "\nAssertion failed in %s @ %d\n--> '%s' is false\n", __FILE__, __LINE__, #isFalse); \
+            ASSERT_BREAK(); \
+        }
+#endif
+
+#endif
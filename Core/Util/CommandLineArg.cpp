@@ -11,10 +11,11 @@
 // Author:  Jack Elliott
 //
 
-#include "pch.h"
+#include "CommandLineArg.h"
 #include <unordered_map>
 #include <string>
 #include <sstream>
+#include <cwchar>
 
 namespace CommandLineArgs
 {
@@ -72,7 +73,7 @@ namespace CommandLineArgs
     {
         return Lookup(key, [&value](std::wstring& val)
         {
-            value = (float)_wtof(val.c_str());
+            value = (float)wcstod(val.c_str(), nullptr);
         });
     }
 
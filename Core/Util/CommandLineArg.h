@@ -13,6 +13,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 namespace CommandLineArgs
 {
     void Initialize(int argc, wchar_t** argv);
@@ -0,0 +1,438 @@
+//
+// Description:  Work-stealing job scheduler, see JobSystem.h
+//
+
+#include "JobSystem.h"
+#include "CommandLineArg.h"
+#include "Assertions.h"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+using namespace std;
+
+namespace
+{
+    struct Job
+    {
+        function<void()> Work;
+        JobSystem::JobCounter* Counter;
+    };
+
+    // Jobs are recycled instead of taking a trip through the heap on every Run.  Each thread keeps a magazine of free
+    // jobs; a thread that frees more than it submits hands full magazines to a shared depot, and a thread that runs dry
+    // takes one back, so the depot lock is only taken once per kMagazineSize jobs.
+    class JobPool
+    {
+    public:
+        static const size_t kMagazineSize = 256;
+
+        ~JobPool()
+        {
+            for (Job* FreeJob : m_Magazine)
+                delete FreeJob;
+        }
+
+        Job* Allocate( void )
+        {
+            if (m_Magazine.empty())
+            {
+                lock_guard<mutex> LockGuard(s_DepotMutex);
+                if (!s_Depot.empty())
+                {
+                    m_Magazine.swap(s_Depot.back());
+                    s_Depot.pop_back();
+                }
+            }
+            if (m_Magazine.empty())
+                return new Job;
+
+            Job* FreeJob = m_Magazine.back();
+            m_Magazine.pop_back();
+            return FreeJob;
+        }
+
+        void Free( Job* UsedJob )
+        {
+            m_Magazine.push_back(UsedJob);
+            if (m_Magazine.size() < 2 * kMagazineSize)
+                return;
+
+            vector<Job*> Full(m_Magazine.end() - kMagazineSize, m_Magazine.end());
+            m_Magazine.resize(m_Magazine.size() - kMagazineSize);
+            lock_guard<mutex> LockGuard(s_DepotMutex);
+            s_Depot.push_back(move(Full));
+        }
+
+        // Frees the jobs in the depot, the magazines of the threads go with them
+        static void ReleaseDepot( void )
+        {
+            lock_guard<mutex> LockGuard(s_DepotMutex);
+            for (vector<Job*>& Magazine : s_Depot)
+            {
+                for (Job* FreeJob : Magazine)
+                    delete FreeJob;
+            }
+            s_Depot.clear();
+        }
+
+    private:
+        vector<Job*> m_Magazine;
+
+        static mutex s_DepotMutex;
+        static vector<vector<Job*>> s_Depot;
+    };
+
+    mutex JobPool::s_DepotMutex;
+    vector<vector<Job*>> JobPool::s_Depot;
+
+    thread_local JobPool t_JobPool;
+
+    // Chase-Lev deque.  The owner pushes and pops at the bottom, thieves take from the top; only the last job in the
+    // deque is contended between the owner and a thief.
+    class WorkStealingQueue
+    {
+    public:
+        static const int64_t kCapacity = 4096;
+
+        WorkStealingQueue() : m_Top(0), m_Bottom(0), m_Jobs(new atomic<Job*>[kCapacity])
+        {
+            for (int64_t i = 0; i < kCapacity; ++i)
+                m_Jobs[i].store(nullptr, memory_order_relaxed);
+        }
+
+        // Owner only, false when the deque is full
+        bool Push( Job* NewJob )
+        {
+            const int64_t Bottom = m_Bottom.load(memory_order_relaxed);
+            const int64_t Top = m_Top.load(memory_order_acquire);
+            if (Bottom - Top >= kCapacity)
+                return false;
+
+            m_Jobs[Bottom & (kCapacity - 1)].store(NewJob, memory_order_relaxed);
+            m_Bottom.store(Bottom + 1, memory_order_seq_cst);
+            return true;
+        }
+
+        // Owner only
+        Job* Pop( void )
+        {
+            const int64_t Bottom = m_Bottom.load(memory_order_relaxed) - 1;
+            m_Bottom.store(Bottom, memory_order_seq_cst);
+            int64_t Top = m_Top.load(memory_order_seq_cst);
+
+            if (Top > Bottom)
+            {
+                m_Bottom.store(Bottom + 1, memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* PoppedJob = m_Jobs[Bottom & (kCapacity - 1)].load(memory_order_relaxed);
+            if (Top == Bottom)
+            {
+                // The last job, a thief may be taking it at the same time
+                if (!m_Top.compare_exchange_strong(Top, Top + 1, memory_order_seq_cst, memory_order_relaxed))
+                    PoppedJob = nullptr;
+                m_Bottom.store(Bottom + 1, memory_order_relaxed);
+            }
+            return PoppedJob;
+        }
+
+        // Any thread
+        Job* Steal( void )
+        {
+            int64_t Top = m_Top.load(memory_order_seq_cst);
+            const int64_t Bottom = m_Bottom.load(memory_order_seq_cst);
+            if (Top >= Bottom)
+                return nullptr;
+
+            Job* StolenJob = m_Jobs[Top & (kCapacity - 1)].load(memory_order_relaxed);
+            if (!m_Top.compare_exchange_strong(Top, Top + 1, memory_order_seq_cst, memory_order_relaxed))
+                return nullptr;
+            return StolenJob;
+        }
+
+    private:
+        atomic<int64_t> m_Top;
+        atomic<int64_t> m_Bottom;
+        unique_ptr<atomic<Job*>[]> m_Jobs;
+    };
+
+    // Deque 0 belongs to the thread that called Initialize, deque i to worker i
+    uint32_t s_QueueCount = 0;
+    unique_ptr<WorkStealingQueue[]> s_Queues;
+    vector<thread> s_Workers;
+    thread_local int32_t t_QueueIndex = -1;
+
+    // Jobs submitted by threads without a deque
+    mutex s_SharedQueueMutex;
+    deque<Job*> s_SharedQueue;
+    atomic<int32_t> s_SharedQueueSize(0);
+
+    // Sleeping workers are woken when jobs are queued.  A worker announces itself in s_SleepingWorkers before it
+    // checks s_QueuedJobs for the last time, a submitter counts its job in s_QueuedJobs before it checks
+    // s_SleepingWorkers, so one of the two always sees the other.
+    atomic<int32_t> s_QueuedJobs(0);
+    atomic<int32_t> s_SleepingWorkers(0);
+    atomic<bool> s_Quit(false);
+    mutex s_SleepMutex;
+    condition_variable s_WakeUp;
+
+    void Execute( Job* CurJob )
+    {
+        CurJob->Work();
+        JobSystem::Finish(CurJob->Counter);
+        // Let go of the captures now rather than when the job is reused
+        CurJob->Work = nullptr;
+        t_JobPool.Free(CurJob);
+    }
+
+    Job* FindJob( int32_t QueueIndex )
+    {
+        Job* FoundJob = nullptr;
+        if (QueueIndex >= 0)
+            FoundJob = s_Queues[QueueIndex].Pop();
+
+        if (FoundJob == nullptr && s_SharedQueueSize.load(memory_order_relaxed) > 0)
+        {
+            lock_guard<mutex> LockGuard(s_SharedQueueMutex);
+            if (!s_SharedQueue.empty())
+            {
+                FoundJob = s_SharedQueue.front();
+                s_SharedQueue.pop_front();
+                s_SharedQueueSize.fetch_sub(1, memory_order_relaxed);
+            }
+        }
+
+        // Start at a different victim each time so that thieves spread out
+        static atomic<uint32_t> s_NextVictim(0);
+        const uint32_t FirstVictim = s_NextVictim.fetch_add(1, memory_order_relaxed);
+        for (uint32_t i = 0; FoundJob == nullptr && i < s_QueueCount; ++i)
+        {
+            const uint32_t Victim = (FirstVictim + i) % s_QueueCount;
+            if ((int32_t)Victim != QueueIndex)
+                FoundJob = s_Queues[Victim].Steal();
+        }
+
+        if (FoundJob != nullptr)
+            s_QueuedJobs.fetch_sub(1, memory_order_seq_cst);
+        return FoundJob;
+    }
+
+    void WorkerMain( int32_t QueueIndex )
+    {
+        t_QueueIndex = QueueIndex;
+
+        uint32_t IdleRounds = 0;
+        while (!s_Quit.load(memory_order_acquire))
+        {
+            Job* FoundJob = FindJob(QueueIndex);
+            if (FoundJob != nullptr)
+            {
+                Execute(FoundJob);
+                IdleRounds = 0;
+                continue;
+            }
+
+            // A job that is about to be pushed is usually worth a few yields, after that go to sleep
+            if (++IdleRounds < 64)
+            {
+                this_thread::yield();
+                continue;
+            }
+
+            unique_lock<mutex> Lock(s_SleepMutex);
+            s_SleepingWorkers.fetch_add(1, memory_order_seq_cst);
+            s_WakeUp.wait(Lock, []() { return s_QueuedJobs.load(memory_order_seq_cst) > 0 || s_Quit.load(memory_order_seq_cst); });
+            s_SleepingWorkers.fetch_sub(1, memory_order_seq_cst);
+            IdleRounds = 0;
+        }
+    }
+}
+
+void JobSystem::Initialize( uint32_t WorkerCount )
+{
+    ASSERT(s_Workers.empty(), "Job system is already running");
+
+    if (WorkerCount == ~0u)
+    {
+        uint32_t CommandLineCount;
+        if (CommandLineArgs::GetInteger(L"jobworkers", CommandLineCount))
+            WorkerCount = CommandLineCount;
+        else
+            WorkerCount = max(thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    s_Quit = false;
+    s_QueueCount = WorkerCount + 1;
+    s_Queues.reset(new WorkStealingQueue[s_QueueCount]);
+    t_QueueIndex = 0;
+
+    for (uint32_t i = 1; i <= WorkerCount; ++i)
+        s_Workers.emplace_back(WorkerMain, (int32_t)i);
+}
+
+void JobSystem::Shutdown( void )
+{
+    {
+        lock_guard<mutex> Lock(s_SleepMutex);
+        s_Quit = true;
+    }
+    s_WakeUp.notify_all();
+
+    for (thread& Worker : s_Workers)
+        Worker.join();
+    s_Workers.clear();
+
+    ASSERT(s_QueuedJobs == 0, "Jobs were left behind");
+    JobPool::ReleaseDepot();
+    s_Queues.reset();
+    s_QueueCount = 0;
+    t_QueueIndex = -1;
+}
+
+uint32_t JobSystem::GetThreadCount( void )
+{
+    return max(s_QueueCount, 1u);
+}
+
+void JobSystem::Run( const function<void()>& Work, JobCounter* Counter )
+{
+    if (Counter != nullptr)
+        Counter->m_Count.fetch_add(1, memory_order_relaxed);
+
+    if (s_Workers.empty())
+    {
+        Work();
+        Finish(Counter);
+        return;
+    }
+
+    Job* NewJob = t_JobPool.Allocate();
+    NewJob->Work = Work;
+    NewJob->Counter = Counter;
+
+    s_QueuedJobs.fetch_add(1, memory_order_seq_cst);
+    if (t_QueueIndex < 0 || !s_Queues[t_QueueIndex].Push(NewJob))
+    {
+        lock_guard<mutex> LockGuard(s_SharedQueueMutex);
+        s_SharedQueue.push_back(NewJob);
+        s_SharedQueueSize.fetch_add(1, memory_order_relaxed);
+    }
+
+    if (s_SleepingWorkers.load(memory_order_seq_cst) > 0)
+    {
+        {
+            lock_guard<mutex> Lock(s_SleepMutex);
+        }
+        s_WakeUp.notify_one();
+    }
+}
+
+void JobSystem::Wait( JobCounter& Counter )
+{
+    while (!Counter.IsDone())
+    {
+        Job* FoundJob = FindJob(t_QueueIndex);
+        if (FoundJob != nullptr)
+            Execute(FoundJob);
+        else
+            this_thread::yield();
+    }
+}
+
+void JobSystem::Finish( JobCounter* Counter )
+{
+    if (Counter != nullptr)
+        Counter->m_Count.fetch_sub(1, memory_order_release);
+}
+
+JobSystem::TaskGraph::TaskId JobSystem::TaskGraph::AddTask( const function<void()>& Work )
+{
+    unique_ptr<Task> NewTask(new Task);
+    NewTask->Work = Work;
+    NewTask->PredecessorCount = 0;
+    NewTask->PendingPredecessors = 0;
+    m_Tasks.push_back(move(NewTask));
+    m_IsChecked = false;
+    return (TaskId)m_Tasks.size() - 1;
+}
+
+void JobSystem::TaskGraph::AddDependency( TaskId Before, TaskId After )
+{
+    ASSERT(Before < m_Tasks.size() && After < m_Tasks.size() && Before != After);
+    m_Tasks[Before]->Successors.push_back(After);
+    ++m_Tasks[After]->PredecessorCount;
+    m_IsChecked = false;
+}
+
+void JobSystem::TaskGraph::Launch( TaskId Id, JobCounter& Counter )
+{
+    JobSystem::Run([this, Id, &Counter]()
+    {
+        Task& CurTask = *m_Tasks[Id];
+        CurTask.Work();
+        for (TaskId Successor : CurTask.Successors)
+        {
+            if (m_Tasks[Successor]->PendingPredecessors.fetch_sub(1, memory_order_acq_rel) == 1)
+                Launch(Successor, Counter);
+        }
+    }, &Counter);
+}
+
+bool JobSystem::TaskGraph::IsAcyclic( void )
+{
+    if (m_IsChecked)
+        return m_IsAcyclic;
+
+    // Every task has to be reachable from the roots in dependency order
+    vector<uint32_t> Pending(m_Tasks.size());
+    vector<TaskId> Ready;
+    for (TaskId Id = 0; Id < m_Tasks.size(); ++Id)
+    {
+        Pending[Id] = m_Tasks[Id]->PredecessorCount;
+        if (Pending[Id] == 0)
+            Ready.push_back(Id);
+    }
+    size_t Visited = 0;
+    while (!Ready.empty())
+    {
+        TaskId Id = Ready.back();
+        Ready.pop_back();
+        ++Visited;
+        for (TaskId Successor : m_Tasks[Id]->Successors)
+        {
+            if (--Pending[Successor] == 0)
+                Ready.push_back(Successor);
+        }
+    }
+
+    m_IsChecked = true;
+    m_IsAcyclic = Visited == m_Tasks.size();
+    return m_IsAcyclic;
+}
+
+bool JobSystem::TaskGraph::Run( void )
+{
+    if (!IsAcyclic())
+    {
+        ASSERT(false, "Task graph has a cycle");
+        return false;
+    }
+
+    vector<TaskId> Roots;
+    for (TaskId Id = 0; Id < m_Tasks.size(); ++Id)
+    {
+        m_Tasks[Id]->PendingPredecessors.store(m_Tasks[Id]->PredecessorCount, memory_order_relaxed);
+        if (m_Tasks[Id]->PredecessorCount == 0)
+            Roots.push_back(Id);
+    }
+
+    JobCounter Counter;
+    for (TaskId Root : Roots)
+        Launch(Root, Counter);
+    Wait(Counter);
+    return true;
+}
@@ -0,0 +1,130 @@
+//
+// Description:  Work-stealing job scheduler.
+//
+// Every worker thread owns a deque of jobs.  A worker pushes and pops jobs at the bottom of its own deque without
+// contention, other workers steal from the top when they run dry.  The thread that calls Initialize gets a deque of
+// its own and takes part in the work whenever it waits; any other thread submits through a shared queue.
+//
+// Waiting never blocks a worker: Wait runs other jobs until the counter it waits for reaches zero, so jobs can
+// submit and wait for jobs of their own.  A TaskGraph launches each task as a continuation of the last predecessor
+// to finish, without any thread waiting in between.
+//
+// Nothing here depends on the platform.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace JobSystem
+{
+    // Number of jobs still to finish, submitted jobs count themselves in and out
+    class JobCounter
+    {
+    public:
+        JobCounter() : m_Count(0) {}
+
+        bool IsDone( void ) const { return m_Count.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend void Run( const std::function<void()>& Work, JobCounter* Counter );
+        friend void Finish( JobCounter* Counter );
+
+        JobCounter( const JobCounter& ) = delete;
+        JobCounter& operator=( const JobCounter& ) = delete;
+
+        std::atomic<uint32_t> m_Count;
+    };
+
+    // WorkerCount extra threads, by default one less than the hardware threads.  With no workers every job runs
+    // inline on the thread that submits it.
+    void Initialize( uint32_t WorkerCount = ~0u );
+    void Shutdown( void );
+
+    // Worker threads plus the thread that called Initialize
+    uint32_t GetThreadCount( void );
+
+    // Queues Work, Counter (optional) stays above zero until it has run
+    void Run( const std::function<void()>& Work, JobCounter* Counter );
+
+    // Runs queued jobs until Counter reaches zero
+    void Wait( JobCounter& Counter );
+
+    // Internal, called once a job of Counter has run
+    void Finish( JobCounter* Counter );
+
+    namespace Detail
+    {
+        template <typename Func>
+        void SplitRange( uint32_t Begin, uint32_t End, uint32_t Grain, const Func& Body, JobCounter& Counter )
+        {
+            // Hand the upper half to whoever steals it and keep splitting the lower half, so that thieves take large
+            // ranges and the owner works through small ones
+            while (End - Begin > Grain)
+            {
+                const uint32_t Mid = Begin + (End - Begin) / 2;
+                Run([Mid, End, Grain, &Body, &Counter]() { SplitRange(Mid, End, Grain, Body, Counter); }, &Counter);
+                End = Mid;
+            }
+            for (uint32_t i = Begin; i < End; ++i)
+                Body(i);
+        }
+    }
+
+    // Calls Body(i) for every i in [Begin, End), ranges of Grain indices at a time.  A Grain of 0 makes about eight
+    // ranges per thread.
+    template <typename Func>
+    void ParallelFor( uint32_t Begin, uint32_t End, uint32_t Grain, const Func& Body )
+    {
+        if (End <= Begin)
+            return;
+        if (Grain == 0)
+            Grain = (End - Begin + 8 * GetThreadCount() - 1) / (8 * GetThreadCount());
+
+        JobCounter Counter;
+        Detail::SplitRange(Begin, End, Grain, Body, Counter);
+        Wait(Counter);
+    }
+
+    // Tasks with dependencies between them.  Run starts the tasks without predecessors; a task that finishes starts
+    // every successor it was the last predecessor of.  The graph can be run any number of times.
+    class TaskGraph
+    {
+    public:
+        typedef uint32_t TaskId;
+
+        TaskGraph() : m_IsChecked(false), m_IsAcyclic(true) {}
+
+        TaskId AddTask( const std::function<void()>& Work );
+
+        // After does not start before Before has finished
+        void AddDependency( TaskId Before, TaskId After );
+
+        // Returns when every task has run.  A graph with a cycle would never finish, it asserts and runs nothing.
+        bool Run( void );
+
+        // Checked in every configuration, once per change of the graph
+        bool IsAcyclic( void );
+
+        uint32_t GetTaskCount( void ) const { return (uint32_t)m_Tasks.size(); }
+
+    private:
+        struct Task
+        {
+            std::function<void()> Work;
+            std::vector<TaskId> Successors;
+            uint32_t PredecessorCount;
+            std::atomic<uint32_t> PendingPredecessors;
+        };
+
+        void Launch( TaskId Id, JobCounter& Counter );
+
+        std::vector<std::unique_ptr<Task>> m_Tasks;
+        bool m_IsChecked;
+        bool m_IsAcyclic;
+    };
+}
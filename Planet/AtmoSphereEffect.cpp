@@ -5,6 +5,8 @@
 #include "RootSignature.h"
 #include "PipelineState.h"
 #include "BufferManager.h"
+#include "PersistentDescriptors.h"
+#include "FrameGraphExecutor.h"
 
 #include "CompiledShaders/atmospherePrecomputeTranssmitance.h"
 #include "CompiledShaders/atmospherePrecomputeSingleScattering.h"
@@ -41,6 +43,13 @@ namespace AtmoSphereEffect {
 
 void AtmoSphereEffect::Initialize()
 {
+	//the LUTs never change place, shaders read them from the persistent descriptor region which Create fills
+	_transmittanceTexture2D.SetPersistentSRV(PERSISTENT_SRV_TRANSMITTANCE);
+	_ambientTexture2D.SetPersistentSRV(PERSISTENT_SRV_AMBIENT);
+	_multiScatteringTexture3D.SetPersistentSRV(PERSISTENT_SRV_MULTI_SCATTERING);
+	_singleRayleighScatteringTexture3D.SetPersistentSRV(PERSISTENT_SRV_SINGLE_RAYLEIGH_SCATTERING);
+	_singleMieScatteringTexture3D.SetPersistentSRV(PERSISTENT_SRV_SINGLE_MIE_SCATTERING);
+
 	//Creation texture
 	_transmittanceTexture2D.Create(L"Atmosphere Transmittance texture", TrancmittanceTextureWidth, TrancmittanceTextureHeight, 1, DXGI_FORMAT_R32G32B32A32_FLOAT);
 	_singleRayleighScatteringTexture3D.Create(L"Atmosphere Single Rayleigh Scattering texture", ScatteringTextureWidth, ScatteringTextureHeight, ScatteringTextureDepth, DXGI_FORMAT_R32G32B32A32_FLOAT);
@@ -116,110 +125,130 @@ void AtmoSphereEffect::PreCompute(const AtmoSphereProperty& proper)
 	
 	const AtmoSphereProperty& _AtmoSpherePropertyCBuffer = proper;
 	context.SetRootSignature(_atmosphereRS);
-	//Clear
-	context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	context.TransitionResource(_multiScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	context.TransitionResource(_singleRayleighScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	context.TransitionResource(_singleMieScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	context.TransitionResource(_ambientTexture2D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	//each pass declares what it reads and writes, the frame graph issues the transitions and UAV barriers between them
+	FrameGraphExecutor graph;
+	const FrameGraph::ResourceHandle transmittance = graph.Import(_transmittanceTexture2D, "Transmittance");
+	const FrameGraph::ResourceHandle singleRayleigh = graph.Import(_singleRayleighScatteringTexture3D, "Single Rayleigh Scattering");
+	const FrameGraph::ResourceHandle singleMie = graph.Import(_singleMieScatteringTexture3D, "Single Mie Scattering");
+	const FrameGraph::ResourceHandle multiScattering = graph.Import(_multiScatteringTexture3D, "Multi Scattering");
+	const FrameGraph::ResourceHandle ambient = graph.Import(_ambientTexture2D, "Ambient");
+	const FrameGraph::ResourceHandle scatteringDensity = graph.Import(_scatteringDensityTexture3D, "Scattering Density");
+	const FrameGraph::ResourceHandle deltaMultiScattering = graph.Import(_deltaMultiScatteringTexture3D, "Delta Multi Scattering");
 
 	//Transmittion Texture
-	context.SetPipelineState(_atmosphereTransmittancePreComputation);
 	{
-		context.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
-		context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		context.SetDynamicDescriptor(2, 0, _transmittanceTexture2D.GetUAV());
-		context.Dispatch2D(_transmittanceTexture2D.GetWidth(), _transmittanceTexture2D.GetHeight(), 8, 8);
-		context.InsertUAVBarrier(_transmittanceTexture2D);
+		const FrameGraph::PassHandle pass = graph.AddPass("Transmittance", [&](CommandContext& passContext)
+		{
+			ComputeContext& computeContext = passContext.GetComputeContext();
+			computeContext.SetPipelineState(_atmosphereTransmittancePreComputation);
+			computeContext.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
+			computeContext.SetDynamicDescriptor(2, 0, _transmittanceTexture2D.GetUAV());
+			computeContext.Dispatch2D(_transmittanceTexture2D.GetWidth(), _transmittanceTexture2D.GetHeight(), 8, 8);
+		});
+		graph.Write(pass, transmittance, FrameGraph::kUnorderedAccess);
 	}
 
 	//SingleScattering Texture
-	context.SetPipelineState(_atmosphereSingleScatteringPreComputation);
 	{
-		D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[2] = { _singleRayleighScatteringTexture3D.GetUAV(), _singleMieScatteringTexture3D.GetUAV() };
-		context.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
-		context.TransitionResource(_singleRayleighScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		context.TransitionResource(_singleMieScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.SetDynamicDescriptors(2, 0, 2, uavHandles);
-		context.SetDynamicDescriptor(3, 0, _transmittanceTexture2D.GetSRV());
-		context.Dispatch3D(ScatteringTextureWidth, ScatteringTextureHeight, ScatteringTextureDepth, 4, 4, 4);
-		context.InsertUAVBarrier(_singleRayleighScatteringTexture3D);
-		context.InsertUAVBarrier(_singleMieScatteringTexture3D);
+		const FrameGraph::PassHandle pass = graph.AddPass("Single Scattering", [&](CommandContext& passContext)
+		{
+			ComputeContext& computeContext = passContext.GetComputeContext();
+			D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[2] = { _singleRayleighScatteringTexture3D.GetUAV(), _singleMieScatteringTexture3D.GetUAV() };
+			computeContext.SetPipelineState(_atmosphereSingleScatteringPreComputation);
+			computeContext.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
+			computeContext.SetDynamicDescriptors(2, 0, 2, uavHandles);
+			computeContext.SetDynamicDescriptor(3, 0, _transmittanceTexture2D.GetSRV());
+			computeContext.Dispatch3D(ScatteringTextureWidth, ScatteringTextureHeight, ScatteringTextureDepth, 4, 4, 4);
+		});
+		graph.Read(pass, transmittance, FrameGraph::kNonPixelShaderResource);
+		graph.Write(pass, singleRayleigh, FrameGraph::kUnorderedAccess);
+		graph.Write(pass, singleMie, FrameGraph::kUnorderedAccess);
 	}
 
 	const UINT maxScatteringOrder = 20;
 	for (UINT scatteringOrder = 2; scatteringOrder <= maxScatteringOrder; ++scatteringOrder)
 	{
 		//Scattering Density Texture
-		context.SetPipelineState(_atmosphereScatteringDensityPreComputation);
 		{
-			D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[4] = {
-				_transmittanceTexture2D.GetSRV(),
-				_singleRayleighScatteringTexture3D.GetSRV(),
-				_singleMieScatteringTexture3D.GetSRV(),
-				_deltaMultiScatteringTexture3D.GetSRV()
-			};
-			context.SetConstant(0, 0, scatteringOrder);
-			context.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
-			context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_singleRayleighScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_singleMieScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_deltaMultiScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_scatteringDensityTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.SetDynamicDescriptor(2, 0, _scatteringDensityTexture3D.GetUAV());
-			context.SetDynamicDescriptors(3, 0, 4, srvHandles);
-			context.Dispatch3D(_scatteringDensityTexture3D.GetWidth(), _scatteringDensityTexture3D.GetHeight(), _scatteringDensityTexture3D.GetDepth(), 4, 4, 4);
-			context.InsertUAVBarrier(_scatteringDensityTexture3D);
+			const FrameGraph::PassHandle pass = graph.AddPass("Scattering Density", [&, scatteringOrder](CommandContext& passContext)
+			{
+				ComputeContext& computeContext = passContext.GetComputeContext();
+				D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[4] = {
+					_transmittanceTexture2D.GetSRV(),
+					_singleRayleighScatteringTexture3D.GetSRV(),
+					_singleMieScatteringTexture3D.GetSRV(),
+					_deltaMultiScatteringTexture3D.GetSRV()
+				};
+				computeContext.SetPipelineState(_atmosphereScatteringDensityPreComputation);
+				computeContext.SetConstant(0, 0, scatteringOrder);
+				computeContext.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
+				computeContext.SetDynamicDescriptor(2, 0, _scatteringDensityTexture3D.GetUAV());
+				computeContext.SetDynamicDescriptors(3, 0, 4, srvHandles);
+				computeContext.Dispatch3D(_scatteringDensityTexture3D.GetWidth(), _scatteringDensityTexture3D.GetHeight(), _scatteringDensityTexture3D.GetDepth(), 4, 4, 4);
+			});
+			graph.Read(pass, transmittance, FrameGraph::kNonPixelShaderResource);
+			graph.Read(pass, singleRayleigh, FrameGraph::kNonPixelShaderResource);
+			graph.Read(pass, singleMie, FrameGraph::kNonPixelShaderResource);
+			graph.Read(pass, deltaMultiScattering, FrameGraph::kNonPixelShaderResource);
+			graph.Write(pass, scatteringDensity, FrameGraph::kUnorderedAccess);
 		}
 
-		//Multi Scattering Texture
-		context.SetPipelineState(_atmosphereMultiScatteringPreComputation);
+		//Multi Scattering Texture, accumulated over the orders
 		{
-			D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[2] = { _transmittanceTexture2D.GetSRV(), _scatteringDensityTexture3D.GetSRV() };
-			D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[2] = { _deltaMultiScatteringTexture3D.GetUAV(), _multiScatteringTexture3D.GetUAV() };
-			context.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
-			context.TransitionResource(_scatteringDensityTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.TransitionResource(_deltaMultiScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.TransitionResource(_multiScatteringTexture3D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.SetDynamicDescriptors(2, 0, 2, uavHandles);
-			context.SetDynamicDescriptors(3, 0, 2, srvHandles);
-			context.Dispatch3D(ScatteringTextureWidth, ScatteringTextureHeight, ScatteringTextureDepth, 4, 4, 4);
-			context.InsertUAVBarrier(_multiScatteringTexture3D);
-			context.InsertUAVBarrier(_deltaMultiScatteringTexture3D);
+			const FrameGraph::PassHandle pass = graph.AddPass("Multi Scattering", [&](CommandContext& passContext)
+			{
+				ComputeContext& computeContext = passContext.GetComputeContext();
+				D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[2] = { _transmittanceTexture2D.GetSRV(), _scatteringDensityTexture3D.GetSRV() };
+				D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[2] = { _deltaMultiScatteringTexture3D.GetUAV(), _multiScatteringTexture3D.GetUAV() };
+				computeContext.SetPipelineState(_atmosphereMultiScatteringPreComputation);
+				computeContext.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
+				computeContext.SetDynamicDescriptors(2, 0, 2, uavHandles);
+				computeContext.SetDynamicDescriptors(3, 0, 2, srvHandles);
+				computeContext.Dispatch3D(ScatteringTextureWidth, ScatteringTextureHeight, ScatteringTextureDepth, 4, 4, 4);
+			});
+			graph.Read(pass, transmittance, FrameGraph::kNonPixelShaderResource);
+			graph.Read(pass, scatteringDensity, FrameGraph::kNonPixelShaderResource);
+			graph.Write(pass, deltaMultiScattering, FrameGraph::kUnorderedAccess);
+			graph.Read(pass, multiScattering, FrameGraph::kUnorderedAccess);
+			graph.Write(pass, multiScattering, FrameGraph::kUnorderedAccess);
 		}
 	}
 
 	//Ambient Texture
-	context.SetPipelineState(_atmosphereAmbientPreComputation);
 	{
-		D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[3] = {
-			_singleRayleighScatteringTexture3D.GetSRV(),
-			_singleMieScatteringTexture3D.GetSRV(),
-			_multiScatteringTexture3D.GetSRV()
-		};
-
-		D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[1] = {
-			_ambientTexture2D.GetUAV(),
-		};
-
-		context.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
-		context.TransitionResource(_singleRayleighScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_singleMieScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_multiScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_ambientTexture2D, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		context.SetDynamicDescriptors(2, 0, 1, uavHandles);
-		context.SetDynamicDescriptors(3, 0, 3, srvHandles);
-		context.Dispatch2D(AmbientTextureWidth, AmbientTextureHeight, 8, 8 );
-		context.InsertUAVBarrier(_ambientTexture2D);
+		const FrameGraph::PassHandle pass = graph.AddPass("Ambient", [&](CommandContext& passContext)
+		{
+			ComputeContext& computeContext = passContext.GetComputeContext();
+			D3D12_CPU_DESCRIPTOR_HANDLE srvHandles[3] = {
+				_singleRayleighScatteringTexture3D.GetSRV(),
+				_singleMieScatteringTexture3D.GetSRV(),
+				_multiScatteringTexture3D.GetSRV()
+			};
+
+			D3D12_CPU_DESCRIPTOR_HANDLE uavHandles[1] = {
+				_ambientTexture2D.GetUAV(),
+			};
+
+			computeContext.SetPipelineState(_atmosphereAmbientPreComputation);
+			computeContext.SetDynamicConstantBufferView(1, sizeof(_AtmoSpherePropertyCBuffer), &_AtmoSpherePropertyCBuffer);
+			computeContext.SetDynamicDescriptors(2, 0, 1, uavHandles);
+			computeContext.SetDynamicDescriptors(3, 0, 3, srvHandles);
+			computeContext.Dispatch2D(AmbientTextureWidth, AmbientTextureHeight, 8, 8 );
+		});
+		graph.Read(pass, singleRayleigh, FrameGraph::kNonPixelShaderResource);
+		graph.Read(pass, singleMie, FrameGraph::kNonPixelShaderResource);
+		graph.Read(pass, multiScattering, FrameGraph::kNonPixelShaderResource);
+		graph.Write(pass, ambient, FrameGraph::kUnorderedAccess);
 	}
 
-	context.TransitionResource(_multiScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	context.TransitionResource(_singleRayleighScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	context.TransitionResource(_singleMieScatteringTexture3D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	context.TransitionResource(_transmittanceTexture2D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	context.TransitionResource(_ambientTexture2D, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	graph.SetFinalState(multiScattering, FrameGraph::kShaderResource);
+	graph.SetFinalState(singleRayleigh, FrameGraph::kShaderResource);
+	graph.SetFinalState(singleMie, FrameGraph::kShaderResource);
+	graph.SetFinalState(transmittance, FrameGraph::kShaderResource);
+	graph.SetFinalState(ambient, FrameGraph::kShaderResource);
+
+	graph.Execute(context);
 
 	context.Finish();
 }
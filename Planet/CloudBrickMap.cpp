@@ -0,0 +1,399 @@
+#include "CloudBrickMap.h"
+
+#include "GraphicsCore.h"
+#include "CommandContext.h"
+#include "Util/JobSystem.h"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	//D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION
+	constexpr UINT MAX_TEXTURE3D_SIZE = 2048;
+	constexpr float eps = 1e-6f;
+
+	struct CellLocation
+	{
+		float _gridCoord[3];
+		UINT _cell[3];
+		UINT _cellIndex;
+	};
+
+	CellLocation Locate(const CloudBrickMap::BrickMap& brickMap, const float u, const float v, const float h)
+	{
+		const float uvh[3] = { u, v, h };
+		CellLocation location;
+		for (int i = 0; i < 3; ++i)
+		{
+			location._gridCoord[i] = std::min(std::max(uvh[i], 0.0f), 1.0f) * brickMap._gridSize[i];
+			location._cell[i] = std::min(static_cast<UINT>(location._gridCoord[i]), brickMap._gridSize[i] - 1);
+		}
+		location._cellIndex = (location._cell[2] * brickMap._gridSize[1] + location._cell[1]) * brickMap._gridSize[0] + location._cell[0];
+		return location;
+	}
+
+	//Height range the gradient can be non zero in for cloud types in [minType, maxType].
+	//The edges are piecewise linear in the cloud type with kinks at 0, 0.5 and 1.5, so their extremes sit at these or at the ends.
+	void GetHeightSupport(const float minType, const float maxType, float& minHeight, float& maxHeight)
+	{
+		const float candidates[5] = { minType, maxType, 0.0f, 0.5f, 1.5f };
+		minHeight = FLT_MAX;
+		maxHeight = -FLT_MAX;
+		for (const float cloudType : candidates)
+		{
+			if (cloudType < minType || maxType < cloudType)
+			{
+				continue;
+			}
+			const float4 edges = CloudBrickMap::GetCloudHeightGradientEdges(cloudType);
+			minHeight = std::min(minHeight, std::min(std::min(edges.x, edges.y), std::min(edges.z, edges.w)));
+			maxHeight = std::max(maxHeight, std::max(std::max(edges.x, edges.y), std::max(edges.z, edges.w)));
+		}
+	}
+
+	//SphereUVMapping in common.hlsli warps the face coordinate q by q * (1.25 - 0.25 * q * q), this undoes it
+	double UnwarpSphereCoordinate(const double warped)
+	{
+		double q = warped;
+		for (int i = 0; i < 8; ++i)
+		{
+			q -= (q * (1.25 - 0.25 * q * q) - warped) / (1.25 - 0.75 * q * q);
+		}
+		return q;
+	}
+
+	//solid angle of [0, x] x [0, y] on the cube face at distance 1
+	double FaceSolidAngle(const double x, const double y)
+	{
+		return atan(x * y / sqrt(1.0 + x * x + y * y));
+	}
+}
+
+namespace CloudBrickMap
+{
+	float4 GetCloudHeightGradientEdges(const float cloudType)
+	{
+		constexpr float STRATUS_GRADIENT[4] = { 0.00f, 0.11f, 0.4f, 0.5f };
+		constexpr float STRATOCUMULUS_GRADIENT[4] = { 0.58f, 0.8f, 0.89f, 0.98f };
+		constexpr float CUMULUS_GRADIENT[4] = { 0.00f, 0.11f, 0.88f, 0.98f };
+
+		const float stratusFactor = 1.0f - std::min(std::max(cloudType * 2.0f, 0.0f), 1.0f);
+		const float stratoCumulusFactor = 1.0f - fabsf(cloudType - 0.5f) * 2.0f;
+		const float cumulusFactor = std::min(std::max(cloudType - 0.5f, 0.0f), 1.0f) * 2.0f;
+
+		float edges[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			edges[i] = stratusFactor * STRATUS_GRADIENT[i] + stratoCumulusFactor * STRATOCUMULUS_GRADIENT[i] + cumulusFactor * CUMULUS_GRADIENT[i];
+		}
+		return float4(edges[0], edges[1], edges[2], edges[3]);
+	}
+
+	void Create(BrickMap& brickMap, const UINT brickSize, const UINT gridSizeX, const UINT gridSizeY, const UINT gridSizeZ)
+	{
+		ASSERT(brickSize == 8 || brickSize == 16);
+		ASSERT(gridSizeX > 0 && gridSizeY > 0 && gridSizeZ > 1, "3D textures need a depth above 1");
+
+		brickMap._brickSize = brickSize;
+		brickMap._gridSize[0] = gridSizeX;
+		brickMap._gridSize[1] = gridSizeY;
+		brickMap._gridSize[2] = gridSizeZ;
+		brickMap._brickIndex.assign(brickMap.GetCellCount(), EMPTY_BRICK);
+		brickMap._brickPool.clear();
+	}
+
+	void BuildFromWeather(const CloudNoise::CpuTexture& weather, const VolumetricCloud::CloudProperty& cloudProperty, BrickMap& brickMap)
+	{
+		ASSERT(weather._channels >= 2);
+
+		const UINT gridSizeX = brickMap._gridSize[0];
+		const UINT gridSizeY = brickMap._gridSize[1];
+		const UINT gridSizeZ = brickMap._gridSize[2];
+		//the apron of a brick reaches one voxel into its neighbours
+		const float apronU = 1.0f / (gridSizeX * brickMap._brickSize);
+		const float apronV = 1.0f / (gridSizeY * brickMap._brickSize);
+		const float apronH = 1.0f / (gridSizeZ * brickMap._brickSize);
+
+		std::vector<uint8_t> isOccupied(brickMap.GetCellCount(), 0);
+		JobSystem::ParallelFor(0, gridSizeX * gridSizeY, 0, [&](const UINT column)
+		{
+			const UINT cellX = column % gridSizeX;
+			const UINT cellY = column / gridSizeX;
+
+			//every weather texel a bilinear fetch inside the footprint can touch
+			const float u0 = static_cast<float>(cellX) / gridSizeX - apronU, u1 = static_cast<float>(cellX + 1) / gridSizeX + apronU;
+			const float v0 = static_cast<float>(cellY) / gridSizeY - apronV, v1 = static_cast<float>(cellY + 1) / gridSizeY + apronV;
+			const int x0 = std::max(static_cast<int>(floorf(u0 * weather._width - 0.5f)), 0);
+			const int x1 = std::min(static_cast<int>(floorf(u1 * weather._width - 0.5f)) + 1, static_cast<int>(weather._width) - 1);
+			const int y0 = std::max(static_cast<int>(floorf(v0 * weather._height - 0.5f)), 0);
+			const int y1 = std::min(static_cast<int>(floorf(v1 * weather._height - 0.5f)) + 1, static_cast<int>(weather._height) - 1);
+
+			float maxCoverage = 0.0f;
+			float minType = FLT_MAX;
+			float maxType = -FLT_MAX;
+			for (int y = y0; y <= y1; ++y)
+			{
+				for (int x = x0; x <= x1; ++x)
+				{
+					maxCoverage = std::max(maxCoverage, weather.Fetch(x, y, 0, 0));
+					minType = std::min(minType, weather.Fetch(x, y, 0, 1));
+					maxType = std::max(maxType, weather.Fetch(x, y, 0, 1));
+				}
+			}
+
+			//GetCloudDensity scales by the coverage after the remap, so no coverage means no cloud at any height
+			if (cloudProperty._cloudCoverageFactor * maxCoverage <= 0.0f)
+			{
+				return;
+			}
+
+			float minHeight, maxHeight;
+			GetHeightSupport(minType, maxType, minHeight, maxHeight);
+			minHeight = std::max(minHeight, eps);
+			maxHeight = std::min(maxHeight, 1.0f + eps);
+
+			for (UINT cellZ = 0; cellZ < gridSizeZ; ++cellZ)
+			{
+				const float h0 = static_cast<float>(cellZ) / gridSizeZ - apronH;
+				const float h1 = static_cast<float>(cellZ + 1) / gridSizeZ + apronH;
+				if (minHeight < h1 && h0 < maxHeight)
+				{
+					isOccupied[(cellZ * gridSizeY + cellY) * gridSizeX + cellX] = 1;
+				}
+			}
+		});
+
+		//slots are handed out in cell order, Fill relies on it when compacting
+		UINT brickCount = 0;
+		for (UINT cell = 0; cell < brickMap.GetCellCount(); ++cell)
+		{
+			brickMap._brickIndex[cell] = isOccupied[cell] ? brickCount++ : EMPTY_BRICK;
+		}
+		brickMap._brickPool.assign(static_cast<size_t>(brickCount) * brickMap.GetPhysicalBrickVoxels(), 0);
+	}
+
+	void Fill(BrickMap& brickMap, const std::function<float(float, float, float)>& density)
+	{
+		const UINT brickSize = brickMap._brickSize;
+		const UINT physicalSize = brickMap.GetPhysicalBrickSize();
+		const size_t physicalVoxels = brickMap.GetPhysicalBrickVoxels();
+		const UINT gridSizeX = brickMap._gridSize[0];
+		const UINT gridSizeY = brickMap._gridSize[1];
+		const float voxelCount[3] = {
+			static_cast<float>(gridSizeX * brickSize),
+			static_cast<float>(gridSizeY * brickSize),
+			static_cast<float>(brickMap._gridSize[2] * brickSize)
+		};
+
+		std::vector<float> maxDensity(brickMap.GetBrickCount(), 0.0f);
+		JobSystem::ParallelFor(0, brickMap.GetCellCount(), 0, [&](const UINT cell)
+		{
+			const UINT slot = brickMap._brickIndex[cell];
+			if (slot == EMPTY_BRICK)
+			{
+				return;
+			}
+
+			const UINT cellX = cell % gridSizeX;
+			const UINT cellY = (cell / gridSizeX) % gridSizeY;
+			const UINT cellZ = cell / (gridSizeX * gridSizeY);
+
+			//voxel i of the physical brick is voxel cell * brickSize + i - 1 of the whole grid
+			uint16_t* brick = &brickMap._brickPool[slot * physicalVoxels];
+			float brickMax = 0.0f;
+			for (UINT z = 0; z < physicalSize; ++z)
+			{
+				const float h = (static_cast<float>(cellZ * brickSize + z) - 0.5f) / voxelCount[2];
+				for (UINT y = 0; y < physicalSize; ++y)
+				{
+					const float v = std::min(std::max((static_cast<float>(cellY * brickSize + y) - 0.5f) / voxelCount[1], 0.0f), 1.0f);
+					for (UINT x = 0; x < physicalSize; ++x)
+					{
+						const float u = std::min(std::max((static_cast<float>(cellX * brickSize + x) - 0.5f) / voxelCount[0], 0.0f), 1.0f);
+						const float value = std::max(density(u, v, h), 0.0f);
+						brickMax = std::max(brickMax, value);
+						brick[(z * physicalSize + y) * physicalSize + x] = XMConvertFloatToHalf(value);
+					}
+				}
+			}
+			maxDensity[slot] = brickMax;
+		});
+
+		//drop bricks left empty, in cell order so that the result does not depend on scheduling
+		UINT brickCount = 0;
+		for (UINT cell = 0; cell < brickMap.GetCellCount(); ++cell)
+		{
+			const UINT slot = brickMap._brickIndex[cell];
+			if (slot == EMPTY_BRICK)
+			{
+				continue;
+			}
+			if (maxDensity[slot] <= 0.0f)
+			{
+				brickMap._brickIndex[cell] = EMPTY_BRICK;
+				continue;
+			}
+
+			ASSERT(brickCount <= slot);
+			if (brickCount != slot)
+			{
+				std::copy_n(&brickMap._brickPool[slot * physicalVoxels], physicalVoxels, &brickMap._brickPool[brickCount * physicalVoxels]);
+			}
+			brickMap._brickIndex[cell] = brickCount++;
+		}
+		brickMap._brickPool.resize(brickCount * physicalVoxels);
+	}
+
+	UINT FindBrick(const BrickMap& brickMap, const float u, const float v, const float h)
+	{
+		return brickMap._brickIndex[Locate(brickMap, u, v, h)._cellIndex];
+	}
+
+	float Sample(const BrickMap& brickMap, const float u, const float v, const float h)
+	{
+		const CellLocation location = Locate(brickMap, u, v, h);
+		const UINT slot = brickMap._brickIndex[location._cellIndex];
+		if (slot == EMPTY_BRICK)
+		{
+			return 0.0f;
+		}
+
+		//voxel centers at i + 0.5 in the physical brick, the apron keeps every fetch inside it
+		const int physicalSize = static_cast<int>(brickMap.GetPhysicalBrickSize());
+		int base[3];
+		float t[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const float position = (location._gridCoord[i] - location._cell[i]) * brickMap._brickSize + 0.5f;
+			base[i] = std::min(static_cast<int>(position), physicalSize - 2);
+			t[i] = position - base[i];
+		}
+
+		const uint16_t* brick = &brickMap._brickPool[static_cast<size_t>(slot) * brickMap.GetPhysicalBrickVoxels()];
+		float result = 0.0f;
+		for (int k = 0; k < 2; ++k)
+		{
+			for (int j = 0; j < 2; ++j)
+			{
+				for (int i = 0; i < 2; ++i)
+				{
+					const float weight = (i ? t[0] : 1.0f - t[0]) * (j ? t[1] : 1.0f - t[1]) * (k ? t[2] : 1.0f - t[2]);
+					const int voxel = ((base[2] + k) * physicalSize + base[1] + j) * physicalSize + base[0] + i;
+					result += XMConvertHalfToFloat(brick[voxel]) * weight;
+				}
+			}
+		}
+		return result;
+	}
+
+	MemoryReport GetMemoryReport(const BrickMap& brickMap, const VolumetricCloud::CloudProperty& cloudProperty)
+	{
+		MemoryReport report = {};
+		report._brickCount = brickMap.GetBrickCount();
+		report._cellCount = brickMap.GetCellCount();
+		report._indexBytes = brickMap._brickIndex.size() * sizeof(UINT);
+		report._poolBytes = brickMap._brickPool.size() * sizeof(uint16_t);
+
+		//SphereUVMapping folds the six cube faces onto the same (u, v), so every column covers six patches of the sphere
+		const double radius = cloudProperty._inRadius;
+		for (UINT cellY = 0; cellY < brickMap._gridSize[1]; ++cellY)
+		{
+			for (UINT cellX = 0; cellX < brickMap._gridSize[0]; ++cellX)
+			{
+				bool isColumnOccupied = false;
+				for (UINT cellZ = 0; cellZ < brickMap._gridSize[2] && !isColumnOccupied; ++cellZ)
+				{
+					isColumnOccupied = brickMap._brickIndex[(cellZ * brickMap._gridSize[1] + cellY) * brickMap._gridSize[0] + cellX] != EMPTY_BRICK;
+				}
+				if (!isColumnOccupied)
+				{
+					continue;
+				}
+
+				const double x0 = UnwarpSphereCoordinate(2.0 * cellX / brickMap._gridSize[0] - 1.0);
+				const double x1 = UnwarpSphereCoordinate(2.0 * (cellX + 1) / brickMap._gridSize[0] - 1.0);
+				const double y0 = UnwarpSphereCoordinate(2.0 * cellY / brickMap._gridSize[1] - 1.0);
+				const double y1 = UnwarpSphereCoordinate(2.0 * (cellY + 1) / brickMap._gridSize[1] - 1.0);
+				const double solidAngle = FaceSolidAngle(x1, y1) - FaceSolidAngle(x0, y1) - FaceSolidAngle(x1, y0) + FaceSolidAngle(x0, y0);
+				report._coveredArea += 6.0 * solidAngle * radius * radius;
+			}
+		}
+
+		report._bytesPerCoveredArea = (report._coveredArea > 0.0) ? ((report._indexBytes + report._poolBytes) / report._coveredArea) : 0.0;
+		return report;
+	}
+
+	void PrintMemoryReport(const BrickMap& brickMap, const VolumetricCloud::CloudProperty& cloudProperty)
+	{
+		const MemoryReport report = GetMemoryReport(brickMap, cloudProperty);
+		Utility::Printf("Cloud brick map %ux%ux%u of %u^3 bricks: %u / %u bricks (%.1f%%), index %.1f KB, pool %.1f MB, covered %.0f km^2, %.1f bytes per km^2\n",
+			brickMap._gridSize[0], brickMap._gridSize[1], brickMap._gridSize[2], brickMap._brickSize,
+			report._brickCount, report._cellCount, 100.0f * report._brickCount / std::max(report._cellCount, 1u),
+			report._indexBytes / 1024.0f, report._poolBytes / (1024.0f * 1024.0f), report._coveredArea, report._bytesPerCoveredArea);
+	}
+
+	void Upload(const BrickMap& brickMap, VolumeTexture3D& brickIndex, VolumeTexture3D& brickAtlas)
+	{
+		//the previous index and atlas may still be read by frames in flight
+		Graphics::g_CommandManager.IdleGPU();
+
+		const UINT physicalSize = brickMap.GetPhysicalBrickSize();
+		const UINT maxAtlasBricks = std::min(1u << ATLAS_AXIS_BITS, MAX_TEXTURE3D_SIZE / physicalSize);
+
+		//an empty map still needs one brick worth of atlas, 3D textures need a depth above 1
+		const UINT brickCount = std::max(brickMap.GetBrickCount(), 1u);
+		const UINT atlasX = std::min(static_cast<UINT>(ceilf(sqrtf(static_cast<float>(brickCount)))), maxAtlasBricks);
+		const UINT atlasY = std::min((brickCount + atlasX - 1) / atlasX, maxAtlasBricks);
+		const UINT atlasZ = (brickCount + atlasX * atlasY - 1) / (atlasX * atlasY);
+		ASSERT(atlasZ <= maxAtlasBricks, "Cloud brick map does not fit in the brick atlas");
+
+		const UINT atlasWidth = atlasX * physicalSize;
+		const UINT atlasHeight = atlasY * physicalSize;
+		const UINT atlasDepth = atlasZ * physicalSize;
+		std::vector<uint16_t> atlas(static_cast<size_t>(atlasWidth) * atlasHeight * atlasDepth, 0);
+
+		for (UINT brick = 0; brick < brickMap.GetBrickCount(); ++brick)
+		{
+			const UINT originX = (brick % atlasX) * physicalSize;
+			const UINT originY = ((brick / atlasX) % atlasY) * physicalSize;
+			const UINT originZ = (brick / (atlasX * atlasY)) * physicalSize;
+			const uint16_t* source = &brickMap._brickPool[static_cast<size_t>(brick) * brickMap.GetPhysicalBrickVoxels()];
+			for (UINT z = 0; z < physicalSize; ++z)
+			{
+				for (UINT y = 0; y < physicalSize; ++y)
+				{
+					const size_t row = (static_cast<size_t>(originZ + z) * atlasHeight + originY + y) * atlasWidth + originX;
+					memcpy(&atlas[row], source + (z * physicalSize + y) * physicalSize, physicalSize * sizeof(uint16_t));
+				}
+			}
+		}
+
+		std::vector<UINT> index(brickMap._brickIndex.size());
+		for (size_t cell = 0; cell < index.size(); ++cell)
+		{
+			const UINT brick = brickMap._brickIndex[cell];
+			index[cell] = (brick == EMPTY_BRICK) ? EMPTY_BRICK :
+				((brick % atlasX) | (((brick / atlasX) % atlasY) << ATLAS_AXIS_BITS) | ((brick / (atlasX * atlasY)) << (2 * ATLAS_AXIS_BITS)));
+		}
+
+		brickIndex.Create(L"Cloud Brick Index", brickMap._gridSize[0], brickMap._gridSize[1], brickMap._gridSize[2], DXGI_FORMAT_R32_UINT);
+		brickAtlas.Create(L"Cloud Brick Atlas", atlasWidth, atlasHeight, atlasDepth, DXGI_FORMAT_R16_FLOAT);
+
+		D3D12_SUBRESOURCE_DATA indexData;
+		indexData.pData = index.data();
+		indexData.RowPitch = brickMap._gridSize[0] * sizeof(UINT);
+		indexData.SlicePitch = indexData.RowPitch * brickMap._gridSize[1];
+		CommandContext::InitializeTexture(brickIndex, 1, &indexData);
+
+		D3D12_SUBRESOURCE_DATA atlasData;
+		atlasData.pData = atlas.data();
+		atlasData.RowPitch = atlasWidth * sizeof(uint16_t);
+		atlasData.SlicePitch = atlasData.RowPitch * atlasHeight;
+		CommandContext::InitializeTexture(brickAtlas, 1, &atlasData);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "d3dx12.h"
+
+#include "pch.h"
+#include "VolumeTexture3D.h"
+#include "VolumetricCloud.h"
+#include "CloudNoise.h"
+#include "types.h"
+
+#include <functional>
+
+//Sparse density over the cloud shell. A top level grid over the sphere mapped (u, v) and the height percent in the cloud layer
+//points to bricks in a pool, empty cells have no brick. Mirrored by cloudBrickMap.hlsli, keep the two in sync.
+namespace CloudBrickMap
+{
+	constexpr UINT EMPTY_BRICK = 0xFFFFFFFF;
+	//atlas brick coordinates are packed with 10 bits per axis
+	constexpr UINT ATLAS_AXIS_BITS = 10;
+
+	struct BrickMap
+	{
+		BrickMap() : _brickSize(0), _gridSize{ 0, 0, 0 } {}
+
+		//8 or 16, every brick carries a one voxel apron on top of that so that it filters without seams
+		UINT _brickSize;
+		UINT _gridSize[3];
+		//per grid cell, brick slot in _brickPool or EMPTY_BRICK
+		std::vector<UINT> _brickIndex;
+		//half precision, GetPhysicalBrickVoxels() per brick
+		std::vector<uint16_t> _brickPool;
+
+		UINT GetPhysicalBrickSize(void) const { return _brickSize + 2; }
+		UINT GetPhysicalBrickVoxels(void) const { return GetPhysicalBrickSize() * GetPhysicalBrickSize() * GetPhysicalBrickSize(); }
+		UINT GetCellCount(void) const { return _gridSize[0] * _gridSize[1] * _gridSize[2]; }
+		UINT GetBrickCount(void) const { return (_brickSize == 0) ? 0 : static_cast<UINT>(_brickPool.size() / GetPhysicalBrickVoxels()); }
+	};
+
+	struct MemoryReport
+	{
+		UINT _brickCount;
+		UINT _cellCount;
+		size_t _indexBytes;
+		size_t _poolBytes;
+		//area under occupied columns on the inner cloud sphere, km^2
+		double _coveredArea;
+		double _bytesPerCoveredArea;
+	};
+
+	//Edges of GetCloudHeightGradient in cloudFunctions.hlsli for a cloud type, rises over [x, y] and falls over [z, w]
+	float4 GetCloudHeightGradientEdges(const float cloudType);
+
+	//Empty map, every cell without a brick
+	void Create(BrickMap& brickMap, const UINT brickSize, const UINT gridSizeX, const UINT gridSizeY, const UINT gridSizeZ);
+
+	//Allocates a zeroed brick for every cell that can hold cloud according to the weather map:
+	//coverage above zero in the footprint of the cell and a height gradient of its cloud types reaching the height range of the cell.
+	void BuildFromWeather(const CloudNoise::CpuTexture& weather, const VolumetricCloud::CloudProperty& cloudProperty, BrickMap& brickMap);
+
+	//Evaluates density(u, v, h) at every voxel of the allocated bricks on the worker threads, then drops bricks left empty.
+	//The apron reaches half a voxel outside [0, 1], u and v are clamped, the height is not.
+	void Fill(BrickMap& brickMap, const std::function<float(float, float, float)>& density);
+
+	//Brick slot of the cell containing uvh, or EMPTY_BRICK
+	UINT FindBrick(const BrickMap& brickMap, const float u, const float v, const float h);
+	//Trilinear inside the brick, same result as SampleCloudBrickMap in cloudBrickMap.hlsli
+	float Sample(const BrickMap& brickMap, const float u, const float v, const float h);
+
+	MemoryReport GetMemoryReport(const BrickMap& brickMap, const VolumetricCloud::CloudProperty& cloudProperty);
+	void PrintMemoryReport(const BrickMap& brickMap, const VolumetricCloud::CloudProperty& cloudProperty);
+
+	//(Re)creates index (R32_UINT, one texel per cell) and atlas (R16_FLOAT) textures for cloudBrickMap.hlsli
+	void Upload(const BrickMap& brickMap, VolumeTexture3D& brickIndex, VolumeTexture3D& brickAtlas);
+}
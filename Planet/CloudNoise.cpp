@@ -1,11 +1,17 @@
 #include "CloudNoise.h"
 #include "GameCore.h"
 #include "CommandContext.h"
+#include "ReadbackBuffer.h"
+#include "PersistentDescriptors.h"
+#include "FrameGraphExecutor.h"
 #include "CompiledShaders/baseCloudNoise.h"
 #include "CompiledShaders/detailCloudNoise.h"
 #include "CompiledShaders/cloudWeatherNoise.h"
 #include "CompiledShaders/bufferNormalizing.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace CloudNoise
 {
 	constexpr UINT BASE_SHAPE_TEXTURE_SIZE = 128;
@@ -16,8 +22,6 @@ namespace CloudNoise
 	VolumeTexture3D _baseShapeNoise;
 	VolumeTexture3D _detailShapeNoise;
 	ColorBuffer _weatherNoise;
-	StructuredBuffer _baseShapeMinMaxStorage;
-	StructuredBuffer _detailShapeMinMaxStorage;
 
 	RootSignature _cloudNoiseRS;
 	ComputePSO _baseShapePSO;
@@ -27,12 +31,13 @@ namespace CloudNoise
 
 	void Initialize()
 	{
-		UINT minmaxInitialData[2] = {0xFFFFFFFF, 0};
+		_baseShapeNoise.SetPersistentSRV(PERSISTENT_SRV_CLOUD_BASE_SHAPE);
+		_detailShapeNoise.SetPersistentSRV(PERSISTENT_SRV_CLOUD_DETAIL_SHAPE);
+		_weatherNoise.SetPersistentSRV(PERSISTENT_SRV_CLOUD_WEATHER);
+
 		_baseShapeNoise.Create(L"Cloud Noise Base Shape", BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, DXGI_FORMAT_R32_FLOAT);
 		_detailShapeNoise.Create(L"Cloud Noise Detail Shape", DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, DXGI_FORMAT_R32_FLOAT);
 
-		_baseShapeMinMaxStorage.Create(L"minMax", 2, sizeof(UINT), static_cast<void*>(minmaxInitialData));
-		_detailShapeMinMaxStorage.Create(L"minMax", 2, sizeof(UINT), static_cast<void*>(minmaxInitialData));
 		_weatherNoise.Create(L"weaderNoise", WEATHER_NOISE_SIZE, WEATHER_NOISE_SIZE, 1, DXGI_FORMAT_R32G32B32A32_FLOAT);
 
 		_cloudNoiseRS.Reset(3, 1);
@@ -69,8 +74,6 @@ namespace CloudNoise
 
 		_baseShapeNoise.Destroy();
 		_detailShapeNoise.Destroy();
-		_baseShapeMinMaxStorage.Destroy();
-		_detailShapeMinMaxStorage.Destroy();
 		_weatherNoise.Destroy();
 	}
 
@@ -78,63 +81,156 @@ namespace CloudNoise
 	{
 		ComputeContext& context = ComputeContext::Begin(L"Cloud Noise Evaluation");
 
-		context.SetRootSignature(_cloudNoiseRS);
-		context.SetPipelineState(_baseShapePSO);
+		//the executor owns the heap of the min max buffers, so it has to outlive them
+		FrameGraphExecutor graph;
+		StructuredBuffer baseShapeMinMax;
+		StructuredBuffer detailShapeMinMax;
+
+		//a shape noise is normalized by the range it came out in, the range is only needed until then
+		const auto AddShapePasses = [&](const std::string& name, VolumeTexture3D& noise, StructuredBuffer& minMax, ComputePSO& noisePSO, const UINT size)
 		{
-			D3D12_CPU_DESCRIPTOR_HANDLE uav_handles[2] = {_baseShapeNoise.GetUAV(), _baseShapeMinMaxStorage.GetUAV()};
-			context.TransitionResource(_baseShapeNoise, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.TransitionResource(_baseShapeMinMaxStorage, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.SetConstant(0, 0, MINMAX_ACCURACY);
-			context.SetDynamicDescriptors(1, 0, 2, uav_handles);
-			context.Dispatch3D(BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, 4, 4, 4);
-			context.InsertUAVBarrier(_baseShapeNoise);
-		}
+			const FrameGraph::ResourceHandle noiseHandle = graph.Import(noise, name);
+			const FrameGraph::ResourceHandle minMaxHandle = graph.CreateTransientBuffer(minMax, name + " Min Max", 2, sizeof(UINT));
+
+			const FrameGraph::PassHandle resetPass = graph.AddPass(name + " Min Max Reset", [&minMax](CommandContext& passContext)
+			{
+				__declspec(align(16)) const UINT minMaxInitialData[4] = { 0xFFFFFFFF, 0, 0, 0 };
+				passContext.WriteBuffer(minMax, 0, minMaxInitialData, 2 * sizeof(UINT));
+			});
+			graph.Write(resetPass, minMaxHandle, FrameGraph::kCopyDest);
+
+			const FrameGraph::PassHandle noisePass = graph.AddPass(name, [&noise, &minMax, &noisePSO, size](CommandContext& passContext)
+			{
+				ComputeContext& noiseContext = passContext.GetComputeContext();
+				D3D12_CPU_DESCRIPTOR_HANDLE uav_handles[2] = { noise.GetUAV(), minMax.GetUAV() };
+				noiseContext.SetRootSignature(_cloudNoiseRS);
+				noiseContext.SetPipelineState(noisePSO);
+				noiseContext.SetConstant(0, 0, MINMAX_ACCURACY);
+				noiseContext.SetDynamicDescriptors(1, 0, 2, uav_handles);
+				noiseContext.Dispatch3D(size, size, size, 4, 4, 4);
+			});
+			graph.Write(noisePass, noiseHandle, FrameGraph::kUnorderedAccess);
+			graph.Read(noisePass, minMaxHandle, FrameGraph::kUnorderedAccess);
+			graph.Write(noisePass, minMaxHandle, FrameGraph::kUnorderedAccess);
+
+			const FrameGraph::PassHandle normalizePass = graph.AddPass(name + " Normalize", [&noise, &minMax, size](CommandContext& passContext)
+			{
+				ComputeContext& normalizeContext = passContext.GetComputeContext();
+				normalizeContext.SetRootSignature(_cloudNoiseRS);
+				normalizeContext.SetPipelineState(_normalizerPSO);
+				normalizeContext.SetConstant(0, 0, MINMAX_ACCURACY);
+				normalizeContext.SetDynamicDescriptor(1, 0, noise.GetUAV());
+				normalizeContext.SetDynamicDescriptor(2, 0, minMax.GetSRV());
+				normalizeContext.Dispatch3D(size, size, size, 4, 4, 4);
+			});
+			graph.Read(normalizePass, noiseHandle, FrameGraph::kUnorderedAccess);
+			graph.Write(normalizePass, noiseHandle, FrameGraph::kUnorderedAccess);
+			graph.Read(normalizePass, minMaxHandle, FrameGraph::kNonPixelShaderResource);
+			graph.SetFinalState(noiseHandle, FrameGraph::kShaderResource);
+		};
+
+		//the detail range takes over the memory of the base range
+		AddShapePasses("Base Shape Noise", _baseShapeNoise, baseShapeMinMax, _baseShapePSO, BASE_SHAPE_TEXTURE_SIZE);
+		AddShapePasses("Detail Shape Noise", _detailShapeNoise, detailShapeMinMax, _detailShapePSO, DETAIL_SHAPE_TEXTURE_SIZE);
+
+		const FrameGraph::ResourceHandle weather = graph.Import(_weatherNoise, "Weather Noise");
+		const FrameGraph::PassHandle weatherPass = graph.AddPass("Weather Noise", [](CommandContext& passContext)
+		{
+			ComputeContext& weatherContext = passContext.GetComputeContext();
+			weatherContext.SetRootSignature(_cloudNoiseRS);
+			weatherContext.SetPipelineState(_weatherNoisePSO);
+			weatherContext.SetDynamicDescriptor(1, 0, _weatherNoise.GetUAV());
+			weatherContext.Dispatch2D(WEATHER_NOISE_SIZE, WEATHER_NOISE_SIZE, 8, 8);
+		});
+		graph.Write(weatherPass, weather, FrameGraph::kUnorderedAccess);
+		graph.SetFinalState(weather, FrameGraph::kShaderResource);
+
+		graph.Execute(context);
+
+		//the transient heap and the min max buffers go away with this scope
+		context.Finish(true);
+	}
 
-		context.SetPipelineState(_normalizerPSO);
+	namespace
+	{
+		int Wrap(const int i, const int size)
 		{
-			context.TransitionResource(_baseShapeNoise, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.TransitionResource(_baseShapeMinMaxStorage, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.SetConstant(0, 0, MINMAX_ACCURACY);
-			context.SetDynamicDescriptor(1, 0, _baseShapeNoise.GetUAV());
-			context.SetDynamicDescriptor(2, 0, _baseShapeMinMaxStorage.GetSRV());
-			context.Dispatch3D(BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, BASE_SHAPE_TEXTURE_SIZE, 4, 4, 4);
-			context.InsertUAVBarrier(_baseShapeNoise);
+			const int r = i % size;
+			return (r < 0) ? (r + size) : r;
 		}
 
-		context.SetPipelineState(_detailShapePSO);
+		int Clamp(const int i, const int size)
 		{
-			D3D12_CPU_DESCRIPTOR_HANDLE uav_handles[2] = {_detailShapeNoise.GetUAV(), _detailShapeMinMaxStorage.GetUAV()};
-
-			context.TransitionResource(_detailShapeNoise, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.TransitionResource(_detailShapeMinMaxStorage, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.SetConstant(0, 0, MINMAX_ACCURACY);
-			context.SetDynamicDescriptors(1, 0, 2, uav_handles);
-			context.Dispatch3D(DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, 4, 4, 4);
-			context.InsertUAVBarrier(_detailShapeNoise);
+			return std::min(std::max(i, 0), size - 1);
 		}
+	}
 
-		context.SetPipelineState(_normalizerPSO);
+	float CpuTexture::SampleWrap(const float u, const float v, const float w) const
+	{
+		const float x = u * _width - 0.5f;
+		const float y = v * _height - 0.5f;
+		const float z = w * _depth - 0.5f;
+		const float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+		const float tx = x - fx, ty = y - fy, tz = z - fz;
+		const int x0 = Wrap(static_cast<int>(fx), _width), x1 = Wrap(static_cast<int>(fx) + 1, _width);
+		const int y0 = static_cast<int>(fy), z0 = static_cast<int>(fz);
+
+		float result = 0.0f;
+		for (int k = 0; k < 2; ++k)
 		{
-			context.TransitionResource(_detailShapeNoise, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.TransitionResource(_detailShapeMinMaxStorage, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-			context.SetConstant(0, 0, MINMAX_ACCURACY);
-			context.SetDynamicDescriptor(1, 0, _detailShapeNoise.GetUAV());
-			context.SetDynamicDescriptor(2, 0, _detailShapeMinMaxStorage.GetSRV());
-			context.Dispatch3D(DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, DETAIL_SHAPE_TEXTURE_SIZE, 4, 4, 4);
-			context.InsertUAVBarrier(_detailShapeNoise);
+			const int zi = Wrap(z0 + k, _depth);
+			const float wz = k ? tz : (1.0f - tz);
+			for (int j = 0; j < 2; ++j)
+			{
+				const int yi = Wrap(y0 + j, _height);
+				const float wy = j ? ty : (1.0f - ty);
+				const float left = Fetch(x0, yi, zi, 0);
+				result += (left + (Fetch(x1, yi, zi, 0) - left) * tx) * wy * wz;
+			}
 		}
+		return result;
+	}
 
-		context.SetPipelineState(_weatherNoisePSO);
+	void CpuTexture::SampleClamp(const float u, const float v, float* out) const
+	{
+		const float x = u * _width - 0.5f;
+		const float y = v * _height - 0.5f;
+		const float fx = floorf(x), fy = floorf(y);
+		const float tx = x - fx, ty = y - fy;
+		const int x0 = Clamp(static_cast<int>(fx), _width), x1 = Clamp(static_cast<int>(fx) + 1, _width);
+		const int y0 = Clamp(static_cast<int>(fy), _height), y1 = Clamp(static_cast<int>(fy) + 1, _height);
+
+		for (UINT c = 0; c < _channels; ++c)
 		{
-			context.TransitionResource(_weatherNoise, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-			context.SetDynamicDescriptor(1, 0, _weatherNoise.GetUAV());
-			context.Dispatch2D(WEATHER_NOISE_SIZE, WEATHER_NOISE_SIZE, 8, 8);
-			context.InsertUAVBarrier(_weatherNoise);
+			const float top = Fetch(x0, y0, 0, c) + (Fetch(x1, y0, 0, c) - Fetch(x0, y0, 0, c)) * tx;
+			const float bottom = Fetch(x0, y1, 0, c) + (Fetch(x1, y1, 0, c) - Fetch(x0, y1, 0, c)) * tx;
+			out[c] = top + (bottom - top) * ty;
 		}
+	}
 
-		context.TransitionResource(_baseShapeNoise, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_detailShapeNoise, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_weatherNoise, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-		context.Finish();
+	CpuTexture ReadbackToCpu(PixelBuffer& texture, const UINT channels)
+	{
+		CpuTexture cpuTexture;
+		cpuTexture._width = texture.GetWidth();
+		cpuTexture._height = texture.GetHeight();
+		cpuTexture._depth = std::max(texture.GetDepth(), 1u);
+		cpuTexture._channels = channels;
+		cpuTexture._texels.resize(static_cast<size_t>(cpuTexture._width) * cpuTexture._height * cpuTexture._depth * channels);
+
+		ReadbackBuffer readback;
+		CommandContext& context = CommandContext::Begin(L"Cloud Noise Readback");
+		const uint32_t rowPitch = context.ReadbackTexture(readback, texture);
+		context.Finish(true);
+
+		//3D slices are packed one after another, height rows each
+		const size_t rowSize = static_cast<size_t>(cpuTexture._width) * channels * sizeof(float);
+		const uint8_t* memory = static_cast<const uint8_t*>(readback.Map());
+		for (UINT row = 0; row < cpuTexture._height * cpuTexture._depth; ++row)
+		{
+			memcpy(&cpuTexture._texels[row * static_cast<size_t>(cpuTexture._width) * channels], memory + static_cast<size_t>(row) * rowPitch, rowSize);
+		}
+		readback.Unmap();
+		readback.Destroy();
+		return cpuTexture;
 	}
 }
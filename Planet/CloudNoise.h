@@ -19,6 +19,29 @@ namespace CloudNoise
 		float3 _numberOfCells;
 	};
 
+	//CPU copy of a single mip of a noise texture, sampled the way the cloud shaders sample it
+	struct CpuTexture
+	{
+		UINT _width;
+		UINT _height;
+		UINT _depth;
+		UINT _channels;
+		std::vector<float> _texels;
+
+		float Fetch(const int x, const int y, const int z, const UINT channel) const
+		{
+			return _texels[((static_cast<size_t>(z) * _height + y) * _width + x) * _channels + channel];
+		}
+
+		//trilinear with wrap addressing (samplerCloudWrap), first channel only
+		float SampleWrap(const float u, const float v, const float w) const;
+		//bilinear with clamp addressing (samplerLinearClamp), every channel
+		void SampleClamp(const float u, const float v, float* out) const;
+	};
+
+	//Copies texture to the CPU, blocks until the GPU is done with it
+	CpuTexture ReadbackToCpu(PixelBuffer& texture, const UINT channels);
+
 
 	extern VolumeTexture3D _baseShapeNoise;
 	extern VolumeTexture3D _detailShapeNoise;
@@ -0,0 +1,231 @@
+#include "CloudVolumeBake.h"
+
+#include "FileUtility.h"
+#include "SystemTime.h"
+#include "EngineTuning.h"
+#include "CloudNoise.h"
+
+#include <zlib.h>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr uint32_t BAKE_FILE_MAGIC = 0x56444C43; //"CLDV"
+	constexpr uint32_t BAKE_FILE_VERSION = 2;
+
+	struct BakeFileHeader
+	{
+		uint32_t _magic;
+		uint32_t _version;
+		uint32_t _brickSize;
+		uint32_t _gridSize[3];
+		uint32_t _brickCount;
+		float _atmosphereOutRadius;
+		VolumetricCloud::CloudProperty _cloudProperty;
+	};
+
+	float SmoothStep(const float edge0, const float edge1, const float x)
+	{
+		const float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	float Remap(const float originalValue, const float originalMin, const float originalMax, const float newMin, const float newMax)
+	{
+		return newMin + (((originalValue - originalMin) / (originalMax - originalMin)) * (newMax - newMin));
+	}
+
+	//GetCloudDensity in cloudFunctions.hlsli with _moveSpeed == 0, in sphere mapped (u, v) and height percent
+	struct DensityEvaluator
+	{
+		const CloudNoise::CpuTexture& _baseNoise;
+		const CloudNoise::CpuTexture& _detailNoise;
+		const CloudNoise::CpuTexture& _weather;
+		const VolumetricCloud::CloudProperty& _property;
+		float _scaleFactor;
+
+		float Evaluate(const float u, const float v, const float h01) const
+		{
+			constexpr float eps = 1e-6f;
+			if (eps > h01 || h01 > 1.0f + eps)
+			{
+				return 0.0f;
+			}
+
+			float weather[4];
+			_weather.SampleClamp(u, v, weather);
+
+			const float texCoord[3] = { u * _property._scale, v * _property._scale, h01 * _scaleFactor };
+			float cloudSample = _baseNoise.SampleWrap(texCoord[0], texCoord[1], texCoord[2]);
+			const float4 gradient = CloudBrickMap::GetCloudHeightGradientEdges(weather[1]);
+			cloudSample *= (SmoothStep(gradient.x, gradient.y, h01) - SmoothStep(gradient.z, gradient.w, h01)) / h01;
+
+			const float coverage = std::min(std::max(_property._cloudCoverageFactor * weather[0], 0.0f), 1.0f);
+			cloudSample = Remap(cloudSample, coverage, 1.0f, 0.0f, 1.0f) * coverage;
+
+			if (0.0f < cloudSample)
+			{
+				const float crispness = _property._crispness;
+				const float detailNoise = _detailNoise.SampleWrap(texCoord[0] * crispness, texCoord[1] * crispness, texCoord[2] * crispness);
+				const float factor = detailNoise + (1.0f - 2.0f * detailNoise) * h01;
+				cloudSample = cloudSample - factor * (1.0f - cloudSample);
+				cloudSample = Remap(cloudSample * 2.0f, factor * 0.2f, 1.0f, 0.0f, 1.0f);
+			}
+
+			//also drops the NaN a fully covered texel produces in the first remap
+			return (cloudSample > 0.0f) ? cloudSample : 0.0f;
+		}
+	};
+}
+
+namespace CloudVolumeBake
+{
+	VolumeTexture3D _brickIndex;
+	VolumeTexture3D _brickAtlas;
+
+	BoolVar _useBakedVolume("Cloud/Bake/UseBakedVolume", true);
+
+	VolumetricCloud::CloudProperty _uploadedCloudProperty;
+	float _uploadedAtmosphereOutRadius = 0.0f;
+	bool _isUploaded = false;
+
+	bool Bake(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const VolumetricCloud::CloudProperty& cloudProperty,
+		const BakeSettings& settings, BakedVolume& volume)
+	{
+		if (cloudProperty._moveSpeed != 0.0f)
+		{
+			Utility::Printf("Cloud volume bake skipped, only a static sky (Cloud/MoveSpeed 0) can be baked\n");
+			return false;
+		}
+
+		const int64_t startTick = SystemTime::GetCurrentTick();
+
+		const CloudNoise::CpuTexture baseNoise = CloudNoise::ReadbackToCpu(CloudNoise::_baseShapeNoise, 1);
+		const CloudNoise::CpuTexture detailNoise = CloudNoise::ReadbackToCpu(CloudNoise::_detailShapeNoise, 1);
+		const CloudNoise::CpuTexture weather = CloudNoise::ReadbackToCpu(CloudNoise::_weatherNoise, 4);
+
+		const DensityEvaluator evaluator = {
+			baseNoise, detailNoise, weather, cloudProperty,
+			(cloudProperty._outRadius - cloudProperty._inRadius) / (atmosphereProperty._outRadius - cloudProperty._inRadius)
+		};
+
+		volume._cloudProperty = cloudProperty;
+		volume._atmosphereOutRadius = atmosphereProperty._outRadius;
+		CloudBrickMap::Create(volume._brickMap, BRICK_SIZE, settings._gridSizeX, settings._gridSizeY, settings._gridSizeZ);
+		CloudBrickMap::BuildFromWeather(weather, cloudProperty, volume._brickMap);
+		const UINT weatherBrickCount = volume._brickMap.GetBrickCount();
+		CloudBrickMap::Fill(volume._brickMap, [&evaluator](float u, float v, float h) { return evaluator.Evaluate(u, v, h); });
+
+		const double seconds = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+		Utility::Printf("Cloud volume baked in %.2f s, %u bricks from the weather map, %u kept\n", seconds, weatherBrickCount, volume._brickMap.GetBrickCount());
+		CloudBrickMap::PrintMemoryReport(volume._brickMap, cloudProperty);
+		return true;
+	}
+
+	bool Save(const std::wstring& path, const BakedVolume& volume)
+	{
+		const CloudBrickMap::BrickMap& brickMap = volume._brickMap;
+
+		BakeFileHeader header = {};
+		header._magic = BAKE_FILE_MAGIC;
+		header._version = BAKE_FILE_VERSION;
+		header._brickSize = brickMap._brickSize;
+		header._gridSize[0] = brickMap._gridSize[0];
+		header._gridSize[1] = brickMap._gridSize[1];
+		header._gridSize[2] = brickMap._gridSize[2];
+		header._brickCount = brickMap.GetBrickCount();
+		header._atmosphereOutRadius = volume._atmosphereOutRadius;
+		header._cloudProperty = volume._cloudProperty;
+
+		const size_t indexBytes = brickMap._brickIndex.size() * sizeof(UINT);
+		const size_t poolBytes = brickMap._brickPool.size() * sizeof(uint16_t);
+		std::vector<uint8_t> raw(sizeof(header) + indexBytes + poolBytes);
+		memcpy(raw.data(), &header, sizeof(header));
+		memcpy(raw.data() + sizeof(header), brickMap._brickIndex.data(), indexBytes);
+		memcpy(raw.data() + sizeof(header) + indexBytes, brickMap._brickPool.data(), poolBytes);
+
+		uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+		std::vector<uint8_t> compressed(compressedSize);
+		if (compress2(compressed.data(), &compressedSize, raw.data(), static_cast<uLong>(raw.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+		{
+			Utility::Printf("Cloud volume compression failed\n");
+			return false;
+		}
+
+		std::ofstream file(path + L".gz", std::ios::out | std::ios::binary);
+		if (!file)
+		{
+			Utility::Printf("Cloud volume could not be written\n");
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(compressed.data()), compressedSize);
+
+		Utility::Printf("Cloud volume saved, %.1f MB compressed to %.1f MB\n", raw.size() / (1024.0f * 1024.0f), compressedSize / (1024.0f * 1024.0f));
+		return file.good();
+	}
+
+	bool Load(const std::wstring& path, BakedVolume& volume)
+	{
+		Utility::ByteArray data = Utility::ReadFileSync(path);
+		if (data == Utility::NullFile || data->size() < sizeof(BakeFileHeader))
+		{
+			return false;
+		}
+
+		BakeFileHeader header;
+		memcpy(&header, data->data(), sizeof(header));
+		if (header._magic != BAKE_FILE_MAGIC || header._version != BAKE_FILE_VERSION || header._brickSize != BRICK_SIZE)
+		{
+			Utility::Printf("Cloud volume file is out of date, bake it again\n");
+			return false;
+		}
+		if (header._gridSize[0] == 0 || header._gridSize[1] == 0 || header._gridSize[2] < 2)
+		{
+			Utility::Printf("Cloud volume file is corrupted\n");
+			return false;
+		}
+
+		CloudBrickMap::BrickMap& brickMap = volume._brickMap;
+		CloudBrickMap::Create(brickMap, header._brickSize, header._gridSize[0], header._gridSize[1], header._gridSize[2]);
+
+		const size_t indexBytes = brickMap._brickIndex.size() * sizeof(UINT);
+		const size_t poolBytes = static_cast<size_t>(header._brickCount) * brickMap.GetPhysicalBrickVoxels() * sizeof(uint16_t);
+		if (data->size() != sizeof(header) + indexBytes + poolBytes)
+		{
+			Utility::Printf("Cloud volume file is truncated\n");
+			return false;
+		}
+
+		volume._cloudProperty = header._cloudProperty;
+		volume._atmosphereOutRadius = header._atmosphereOutRadius;
+		brickMap._brickPool.resize(poolBytes / sizeof(uint16_t));
+		memcpy(brickMap._brickIndex.data(), data->data() + sizeof(header), indexBytes);
+		memcpy(brickMap._brickPool.data(), data->data() + sizeof(header) + indexBytes, poolBytes);
+		return true;
+	}
+
+	void Upload(const BakedVolume& volume)
+	{
+		CloudBrickMap::Upload(volume._brickMap, _brickIndex, _brickAtlas);
+
+		_uploadedCloudProperty = volume._cloudProperty;
+		_uploadedAtmosphereOutRadius = volume._atmosphereOutRadius;
+		_isUploaded = true;
+	}
+
+	void Shutdown(void)
+	{
+		_brickIndex.Destroy();
+		_brickAtlas.Destroy();
+		_isUploaded = false;
+	}
+
+	bool IsUsable(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const VolumetricCloud::CloudProperty& cloudProperty)
+	{
+		return _useBakedVolume && _isUploaded
+			&& _uploadedAtmosphereOutRadius == atmosphereProperty._outRadius
+			&& VolumetricCloud::IsSameCloudProperty(_uploadedCloudProperty, cloudProperty);
+	}
+}
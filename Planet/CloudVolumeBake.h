@@ -0,0 +1,54 @@
+#pragma once
+
+#include "d3dx12.h"
+
+#include "pch.h"
+#include "BufferManager.h"
+#include "VolumeTexture3D.h"
+#include "AtmoSphereEffect.h"
+#include "VolumetricCloud.h"
+#include "CloudBrickMap.h"
+#include "types.h"
+
+//Bakes GetCloudDensity of a static sky (_moveSpeed == 0) into a CloudBrickMap.
+//Without animation the density only depends on the sphere mapped (u, v) and the height in the cloud layer,
+//which is exactly the domain of the brick map.
+namespace CloudVolumeBake
+{
+	//CLOUD_BAKED_BRICK_SIZE in volumetricCloudBaked.hlsl
+	constexpr UINT BRICK_SIZE = 8;
+
+	struct BakeSettings
+	{
+		BakeSettings() : _gridSizeX(128), _gridSizeY(128), _gridSizeZ(4) {}
+
+		//top level grid over (u, v, height), in bricks
+		UINT _gridSizeX;
+		UINT _gridSizeY;
+		UINT _gridSizeZ;
+	};
+
+	struct BakedVolume
+	{
+		VolumetricCloud::CloudProperty _cloudProperty;
+		float _atmosphereOutRadius;
+		CloudBrickMap::BrickMap _brickMap;
+	};
+
+	//Reads the cloud noise back from the GPU, allocates bricks from the weather map and evaluates them on the worker threads
+	bool Bake(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const VolumetricCloud::CloudProperty& cloudProperty,
+		const BakeSettings& settings, BakedVolume& volume);
+
+	//zlib compressed, written next to path with a .gz suffix so that Utility::ReadFileSync picks it up
+	bool Save(const std::wstring& path, const BakedVolume& volume);
+	bool Load(const std::wstring& path, BakedVolume& volume);
+
+	void Upload(const BakedVolume& volume);
+	void Shutdown(void);
+
+	//True when an uploaded volume was baked with the given properties
+	bool IsUsable(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const VolumetricCloud::CloudProperty& cloudProperty);
+
+	extern VolumeTexture3D _brickIndex;
+	extern VolumeTexture3D _brickAtlas;
+}
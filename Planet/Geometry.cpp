@@ -1,4 +1,5 @@
 #include "Geometry.h"
+#include "MeshOptimizer.h"
 
 namespace Geometry
 {
@@ -80,6 +81,9 @@ namespace Geometry
 		}
 
 
+		MeshOptimizer::Mesh mesh = { &sphere->_indices, sphere->_vertices.data(), sphere->_vertices.size(), sizeof(Vertex), nullptr };
+		MeshOptimizer::OptimizeMesh(mesh, MeshOptimizer::Settings());
+
 		sphere->_name = L"sphere";
 		sphere->_worldStatus = { position, rotation, scale };
 		sphere->_vertices.shrink_to_fit();
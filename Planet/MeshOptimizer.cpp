@@ -0,0 +1,337 @@
+#include "MeshOptimizer.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	//tuning of the Forsyth paper
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+	constexpr UINT VALENCE_TABLE_SIZE = 64;
+	constexpr UINT INVALID_INDEX = 0xFFFFFFFF;
+
+	struct ScoreTables
+	{
+		ScoreTables()
+		{
+			for (UINT position = 0; position < MeshOptimizer::FORSYTH_CACHE_SIZE; ++position)
+			{
+				//the three vertices of the last triangle get a fixed score so that its neighbours are not favoured over each other
+				const float scaler = 1.0f / (MeshOptimizer::FORSYTH_CACHE_SIZE - 3);
+				_cache[position] = (position < 3) ? LAST_TRIANGLE_SCORE : powf(1.0f - (position - 3) * scaler, CACHE_DECAY_POWER);
+			}
+			_valence[0] = 0.0f;
+			for (UINT valence = 1; valence < VALENCE_TABLE_SIZE; ++valence)
+			{
+				_valence[valence] = VALENCE_BOOST_SCALE * powf(static_cast<float>(valence), -VALENCE_BOOST_POWER);
+			}
+		}
+
+		float _cache[MeshOptimizer::FORSYTH_CACHE_SIZE];
+		float _valence[VALENCE_TABLE_SIZE];
+	};
+
+	const ScoreTables& GetScoreTables(void)
+	{
+		static const ScoreTables tables;
+		return tables;
+	}
+
+	float GetVertexScore(const ScoreTables& tables, const int cachePosition, const UINT remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+		{
+			return -1.0f;
+		}
+
+		const float cacheScore = (cachePosition >= 0) ? tables._cache[cachePosition] : 0.0f;
+		const float valenceScore = (remainingTriangles < VALENCE_TABLE_SIZE) ? tables._valence[remainingTriangles]
+			: VALENCE_BOOST_SCALE * powf(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+		return cacheScore + valenceScore;
+	}
+}
+
+namespace MeshOptimizer
+{
+	CacheStatistics AnalyzeVertexCache(const UINT* indices, const size_t indexCount, const size_t vertexCount, const UINT cacheSize)
+	{
+		//a vertex is still in the FIFO while fewer than cacheSize misses happened since it was loaded
+		std::vector<UINT> timestamps(vertexCount, 0);
+		UINT time = cacheSize + 1;
+		UINT misses = 0;
+		UINT uniqueVertices = 0;
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			const UINT vertex = indices[i];
+			if (time - timestamps[vertex] > cacheSize)
+			{
+				uniqueVertices += (timestamps[vertex] == 0) ? 1 : 0;
+				timestamps[vertex] = time++;
+				++misses;
+			}
+		}
+
+		const size_t triangleCount = indexCount / 3;
+		CacheStatistics statistics;
+		statistics._acmr = (triangleCount > 0) ? static_cast<float>(misses) / triangleCount : 0.0f;
+		statistics._atvr = (uniqueVertices > 0) ? static_cast<float>(misses) / uniqueVertices : 0.0f;
+		statistics._misses = misses;
+		return statistics;
+	}
+
+	void OptimizeVertexCache(UINT* indices, const size_t indexCount, const size_t vertexCount)
+	{
+		const ScoreTables& tables = GetScoreTables();
+		const size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		//triangles of every vertex, the live ones first, _remaining of them
+		std::vector<UINT> remaining(vertexCount, 0);
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			++remaining[indices[i]];
+		}
+		std::vector<UINT> offsets(vertexCount + 1, 0);
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+		}
+		std::vector<UINT> adjacency(indexCount);
+		{
+			std::vector<UINT> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; ++i)
+			{
+				adjacency[cursor[indices[i]]++] = static_cast<UINT>(i / 3);
+			}
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			vertexScore[vertex] = GetVertexScore(tables, -1, remaining[vertex]);
+		}
+
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<uint8_t> isAdded(triangleCount, 0);
+		int bestTriangle = 0;
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			triangleScore[triangle] = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+			bestTriangle = (triangleScore[triangle] > triangleScore[bestTriangle]) ? static_cast<int>(triangle) : bestTriangle;
+		}
+
+		std::vector<UINT> output;
+		output.reserve(indexCount);
+		UINT cache[FORSYTH_CACHE_SIZE + 3];
+		UINT cacheCount = 0;
+		size_t scanCursor = 0;
+
+		while (output.size() < triangleCount * 3)
+		{
+			//nothing in the cache has triangles left, continue with the next triangle in the original order
+			if (bestTriangle < 0)
+			{
+				while (isAdded[scanCursor])
+				{
+					++scanCursor;
+				}
+				bestTriangle = static_cast<int>(scanCursor);
+			}
+
+			isAdded[bestTriangle] = 1;
+			UINT triangleVertices[3];
+			UINT uniqueCount = 0;
+			for (UINT corner = 0; corner < 3; ++corner)
+			{
+				const UINT vertex = indices[bestTriangle * 3 + corner];
+				output.push_back(vertex);
+
+				UINT* live = adjacency.data() + offsets[vertex];
+				const UINT* found = std::find(live, live + remaining[vertex], static_cast<UINT>(bestTriangle));
+				std::swap(live[found - live], live[remaining[vertex] - 1]);
+				--remaining[vertex];
+
+				if (std::find(triangleVertices, triangleVertices + uniqueCount, vertex) == triangleVertices + uniqueCount)
+				{
+					triangleVertices[uniqueCount++] = vertex;
+				}
+			}
+
+			//the triangle moves to the front of the LRU, whatever falls off the end leaves the cache
+			UINT newCache[FORSYTH_CACHE_SIZE + 3];
+			UINT newCount = 0;
+			for (UINT i = 0; i < uniqueCount; ++i)
+			{
+				newCache[newCount++] = triangleVertices[i];
+			}
+			for (UINT i = 0; i < cacheCount; ++i)
+			{
+				if (std::find(triangleVertices, triangleVertices + uniqueCount, cache[i]) == triangleVertices + uniqueCount)
+				{
+					newCache[newCount++] = cache[i];
+				}
+			}
+
+			for (UINT i = 0; i < newCount; ++i)
+			{
+				const UINT vertex = newCache[i];
+				cachePosition[vertex] = (i < FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+				vertexScore[vertex] = GetVertexScore(tables, cachePosition[vertex], remaining[vertex]);
+			}
+
+			bestTriangle = -1;
+			float bestScore = -FLT_MAX;
+			for (UINT i = 0; i < newCount; ++i)
+			{
+				const UINT vertex = newCache[i];
+				for (UINT j = offsets[vertex]; j < offsets[vertex] + remaining[vertex]; ++j)
+				{
+					const UINT triangle = adjacency[j];
+					const float score = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+					triangleScore[triangle] = score;
+					if (i < FORSYTH_CACHE_SIZE && score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = static_cast<int>(triangle);
+					}
+				}
+			}
+
+			cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	std::vector<UINT> OptimizeVertexFetch(UINT* indices, const size_t indexCount, const size_t vertexCount)
+	{
+		std::vector<UINT> remap(vertexCount, INVALID_INDEX);
+		UINT nextVertex = 0;
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			UINT& newIndex = remap[indices[i]];
+			if (newIndex == INVALID_INDEX)
+			{
+				newIndex = nextVertex++;
+			}
+			indices[i] = newIndex;
+		}
+		for (UINT& newIndex : remap)
+		{
+			newIndex = (newIndex == INVALID_INDEX) ? nextVertex++ : newIndex;
+		}
+		return remap;
+	}
+
+	void RemapVertices(void* vertices, const size_t vertexCount, const size_t vertexStride, const std::vector<UINT>& remap)
+	{
+		ASSERT(remap.size() == vertexCount);
+
+		const std::vector<uint8_t> source(static_cast<uint8_t*>(vertices), static_cast<uint8_t*>(vertices) + vertexCount * vertexStride);
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			memcpy(static_cast<uint8_t*>(vertices) + remap[vertex] * vertexStride, source.data() + vertex * vertexStride, vertexStride);
+		}
+	}
+
+	MeshletData BuildMeshlets(const UINT* indices, const size_t indexCount, const size_t vertexCount, const UINT maxVertices, const UINT maxTriangles)
+	{
+		ASSERT(maxVertices >= 3 && maxVertices <= 256, "Meshlet local indices are bytes");
+		ASSERT(maxTriangles >= 1);
+
+		MeshletData data;
+		std::vector<UINT> localIndex(vertexCount, INVALID_INDEX);
+		Meshlet meshlet = {};
+
+		const auto flush = [&]()
+		{
+			for (UINT i = 0; i < meshlet._vertexCount; ++i)
+			{
+				localIndex[data._vertexIndices[meshlet._vertexOffset + i]] = INVALID_INDEX;
+			}
+			data._meshlets.push_back(meshlet);
+			meshlet = { static_cast<UINT>(data._vertexIndices.size()), 0, static_cast<UINT>(data._primitiveIndices.size() / 3), 0 };
+		};
+
+		for (size_t triangle = 0; triangle < indexCount / 3; ++triangle)
+		{
+			const UINT* corners = indices + triangle * 3;
+			UINT newVertices = 0;
+			for (UINT corner = 0; corner < 3; ++corner)
+			{
+				const bool isRepeated = (corner > 0 && corners[corner] == corners[0]) || (corner > 1 && corners[corner] == corners[1]);
+				newVertices += (localIndex[corners[corner]] == INVALID_INDEX && false == isRepeated) ? 1 : 0;
+			}
+
+			if (meshlet._vertexCount + newVertices > maxVertices || meshlet._triangleCount + 1 > maxTriangles)
+			{
+				flush();
+			}
+
+			for (UINT corner = 0; corner < 3; ++corner)
+			{
+				UINT& local = localIndex[corners[corner]];
+				if (local == INVALID_INDEX)
+				{
+					local = meshlet._vertexCount++;
+					data._vertexIndices.push_back(corners[corner]);
+				}
+				data._primitiveIndices.push_back(static_cast<uint8_t>(local));
+			}
+			++meshlet._triangleCount;
+		}
+
+		if (meshlet._triangleCount > 0)
+		{
+			flush();
+		}
+		return data;
+	}
+
+	MeshReport OptimizeMesh(Mesh& mesh, const Settings& settings)
+	{
+		std::vector<UINT>& indices = *mesh._indices;
+
+		MeshReport report = {};
+		report._before = AnalyzeVertexCache(indices.data(), indices.size(), mesh._vertexCount, settings._fifoCacheSize);
+
+		if (true == settings._optimizeVertexCache)
+		{
+			OptimizeVertexCache(indices.data(), indices.size(), mesh._vertexCount);
+		}
+		if (true == settings._optimizeVertexFetch && nullptr != mesh._vertices)
+		{
+			const std::vector<UINT> remap = OptimizeVertexFetch(indices.data(), indices.size(), mesh._vertexCount);
+			RemapVertices(mesh._vertices, mesh._vertexCount, mesh._vertexStride, remap);
+		}
+
+		report._after = AnalyzeVertexCache(indices.data(), indices.size(), mesh._vertexCount, settings._fifoCacheSize);
+
+		if (true == settings._buildMeshlets && nullptr != mesh._meshlets)
+		{
+			*mesh._meshlets = BuildMeshlets(indices.data(), indices.size(), mesh._vertexCount);
+			report._meshletCount = static_cast<UINT>(mesh._meshlets->_meshlets.size());
+		}
+		return report;
+	}
+
+	std::vector<MeshReport> OptimizeMeshes(std::vector<Mesh>& meshes, const Settings& settings)
+	{
+		std::vector<MeshReport> reports(meshes.size());
+		JobSystem::ParallelFor(0, static_cast<UINT>(meshes.size()), 1, [&](const UINT i)
+		{
+			reports[i] = OptimizeMesh(meshes[i], settings);
+		});
+		return reports;
+	}
+}
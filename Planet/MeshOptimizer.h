@@ -0,0 +1,88 @@
+#pragma once
+
+#include "pch.h"
+#include "types.h"
+
+//Index and vertex reordering for generated meshes, triangle lists only.
+//Vertex cache order follows Tom Forsyth's "Linear-Speed Vertex Cache Optimisation",
+//the vertex fetch order follows the first use of every vertex in the reordered indices.
+namespace MeshOptimizer
+{
+	//LRU cache the Forsyth scores assume
+	constexpr UINT FORSYTH_CACHE_SIZE = 32;
+	//FIFO post transform cache AnalyzeVertexCache simulates
+	constexpr UINT DEFAULT_FIFO_CACHE_SIZE = 16;
+	//mesh shader friendly limits
+	constexpr UINT MESHLET_MAX_VERTICES = 64;
+	constexpr UINT MESHLET_MAX_TRIANGLES = 124;
+
+	struct CacheStatistics
+	{
+		//average cache miss ratio, transformed vertices per triangle, 0.5 at best for large grids
+		float _acmr;
+		//average transformed to vertex ratio, 1 at best
+		float _atvr;
+		UINT _misses;
+	};
+
+	struct Meshlet
+	{
+		UINT _vertexOffset;
+		UINT _vertexCount;
+		UINT _triangleOffset;
+		UINT _triangleCount;
+	};
+
+	struct MeshletData
+	{
+		std::vector<Meshlet> _meshlets;
+		//mesh vertex of every meshlet vertex
+		std::vector<UINT> _vertexIndices;
+		//three meshlet local vertices per triangle
+		std::vector<uint8_t> _primitiveIndices;
+	};
+
+	struct Settings
+	{
+		Settings() : _optimizeVertexCache(true), _optimizeVertexFetch(true), _buildMeshlets(false), _fifoCacheSize(DEFAULT_FIFO_CACHE_SIZE) {}
+
+		bool _optimizeVertexCache;
+		//reorders the vertices themselves, _vertices has to be set
+		bool _optimizeVertexFetch;
+		bool _buildMeshlets;
+		UINT _fifoCacheSize;
+	};
+
+	struct Mesh
+	{
+		std::vector<UINT>* _indices;
+		//optional, _vertexCount vertices of _vertexStride bytes
+		void* _vertices;
+		size_t _vertexCount;
+		size_t _vertexStride;
+		//filled when Settings::_buildMeshlets is set
+		MeshletData* _meshlets;
+	};
+
+	struct MeshReport
+	{
+		CacheStatistics _before;
+		CacheStatistics _after;
+		UINT _meshletCount;
+	};
+
+	CacheStatistics AnalyzeVertexCache(const UINT* indices, const size_t indexCount, const size_t vertexCount, const UINT cacheSize = DEFAULT_FIFO_CACHE_SIZE);
+
+	void OptimizeVertexCache(UINT* indices, const size_t indexCount, const size_t vertexCount);
+	//Renumbers the vertices in order of first use, unreferenced vertices go last. Returns the new index of every old vertex.
+	std::vector<UINT> OptimizeVertexFetch(UINT* indices, const size_t indexCount, const size_t vertexCount);
+	void RemapVertices(void* vertices, const size_t vertexCount, const size_t vertexStride, const std::vector<UINT>& remap);
+
+	//Greedy in index order, run after OptimizeVertexCache so that meshlets stay compact
+	MeshletData BuildMeshlets(const UINT* indices, const size_t indexCount, const size_t vertexCount,
+		const UINT maxVertices = MESHLET_MAX_VERTICES, const UINT maxTriangles = MESHLET_MAX_TRIANGLES);
+
+	MeshReport OptimizeMesh(Mesh& mesh, const Settings& settings);
+	//Meshes are optimized on the worker threads, reports in the order of meshes
+	std::vector<MeshReport> OptimizeMeshes(std::vector<Mesh>& meshes, const Settings& settings);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+//Slots of the persistent descriptor region of the dynamic descriptor heaps (DynamicDescriptorHeap::SetPersistentDescriptor),
+//written by the Create of the textures, see SetPersistentSRV. Shaders read slot N at register tN, see persistentTextures.hlsli,
+//so the per pass SRVs of a root signature start at register PERSISTENT_SRV_COUNT.
+enum PersistentSRV
+{
+	PERSISTENT_SRV_TRANSMITTANCE = 0,
+	PERSISTENT_SRV_AMBIENT,
+	PERSISTENT_SRV_MULTI_SCATTERING,
+	PERSISTENT_SRV_SINGLE_RAYLEIGH_SCATTERING,
+	PERSISTENT_SRV_SINGLE_MIE_SCATTERING,
+	PERSISTENT_SRV_CLOUD_BASE_SHAPE,
+	PERSISTENT_SRV_CLOUD_DETAIL_SHAPE,
+	PERSISTENT_SRV_CLOUD_WEATHER,
+	PERSISTENT_SRV_COUNT
+};
@@ -0,0 +1,155 @@
+#include "PhaseFunction.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace PhaseFunction
+{
+	float HenyeyGreenstein(const float nu, const float g)
+	{
+		const float gg = g * g;
+		const float denom = 1.0f + gg - 2.0f * g * nu;
+		return (1.0f - gg) / (4.0f * FPI * denom * sqrtf(denom));
+	}
+
+	float HenyeyGreensteinSchlickK(const float g)
+	{
+		return 1.55f * g - 0.55f * g * g * g;
+	}
+
+	float HenyeyGreensteinSchlick(const float nu, const float k)
+	{
+		const float denom = 1.0f - k * nu;
+		return (1.0f - k * k) / (4.0f * FPI * denom * denom);
+	}
+
+	float DualLobeHenyeyGreenstein(const float nu, const float gForward, const float gBackward, const float forwardWeight)
+	{
+		const float backward = HenyeyGreenstein(nu, gBackward);
+		return backward + (HenyeyGreenstein(nu, gForward) - backward) * forwardWeight;
+	}
+
+	float CornetteShanks(const float nu, const float g)
+	{
+		const float gg = g * g;
+		const float k = 3.0f / (8.0f * FPI) * (1.0f - gg) / (2.0f + gg);
+		const float denom = 1.0f + gg - 2.0f * g * nu;
+		return k * (1.0f + nu * nu) / (denom * sqrtf(denom));
+	}
+
+	namespace
+	{
+		XMVECTOR XM_CALLCONV HenyeyGreensteinVector(FXMVECTOR nu, const float g)
+		{
+			const float gg = g * g;
+			const XMVECTOR numerator = XMVectorReplicate((1.0f - gg) / (4.0f * FPI));
+			const XMVECTOR denom = XMVectorNegativeMultiplySubtract(XMVectorReplicate(2.0f * g), nu, XMVectorReplicate(1.0f + gg));
+			return XMVectorDivide(numerator, XMVectorMultiply(denom, XMVectorSqrt(denom)));
+		}
+	}
+
+	void HenyeyGreensteinBatch(const float* nu, float* out, const size_t count, const float g)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMVECTOR vnu = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nu + i));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + i), HenyeyGreensteinVector(vnu, g));
+		}
+		for (; i < count; ++i)
+		{
+			out[i] = HenyeyGreenstein(nu[i], g);
+		}
+	}
+
+	void HenyeyGreensteinSchlickBatch(const float* nu, float* out, const size_t count, const float g)
+	{
+		const float k = HenyeyGreensteinSchlickK(g);
+		const XMVECTOR numerator = XMVectorReplicate((1.0f - k * k) / (4.0f * FPI));
+		const XMVECTOR vk = XMVectorReplicate(k);
+		const XMVECTOR one = XMVectorSplatOne();
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMVECTOR vnu = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nu + i));
+			const XMVECTOR denom = XMVectorNegativeMultiplySubtract(vk, vnu, one);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + i), XMVectorDivide(numerator, XMVectorMultiply(denom, denom)));
+		}
+		for (; i < count; ++i)
+		{
+			out[i] = HenyeyGreensteinSchlick(nu[i], k);
+		}
+	}
+
+	void DualLobeHenyeyGreensteinBatch(const float* nu, float* out, const size_t count, const float gForward, const float gBackward, const float forwardWeight)
+	{
+		const XMVECTOR weight = XMVectorReplicate(forwardWeight);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMVECTOR vnu = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nu + i));
+			const XMVECTOR forward = HenyeyGreensteinVector(vnu, gForward);
+			const XMVECTOR backward = HenyeyGreensteinVector(vnu, gBackward);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + i), XMVectorLerpV(backward, forward, weight));
+		}
+		for (; i < count; ++i)
+		{
+			out[i] = DualLobeHenyeyGreenstein(nu[i], gForward, gBackward, forwardWeight);
+		}
+	}
+
+	void CornetteShanksBatch(const float* nu, float* out, const size_t count, const float g)
+	{
+		const float gg = g * g;
+		const XMVECTOR k = XMVectorReplicate(3.0f / (8.0f * FPI) * (1.0f - gg) / (2.0f + gg));
+		const XMVECTOR twoG = XMVectorReplicate(2.0f * g);
+		const XMVECTOR onePlusGG = XMVectorReplicate(1.0f + gg);
+		const XMVECTOR one = XMVectorSplatOne();
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMVECTOR vnu = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nu + i));
+			const XMVECTOR denom = XMVectorNegativeMultiplySubtract(twoG, vnu, onePlusGG);
+			const XMVECTOR numerator = XMVectorMultiply(k, XMVectorMultiplyAdd(vnu, vnu, one));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + i), XMVectorDivide(numerator, XMVectorMultiply(denom, XMVectorSqrt(denom))));
+		}
+		for (; i < count; ++i)
+		{
+			out[i] = CornetteShanks(nu[i], g);
+		}
+	}
+
+	void PhaseFunctionTable::Build(const std::function<float(float)>& phase, const UINT size)
+	{
+		ASSERT(size >= 2);
+
+		_table.resize(size);
+		_scale = static_cast<float>(size - 1) * 0.5f;
+		for (UINT i = 0; i < size; ++i)
+		{
+			const float nu = static_cast<float>(i) / _scale - 1.0f;
+			_table[i] = phase(nu);
+		}
+	}
+
+	float PhaseFunctionTable::Evaluate(const float nu) const
+	{
+		const float position = std::min(std::max((nu + 1.0f) * _scale, 0.0f), static_cast<float>(_table.size() - 1));
+		const size_t index = std::min(static_cast<size_t>(position), _table.size() - 2);
+		const float t = position - static_cast<float>(index);
+		return _table[index] + (_table[index + 1] - _table[index]) * t;
+	}
+
+	void PhaseFunctionTable::EvaluateBatch(const float* nu, float* out, const size_t count) const
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			out[i] = Evaluate(nu[i]);
+		}
+	}
+}
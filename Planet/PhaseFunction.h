@@ -0,0 +1,37 @@
+#pragma once
+
+#include "pch.h"
+#include "types.h"
+#include <functional>
+
+//CPU side of phaseFunctions.hlsli, nu is the cosine between the view direction and the light direction.
+namespace PhaseFunction
+{
+	float HenyeyGreenstein(const float nu, const float g);
+	float HenyeyGreensteinSchlickK(const float g);
+	float HenyeyGreensteinSchlick(const float nu, const float k);
+	float DualLobeHenyeyGreenstein(const float nu, const float gForward, const float gBackward, const float forwardWeight);
+	float CornetteShanks(const float nu, const float g);
+
+	//SIMD batch evaluation, four cosines at a time. The tail of a count that is not a multiple of four falls back to the scalar version.
+	void HenyeyGreensteinBatch(const float* nu, float* out, const size_t count, const float g);
+	void HenyeyGreensteinSchlickBatch(const float* nu, float* out, const size_t count, const float g);
+	void DualLobeHenyeyGreensteinBatch(const float* nu, float* out, const size_t count, const float gForward, const float gBackward, const float forwardWeight);
+	void CornetteShanksBatch(const float* nu, float* out, const size_t count, const float g);
+
+	//Phase function tabulated over nu in [-1, 1] and linearly interpolated
+	class PhaseFunctionTable
+	{
+	public:
+		PhaseFunctionTable() : _scale(0.0f) {}
+
+		void Build(const std::function<float(float)>& phase, const UINT size);
+		float Evaluate(const float nu) const;
+		void EvaluateBatch(const float* nu, float* out, const size_t count) const;
+		size_t GetSize(void) const { return _table.size(); }
+
+	private:
+		std::vector<float> _table;
+		float _scale;
+	};
+}
@@ -1,9 +1,13 @@
 #include "PlanetCamera.h"
 #include "GameInput.h"
 
+#include <algorithm>
+#include <cmath>
+
 PlanetCamera::PlanetCamera(const PlanetCameraSetting& settings, Camera& camera)
 	: CameraController(camera)
 	, _settings(settings)
+	, _worldPosition(0,1,0)
 	, _planetNormal(0,0,0)
 	, _planetTangent(0,0,0)
 	, _currentYaw(0.0)
@@ -12,7 +16,7 @@ PlanetCamera::PlanetCamera(const PlanetCameraSetting& settings, Camera& camera)
 	, _currentPhi(0.0)
 	, _currentTheta(0.0)
 {
-	camera.SetPosition(float3(0, 1, 0));
+	camera.SetPosition(float3(0, 0, 0));
 	camera.SetLookDirection(Vector3(0, 0, 1), Vector3(0, 1, 0));
 }
 
@@ -29,11 +33,11 @@ void PlanetCamera::Movement(const float deltaTime)
 	_currentHeight = _currentHeight < _settings._minHeight ? _settings._minHeight : _currentHeight;
 	_currentHeight = _currentHeight > _settings._maxHeight ? _settings._maxHeight : _currentHeight;
 
-	const Vector3 center = _settings._planetCenter;
-	const Vector3 fowardAxis = static_cast<Vector3>(XMVector3Cross(_planetTangent, _planetNormal));
-	const Vector3 newPosition = center + _planetNormal * _currentHeight;
+	_worldPosition = _settings._planetCenter + _planetNormal * _currentHeight;
 
-	m_TargetCamera.SetPosition(newPosition);
+	//Rendering is camera relative, the camera stays at the render origin and the shaders
+	//get the planet center relative to it, see Planet::RenderScene
+	m_TargetCamera.SetPosition(float3(0, 0, 0));
 }
 
 void PlanetCamera::Rotation(const float deltaTime)
@@ -60,10 +64,7 @@ void PlanetCamera::Rotation(const float deltaTime)
 
 void PlanetCamera::UpdateCameraUpVector()
 {
-	const Vector3 center = _settings._planetCenter;
-	const Vector3 position = m_TargetCamera.GetPosition();
-	const Vector3 direction = Normalize(position - center);
-	_planetNormal = direction;
-	const float cosTheta = Dot(_planetNormal, float3(1,0,0));
+	_planetNormal = Normalize(_worldPosition - _settings._planetCenter);
+	const float cosTheta = static_cast<float>(_planetNormal.x);
 	_planetTangent = float3(cosTheta, 0.0f, sqrtf(1.0f - cosTheta * cosTheta));
 }
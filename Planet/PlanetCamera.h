@@ -8,7 +8,7 @@ class PlanetCamera  : public CameraController
 {
 public:
 	struct PlanetCameraSetting {
-		explicit PlanetCameraSetting(const float3& planetCenter, const float minHeight, const float maxHeight, const float rotationSpeed = 1.0, const float movementSpeed = 1.0)
+		explicit PlanetCameraSetting(const double3& planetCenter, const double minHeight, const double maxHeight, const float rotationSpeed = 1.0, const float movementSpeed = 1.0)
 		:_planetCenter(planetCenter)
 		,_minHeight(minHeight)
 		,_maxHeight(maxHeight)
@@ -16,9 +16,9 @@ public:
 		,_movementSpeed(movementSpeed)
 		{}
 
-		float3 _planetCenter;
-		float _minHeight;
-		float _maxHeight;
+		double3 _planetCenter;
+		double _minHeight;
+		double _maxHeight;
 		float _rotationSpeed;
 		float _movementSpeed;
 	};
@@ -29,6 +29,9 @@ public:
 public:
 	virtual void Update(float deltaTime) override;
 
+	//The Math::Camera stays at the render origin, this is the double precision world position
+	const double3& GetWorldPosition(void) const { return _worldPosition; }
+
 private:
 	void Movement(const float deltaTime);
 	void Rotation(const float deltaTime);
@@ -36,13 +39,14 @@ private:
 
 private:
 	PlanetCameraSetting _settings;
-	Vector3 _planetNormal;
+	double3 _worldPosition;
+	double3 _planetNormal;
 	Vector3 _planetTangent;
 
 	float _currentYaw;
 	float _currentPitch;
 
-	float _currentHeight;
+	double _currentHeight;
 	float _currentPhi;
 	float _currentTheta;
 };
@@ -0,0 +1,406 @@
+#include "PlanetQuadTree.h"
+#include "MeshOptimizer.h"
+#include "TerrainStreaming.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	//normal, u axis and v axis of every cube face, u x v is the normal so that all faces wind the same way
+	constexpr double FACE_FRAMES[6][3][3] = {
+		{ { +1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+		{ { -1, 0, 0 }, { 0, 0, +1 }, { 0, 1, 0 } },
+		{ { 0, +1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, +1 } },
+		{ { 0, 0, +1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+	};
+
+	constexpr UINT FACE_COUNT = 6;
+	//detail is lowered by this factor per try until the selection fits the triangle budget
+	constexpr double DETAIL_SCALE_STEP = 0.7;
+	constexpr UINT MAX_DETAIL_TRIES = 24;
+
+	struct SelectionCandidate
+	{
+		PlanetQuadTree::NodeKey _key;
+		double _distance;
+	};
+
+	double3 Lerp(const double3& a, const double3& b, const double t)
+	{
+		return a + (b - a) * t;
+	}
+}
+
+namespace PlanetQuadTree
+{
+	QuadTreeSettings _settings;
+	HeightFunction _heightFunction;
+	std::vector<UINT> _chunkIndices;
+	//grid vertex to position in the chunk vertex buffers
+	std::vector<UINT> _chunkVertexRemap;
+	std::vector<SelectedNode> _drawList;
+	FrameStats _frameStats = {};
+
+	namespace
+	{
+		double GetRange(const UINT level, const double detailScale)
+		{
+			return _settings._leafRange * detailScale * static_cast<double>(1ull << (_settings._maxLevel - level));
+		}
+
+		double3 GetNodeCenter(const NodeKey& key)
+		{
+			const double size = 1.0 / static_cast<double>(1u << key._level);
+			return CubeToSphere(key._face, (key._x + 0.5) * size, (key._y + 0.5) * size) * _settings._radius;
+		}
+
+		//Bounding sphere over the node on the surface and up to _maxHeight above it
+		double GetNodeDistance(const NodeKey& key, const double3& cameraPosition)
+		{
+			const double size = 1.0 / static_cast<double>(1u << key._level);
+			const double u0 = key._x * size;
+			const double v0 = key._y * size;
+			const double3 center = GetNodeCenter(key);
+
+			double radius = 0.0;
+			for (UINT corner = 0; corner < 4; ++corner)
+			{
+				const double3 position = CubeToSphere(key._face, u0 + size * (corner & 1), v0 + size * (corner >> 1)) * _settings._radius;
+				radius = std::max(radius, Length(position - center));
+			}
+			radius += _settings._maxHeight;
+
+			return std::max(Length(cameraPosition - center) - radius, 0.0);
+		}
+
+		//CDLOD selection: a node is split while its children are in range of their level.
+		//Returns false as soon as the selection outgrows maxNodes.
+		bool SelectNode(const NodeKey& key, const double3& cameraPosition, const double detailScale, const size_t maxNodes, std::vector<SelectionCandidate>& selection)
+		{
+			const double distance = GetNodeDistance(key, cameraPosition);
+			if (key._level == _settings._maxLevel || distance > GetRange(key._level + 1, detailScale))
+			{
+				if (selection.size() >= maxNodes)
+				{
+					return false;
+				}
+				selection.push_back({ key, distance });
+				return true;
+			}
+
+			for (UINT child = 0; child < 4; ++child)
+			{
+				const NodeKey childKey = { key._face, key._level + 1, key._x * 2 + (child & 1), key._y * 2 + (child >> 1) };
+				if (false == SelectNode(childKey, cameraPosition, detailScale, maxNodes, selection))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		SelectedNode MakeSelectedNode(const NodeKey& key, const double detailScale, const TerrainStreaming::ResidentChunk& chunk)
+		{
+			//root nodes have no parent to morph into
+			if (key._level == 0)
+			{
+				return { key, FLT_MAX, FLT_MAX, chunk._chunk, chunk._vertexAddress, chunk._morphTargetAddress };
+			}
+
+			const double morphEnd = GetRange(key._level, detailScale);
+			const double morphStart = morphEnd * (0.5 + 0.5 * _settings._morphStartRatio);
+			return { key, static_cast<float>(morphStart), static_cast<float>(morphEnd), chunk._chunk, chunk._vertexAddress, chunk._morphTargetAddress };
+		}
+
+		void BuildChunkIndices(void)
+		{
+			constexpr UINT rowPitch = GRID_SIZE + 1;
+
+			//every quad is split along the same diagonal as its parent quad, odd vertices then morph onto parent triangles.
+			//Counter clockwise seen from outside the planet.
+			_chunkIndices.clear();
+			_chunkIndices.reserve(TRIANGLES_PER_CHUNK * 3);
+			for (UINT y = 0; y < GRID_SIZE; ++y)
+			{
+				for (UINT x = 0; x < GRID_SIZE; ++x)
+				{
+					const UINT a = y * rowPitch + x;
+					const UINT b = a + 1;
+					const UINT c = a + rowPitch;
+					const UINT d = c + 1;
+
+					_chunkIndices.push_back(a);
+					_chunkIndices.push_back(b);
+					_chunkIndices.push_back(d);
+
+					_chunkIndices.push_back(a);
+					_chunkIndices.push_back(d);
+					_chunkIndices.push_back(c);
+				}
+			}
+
+			//every chunk shares the grid, so it is optimized once and the vertex order is applied to every generated chunk
+			constexpr UINT vertexCount = rowPitch * rowPitch;
+			const MeshOptimizer::CacheStatistics before = MeshOptimizer::AnalyzeVertexCache(_chunkIndices.data(), _chunkIndices.size(), vertexCount);
+			MeshOptimizer::OptimizeVertexCache(_chunkIndices.data(), _chunkIndices.size(), vertexCount);
+			_chunkVertexRemap = MeshOptimizer::OptimizeVertexFetch(_chunkIndices.data(), _chunkIndices.size(), vertexCount);
+			const MeshOptimizer::CacheStatistics after = MeshOptimizer::AnalyzeVertexCache(_chunkIndices.data(), _chunkIndices.size(), vertexCount);
+			Utility::Printf("Planet chunk grid, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before._acmr, after._acmr, before._atvr, after._atvr);
+		}
+	}
+
+	double3 CubeToSphere(const UINT face, const double u, const double v)
+	{
+		const double (&frame)[3][3] = FACE_FRAMES[face];
+		const double s = u * 2.0 - 1.0;
+		const double t = v * 2.0 - 1.0;
+		const double x = frame[0][0] + frame[1][0] * s + frame[2][0] * t;
+		const double y = frame[0][1] + frame[1][1] * s + frame[2][1] * t;
+		const double z = frame[0][2] + frame[1][2] * s + frame[2][2] * t;
+
+		//area preserving cube to sphere mapping, texels stay close in size from face centers to the corners
+		const double xx = x * x, yy = y * y, zz = z * z;
+		const double3 direction(
+			x * sqrt(std::max(1.0 - yy * 0.5 - zz * 0.5 + yy * zz / 3.0, 0.0)),
+			y * sqrt(std::max(1.0 - zz * 0.5 - xx * 0.5 + zz * xx / 3.0, 0.0)),
+			z * sqrt(std::max(1.0 - xx * 0.5 - yy * 0.5 + xx * yy / 3.0, 0.0)));
+		return Normalize(direction);
+	}
+
+	void GenerateChunkVertices(const NodeKey& key, const QuadTreeSettings& settings, const HeightFunction& heightFunction,
+		double3& origin, std::vector<Geometry::Vertex>& vertices, std::vector<float3>& morphTargets)
+	{
+		//one vertex of border around the grid for the normals
+		constexpr int border = 1;
+		constexpr int samplePitch = GRID_SIZE + 1 + border * 2;
+		constexpr UINT rowPitch = GRID_SIZE + 1;
+
+		const double size = 1.0 / static_cast<double>(1u << key._level);
+		const double step = size / GRID_SIZE;
+		const double u0 = key._x * size;
+		const double v0 = key._y * size;
+
+		origin = CubeToSphere(key._face, u0 + size * 0.5, v0 + size * 0.5) * settings._radius;
+
+		std::vector<double3> positions(samplePitch * samplePitch);
+		std::vector<double3> directions(samplePitch * samplePitch);
+		for (int y = -border; y <= static_cast<int>(GRID_SIZE) + border; ++y)
+		{
+			for (int x = -border; x <= static_cast<int>(GRID_SIZE) + border; ++x)
+			{
+				const size_t sample = (y + border) * samplePitch + (x + border);
+				const double3 direction = CubeToSphere(key._face, u0 + x * step, v0 + y * step);
+				const double height = heightFunction ? heightFunction(direction) : 0.0;
+				directions[sample] = direction;
+				positions[sample] = direction * (settings._radius + height);
+			}
+		}
+
+		const auto P = [&](const int x, const int y) -> const double3& { return positions[(y + border) * samplePitch + (x + border)]; };
+
+		vertices.resize(rowPitch * rowPitch);
+		morphTargets.resize(rowPitch * rowPitch);
+		for (int y = 0; y <= static_cast<int>(GRID_SIZE); ++y)
+		{
+			for (int x = 0; x <= static_cast<int>(GRID_SIZE); ++x)
+			{
+				const double3& position = P(x, y);
+
+				double3 normal = directions[(y + border) * samplePitch + (x + border)];
+				if (heightFunction)
+				{
+					const double3 du = P(x + 1, y) - P(x - 1, y);
+					const double3 dv = P(x, y + 1) - P(x, y - 1);
+					normal = Normalize(double3(du.y * dv.z - du.z * dv.y, du.z * dv.x - du.x * dv.z, du.x * dv.y - du.y * dv.x));
+				}
+
+				//odd rows and columns slide onto the parent edge or, in the middle of a parent quad, onto its diagonal
+				double3 morphTarget = position;
+				const bool isOddX = (x & 1) != 0;
+				const bool isOddY = (y & 1) != 0;
+				if (isOddX && isOddY)
+				{
+					morphTarget = Lerp(P(x - 1, y - 1), P(x + 1, y + 1), 0.5);
+				}
+				else if (isOddX)
+				{
+					morphTarget = Lerp(P(x - 1, y), P(x + 1, y), 0.5);
+				}
+				else if (isOddY)
+				{
+					morphTarget = Lerp(P(x, y - 1), P(x, y + 1), 0.5);
+				}
+
+				const UINT vertex = y * rowPitch + x;
+				vertices[vertex] = Geometry::Vertex(
+					ToRelativeFloat3(position, origin),
+					ToRelativeFloat3(normal, double3()),
+					float2(static_cast<float>(u0 + x * step), static_cast<float>(v0 + y * step)));
+				morphTargets[vertex] = ToRelativeFloat3(morphTarget, origin);
+			}
+		}
+	}
+
+	std::shared_ptr<Chunk> GenerateChunk(const NodeKey& key, const QuadTreeSettings& settings, const HeightFunction& heightFunction)
+	{
+		std::vector<Geometry::Vertex> vertices;
+		std::vector<float3> morphTargets;
+
+		std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+		chunk->_key = key;
+		GenerateChunkVertices(key, settings, heightFunction, chunk->_origin, vertices, morphTargets);
+		MeshOptimizer::RemapVertices(vertices.data(), vertices.size(), sizeof(Geometry::Vertex), _chunkVertexRemap);
+		MeshOptimizer::RemapVertices(morphTargets.data(), morphTargets.size(), sizeof(float3), _chunkVertexRemap);
+
+		//morph targets are midpoints of grid vertices and stay inside the bounds
+		chunk->_bounds = VertexPacking::ComputeBounds(vertices.data(), vertices.size());
+		chunk->_vertices.resize(vertices.size());
+		chunk->_morphTargets.resize(morphTargets.size());
+		VertexPacking::EncodeBatch(vertices.data(), chunk->_vertices.data(), vertices.size(), chunk->_bounds);
+		VertexPacking::EncodePositionBatch(morphTargets.data(), chunk->_morphTargets.data(), morphTargets.size(), chunk->_bounds);
+		return chunk;
+	}
+
+	void Initialize(const QuadTreeSettings& settings, const TerrainStreaming::StreamingSettings& streamingSettings, const HeightFunction& heightFunction)
+	{
+		ASSERT(settings._maxLevel <= MAX_LEVEL);
+		ASSERT(settings._maxTriangles >= FACE_COUNT * TRIANGLES_PER_CHUNK, "The triangle budget has to hold the six root chunks");
+
+		_settings = settings;
+		_heightFunction = heightFunction;
+		_drawList.clear();
+		_frameStats = {};
+		BuildChunkIndices();
+		TerrainStreaming::Initialize(streamingSettings, settings, heightFunction);
+	}
+
+	void Shutdown(void)
+	{
+		TerrainStreaming::Shutdown();
+		_drawList.clear();
+		_heightFunction = nullptr;
+	}
+
+	void Update(const double3& cameraPosition, const double3& viewDirection)
+	{
+		//lower the detail until the selection fits the triangle budget, the six roots always do
+		const size_t maxNodes = _settings._maxTriangles / TRIANGLES_PER_CHUNK;
+		std::vector<SelectionCandidate> selection;
+		double detailScale = 1.0;
+		bool isInBudget = false;
+		for (UINT tries = 0; tries < MAX_DETAIL_TRIES; ++tries, detailScale *= DETAIL_SCALE_STEP)
+		{
+			selection.clear();
+			isInBudget = true;
+			for (UINT face = 0; face < FACE_COUNT && isInBudget; ++face)
+			{
+				isInBudget = SelectNode({ face, 0, 0, 0 }, cameraPosition, detailScale, maxNodes, selection);
+			}
+			if (true == isInBudget)
+			{
+				break;
+			}
+		}
+		if (false == isInBudget)
+		{
+			selection.clear();
+			for (UINT face = 0; face < FACE_COUNT; ++face)
+			{
+				selection.push_back({ { face, 0, 0, 0 }, 0.0 });
+			}
+		}
+
+		//a missing node is requested once its parent is resident, so detail streams in coarse to fine without holes
+		std::unordered_map<uint64_t, TerrainStreaming::ChunkRequest> requests;
+		UINT pendingCount = 0;
+		for (const SelectionCandidate& candidate : selection)
+		{
+			NodeKey key = candidate._key;
+			if (true == TerrainStreaming::IsResident(key))
+			{
+				continue;
+			}
+			++pendingCount;
+			while (key._level > 1 && false == TerrainStreaming::IsResident(key.GetParent()))
+			{
+				key = key.GetParent();
+			}
+
+			const double priority = TerrainStreaming::GetPriority(candidate._distance, GetNodeCenter(key) - cameraPosition, viewDirection);
+			const auto inserted = requests.insert({ key.Pack(), { key, priority } });
+			if (false == inserted.second)
+			{
+				inserted.first->second._priority = std::min(inserted.first->second._priority, priority);
+			}
+		}
+		std::vector<TerrainStreaming::ChunkRequest> requestList;
+		requestList.reserve(requests.size());
+		for (const auto& request : requests)
+		{
+			requestList.push_back(request.second);
+		}
+		TerrainStreaming::RequestChunks(requestList);
+
+		//a node without a chunk yet is drawn by its closest resident ancestor, which then covers all of its selected descendants
+		std::vector<NodeKey> drawKeys(selection.size());
+		std::unordered_set<uint64_t> fallbacks;
+		for (size_t i = 0; i < selection.size(); ++i)
+		{
+			NodeKey key = selection[i]._key;
+			while (key._level > 0 && false == TerrainStreaming::IsResident(key))
+			{
+				key = key.GetParent();
+			}
+			drawKeys[i] = key;
+			if (key._level != selection[i]._key._level)
+			{
+				fallbacks.insert(key.Pack());
+			}
+		}
+
+		_drawList.clear();
+		std::unordered_set<uint64_t> drawn;
+		for (const NodeKey& drawKey : drawKeys)
+		{
+			bool isCovered = false;
+			for (NodeKey ancestor = drawKey; ancestor._level > 0 && false == isCovered;)
+			{
+				ancestor = ancestor.GetParent();
+				isCovered = fallbacks.count(ancestor.Pack()) != 0;
+			}
+			if (true == isCovered || false == drawn.insert(drawKey.Pack()).second)
+			{
+				continue;
+			}
+			_drawList.push_back(MakeSelectedNode(drawKey, detailScale, TerrainStreaming::FindResident(drawKey)));
+		}
+
+		_frameStats._selectedNodes = static_cast<UINT>(selection.size());
+		_frameStats._drawnChunks = static_cast<UINT>(_drawList.size());
+		_frameStats._triangles = static_cast<UINT>(_drawList.size()) * TRIANGLES_PER_CHUNK;
+		_frameStats._pendingChunks = pendingCount;
+		_frameStats._requestedChunks = static_cast<UINT>(requestList.size());
+		_frameStats._detailScale = detailScale;
+	}
+
+	const std::vector<SelectedNode>& GetDrawList(void)
+	{
+		return _drawList;
+	}
+
+	const FrameStats& GetFrameStats(void)
+	{
+		return _frameStats;
+	}
+
+	const std::vector<UINT>& GetChunkIndices(void)
+	{
+		return _chunkIndices;
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "pch.h"
+#include "Geometry.h"
+#include "VertexPacking.h"
+#include "types.h"
+
+#include <functional>
+
+namespace TerrainStreaming
+{
+	struct StreamingSettings;
+}
+
+//Cube-sphere planet surface split into a quadtree per cube face, drawn as CDLOD chunks (Strugar, Continuous Distance-Dependent Level of Detail).
+//Every node is the same grid of GRID_SIZE x GRID_SIZE quads, nodes are selected by distance ranges doubling per level
+//and their vertices morph towards the grid of the parent before the parent takes over, so neighbouring levels meet without seams.
+//Positions are planet relative, the planet center is the origin like in the shaders.
+namespace PlanetQuadTree
+{
+	//quads per chunk side, even so that every odd vertex has a parent edge to morph onto
+	constexpr UINT GRID_SIZE = 32;
+	constexpr UINT TRIANGLES_PER_CHUNK = GRID_SIZE * GRID_SIZE * 2;
+	constexpr UINT MAX_LEVEL = 20;
+
+	//Height above the planet radius for a unit direction, km
+	typedef std::function<double(const double3&)> HeightFunction;
+
+	struct NodeKey
+	{
+		UINT _face;
+		UINT _level;
+		UINT _x;
+		UINT _y;
+
+		//3 bits face, 5 bits level, 28 bits per axis
+		uint64_t Pack(void) const { return static_cast<uint64_t>(_face) | (static_cast<uint64_t>(_level) << 3) | (static_cast<uint64_t>(_x) << 8) | (static_cast<uint64_t>(_y) << 36); }
+		NodeKey GetParent(void) const { return { _face, _level - 1, _x >> 1, _y >> 1 }; }
+	};
+
+	struct QuadTreeSettings
+	{
+		QuadTreeSettings() : _radius(6360.0), _maxHeight(0.0), _maxLevel(14), _leafRange(2.0), _morphStartRatio(0.66), _maxTriangles(1 << 20) {}
+
+		double _radius;
+		//upper bound of the height function, km, widens the node bounds
+		double _maxHeight;
+		UINT _maxLevel;
+		//selection range of the finest level, km, doubles per coarser level
+		double _leafRange;
+		//part of its range after which a node starts to morph towards its parent
+		double _morphStartRatio;
+		//the detail is lowered until a selection fits
+		UINT _maxTriangles;
+	};
+
+	struct Chunk
+	{
+		NodeKey _key;
+		//on the planet surface under the chunk center, vertex positions are relative to it
+		double3 _origin;
+		//vertices and morph targets are quantized inside the same bounds
+		VertexPacking::QuantizationBounds _bounds;
+		//(GRID_SIZE + 1)^2 vertices in the order of GetChunkIndices, uv in [0, 1] over the cube face
+		std::vector<VertexPacking::PackedVertex> _vertices;
+		//where every vertex lands on the grid of the parent
+		std::vector<VertexPacking::PackedPosition> _morphTargets;
+	};
+
+	//A selected node and the distances its vertices morph between, km
+	struct SelectedNode
+	{
+		NodeKey _key;
+		float _morphStart;
+		float _morphEnd;
+		std::shared_ptr<const Chunk> _chunk;
+		//the chunk inside the terrain streaming pool
+		D3D12_GPU_VIRTUAL_ADDRESS _vertexAddress;
+		D3D12_GPU_VIRTUAL_ADDRESS _morphTargetAddress;
+	};
+
+	struct FrameStats
+	{
+		UINT _selectedNodes;
+		UINT _drawnChunks;
+		UINT _triangles;
+		//selected nodes drawn by an ancestor until their chunk is streamed in
+		UINT _pendingChunks;
+		UINT _requestedChunks;
+		//scale applied to the ranges to stay inside the triangle budget, 1 at full detail
+		double _detailScale;
+	};
+
+	//Starts the terrain streaming, the height function is called from job system threads
+	void Initialize(const QuadTreeSettings& settings, const TerrainStreaming::StreamingSettings& streamingSettings, const HeightFunction& heightFunction = HeightFunction());
+	void Shutdown(void);
+
+	//Selects nodes for a planet relative camera position, requests missing chunks from the terrain streaming
+	//and falls back to the closest resident ancestor for chunks still missing
+	void Update(const double3& cameraPosition, const double3& viewDirection);
+
+	//Chunks to draw this frame, at most _maxTriangles triangles
+	const std::vector<SelectedNode>& GetDrawList(void);
+	const FrameStats& GetFrameStats(void);
+
+	//Triangle list shared by every chunk, (GRID_SIZE + 1)^2 vertices
+	const std::vector<UINT>& GetChunkIndices(void);
+
+	double3 CubeToSphere(const UINT face, const double u, const double v);
+	//Full precision chunk grid in rows, positions and morph targets relative to origin
+	void GenerateChunkVertices(const NodeKey& key, const QuadTreeSettings& settings, const HeightFunction& heightFunction,
+		double3& origin, std::vector<Geometry::Vertex>& vertices, std::vector<float3>& morphTargets);
+	std::shared_ptr<Chunk> GenerateChunk(const NodeKey& key, const QuadTreeSettings& settings, const HeightFunction& heightFunction);
+}
@@ -1,128 +1,209 @@
 #include "RTHelper.h"
+#include "Display.h"
+#include "CommandListManager.h"
+#include "FencedReleaseQueue.h"
 
 namespace RTHelper
 {
-	bool tlas::Initialize(UINT maxInstance)
+	namespace
 	{
-		ASSERT(_instanceDescsResource == nullptr);
-		D3D12_HEAP_PROPERTIES properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC resource_desc = CD3DX12_RESOURCE_DESC::Buffer
-		(
-			sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * maxInstance,
-			D3D12_RESOURCE_FLAG_NONE,
-			0
-		);
+		FencedReleaseQueue<CComPtr<ID3D12Resource>> s_RetiredBuffers;
 
-		Graphics::g_Device->CreateCommittedResource(
-			&properties,
-			D3D12_HEAP_FLAG_NONE,
-			&resource_desc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&_instanceDescsResource)
-		);
+		CComPtr<ID3D12Resource> CreateBuffer(UINT64 size, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES state)
+		{
+			CComPtr<ID3D12Resource> buffer;
+			auto properties = CD3DX12_HEAP_PROPERTIES(heapType);
+			CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(size, flags);
+			Graphics::g_Device->CreateCommittedResource(
+				&properties,
+				D3D12_HEAP_FLAG_NONE,
+				&buffer_desc,
+				state,
+				nullptr,
+				IID_PPV_ARGS(&buffer)
+			);
+			return buffer;
+		}
 
-		return _instanceDescsResource != nullptr;
-	}
+		CComPtr<ID3D12Device5> GetRaytracingDevice()
+		{
+			CComPtr<ID3D12Device5> device;
+			Graphics::g_Device->QueryInterface(IID_PPV_ARGS(&device));
+			return device;
+		}
 
-	bool tlas::Generate(ComputeContext& context) {
+		// Keeps the buffer while it is large enough, otherwise retires it and creates one of the grown size
+		bool EnsureBuffer(CComPtr<ID3D12Resource>& buffer, GrowOnlySize& size, UINT64 required, D3D12_RESOURCE_STATES state)
 		{
-			UINT8* p_data;
-			ASSERT(_instanceDescsResource != nullptr);
-			HRESULT hr = (_instanceDescsResource->Map(0, nullptr, reinterpret_cast<void**>(&p_data)));
-			if (true == FAILED(hr)) { return false; }
-			::memcpy(p_data, _instanceDescs.data(), _instanceDescs.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
-			_instanceDescsResource->Unmap(0, nullptr);
+			if (false == size.Reserve(required, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT) && buffer != nullptr) {
+				return true;
+			}
+			RetireBuffer(buffer);
+			buffer = CreateBuffer(size.Capacity, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, state);
+			return buffer != nullptr;
 		}
 
-		CComPtr<ID3D12Device5> device;
+		void AddUAVBarrier(ID3D12GraphicsCommandList4* commandList, ID3D12Resource* resource)
 		{
-			HRESULT hr = Graphics::g_Device->QueryInterface(IID_PPV_ARGS(&device));
-			if (true == FAILED(hr)) { return false; }
+			D3D12_RESOURCE_BARRIER uav_barrier;
+			uav_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			uav_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+			uav_barrier.UAV.pResource = resource;
+			commandList->ResourceBarrier(1, &uav_barrier);
 		}
+	}
 
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+	void RetireBuffer(CComPtr<ID3D12Resource>& buffer)
+	{
+		if (buffer != nullptr) {
+			s_RetiredBuffers.Retire(buffer);
+			buffer.Release();
+		}
+	}
+
+	void OnFrameSubmitted(UINT64 graphicsFence)
+	{
+		s_RetiredBuffers.OnFrameSubmitted(graphicsFence);
+		s_RetiredBuffers.Release([](UINT64 fence) { return Graphics::g_CommandManager.IsFenceComplete(fence); });
+	}
+
+	void ReleaseRetiredBuffers()
+	{
+		s_RetiredBuffers.ReleaseAll();
+	}
+
+	bool tlas::Generate(ComputeContext& context) {
+		const UINT64 frame = Graphics::GetFrameCount();
+
+		TlasBuildKind kind = _tracker.GetPendingBuild();
+		if (kind == TlasBuildKind::None) { return true; }
+
+		CComPtr<ID3D12Device5> device = GetRaytracingDevice();
+		if (device == nullptr) { return false; }
+
+		if (true == _tracker.ReserveInstanceRing()) {
+			if (_instanceDescsResource != nullptr) {
+				_instanceDescsResource->Unmap(0, nullptr);
+				_mappedInstanceDescs = nullptr;
+				RetireBuffer(_instanceDescsResource);
+			}
+
+			_instanceDescsResource = CreateBuffer(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * _tracker.GetRegionCapacity() * FRAMES_IN_FLIGHT,
+				D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+			if (_instanceDescsResource == nullptr) { return false; }
+
+			// upload heaps may stay mapped for their whole lifetime
+			HRESULT hr = _instanceDescsResource->Map(0, nullptr, reinterpret_cast<void**>(&_mappedInstanceDescs));
+			if (true == FAILED(hr)) {
+				_instanceDescsResource.Release();
+				return false;
+			}
+		}
+
+		const UINT region = static_cast<UINT>(frame % FRAMES_IN_FLIGHT);
+		const UINT64 regionOffset = static_cast<UINT64>(region) * _tracker.GetRegionCapacity();
+		_tracker.WriteInstances(reinterpret_cast<TlasInstanceDesc*>(_mappedInstanceDescs + regionOffset), region);
 
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS as_input = {};
 		as_input.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 		as_input.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-		as_input.InstanceDescs = _instanceDescsResource->GetGPUVirtualAddress();
-		as_input.NumDescs = _instanceDescs.size();
-		as_input.Flags = buildFlags;
-
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuild_info;
-		device->GetRaytracingAccelerationStructurePrebuildInfo(&as_input, &prebuild_info);
-
-		prebuild_info.ScratchDataSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ScratchDataSizeInBytes);
-		prebuild_info.ResultDataMaxSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ResultDataMaxSizeInBytes);
-
-		auto properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-		CD3DX12_RESOURCE_DESC scratch_buf_desc = CD3DX12_RESOURCE_DESC::Buffer(prebuild_info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-		ASSERT(_scratchBuffer == nullptr);
-		device->CreateCommittedResource(
-			&properties,
-			D3D12_HEAP_FLAG_NONE,
-			&scratch_buf_desc,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			nullptr,
-			IID_PPV_ARGS(&_scratchBuffer)
-		);
-		if (_scratchBuffer == nullptr) { return false; }
-
-		CD3DX12_RESOURCE_DESC resoult_buf_desc = CD3DX12_RESOURCE_DESC::Buffer(prebuild_info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-		ASSERT(_resultDataBuffer == nullptr);
-		device->CreateCommittedResource(
-			&properties,
-			D3D12_HEAP_FLAG_NONE,
-			&resoult_buf_desc,
-			D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-			nullptr,
-			IID_PPV_ARGS(&_resultDataBuffer)
-		);
-		if (_resultDataBuffer == nullptr) {
-			_scratchBuffer.Release();
-			return false;
+		as_input.InstanceDescs = _instanceDescsResource->GetGPUVirtualAddress() + sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * regionOffset;
+		as_input.NumDescs = _tracker.GetInstanceCount();
+		as_input.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+
+		if (kind == TlasBuildKind::Rebuild) {
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuild_info;
+			device->GetRaytracingAccelerationStructurePrebuildInfo(&as_input, &prebuild_info);
+
+			const UINT64 scratchSize = (prebuild_info.ScratchDataSizeInBytes > prebuild_info.UpdateScratchDataSizeInBytes) ?
+				prebuild_info.ScratchDataSizeInBytes : prebuild_info.UpdateScratchDataSizeInBytes;
+			if (false == EnsureBuffer(_scratchBuffer, _scratchSize, scratchSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) { return false; }
+			if (false == EnsureBuffer(_resultDataBuffer, _resultSize, prebuild_info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE)) { return false; }
+		}
+		else {
+			// the instance count and order are unchanged, the buffers fit
+			as_input.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
 		}
 
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC build_desc = {};
 		build_desc.Inputs = as_input;
-
 		build_desc.ScratchAccelerationStructureData = _scratchBuffer->GetGPUVirtualAddress();
 		build_desc.DestAccelerationStructureData = _resultDataBuffer->GetGPUVirtualAddress();
+		build_desc.SourceAccelerationStructureData = (kind == TlasBuildKind::Refit) ? _resultDataBuffer->GetGPUVirtualAddress() : 0;
 
 		CComPtr<ID3D12GraphicsCommandList4> raytracingCommandList;
 		context.GetCommandList()->QueryInterface(IID_PPV_ARGS(&raytracingCommandList));
 		raytracingCommandList->BuildRaytracingAccelerationStructure(&build_desc, 0, nullptr);
+		AddUAVBarrier(raytracingCommandList, _resultDataBuffer);
+
+		// nothing recorded from here on points at the old bottom levels, they wait for the end of this frame
+		if (kind == TlasBuildKind::Rebuild) {
+			for (CComPtr<ID3D12Resource>& buffer : _heldUntilRebuild) {
+				RetireBuffer(buffer);
+			}
+			_heldUntilRebuild.clear();
+		}
+
+		_tracker.OnBuilt(kind);
 		return true;
 	}
 
-	void tlas::AddInstance(D3D12_RAYTRACING_INSTANCE_DESC& instDesc) {
-		_instanceDescs.push_back(instDesc);
+	UINT tlas::AddInstance(const D3D12_RAYTRACING_INSTANCE_DESC& instDesc) {
+		return _tracker.AddInstance(reinterpret_cast<const TlasInstanceDesc&>(instDesc));
+	}
+
+	void tlas::RemoveInstance(UINT handle) {
+		_tracker.RemoveInstance(handle);
+	}
+
+	void tlas::SetTransform(UINT handle, const FLOAT transform[3][4]) {
+		_tracker.SetTransform(handle, transform);
+	}
+
+	void tlas::SetInstance(UINT handle, const D3D12_RAYTRACING_INSTANCE_DESC& instDesc) {
+		_tracker.SetInstance(handle, reinterpret_cast<const TlasInstanceDesc&>(instDesc));
+	}
+
+	void tlas::ReplaceBottomLevel(D3D12_GPU_VIRTUAL_ADDRESS oldAddress, D3D12_GPU_VIRTUAL_ADDRESS newAddress, CComPtr<ID3D12Resource>& oldBuffer) {
+		if (_tracker.ReplaceBottomLevel(oldAddress, newAddress) > 0 && oldBuffer != nullptr) {
+			_heldUntilRebuild.push_back(oldBuffer);
+			oldBuffer.Release();
+		}
+		else {
+			RetireBuffer(oldBuffer);
+		}
 	}
 
 	void tlas::Clear() {
-		_instanceDescs.clear();
-		_instanceDescs.shrink_to_fit();
+		_tracker.Clear();
+	}
+
+	void tlas::Destroy() {
+		_tracker = TlasInstanceTracker(FRAMES_IN_FLIGHT);
+		if (_instanceDescsResource != nullptr) {
+			_instanceDescsResource->Unmap(0, nullptr);
+		}
+		_mappedInstanceDescs = nullptr;
+		_scratchSize = GrowOnlySize();
+		_resultSize = GrowOnlySize();
 		_scratchBuffer.Release();
 		_resultDataBuffer.Release();
 		_instanceDescsResource.Release();
+		_heldUntilRebuild.clear();
 	}
 
 	UINT tlas::Size() {
-		return _instanceDescs.size();
+		return _tracker.GetInstanceCount();
 	}
 
 	bool blas::Generate(ComputeContext& context) {
-		CComPtr<ID3D12Device5> device;
-		{
-			HRESULT hr = Graphics::g_Device->QueryInterface(IID_PPV_ARGS(&device));
-			if (true == FAILED(hr)) { return false; }
-		}
+		CComPtr<ID3D12Device5> device = GetRaytracingDevice();
+		if (device == nullptr) { return false; }
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS build_flag;
 		build_flag = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
 
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS as_input;
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS as_input = {};
 		as_input.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
 		as_input.Flags = build_flag;
 		as_input.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
@@ -132,42 +213,8 @@ namespace RTHelper
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuild_info;
 		device->GetRaytracingAccelerationStructurePrebuildInfo(&as_input, &prebuild_info);
 
-		prebuild_info.ScratchDataSizeInBytes =
-			ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ScratchDataSizeInBytes);
-		prebuild_info.ResultDataMaxSizeInBytes =
-			ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ResultDataMaxSizeInBytes);
-
-		CD3DX12_RESOURCE_DESC scratch_buf_desc =
-			CD3DX12_RESOURCE_DESC::Buffer(prebuild_info.ScratchDataSizeInBytes,
-				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-
-		auto properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-		device->CreateCommittedResource(
-			&properties,
-			D3D12_HEAP_FLAG_NONE,
-			&scratch_buf_desc,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			nullptr, IID_PPV_ARGS(&_scratchBuffer)
-		);
-
-		if (_scratchBuffer == nullptr) { return false; }
-
-		CD3DX12_RESOURCE_DESC result_buf_desc =
-			CD3DX12_RESOURCE_DESC::Buffer(prebuild_info.ResultDataMaxSizeInBytes,
-				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-		device->CreateCommittedResource(
-			&properties,
-			D3D12_HEAP_FLAG_NONE,
-			&result_buf_desc,
-			D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-			nullptr,
-			IID_PPV_ARGS(&_resultDataBuffer)
-		);
-
-		if (_resultDataBuffer == nullptr) {
-			_scratchBuffer.Release();
-			return false;
-		}
+		if (false == EnsureBuffer(_scratchBuffer, _scratchSize, prebuild_info.ScratchDataSizeInBytes, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) { return false; }
+		if (false == EnsureBuffer(_resultDataBuffer, _resultSize, prebuild_info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE)) { return false; }
 
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC build_desc = {};
 		build_desc.Inputs = as_input;
@@ -178,11 +225,11 @@ namespace RTHelper
 		context.GetCommandList()->QueryInterface(IID_PPV_ARGS(&raytracingCommandList));
 
 		raytracingCommandList->BuildRaytracingAccelerationStructure(&build_desc, 0, nullptr);
-		D3D12_RESOURCE_BARRIER uav_barrier;
-		uav_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		uav_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-		uav_barrier.UAV.pResource = _resultDataBuffer;
-		raytracingCommandList->ResourceBarrier(1, &uav_barrier);
+		AddUAVBarrier(raytracingCommandList, _resultDataBuffer);
+
+		_compactedAddress = 0;
+		_memory._buildBytes = prebuild_info.ResultDataMaxSizeInBytes;
+		_memory._compactedBytes = prebuild_info.ResultDataMaxSizeInBytes;
 		return true;
 	}
 
@@ -200,11 +247,241 @@ namespace RTHelper
 	}
 
 	void RTHelper::blas::Clear()
+	{
+		_geometryDescs.clear();
+	}
+
+	void RTHelper::blas::Destroy()
 	{
 		_geometryDescs.clear();
 		_geometryDescs.shrink_to_fit();
+		_scratchSize = GrowOnlySize();
+		_resultSize = GrowOnlySize();
 		_scratchBuffer.Release();
 		_resultDataBuffer.Release();
+		_compactedAddress = 0;
+		_memory = BlasMemoryReport();
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS blas::GetAddress() const
+	{
+		if (_compactedAddress != 0) { return _compactedAddress; }
+		return (_resultDataBuffer != nullptr) ? _resultDataBuffer->GetGPUVirtualAddress() : 0;
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS BlasPool::Allocate(UINT64 size)
+	{
+		size = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, size);
+		for (Page& page : _pages) {
+			if (page._used + size <= page._size) {
+				D3D12_GPU_VIRTUAL_ADDRESS address = page._buffer->GetGPUVirtualAddress() + page._used;
+				page._used += size;
+				return address;
+			}
+		}
+
+		Page page;
+		page._size = (size > PAGE_SIZE) ? size : PAGE_SIZE;
+		page._used = size;
+		page._buffer = CreateBuffer(page._size, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+		if (page._buffer == nullptr) { return 0; }
+		_pages.push_back(page);
+		return page._buffer->GetGPUVirtualAddress();
+	}
+
+	void BlasPool::Destroy()
+	{
+		for (Page& page : _pages) {
+			RetireBuffer(page._buffer);
+		}
+		_pages.clear();
+	}
+
+	UINT64 BlasPool::GetUsedBytes() const
+	{
+		UINT64 used = 0;
+		for (const Page& page : _pages) { used += page._used; }
+		return used;
+	}
+
+	UINT64 BlasPool::GetCapacityBytes() const
+	{
+		UINT64 capacity = 0;
+		for (const Page& page : _pages) { capacity += page._size; }
+		return capacity;
+	}
+
+	void BlasBatchBuilder::Add(blas* bottomLevel)
+	{
+		ASSERT(bottomLevel != nullptr && bottomLevel->Size() > 0);
+		_blases.push_back(bottomLevel);
+	}
+
+	bool BlasBatchBuilder::Build(BlasPool& pool, tlas* topLevel)
+	{
+		if (true == _blases.empty()) { return true; }
+
+		CComPtr<ID3D12Device5> device = GetRaytracingDevice();
+		if (device == nullptr) { return false; }
+
+		const UINT count = static_cast<UINT>(_blases.size());
+		std::vector<D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS> inputs(count);
+		std::vector<UINT64> resultOffsets(count);
+		std::vector<UINT64> scratchSizes(count);
+		UINT64 resultBytes = 0;
+		UINT64 scratchBytes = 0;
+		UINT64 largestScratch = 0;
+		_reports.assign(count, BlasMemoryReport());
+
+		for (UINT i = 0; i < count; ++i) {
+			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& as_input = inputs[i];
+			as_input = {};
+			as_input.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+			as_input.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+			as_input.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+			as_input.NumDescs = static_cast<UINT>(_blases[i]->_geometryDescs.size());
+			as_input.pGeometryDescs = _blases[i]->_geometryDescs.data();
+
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuild_info;
+			device->GetRaytracingAccelerationStructurePrebuildInfo(&as_input, &prebuild_info);
+
+			resultOffsets[i] = resultBytes;
+			resultBytes += ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ResultDataMaxSizeInBytes);
+			scratchSizes[i] = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, prebuild_info.ScratchDataSizeInBytes);
+			scratchBytes += scratchSizes[i];
+			largestScratch = (scratchSizes[i] > largestScratch) ? scratchSizes[i] : largestScratch;
+			_reports[i]._buildBytes = prebuild_info.ResultDataMaxSizeInBytes;
+		}
+
+		// one region per build while they fit, a single build larger than the budget gets the buffer to itself
+		if (scratchBytes > MAX_SCRATCH_BYTES) {
+			scratchBytes = (largestScratch > MAX_SCRATCH_BYTES) ? largestScratch : MAX_SCRATCH_BYTES;
+		}
+		const UINT64 sizeBytes = sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC) * count;
+		if (false == EnsureBuffer(_scratchBuffer, _scratchSize, scratchBytes, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) { return false; }
+		if (false == EnsureBuffer(_buildBuffer, _buildSize, resultBytes, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE)) { return false; }
+		if (false == EnsureBuffer(_compactedSizeBuffer, _compactedSizeSize, sizeBytes, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) { return false; }
+		if (_readbackBuffer == nullptr || _readbackBuffer->GetDesc().Width < _compactedSizeSize.Capacity) {
+			RetireBuffer(_readbackBuffer);
+			_readbackBuffer = CreateBuffer(_compactedSizeSize.Capacity, D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+			if (_readbackBuffer == nullptr) { return false; }
+		}
+
+		{
+			ComputeContext& context = ComputeContext::Begin(L"BLAS Batch Build");
+			CComPtr<ID3D12GraphicsCommandList4> raytracingCommandList;
+			context.GetCommandList()->QueryInterface(IID_PPV_ARGS(&raytracingCommandList));
+
+			UINT64 scratchOffset = 0;
+			for (UINT i = 0; i < count; ++i) {
+				if (scratchOffset + scratchSizes[i] > scratchBytes) {
+					// the earlier builds have to finish with their regions first
+					AddUAVBarrier(raytracingCommandList, _scratchBuffer);
+					scratchOffset = 0;
+				}
+
+				D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC build_desc = {};
+				build_desc.Inputs = inputs[i];
+				build_desc.ScratchAccelerationStructureData = _scratchBuffer->GetGPUVirtualAddress() + scratchOffset;
+				build_desc.DestAccelerationStructureData = _buildBuffer->GetGPUVirtualAddress() + resultOffsets[i];
+
+				D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuild_desc;
+				postbuild_desc.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+				postbuild_desc.DestBuffer = _compactedSizeBuffer->GetGPUVirtualAddress() + sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC) * i;
+
+				raytracingCommandList->BuildRaytracingAccelerationStructure(&build_desc, 1, &postbuild_desc);
+				scratchOffset += scratchSizes[i];
+			}
+			AddUAVBarrier(raytracingCommandList, _buildBuffer);
+
+			D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(_compactedSizeBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+			raytracingCommandList->ResourceBarrier(1, &barrier);
+			raytracingCommandList->CopyBufferRegion(_readbackBuffer, 0, _compactedSizeBuffer, 0, sizeBytes);
+			barrier = CD3DX12_RESOURCE_BARRIER::Transition(_compactedSizeBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			raytracingCommandList->ResourceBarrier(1, &barrier);
+			context.Finish(true);
+		}
+
+		std::vector<D3D12_GPU_VIRTUAL_ADDRESS> compactedAddresses(count);
+		{
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC* compactedSizes;
+			D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(sizeBytes) };
+			HRESULT hr = _readbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&compactedSizes));
+			if (true == FAILED(hr)) { return false; }
+			for (UINT i = 0; i < count; ++i) {
+				_reports[i]._compactedBytes = compactedSizes[i].CompactedSizeInBytes;
+				compactedAddresses[i] = pool.Allocate(compactedSizes[i].CompactedSizeInBytes);
+			}
+			D3D12_RANGE writeRange = { 0, 0 };
+			_readbackBuffer->Unmap(0, &writeRange);
+		}
+		for (UINT i = 0; i < count; ++i) {
+			if (compactedAddresses[i] == 0) { return false; }
+		}
+
+		{
+			ComputeContext& context = ComputeContext::Begin(L"BLAS Batch Compaction");
+			CComPtr<ID3D12GraphicsCommandList4> raytracingCommandList;
+			context.GetCommandList()->QueryInterface(IID_PPV_ARGS(&raytracingCommandList));
+			for (UINT i = 0; i < count; ++i) {
+				raytracingCommandList->CopyRaytracingAccelerationStructure(compactedAddresses[i],
+					_buildBuffer->GetGPUVirtualAddress() + resultOffsets[i], D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+			}
+			AddUAVBarrier(raytracingCommandList, nullptr);
+			context.Finish(true);
+		}
+
+		// Frames already recorded or still in flight may trace the bottom levels at their old addresses. The instances
+		// move to the compacted ones and the old buffers are released after the rebuild, at the fence of the frame that
+		// recorded it.
+		for (UINT i = 0; i < count; ++i) {
+			blas* bottomLevel = _blases[i];
+			const D3D12_GPU_VIRTUAL_ADDRESS oldAddress = bottomLevel->GetAddress();
+			if (topLevel != nullptr && oldAddress != 0) {
+				topLevel->ReplaceBottomLevel(oldAddress, compactedAddresses[i], bottomLevel->_resultDataBuffer);
+			}
+			else {
+				RetireBuffer(bottomLevel->_resultDataBuffer);
+			}
+			RetireBuffer(bottomLevel->_scratchBuffer);
+			bottomLevel->_scratchSize = GrowOnlySize();
+			bottomLevel->_resultSize = GrowOnlySize();
+			bottomLevel->_compactedAddress = compactedAddresses[i];
+			bottomLevel->_memory = _reports[i];
+		}
+		return true;
+	}
+
+	void BlasBatchBuilder::PrintReport() const
+	{
+		UINT64 buildBytes = 0;
+		UINT64 compactedBytes = 0;
+		for (UINT i = 0; i < _reports.size(); ++i) {
+			const BlasMemoryReport& report = _reports[i];
+			Utility::Printf("BLAS %u: %llu KB -> %llu KB\n", i, report._buildBytes >> 10, report._compactedBytes >> 10);
+			buildBytes += report._buildBytes;
+			compactedBytes += report._compactedBytes;
+		}
+		Utility::Printf("BLAS batch of %u: %llu KB -> %llu KB (%.1f%%)\n", static_cast<UINT>(_reports.size()), buildBytes >> 10, compactedBytes >> 10,
+			(buildBytes > 0) ? 100.0 * compactedBytes / buildBytes : 0.0);
+	}
+
+	void BlasBatchBuilder::Clear()
+	{
+		_blases.clear();
+	}
+
+	void BlasBatchBuilder::Destroy()
+	{
+		_blases.clear();
+		_reports.clear();
+		_scratchSize = GrowOnlySize();
+		_buildSize = GrowOnlySize();
+		_compactedSizeSize = GrowOnlySize();
+		RetireBuffer(_scratchBuffer);
+		RetireBuffer(_buildBuffer);
+		RetireBuffer(_compactedSizeBuffer);
+		RetireBuffer(_readbackBuffer);
 	}
 
 	RTMeshHitShaderInformation::RTMeshHitShaderInformation(UINT materialID) : _materialID(materialID)
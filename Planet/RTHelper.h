@@ -7,96 +7,138 @@
 #include "pch.h"
 #include "GameCore.h"
 #include "GraphicsCore.h"
+#include "ShaderTableWriter.h"
+#include "TlasInstanceTracker.h"
 #include "types.h"
 #include "ModelLoader.h"
 
 namespace RTHelper
 {
-	struct ShaderRecord {
-        void AddShaderID(void* IDBuffer) {
-            std::vector<UINT8> copied;
-            copied.reserve(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-            for (int i = 0; i < D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES; i++) {
-                copied.push_back(reinterpret_cast<UINT8*>(IDBuffer)[i]);
-            }
-            copied.shrink_to_fit();
-            _data.push_back(copied);
-            _recordeSize += D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-        }
-
-        template<typename T, UINT Tsize>
-        void AddField(T pData) {
-            std::vector<UINT8> dest(Tsize);
-            memcpy(dest.data(), &pData, Tsize);
-            _recordeSize += Tsize;
-            dest.shrink_to_fit();
-            _data.push_back(dest);
-        }
-
-        UINT _recordeSize = 0;
-        std::vector<std::vector<UINT8>> _data;
-	};
-
-    struct ShaderTable {
-        void AddRecord(const ShaderRecord& record) 
-        {
-            UINT aligned = ALIGN(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, record._recordeSize);
-            _maxRecordSize = (_maxRecordSize > aligned) ? _maxRecordSize : aligned;
-            _records.push_back(record);
-        }
-
-        UINT GetBytesSize() 
-        {
-            return ALIGN(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, _maxRecordSize * _records.size());
-        }
-
-        void Generate(void* buffer, UINT sizeofBuffer) 
-        {
-            UINT requireSize = GetBytesSize();
-            ASSERT(sizeofBuffer >= requireSize);
-            UINT offset = 0;
-            for (auto& record : _records) {
-                for (auto p : record._data) {
-                    ::memcpy(static_cast<char*>(buffer) + offset, p.data(), p.size());
-                    offset += p.size();
-                }
-                offset = ALIGN(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, offset);
-            }
-        }
-
-        void Clear() {
-            _maxRecordSize = 0;
-            _records.clear();
-        }
-
-        UINT _maxRecordSize = 0;
-        std::vector<ShaderRecord> _records;
-    };
-
+	// Shader tables are written in place with ShaderTableWriter, its layout repeats the d3d12.h constants
+	static_assert(ShaderTableWriter::kShaderIdentifierSize == D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, "");
+	static_assert(ShaderTableWriter::kRecordAlignment == D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, "");
+	static_assert(ShaderTableWriter::kTableAlignment == D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, "");
+
+    // frames the GPU can still use a buffer or a ring region after it was replaced
+    constexpr UINT FRAMES_IN_FLIGHT = 3;
+
+    // TlasInstanceTracker keeps the descs in the layout the device reads
+    static_assert(sizeof(TlasInstanceDesc) == sizeof(D3D12_RAYTRACING_INSTANCE_DESC), "");
+    static_assert(offsetof(TlasInstanceDesc, AccelerationStructure) == offsetof(D3D12_RAYTRACING_INSTANCE_DESC, AccelerationStructure), "");
+
+    // Buffers replaced by larger ones or compacted away stay alive until the last frame that used them has completed
+    void RetireBuffer(CComPtr<ID3D12Resource>& buffer);
+    // Once per frame with the fence of its last command list on the graphics queue, releases what has completed
+    void OnFrameSubmitted(UINT64 graphicsFence);
+    // Only once the GPU is idle
+    void ReleaseRetiredBuffers();
+
+    // Buffers only grow and are kept across builds, instances go through a persistently mapped ring of FRAMES_IN_FLIGHT
+    // regions. The CPU side bookkeeping is TlasInstanceTracker. Generate is meant to be called at most once per frame.
     struct tlas
     {
-        bool Initialize(UINT maxInstance);
+        tlas() : _tracker(FRAMES_IN_FLIGHT) {}
+
+        // Nothing is recorded when no instance changed
         bool Generate(ComputeContext& context);
-        void AddInstance(D3D12_RAYTRACING_INSTANCE_DESC& instDesc);
+        UINT AddInstance(const D3D12_RAYTRACING_INSTANCE_DESC& instDesc);
+        void RemoveInstance(UINT handle);
+        void SetTransform(UINT handle, const FLOAT transform[3][4]);
+        void SetInstance(UINT handle, const D3D12_RAYTRACING_INSTANCE_DESC& instDesc);
+        // A bottom level moved, e.g. when it was compacted. Its old buffer is retired once the rebuild that drops the old address was recorded.
+        void ReplaceBottomLevel(D3D12_GPU_VIRTUAL_ADDRESS oldAddress, D3D12_GPU_VIRTUAL_ADDRESS newAddress, CComPtr<ID3D12Resource>& oldBuffer);
+        // Drops the instances and keeps the buffers
         void Clear();
+        void Destroy();
         UINT Size();
 
+        TlasInstanceTracker _tracker;
+        GrowOnlySize _scratchSize;
+        GrowOnlySize _resultSize;
         CComPtr<ID3D12Resource> _instanceDescsResource;
+        D3D12_RAYTRACING_INSTANCE_DESC* _mappedInstanceDescs = nullptr;
         CComPtr<ID3D12Resource> _scratchBuffer;
         CComPtr<ID3D12Resource> _resultDataBuffer;
-        std::vector<D3D12_RAYTRACING_INSTANCE_DESC> _instanceDescs;
+        // old bottom levels the current tree may still point at
+        std::vector<CComPtr<ID3D12Resource>> _heldUntilRebuild;
+    };
+
+    // Bytes of one bottom level before and after compaction
+    struct BlasMemoryReport
+    {
+        UINT64 _buildBytes = 0;
+        UINT64 _compactedBytes = 0;
     };
 
+    // Rebuilt in place, the buffers only grow. A bottom level compacted by BlasBatchBuilder lives in a BlasPool instead.
     struct blas {
         bool Initialize();
         bool Generate(ComputeContext& context);
         void AddGeometry(D3D12_RAYTRACING_GEOMETRY_DESC& geoDesc);
         UINT Size();
+        // Drops the geometries and keeps the buffers
         void Clear();
+        void Destroy();
+        // For D3D12_RAYTRACING_INSTANCE_DESC::AccelerationStructure
+        D3D12_GPU_VIRTUAL_ADDRESS GetAddress() const;
 
         std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> _geometryDescs;
+        GrowOnlySize _scratchSize;
+        GrowOnlySize _resultSize;
         CComPtr<ID3D12Resource> _scratchBuffer;
         CComPtr<ID3D12Resource> _resultDataBuffer;
+        // 0 while the bottom level is in _resultDataBuffer
+        D3D12_GPU_VIRTUAL_ADDRESS _compactedAddress = 0;
+        BlasMemoryReport _memory;
+    };
+
+    // Compacted bottom levels sub-allocated from large buffers, released all together
+    struct BlasPool
+    {
+        static constexpr UINT64 PAGE_SIZE = 16 << 20;
+
+        D3D12_GPU_VIRTUAL_ADDRESS Allocate(UINT64 size);
+        void Destroy();
+        UINT64 GetUsedBytes() const;
+        UINT64 GetCapacityBytes() const;
+
+        struct Page
+        {
+            CComPtr<ID3D12Resource> _buffer;
+            UINT64 _size;
+            UINT64 _used;
+        };
+        std::vector<Page> _pages;
+    };
+
+    // Builds many bottom levels in one submission and compacts them into a BlasPool.
+    // The builds share one scratch buffer of at most MAX_SCRATCH_BYTES, regions are reused after a UAV barrier once it is full.
+    // Build waits for the GPU twice, it is meant for load time.
+    struct BlasBatchBuilder
+    {
+        static constexpr UINT64 MAX_SCRATCH_BYTES = 32 << 20;
+
+        void Add(blas* bottomLevel);
+        // The instances of topLevel that point at the batch are moved to the compacted bottom levels, the buffers they
+        // pointed at are released after the rebuild has completed on the GPU
+        bool Build(BlasPool& pool, tlas* topLevel);
+        // Per added bottom level, in the order they were added
+        const std::vector<BlasMemoryReport>& GetReports() const { return _reports; }
+        void PrintReport() const;
+        // Drops the bottom levels and keeps the buffers for the next batch
+        void Clear();
+        void Destroy();
+
+        std::vector<blas*> _blases;
+        std::vector<BlasMemoryReport> _reports;
+        GrowOnlySize _scratchSize;
+        GrowOnlySize _buildSize;
+        GrowOnlySize _compactedSizeSize;
+        CComPtr<ID3D12Resource> _scratchBuffer;
+        // uncompacted results of the whole batch
+        CComPtr<ID3D12Resource> _buildBuffer;
+        CComPtr<ID3D12Resource> _compactedSizeBuffer;
+        CComPtr<ID3D12Resource> _readbackBuffer;
     };
 
 	struct RTMeshHitShaderInformation
@@ -0,0 +1,147 @@
+#include "TerrainRender.h"
+#include "PlanetQuadTree.h"
+#include "TerrainStreaming.h"
+#include "VertexPacking.h"
+#include "PersistentDescriptors.h"
+#include "BufferManager.h"
+
+#include "CompiledShaders/terrain_vs.h"
+#include "CompiledShaders/terrain_ps.h"
+
+namespace
+{
+	constexpr UINT VERTICES_PER_CHUNK = (PlanetQuadTree::GRID_SIZE + 1) * (PlanetQuadTree::GRID_SIZE + 1);
+
+	//terrain_vs.hlsl Chunk, root constants
+	__declspec(align(16)) struct ChunkConstants
+	{
+		float3 _origin;
+		float _morphStart;
+		VertexPacking::QuantizationBounds _bounds;
+		float _morphEnd;
+	};
+
+	RootSignature _terrainRS;
+	GraphicsPSO _terrainPSO;
+	//GetChunkIndices in 16 bits, shared by every chunk
+	ByteAddressBuffer _chunkIndices;
+}
+
+namespace TerrainRender
+{
+	void Initialize(const DXGI_FORMAT renderTargetFormat)
+	{
+		SamplerDesc SamplerCloudWrapDesc;
+		SamplerCloudWrapDesc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+		SamplerCloudWrapDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+		SamplerCloudWrapDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+		SamplerCloudWrapDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+
+		//the first three match the planet pass, the pixel shader shares its bindings
+		_terrainRS.Reset(6, 3);
+		_terrainRS[0].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, PERSISTENT_SRV_COUNT, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, PERSISTENT_SRV_COUNT, 4, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS[3].InitAsConstantBuffer(1, D3D12_SHADER_VISIBILITY_VERTEX);
+		_terrainRS[4].InitAsConstants(2, sizeof(ChunkConstants) / 4, D3D12_SHADER_VISIBILITY_VERTEX);
+		_terrainRS[5].InitAsBufferSRV(PERSISTENT_SRV_COUNT + 4, D3D12_SHADER_VISIBILITY_VERTEX);
+
+		_terrainRS.InitStaticSampler(0, Graphics::SamplerLinearClampDesc, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS.InitStaticSampler(1, Graphics::SamplerPointClampDesc, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS.InitStaticSampler(2, SamplerCloudWrapDesc, D3D12_SHADER_VISIBILITY_PIXEL);
+		_terrainRS.Finalize(L"Terrain Rootsignature", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+		_terrainPSO.SetRootSignature(_terrainRS);
+		_terrainPSO.SetInputLayout(_countof(VertexPacking::INPUT_LAYOUT), VertexPacking::INPUT_LAYOUT);
+		_terrainPSO.SetVertexShader(g_pterrain_vs, sizeof(g_pterrain_vs));
+		_terrainPSO.SetPixelShader(g_pterrain_ps, sizeof(g_pterrain_ps));
+		_terrainPSO.SetRenderTargetFormat(renderTargetFormat, Graphics::g_SceneDepthBuffer.GetFormat());
+		//reverse z, chunk triangles are counter clockwise seen from outside the planet
+		_terrainPSO.SetDepthStencilState(Graphics::DepthStateReadWrite);
+		_terrainPSO.SetRasterizerState(Graphics::RasterizerDefault);
+		_terrainPSO.SetBlendState(Graphics::BlendDisable);
+		_terrainPSO.SetSampleMask(D3D12_DEFAULT_SAMPLE_MASK);
+		_terrainPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
+		_terrainPSO.Finalize();
+
+		const std::vector<UINT>& indices = PlanetQuadTree::GetChunkIndices();
+		static_assert(VERTICES_PER_CHUNK <= 0xFFFF, "chunk indices are 16 bits");
+		const std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+		_chunkIndices.Create(L"Terrain Chunk Indices", static_cast<uint32_t>(shortIndices.size()), sizeof(uint16_t), shortIndices.data());
+	}
+
+	void Shutdown(void)
+	{
+		_terrainPSO.DestroyAll();
+		_terrainRS.DestroyAll();
+		_chunkIndices.Destroy();
+	}
+
+	void Render(GraphicsContext& context, const VolumetricCloud::PerFrameSceneInfo& perframe, const Math::Matrix4& viewProjection,
+		const double3& cameraPosition, ColorBuffer& renderTarget)
+	{
+		const std::vector<PlanetQuadTree::SelectedNode>& drawList = PlanetQuadTree::GetDrawList();
+		ByteAddressBuffer& chunkPool = TerrainStreaming::GetChunkPool();
+
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[4] = {
+			VolumetricCloud::_cloudTransmittance.GetSRV(),
+			VolumetricCloud::_cloudShadowMap.GetSRV(),
+			VolumetricCloud::_cloudScattering.GetSRV(),
+			VolumetricCloud::_cloudDistance.GetSRV()
+		};
+
+		context.TransitionResource(VolumetricCloud::_cloudTransmittance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudShadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudScattering, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudDistance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		//vertices through the input assembler, morph targets through the vertex shader
+		context.TransitionResource(chunkPool, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(_chunkIndices, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+		context.TransitionResource(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		context.TransitionResource(Graphics::g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
+		context.ClearDepth(Graphics::g_SceneDepthBuffer);
+
+		if (true == drawList.empty())
+		{
+			return;
+		}
+
+		context.SetPipelineState(_terrainPSO);
+		context.SetRootSignature(_terrainRS);
+		context.SetDynamicConstantBufferView(0, sizeof(perframe), &perframe);
+		context.SetPersistentDescriptorTable(1);
+		context.SetDynamicDescriptors(2, 0, 4, srvHandels);
+		context.SetDynamicConstantBufferView(3, sizeof(viewProjection), &viewProjection);
+
+		context.SetViewportAndScissor(0, 0, renderTarget.GetWidth(), renderTarget.GetHeight());
+		context.SetRenderTarget(renderTarget.GetRTV(), Graphics::g_SceneDepthBuffer.GetDSV());
+		context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context.SetIndexBuffer(_chunkIndices.IndexBufferView());
+
+		const D3D12_GPU_VIRTUAL_ADDRESS poolAddress = chunkPool.GetGpuVirtualAddress();
+		for (const PlanetQuadTree::SelectedNode& node : drawList)
+		{
+			//the chunk was evicted before the selection was drawn
+			if (nullptr == node._chunk || 0 == node._vertexAddress)
+			{
+				continue;
+			}
+
+			ChunkConstants constants;
+			constants._origin = ToRelativeFloat3(node._chunk->_origin, cameraPosition);
+			constants._morphStart = node._morphStart;
+			constants._bounds = node._chunk->_bounds;
+			constants._morphEnd = node._morphEnd;
+
+			D3D12_VERTEX_BUFFER_VIEW vertexView;
+			vertexView.BufferLocation = node._vertexAddress;
+			vertexView.SizeInBytes = VERTICES_PER_CHUNK * sizeof(VertexPacking::PackedVertex);
+			vertexView.StrideInBytes = sizeof(VertexPacking::PackedVertex);
+
+			context.SetVertexBuffer(0, vertexView);
+			context.SetConstantArray(4, sizeof(ChunkConstants) / 4, &constants);
+			context.SetBufferSRV(5, chunkPool, node._morphTargetAddress - poolAddress);
+			context.DrawIndexed(PlanetQuadTree::TRIANGLES_PER_CHUNK * 3);
+		}
+	}
+}
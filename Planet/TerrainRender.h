@@ -0,0 +1,19 @@
+#pragma once
+
+#include "pch.h"
+#include "CommandContext.h"
+#include "ColorBuffer.h"
+#include "VolumetricCloud.h"
+#include "types.h"
+
+//Rasterizes the chunks selected by PlanetQuadTree straight out of the terrain streaming pool.
+//Drawn over the ray traced planet and shaded by the same functions, see planetShading.hlsli.
+namespace TerrainRender
+{
+	void Initialize(const DXGI_FORMAT renderTargetFormat);
+	void Shutdown(void);
+
+	//cameraPosition is planet relative, the chunks are placed relative to it like every other pass
+	void Render(GraphicsContext& context, const VolumetricCloud::PerFrameSceneInfo& perframe, const Math::Matrix4& viewProjection,
+		const double3& cameraPosition, ColorBuffer& renderTarget);
+}
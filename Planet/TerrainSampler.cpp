@@ -0,0 +1,369 @@
+#include "TerrainSampler.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	//normal, u axis and v axis of every cube face, u x v is the normal
+	constexpr float FACE_FRAMES[6][3][3] = {
+		{ { +1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+		{ { -1, 0, 0 }, { 0, 0, +1 }, { 0, 1, 0 } },
+		{ { 0, +1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, +1 } },
+		{ { 0, 0, +1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+	};
+
+	constexpr UINT FACE_COUNT = 6;
+	//octave rotation of sdTerrain, row vector times matrix like mul(p, m) in HLSL
+	constexpr float OCTAVE_ROTATION[3][3] = {
+		{ 0.0f, 1.6f, 1.2f },
+		{ -1.6f, 0.72f, -0.96f },
+		{ -1.2f, -0.96f, 1.28f },
+	};
+
+	constexpr int MAX_GROUND_STEPS = 256;
+	constexpr int MAX_RAY_STEPS = 1024;
+	//hierarchy steps shorter than this are not worth skipping the distance field for
+	constexpr float MIN_HIERARCHY_STEP = 0.02f;
+	//top of the search for the ground, above anything the octaves can raise
+	constexpr float GROUND_SEARCH_HEIGHT = 2.0f;
+
+	float Dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	float Length(const float3& v) { return sqrtf(Dot(v, v)); }
+	float3 Add(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+	float3 Scale(const float3& v, const float s) { return float3(v.x * s, v.y * s, v.z * s); }
+	float3 Cross(const float3& a, const float3& b) { return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	float3 Normalize(const float3& v) { return Scale(v, 1.0f / Length(v)); }
+	float Fract(const float x) { return x - floorf(x); }
+
+	float3 GetFaceAxis(const UINT face, const UINT axis)
+	{
+		return float3(FACE_FRAMES[face][axis][0], FACE_FRAMES[face][axis][1], FACE_FRAMES[face][axis][2]);
+	}
+
+	//face and (u, v) in [0, 1] of the gnomonic projection
+	void DirectionToFace(const float3& direction, UINT& face, float& u, float& v)
+	{
+		const float ax = fabsf(direction.x), ay = fabsf(direction.y), az = fabsf(direction.z);
+		if (ax >= ay && ax >= az)
+		{
+			face = (direction.x >= 0.0f) ? 0 : 1;
+		}
+		else if (ay >= az)
+		{
+			face = (direction.y >= 0.0f) ? 2 : 3;
+		}
+		else
+		{
+			face = (direction.z >= 0.0f) ? 4 : 5;
+		}
+
+		const float depth = Dot(direction, GetFaceAxis(face, 0));
+		u = std::min(std::max((Dot(direction, GetFaceAxis(face, 1)) / depth + 1.0f) * 0.5f, 0.0f), 1.0f);
+		v = std::min(std::max((Dot(direction, GetFaceAxis(face, 2)) / depth + 1.0f) * 0.5f, 0.0f), 1.0f);
+	}
+
+	float3 FaceToDirection(const UINT face, const float u, const float v)
+	{
+		const float3 onCube = Add(GetFaceAxis(face, 0), Add(Scale(GetFaceAxis(face, 1), u * 2.0f - 1.0f), Scale(GetFaceAxis(face, 2), v * 2.0f - 1.0f)));
+		return Normalize(onCube);
+	}
+
+	//Distance from a point inside the column of a texel to its four side planes
+	float GetDistanceToTexelSides(const float3& position, const UINT face, const float u0, const float u1, const float v0, const float v1)
+	{
+		const float3 normal = GetFaceAxis(face, 0);
+		const float3 axisU = GetFaceAxis(face, 1);
+		const float3 axisV = GetFaceAxis(face, 2);
+		const float3 edgeU0 = Add(normal, Scale(axisU, u0 * 2.0f - 1.0f));
+		const float3 edgeU1 = Add(normal, Scale(axisU, u1 * 2.0f - 1.0f));
+		const float3 edgeV0 = Add(normal, Scale(axisV, v0 * 2.0f - 1.0f));
+		const float3 edgeV1 = Add(normal, Scale(axisV, v1 * 2.0f - 1.0f));
+
+		//plane normals point into the texel
+		const float distances[4] = {
+			Dot(position, Normalize(Cross(axisV, edgeU0))),
+			Dot(position, Normalize(Cross(edgeU1, axisV))),
+			Dot(position, Normalize(Cross(edgeV0, axisU))),
+			Dot(position, Normalize(Cross(axisU, edgeV1))),
+		};
+		return std::min(std::min(distances[0], distances[1]), std::min(distances[2], distances[3]));
+	}
+
+	//hash3, smin and smax in terrain.hlsli
+	float Hash3(const float x, const float y, const float z)
+	{
+		uint32_t h = (static_cast<uint32_t>(static_cast<int32_t>(x)) * 73856093u)
+			^ (static_cast<uint32_t>(static_cast<int32_t>(y)) * 19349663u)
+			^ (static_cast<uint32_t>(static_cast<int32_t>(z)) * 83492791u);
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float SmoothMin(const float a, const float b, const float k)
+	{
+		const float h = std::max(k - fabsf(a - b), 0.0f) / k;
+		return std::min(a, b) - h * h * k * 0.25f;
+	}
+
+	float SmoothMax(const float a, const float b, const float k)
+	{
+		return -SmoothMin(-a, -b, k);
+	}
+
+	//sdSphereTerrain in terrain_cs.hlsl, a sphere of random radius on every lattice corner around p
+	float SphereTerrain(const float3& p)
+	{
+		const float tickX = floorf(p.x), tickY = floorf(p.y), tickZ = floorf(p.z);
+		const float offsetX = p.x - tickX, offsetY = p.y - tickY, offsetZ = p.z - tickZ;
+
+		float result = FLT_MAX;
+		for (UINT corner = 0; corner < 8; ++corner)
+		{
+			const float cornerX = static_cast<float>(corner >> 2), cornerY = static_cast<float>((corner >> 1) & 1), cornerZ = static_cast<float>(corner & 1);
+			const float radius = 0.5f * Hash3(tickX + cornerX, tickY + cornerY, tickZ + cornerZ);
+			const float3 toCorner(offsetX - cornerX, offsetY - cornerY, offsetZ - cornerZ);
+			result = std::min(result, Length(toCorner) - radius);
+		}
+		return result;
+	}
+}
+
+namespace TerrainSampler
+{
+	float Evaluate(const float3& position)
+	{
+		float3 p = position;
+		float d = Length(p) - RADIUS;
+
+		const float G = exp2f(-HURST);
+		float a = 1.0f;
+		for (int i = 0; i < NOISE_OCTAVES; ++i)
+		{
+			float n = a * SphereTerrain(p);
+			const float smoothness = 0.3f * a;
+			n = SmoothMax(n, d - 0.1f * a, smoothness);
+			d = SmoothMin(n, d, smoothness);
+			a *= G;
+
+			const float offset = d * 0.1f * a;
+			p = float3(
+				p.x * OCTAVE_ROTATION[0][0] + p.y * OCTAVE_ROTATION[1][0] + p.z * OCTAVE_ROTATION[2][0] + offset,
+				p.x * OCTAVE_ROTATION[0][1] + p.y * OCTAVE_ROTATION[1][1] + p.z * OCTAVE_ROTATION[2][1] + offset,
+				p.x * OCTAVE_ROTATION[0][2] + p.y * OCTAVE_ROTATION[1][2] + p.z * OCTAVE_ROTATION[2][2] + offset);
+		}
+		return d;
+	}
+
+	float3 EvaluateNormal(const float3& position)
+	{
+		const float h = Evaluate(position);
+		return Normalize(float3(
+			Evaluate(float3(position.x + NORMAL_EPSILON, position.y, position.z)) - h,
+			Evaluate(float3(position.x, position.y + NORMAL_EPSILON, position.z)) - h,
+			Evaluate(float3(position.x, position.y, position.z + NORMAL_EPSILON)) - h));
+	}
+
+	void EvaluateBatch(const float3* positions, float* distances, const size_t count)
+	{
+		JobSystem::ParallelFor(0, static_cast<UINT>(count), 0, [&](const UINT i)
+		{
+			distances[i] = Evaluate(positions[i]);
+		});
+	}
+
+	float FindGroundHeight(const float3& direction)
+	{
+		//the field is a lower bound of the distance, radial steps of its size never pass the surface
+		float radius = RADIUS + GROUND_SEARCH_HEIGHT;
+		for (int step = 0; step < MAX_GROUND_STEPS; ++step)
+		{
+			const float d = Evaluate(Scale(direction, radius));
+			if (d < SURFACE_EPSILON)
+			{
+				break;
+			}
+			radius -= d;
+		}
+		return radius - RADIUS;
+	}
+
+	void BuildHierarchy(HeightHierarchy& hierarchy, const UINT resolution)
+	{
+		ASSERT(resolution > 0 && (resolution & (resolution - 1)) == 0, "The hierarchy resolution has to be a power of two");
+
+		const UINT cornerPitch = resolution + 1;
+		hierarchy._resolution = resolution;
+		hierarchy._cornerHeights.resize(FACE_COUNT * cornerPitch * cornerPitch);
+		JobSystem::ParallelFor(0, static_cast<UINT>(hierarchy._cornerHeights.size()), 0, [&](const UINT corner)
+		{
+			const UINT face = static_cast<UINT>(corner / (cornerPitch * cornerPitch));
+			const UINT x = static_cast<UINT>(corner % cornerPitch);
+			const UINT y = static_cast<UINT>(corner / cornerPitch % cornerPitch);
+			hierarchy._cornerHeights[corner] = FindGroundHeight(FaceToDirection(face, static_cast<float>(x) / resolution, static_cast<float>(y) / resolution));
+		});
+
+		//level 0 from the four corners, widened by half a texel, the face centers have the largest texels
+		const float margin = 0.5f * (2.0f / resolution) * (RADIUS + GROUND_SEARCH_HEIGHT) * 1.41421356f;
+		hierarchy._levels.clear();
+		hierarchy._levels.emplace_back(FACE_COUNT * resolution * resolution);
+		for (UINT face = 0; face < FACE_COUNT; ++face)
+		{
+			const float* corners = hierarchy._cornerHeights.data() + face * cornerPitch * cornerPitch;
+			for (UINT y = 0; y < resolution; ++y)
+			{
+				for (UINT x = 0; x < resolution; ++x)
+				{
+					const float h00 = corners[y * cornerPitch + x], h10 = corners[y * cornerPitch + x + 1];
+					const float h01 = corners[(y + 1) * cornerPitch + x], h11 = corners[(y + 1) * cornerPitch + x + 1];
+					hierarchy._levels[0][(face * resolution + y) * resolution + x] = float2(
+						std::min(std::min(h00, h10), std::min(h01, h11)) - margin,
+						std::max(std::max(h00, h10), std::max(h01, h11)) + margin);
+				}
+			}
+		}
+
+		for (UINT size = resolution / 2; size > 0; size /= 2)
+		{
+			const std::vector<float2>& finer = hierarchy._levels.back();
+			std::vector<float2> coarser(FACE_COUNT * size * size);
+			for (UINT face = 0; face < FACE_COUNT; ++face)
+			{
+				for (UINT y = 0; y < size; ++y)
+				{
+					for (UINT x = 0; x < size; ++x)
+					{
+						float2 bounds(FLT_MAX, -FLT_MAX);
+						for (UINT child = 0; child < 4; ++child)
+						{
+							const float2& childBounds = finer[(face * size * 2 + y * 2 + (child >> 1)) * size * 2 + x * 2 + (child & 1)];
+							bounds = float2(std::min(bounds.x, childBounds.x), std::max(bounds.y, childBounds.y));
+						}
+						coarser[(face * size + y) * size + x] = bounds;
+					}
+				}
+			}
+			hierarchy._levels.push_back(std::move(coarser));
+		}
+
+		hierarchy._minHeight = FLT_MAX;
+		hierarchy._maxHeight = -FLT_MAX;
+		for (const float2& bounds : hierarchy._levels.back())
+		{
+			hierarchy._minHeight = std::min(hierarchy._minHeight, bounds.x);
+			hierarchy._maxHeight = std::max(hierarchy._maxHeight, bounds.y);
+		}
+	}
+
+	float GetGroundHeight(const HeightHierarchy& hierarchy, const float3& direction)
+	{
+		UINT face;
+		float u, v;
+		DirectionToFace(Normalize(direction), face, u, v);
+
+		const UINT cornerPitch = hierarchy._resolution + 1;
+		const float x = u * hierarchy._resolution;
+		const float y = v * hierarchy._resolution;
+		const UINT x0 = std::min(static_cast<UINT>(x), hierarchy._resolution - 1);
+		const UINT y0 = std::min(static_cast<UINT>(y), hierarchy._resolution - 1);
+		const float fx = x - x0, fy = y - y0;
+
+		const float* corners = hierarchy._cornerHeights.data() + face * cornerPitch * cornerPitch + y0 * cornerPitch + x0;
+		const float top = corners[0] + (corners[1] - corners[0]) * fx;
+		const float bottom = corners[cornerPitch] + (corners[cornerPitch + 1] - corners[cornerPitch]) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	void GetGroundHeightBatch(const HeightHierarchy& hierarchy, const float3* directions, float* heights, const size_t count)
+	{
+		//a lookup is a few bilinear fetches, ranges of 1024 keep the scheduling cost out of sight
+		JobSystem::ParallelFor(0, static_cast<UINT>(count), 1024, [&](const UINT i)
+		{
+			heights[i] = GetGroundHeight(hierarchy, directions[i]);
+		});
+	}
+
+	float RayCast(const HeightHierarchy* hierarchy, const float3& origin, const float3& direction, const float maxDistance, RayCastStats* stats)
+	{
+		RayCastStats localStats = {};
+		RayCastStats& counters = (nullptr != stats) ? *stats : localStats;
+		counters = {};
+
+		float t = 0.0f;
+		if (nullptr != hierarchy)
+		{
+			//nothing above the highest texel, start on that shell
+			const float shellRadius = RADIUS + hierarchy->_maxHeight;
+			const float halfB = Dot(origin, direction);
+			const float c = Dot(origin, origin) - shellRadius * shellRadius;
+			if (c > 0.0f)
+			{
+				const float disc = halfB * halfB - c;
+				if (halfB > 0.0f || disc < 0.0f)
+				{
+					return -1.0f;
+				}
+				t = -halfB - sqrtf(disc);
+			}
+		}
+
+		for (int step = 0; step < MAX_RAY_STEPS && t < maxDistance; ++step)
+		{
+			++counters._steps;
+			const float3 position = Add(origin, Scale(direction, t));
+
+			if (nullptr != hierarchy)
+			{
+				const float radius = Length(position);
+				const float height = radius - RADIUS;
+				if (height > hierarchy->_maxHeight && Dot(position, direction) > 0.0f)
+				{
+					return -1.0f;
+				}
+
+				//a ball inside the column of a texel and above its highest ground is empty
+				UINT face;
+				float u, v;
+				DirectionToFace(Scale(position, 1.0f / radius), face, u, v);
+				float safeDistance = 0.0f;
+				for (UINT level = hierarchy->GetLevelCount(); level-- > 0;)
+				{
+					const UINT size = hierarchy->_resolution >> level;
+					const UINT x = std::min(static_cast<UINT>(u * size), size - 1);
+					const UINT y = std::min(static_cast<UINT>(v * size), size - 1);
+					const float clearance = height - hierarchy->_levels[level][(face * size + y) * size + x].y;
+					if (clearance <= safeDistance)
+					{
+						continue;
+					}
+					const float texelSize = 1.0f / size;
+					const float sides = GetDistanceToTexelSides(position, face, x * texelSize, (x + 1) * texelSize, y * texelSize, (y + 1) * texelSize);
+					safeDistance = std::max(safeDistance, std::min(clearance, sides));
+				}
+
+				if (safeDistance > MIN_HIERARCHY_STEP)
+				{
+					t += safeDistance;
+					continue;
+				}
+			}
+
+			++counters._evaluations;
+			const float d = Evaluate(position);
+			if (d < SURFACE_EPSILON)
+			{
+				return t;
+			}
+			t += d;
+		}
+		return -1.0f;
+	}
+}
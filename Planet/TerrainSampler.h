@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.h"
+#include "types.h"
+
+//CPU side of the terrain in terrain_cs.hlsl: the same signed distance field, ground height queries
+//and a min/max height hierarchy over the sphere for conservative sphere tracing.
+//Distances are in terrain units, the planet of terrain_cs.hlsl has a radius of 100.
+namespace TerrainSampler
+{
+	//static constants of terrain_cs.hlsl
+	constexpr float RADIUS = 100.0f;
+	constexpr float HURST = 1.0f;
+	constexpr int NOISE_OCTAVES = 8;
+	constexpr float SURFACE_EPSILON = 0.001f;
+	constexpr float NORMAL_EPSILON = 0.01f;
+
+	//sdTerrain(p, radius, 1.0) and terrainNormal in terrain_cs.hlsl
+	float Evaluate(const float3& position);
+	float3 EvaluateNormal(const float3& position);
+	//On the worker threads
+	void EvaluateBatch(const float3* positions, float* distances, const size_t count);
+
+	//Height of the surface above RADIUS along a direction, traced radially down the distance field
+	float FindGroundHeight(const float3& direction);
+
+	//Min/max ground height per texel of a gnomonic cube map, one mip chain per face down to a single texel.
+	//The edges of a gnomonic texel are great circles, so the column over a texel is bounded by four planes through the planet center.
+	struct HeightHierarchy
+	{
+		HeightHierarchy() : _resolution(0), _minHeight(0.0f), _maxHeight(0.0f) {}
+
+		//level 0 texels per face side, a power of two
+		UINT _resolution;
+		//FindGroundHeight at the texel corners, 6 faces of (_resolution + 1)^2
+		std::vector<float> _cornerHeights;
+		//per level, 6 faces of (_resolution >> level)^2 texels of (min, max)
+		std::vector<std::vector<float2>> _levels;
+		float _minHeight;
+		float _maxHeight;
+
+		UINT GetLevelCount(void) const { return static_cast<UINT>(_levels.size()); }
+	};
+
+	struct RayCastStats
+	{
+		UINT _steps;
+		UINT _evaluations;
+	};
+
+	//Bounds are widened by half a texel on the assumption of slopes up to 1 between the corner samples
+	void BuildHierarchy(HeightHierarchy& hierarchy, const UINT resolution);
+
+	//Bilinear between the corner samples
+	float GetGroundHeight(const HeightHierarchy& hierarchy, const float3& direction);
+	void GetGroundHeightBatch(const HeightHierarchy& hierarchy, const float3* directions, float* heights, const size_t count);
+
+	//Sphere tracing like castRay in terrain_cs.hlsl, distance to the hit or -1.
+	//With a hierarchy, steps over texels lower than the ray skip the distance field.
+	float RayCast(const HeightHierarchy* hierarchy, const float3& origin, const float3& direction, const float maxDistance, RayCastStats* stats = nullptr);
+}
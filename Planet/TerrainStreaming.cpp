@@ -0,0 +1,425 @@
+#include "TerrainStreaming.h"
+#include "Display.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	constexpr UINT ROOT_COUNT = 6;
+	//weight of the last frame in the moving averages
+	constexpr double AVERAGE_WEIGHT = 0.1;
+
+	struct PendingChunk
+	{
+		TerrainStreaming::ChunkRequest _request;
+		int64_t _requestTick;
+	};
+
+	struct ReadyChunk
+	{
+		std::shared_ptr<PlanetQuadTree::Chunk> _chunk;
+		//DBL_MAX once the chunk is no longer requested, then it only takes free slots
+		double _priority;
+	};
+
+	struct ResidentEntry
+	{
+		std::shared_ptr<const PlanetQuadTree::Chunk> _chunk;
+		UINT _slot;
+		uint64_t _lastUsedFrame;
+		bool _isPinned;
+		std::list<uint64_t>::iterator _lruPosition;
+	};
+
+	//written by the generation jobs, collected once per frame
+	struct WorkerCounters
+	{
+		UINT _completedChunks;
+		double _latencySeconds;
+		double _maxLatencySeconds;
+		double _generationSeconds;
+	};
+}
+
+namespace TerrainStreaming
+{
+	StreamingSettings _settings;
+	PlanetQuadTree::QuadTreeSettings _quadTreeSettings;
+	PlanetQuadTree::HeightFunction _heightFunction;
+
+	//slot layout, packed vertices then morph targets
+	size_t _morphTargetOffset = 0;
+	size_t _slotSize = 0;
+	ByteAddressBuffer _chunkPool;
+	std::vector<UINT> _freeSlots;
+
+	//owned by the frame thread, Upload and FindResident must not be called from a pass recorded on a worker
+	std::unordered_map<uint64_t, ResidentEntry> _residents;
+	//unpinned residents, most recently drawn first
+	std::list<uint64_t> _lru;
+	StreamingStats _stats = {};
+
+	//shared with the generation jobs
+	std::mutex _mutex;
+	//best request last
+	std::vector<PendingChunk> _pending;
+	std::unordered_set<uint64_t> _inFlight;
+	std::vector<ReadyChunk> _ready;
+	WorkerCounters _counters = {};
+	bool _isRunning = false;
+	//a job generates one chunk and hands its place to the next, at most _maxGenerationJobs of them are queued or running
+	//so that a chunk, which takes milliseconds, never holds up every thread
+	UINT _maxGenerationJobs = 0;
+	UINT _generationJobs = 0;
+	JobSystem::JobCounter _generationCounter;
+
+	namespace
+	{
+		size_t GetChunkBytes(const PlanetQuadTree::Chunk& chunk)
+		{
+			return _morphTargetOffset + chunk._morphTargets.size() * sizeof(VertexPacking::PackedPosition);
+		}
+
+		void WriteChunk(const PlanetQuadTree::Chunk& chunk, uint8_t* destination)
+		{
+			memcpy(destination, chunk._vertices.data(), chunk._vertices.size() * sizeof(VertexPacking::PackedVertex));
+			memcpy(destination + _morphTargetOffset, chunk._morphTargets.data(), chunk._morphTargets.size() * sizeof(VertexPacking::PackedPosition));
+		}
+
+		void AddResident(const std::shared_ptr<const PlanetQuadTree::Chunk>& chunk, const UINT slot, const bool isPinned)
+		{
+			const uint64_t key = chunk->_key.Pack();
+			ASSERT(_residents.count(key) == 0);
+			ResidentEntry entry = { chunk, slot, Graphics::GetFrameCount(), isPinned, _lru.end() };
+			if (false == isPinned)
+			{
+				_lru.push_front(key);
+				entry._lruPosition = _lru.begin();
+			}
+			_residents[key] = entry;
+		}
+
+		//A free slot, or the one of the least recently drawn chunk once the GPU is done with it
+		bool AcquireSlot(const bool canEvict, UINT& slot)
+		{
+			if (false == _freeSlots.empty())
+			{
+				slot = _freeSlots.back();
+				_freeSlots.pop_back();
+				return true;
+			}
+			if (false == canEvict || true == _lru.empty())
+			{
+				return false;
+			}
+
+			const auto victim = _residents.find(_lru.back());
+			if (victim->second._lastUsedFrame + FRAMES_IN_FLIGHT >= Graphics::GetFrameCount())
+			{
+				return false;
+			}
+			slot = victim->second._slot;
+			_residents.erase(victim);
+			_lru.pop_back();
+			++_stats._evictedChunks;
+			return true;
+		}
+
+		bool HasGenerationWork(void)
+		{
+			return true == _isRunning && false == _pending.empty() && _ready.size() < _settings._maxReadyChunks;
+		}
+
+		void GenerateChunkJob(void);
+
+		//Run may call the job right away, it is never called under the lock
+		void LaunchGenerationJobs(void)
+		{
+			UINT launchCount = 0;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				while (true == HasGenerationWork() && _generationJobs < _maxGenerationJobs && launchCount < _pending.size())
+				{
+					++_generationJobs;
+					++launchCount;
+				}
+			}
+			for (UINT i = 0; i < launchCount; ++i)
+			{
+				JobSystem::Run(GenerateChunkJob, &_generationCounter);
+			}
+		}
+
+		void GenerateChunkJob(void)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (false == HasGenerationWork())
+			{
+				--_generationJobs;
+				return;
+			}
+
+			const PendingChunk pending = _pending.back();
+			_pending.pop_back();
+			const uint64_t key = pending._request._key.Pack();
+			_inFlight.insert(key);
+			lock.unlock();
+
+			const int64_t startTick = SystemTime::GetCurrentTick();
+			std::shared_ptr<PlanetQuadTree::Chunk> chunk = PlanetQuadTree::GenerateChunk(pending._request._key, _quadTreeSettings, _heightFunction);
+			const int64_t endTick = SystemTime::GetCurrentTick();
+
+			lock.lock();
+			_inFlight.erase(key);
+			_ready.push_back({ std::move(chunk), pending._request._priority });
+			const double latency = SystemTime::TimeBetweenTicks(pending._requestTick, endTick);
+			++_counters._completedChunks;
+			_counters._latencySeconds += latency;
+			_counters._maxLatencySeconds = std::max(_counters._maxLatencySeconds, latency);
+			_counters._generationSeconds += SystemTime::TimeBetweenTicks(startTick, endTick);
+
+			//the next chunk is a job of its own, waiting threads only ever pick up one chunk at a time
+			const bool hasMoreWork = HasGenerationWork();
+			if (false == hasMoreWork)
+			{
+				--_generationJobs;
+			}
+			lock.unlock();
+			if (true == hasMoreWork)
+			{
+				JobSystem::Run(GenerateChunkJob, &_generationCounter);
+			}
+		}
+	}
+
+	void Initialize(const StreamingSettings& settings, const PlanetQuadTree::QuadTreeSettings& quadTreeSettings, const PlanetQuadTree::HeightFunction& heightFunction)
+	{
+		ASSERT(false == _isRunning, "Terrain streaming is already running");
+
+		_settings = settings;
+		_quadTreeSettings = quadTreeSettings;
+		_heightFunction = heightFunction;
+		_stats = {};
+		_counters = {};
+
+		constexpr size_t vertexCount = (PlanetQuadTree::GRID_SIZE + 1) * (PlanetQuadTree::GRID_SIZE + 1);
+		_morphTargetOffset = Math::AlignUp(vertexCount * sizeof(VertexPacking::PackedVertex), 16);
+		_slotSize = Math::AlignUp(_morphTargetOffset + vertexCount * sizeof(VertexPacking::PackedPosition), 256);
+		const UINT slotCount = static_cast<UINT>(settings._maxResidentBytes / _slotSize);
+		ASSERT(slotCount > ROOT_COUNT, "The chunk pool has to hold more than the root chunks");
+
+		_chunkPool.Create(L"Terrain Chunk Pool", static_cast<uint32_t>(slotCount * _slotSize / 4), 4);
+		_freeSlots.clear();
+		for (UINT slot = slotCount; slot-- > ROOT_COUNT;)
+		{
+			_freeSlots.push_back(slot);
+		}
+		_stats._capacityBytes = slotCount * _slotSize;
+
+		//every fallback ends at a root, so they are resident before the first frame
+		std::vector<std::shared_ptr<PlanetQuadTree::Chunk>> roots(ROOT_COUNT);
+		JobSystem::ParallelFor(0, ROOT_COUNT, 1, [&](const UINT face)
+		{
+			roots[face] = PlanetQuadTree::GenerateChunk({ face, 0, 0, 0 }, _quadTreeSettings, _heightFunction);
+		});
+		std::vector<uint8_t> rootData(ROOT_COUNT * _slotSize);
+		for (UINT face = 0; face < ROOT_COUNT; ++face)
+		{
+			WriteChunk(*roots[face], rootData.data() + face * _slotSize);
+			AddResident(roots[face], face, true);
+		}
+		CommandContext::InitializeBuffer(_chunkPool, rootData.data(), rootData.size());
+
+		_maxGenerationJobs = (settings._maxGenerationJobs > 0) ? settings._maxGenerationJobs : std::max(JobSystem::GetThreadCount() / 2, 1u);
+		_generationJobs = 0;
+		_isRunning = true;
+	}
+
+	void Shutdown(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_isRunning = false;
+			_pending.clear();
+		}
+		//chunks being generated are finished and dropped
+		JobSystem::Wait(_generationCounter);
+		ASSERT(_generationJobs == 0);
+
+		_ready.clear();
+		_inFlight.clear();
+		_residents.clear();
+		_lru.clear();
+		_freeSlots.clear();
+		_chunkPool.Destroy();
+		_heightFunction = nullptr;
+	}
+
+	double GetPriority(const double distance, const double3& toNode, const double3& viewDirection)
+	{
+		const double length = Length(toNode);
+		const double cosine = (length > 0.0) ? Dot(toNode, viewDirection) / length : 1.0;
+		return distance * (1.0 + _settings._viewDirectionWeight * (1.0 - cosine) * 0.5);
+	}
+
+	void RequestChunks(std::vector<ChunkRequest>& requests)
+	{
+		std::sort(requests.begin(), requests.end(), [](const ChunkRequest& lhs, const ChunkRequest& rhs) { return lhs._priority < rhs._priority; });
+		const int64_t tick = SystemTime::GetCurrentTick();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			//requests still queued keep their age for the latency
+			std::unordered_map<uint64_t, int64_t> requestTicks;
+			for (const PendingChunk& pending : _pending)
+			{
+				requestTicks[pending._request._key.Pack()] = pending._requestTick;
+			}
+			std::unordered_map<uint64_t, size_t> readyIndices;
+			for (size_t i = 0; i < _ready.size(); ++i)
+			{
+				readyIndices[_ready[i]._chunk->_key.Pack()] = i;
+				_ready[i]._priority = DBL_MAX;
+			}
+
+			_pending.clear();
+			std::unordered_set<uint64_t> requested;
+			for (const ChunkRequest& request : requests)
+			{
+				const uint64_t key = request._key.Pack();
+				const auto ready = readyIndices.find(key);
+				if (false == requested.insert(key).second)
+				{
+					continue;
+				}
+				if (ready != readyIndices.end())
+				{
+					_ready[ready->second]._priority = request._priority;
+					continue;
+				}
+				if (_inFlight.count(key) != 0 || _residents.count(key) != 0 || _pending.size() >= _settings._maxQueuedRequests)
+				{
+					continue;
+				}
+				const auto requestTick = requestTicks.find(key);
+				_pending.push_back({ request, (requestTick != requestTicks.end()) ? requestTick->second : tick });
+			}
+			std::reverse(_pending.begin(), _pending.end());
+		}
+		LaunchGenerationJobs();
+	}
+
+	bool IsResident(const PlanetQuadTree::NodeKey& key)
+	{
+		return _residents.count(key.Pack()) != 0;
+	}
+
+	ResidentChunk FindResident(const PlanetQuadTree::NodeKey& key)
+	{
+		const auto found = _residents.find(key.Pack());
+		if (found == _residents.end())
+		{
+			return { nullptr, 0, 0 };
+		}
+
+		ResidentEntry& entry = found->second;
+		entry._lastUsedFrame = Graphics::GetFrameCount();
+		if (false == entry._isPinned)
+		{
+			_lru.splice(_lru.begin(), _lru, entry._lruPosition);
+		}
+		const D3D12_GPU_VIRTUAL_ADDRESS slotAddress = _chunkPool.GetGpuVirtualAddress() + entry._slot * _slotSize;
+		return { entry._chunk, slotAddress, slotAddress + _morphTargetOffset };
+	}
+
+	void Upload(CommandContext& context)
+	{
+		std::vector<ReadyChunk> ready;
+		WorkerCounters counters;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			ready.swap(_ready);
+			counters = _counters;
+			_counters = {};
+		}
+		std::sort(ready.begin(), ready.end(), [](const ReadyChunk& lhs, const ReadyChunk& rhs) { return lhs._priority < rhs._priority; });
+
+		_stats._uploadedChunks = 0;
+		_stats._uploadedBytes = 0;
+		_stats._evictedChunks = 0;
+		_stats._stalledUploads = 0;
+		std::vector<ReadyChunk> waiting;
+		for (ReadyChunk& readyChunk : ready)
+		{
+			//at least one chunk per frame whatever the budget
+			const size_t bytes = GetChunkBytes(*readyChunk._chunk);
+			const bool isInBudget = _stats._uploadedChunks == 0 || _stats._uploadedBytes + bytes <= _settings._uploadBytesPerFrame;
+			UINT slot = 0;
+			if (false == isInBudget || false == AcquireSlot(readyChunk._priority != DBL_MAX, slot))
+			{
+				_stats._stalledUploads += (true == isInBudget && readyChunk._priority != DBL_MAX) ? 1 : 0;
+				waiting.push_back(std::move(readyChunk));
+				continue;
+			}
+
+			DynAlloc upload = context.ReserveUploadMemory(bytes);
+			WriteChunk(*readyChunk._chunk, static_cast<uint8_t*>(upload.DataPtr));
+			context.CopyBufferRegion(_chunkPool, slot * _slotSize, upload.Buffer, upload.Offset, bytes);
+			AddResident(readyChunk._chunk, slot, false);
+			++_stats._uploadedChunks;
+			_stats._uploadedBytes += bytes;
+		}
+		if (_stats._uploadedChunks > 0)
+		{
+			//the state TerrainRender draws the pool in
+			context.TransitionResource(_chunkPool, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			//chunks finished during the upload join the ones still waiting, the least wanted are dropped past the cap
+			_ready.insert(_ready.end(), std::make_move_iterator(waiting.begin()), std::make_move_iterator(waiting.end()));
+			if (_ready.size() > _settings._maxReadyChunks)
+			{
+				std::sort(_ready.begin(), _ready.end(), [](const ReadyChunk& lhs, const ReadyChunk& rhs) { return lhs._priority < rhs._priority; });
+				_ready.resize(_settings._maxReadyChunks);
+			}
+			_stats._queueDepth = static_cast<UINT>(_pending.size());
+			_stats._inFlightChunks = static_cast<UINT>(_inFlight.size());
+			_stats._readyChunks = static_cast<UINT>(_ready.size());
+		}
+		//uploads made room among the ready chunks
+		LaunchGenerationJobs();
+
+		_stats._residentChunks = static_cast<UINT>(_residents.size());
+		_stats._residentBytes = _residents.size() * _slotSize;
+		_stats._completedChunks = counters._completedChunks;
+		if (counters._completedChunks > 0)
+		{
+			const double latency = counters._latencySeconds * 1000.0 / counters._completedChunks;
+			const double generation = counters._generationSeconds * 1000.0 / counters._completedChunks;
+			const bool isFirst = _stats._averageLatencyMilliseconds == 0.0;
+			_stats._averageLatencyMilliseconds = isFirst ? latency : _stats._averageLatencyMilliseconds + (latency - _stats._averageLatencyMilliseconds) * AVERAGE_WEIGHT;
+			_stats._averageGenerationMilliseconds = isFirst ? generation : _stats._averageGenerationMilliseconds + (generation - _stats._averageGenerationMilliseconds) * AVERAGE_WEIGHT;
+		}
+		_stats._maxLatencyMilliseconds = counters._maxLatencySeconds * 1000.0;
+	}
+
+	ByteAddressBuffer& GetChunkPool(void)
+	{
+		return _chunkPool;
+	}
+
+	const StreamingStats& GetStats(void)
+	{
+		return _stats;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pch.h"
+#include "PlanetQuadTree.h"
+#include "GpuBuffer.h"
+#include "CommandContext.h"
+
+//Background generation and GPU residency of planet chunks.
+//Chunks are requested every frame in priority order, generated as jobs of the JobSystem, copied into a pool of fixed size slots
+//under a per frame upload budget and evicted least recently used first once the pool is full.
+namespace TerrainStreaming
+{
+	//frames the GPU can still read a slot after its chunk was last drawn
+	constexpr UINT FRAMES_IN_FLIGHT = 3;
+
+	struct StreamingSettings
+	{
+		StreamingSettings() : _maxGenerationJobs(0), _maxQueuedRequests(512), _maxReadyChunks(256),
+			_uploadBytesPerFrame(2 << 20), _maxResidentBytes(64 << 20), _viewDirectionWeight(1.0) {}
+
+		//chunks generated at once, 0 uses half of the job system threads so that the short jobs of a frame find the rest free
+		UINT _maxGenerationJobs;
+		UINT _maxQueuedRequests;
+		//generated chunks waiting for upload, generation pauses while it is full
+		UINT _maxReadyChunks;
+		size_t _uploadBytesPerFrame;
+		//size of the GPU chunk pool
+		size_t _maxResidentBytes;
+		//chunks behind the camera wait as if they were (1 + weight) times farther away
+		double _viewDirectionWeight;
+	};
+
+	struct ChunkRequest
+	{
+		PlanetQuadTree::NodeKey _key;
+		//lower is served first
+		double _priority;
+	};
+
+	struct ResidentChunk
+	{
+		std::shared_ptr<const PlanetQuadTree::Chunk> _chunk;
+		//packed vertices and morph targets inside the chunk pool
+		D3D12_GPU_VIRTUAL_ADDRESS _vertexAddress;
+		D3D12_GPU_VIRTUAL_ADDRESS _morphTargetAddress;
+	};
+
+	struct StreamingStats
+	{
+		UINT _queueDepth;
+		UINT _inFlightChunks;
+		UINT _readyChunks;
+		UINT _residentChunks;
+		size_t _residentBytes;
+		size_t _capacityBytes;
+		//last frame
+		UINT _completedChunks;
+		UINT _uploadedChunks;
+		size_t _uploadedBytes;
+		UINT _evictedChunks;
+		//ready chunks that found no slot, every resident chunk was drawn within FRAMES_IN_FLIGHT
+		UINT _stalledUploads;
+		//request to ready, moving averages and the worst of the last frame
+		double _averageLatencyMilliseconds;
+		double _maxLatencyMilliseconds;
+		double _averageGenerationMilliseconds;
+	};
+
+	//The height function is called from the job system threads. The six root chunks are generated and uploaded right away and never evicted.
+	void Initialize(const StreamingSettings& settings, const PlanetQuadTree::QuadTreeSettings& quadTreeSettings, const PlanetQuadTree::HeightFunction& heightFunction);
+	void Shutdown(void);
+
+	double GetPriority(const double distance, const double3& toNode, const double3& viewDirection);
+
+	//Replaces the queue, chunks no longer requested are dropped before they are generated
+	void RequestChunks(std::vector<ChunkRequest>& requests);
+	bool IsResident(const PlanetQuadTree::NodeKey& key);
+	//Marks the chunk as drawn this frame, empty if it is not resident
+	ResidentChunk FindResident(const PlanetQuadTree::NodeKey& key);
+
+	//Copies ready chunks into the pool, closest first, until the frame budget is spent. Frame thread only
+	void Upload(CommandContext& context);
+
+	ByteAddressBuffer& GetChunkPool(void);
+	const StreamingStats& GetStats(void);
+}
@@ -0,0 +1,628 @@
+#include "TriangleBvh.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace
+{
+	//SAH costs of a node visit and of a triangle test
+	constexpr float TRAVERSAL_COST = 1.0f;
+	constexpr float INTERSECTION_COST = 1.0f;
+	//subtrees larger than this are built as separate tasks
+	constexpr UINT PARALLEL_BUILD_THRESHOLD = 4096;
+	//deeper nodes become leaves so that the traversal stacks never overflow
+	constexpr UINT MAX_DEPTH = 60;
+	constexpr UINT STACK_SIZE = MAX_DEPTH + 4;
+	constexpr float HIT_EPSILON = 1e-5f;
+
+	float GetAxis(const float3& v, const UINT axis) { return (&v.x)[axis]; }
+	float3 Min(const float3& a, const float3& b) { return float3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+	float3 Max(const float3& a, const float3& b) { return float3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+	float3 Subtract(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+	float3 Cross(const float3& a, const float3& b) { return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	float Dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	float SafeInverse(const float value)
+	{
+		return 1.0f / ((fabsf(value) > 1e-12f) ? value : copysignf(1e-12f, value));
+	}
+
+	struct Bounds
+	{
+		Bounds() : _min(FLT_MAX, FLT_MAX, FLT_MAX), _max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+		void Grow(const float3& point) { _min = Min(_min, point); _max = Max(_max, point); }
+		void Grow(const Bounds& bounds) { _min = Min(_min, bounds._min); _max = Max(_max, bounds._max); }
+
+		//half of the surface area, SAH only compares ratios
+		float GetHalfArea(void) const
+		{
+			if (_min.x > _max.x)
+			{
+				return 0.0f;
+			}
+			const float3 extent = Subtract(_max, _min);
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+
+		float3 _min;
+		float3 _max;
+	};
+
+	struct BuildContext
+	{
+		TriangleBvh::Node* _nodes;
+		const Bounds* _triangleBounds;
+		const float3* _centroids;
+		UINT* _references;
+		std::atomic<UINT> _nodeCount;
+		std::atomic<UINT> _leafCount;
+		std::atomic<UINT> _maxDepth;
+	};
+
+	UINT GetBin(const float3& centroid, const UINT axis, const float minimum, const float scale)
+	{
+		return std::min(TriangleBvh::BIN_COUNT - 1, static_cast<UINT>((GetAxis(centroid, axis) - minimum) * scale));
+	}
+
+	void Subdivide(BuildContext& context, const UINT nodeIndex, const UINT first, const UINT count, const UINT depth)
+	{
+		Bounds bounds;
+		Bounds centroidBounds;
+		for (UINT i = first; i < first + count; ++i)
+		{
+			bounds.Grow(context._triangleBounds[context._references[i]]);
+			centroidBounds.Grow(context._centroids[context._references[i]]);
+		}
+
+		TriangleBvh::Node& node = context._nodes[nodeIndex];
+		node._min = bounds._min;
+		node._max = bounds._max;
+
+		UINT maxDepth = context._maxDepth.load();
+		while (depth > maxDepth && false == context._maxDepth.compare_exchange_weak(maxDepth, depth)) {}
+
+		const auto MakeLeaf = [&]()
+		{
+			node._leftOrFirst = first;
+			node._triangleCount = count;
+			++context._leafCount;
+		};
+		if (count == 1 || depth >= MAX_DEPTH)
+		{
+			MakeLeaf();
+			return;
+		}
+
+		//cheapest boundary between bins over the three axes
+		float bestCost = FLT_MAX;
+		UINT bestAxis = 3;
+		UINT bestBin = 0;
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			const float minimum = GetAxis(centroidBounds._min, axis);
+			const float extent = GetAxis(centroidBounds._max, axis) - minimum;
+			if (extent <= 0.0f)
+			{
+				continue;
+			}
+
+			const float scale = TriangleBvh::BIN_COUNT / extent;
+			Bounds binBounds[TriangleBvh::BIN_COUNT];
+			UINT binCounts[TriangleBvh::BIN_COUNT] = {};
+			for (UINT i = first; i < first + count; ++i)
+			{
+				const UINT triangle = context._references[i];
+				const UINT bin = GetBin(context._centroids[triangle], axis, minimum, scale);
+				binBounds[bin].Grow(context._triangleBounds[triangle]);
+				++binCounts[bin];
+			}
+
+			float leftCosts[TriangleBvh::BIN_COUNT - 1];
+			Bounds leftBounds;
+			UINT leftCount = 0;
+			for (UINT bin = 0; bin < TriangleBvh::BIN_COUNT - 1; ++bin)
+			{
+				leftBounds.Grow(binBounds[bin]);
+				leftCount += binCounts[bin];
+				leftCosts[bin] = leftCount * leftBounds.GetHalfArea();
+			}
+			Bounds rightBounds;
+			UINT rightCount = 0;
+			for (UINT bin = TriangleBvh::BIN_COUNT - 1; bin > 0; --bin)
+			{
+				rightBounds.Grow(binBounds[bin]);
+				rightCount += binCounts[bin];
+				const float cost = leftCosts[bin - 1] + rightCount * rightBounds.GetHalfArea();
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin - 1;
+				}
+			}
+		}
+
+		UINT* const references = context._references + first;
+		UINT leftCount = count / 2;
+		if (bestAxis < 3)
+		{
+			const float leafCost = INTERSECTION_COST * count * bounds.GetHalfArea();
+			const float splitCost = TRAVERSAL_COST * bounds.GetHalfArea() + INTERSECTION_COST * bestCost;
+			if (splitCost >= leafCost && count <= TriangleBvh::MAX_LEAF_TRIANGLES)
+			{
+				MakeLeaf();
+				return;
+			}
+
+			const float minimum = GetAxis(centroidBounds._min, bestAxis);
+			const float scale = TriangleBvh::BIN_COUNT / (GetAxis(centroidBounds._max, bestAxis) - minimum);
+			const UINT* middle = std::partition(references, references + count, [&](const UINT triangle)
+			{
+				return GetBin(context._centroids[triangle], bestAxis, minimum, scale) <= bestBin;
+			});
+			leftCount = static_cast<UINT>(middle - references);
+		}
+		else if (count <= TriangleBvh::MAX_LEAF_TRIANGLES)
+		{
+			//every centroid in one point, nothing to split by
+			MakeLeaf();
+			return;
+		}
+		if (leftCount == 0 || leftCount == count)
+		{
+			leftCount = count / 2;
+		}
+
+		const UINT leftIndex = context._nodeCount.fetch_add(2);
+		node._leftOrFirst = leftIndex;
+		node._triangleCount = 0;
+
+		const auto BuildLeft = [&]() { Subdivide(context, leftIndex, first, leftCount, depth + 1); };
+		const auto BuildRight = [&]() { Subdivide(context, leftIndex + 1, first + leftCount, count - leftCount, depth + 1); };
+		if (count > PARALLEL_BUILD_THRESHOLD)
+		{
+			//the right subtree goes to whoever steals it, waiting runs other jobs meanwhile
+			JobSystem::JobCounter counter;
+			JobSystem::Run(BuildRight, &counter);
+			BuildLeft();
+			JobSystem::Wait(counter);
+		}
+		else
+		{
+			BuildLeft();
+			BuildRight();
+		}
+	}
+
+	//Entry distance or FLT_MAX
+	float IntersectNode(const TriangleBvh::Node& node, const float3& origin, const float3& inverseDirection, const float maxDistance)
+	{
+		const float tx1 = (node._min.x - origin.x) * inverseDirection.x, tx2 = (node._max.x - origin.x) * inverseDirection.x;
+		const float ty1 = (node._min.y - origin.y) * inverseDirection.y, ty2 = (node._max.y - origin.y) * inverseDirection.y;
+		const float tz1 = (node._min.z - origin.z) * inverseDirection.z, tz2 = (node._max.z - origin.z) * inverseDirection.z;
+		const float entry = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+		const float exit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), maxDistance));
+		return (entry <= exit) ? entry : FLT_MAX;
+	}
+
+	bool IntersectTriangle(const TriangleBvh::PreparedTriangle& triangle, const float3& origin, const float3& direction, float& t, float& u, float& v)
+	{
+		const float3 p = Cross(direction, triangle._edge2);
+		const float determinant = Dot(triangle._edge1, p);
+		if (determinant == 0.0f)
+		{
+			return false;
+		}
+		const float inverseDeterminant = 1.0f / determinant;
+		const float3 s = Subtract(origin, triangle._vertex0);
+		u = Dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+		const float3 q = Cross(s, triangle._edge1);
+		v = Dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+		t = Dot(triangle._edge2, q) * inverseDeterminant;
+		return t > HIT_EPSILON;
+	}
+
+	//Closest or any hit down the tree, the hit keeps the leaf triangle
+	template<bool IsAnyHit>
+	bool Traverse(const TriangleBvh::Bvh& bvh, const TriangleBvh::Ray& ray, TriangleBvh::Hit& hit)
+	{
+		hit = { ray._maxDistance, 0.0f, 0.0f, 0, TriangleBvh::INVALID_TRIANGLE };
+		if (true == bvh._nodes.empty())
+		{
+			return false;
+		}
+
+		const float3 inverseDirection(SafeInverse(ray._direction.x), SafeInverse(ray._direction.y), SafeInverse(ray._direction.z));
+		UINT stack[STACK_SIZE];
+		float stackEntries[STACK_SIZE];
+		UINT stackSize = 0;
+
+		UINT nodeIndex = 0;
+		if (IntersectNode(bvh._nodes[0], ray._origin, inverseDirection, hit._distance) == FLT_MAX)
+		{
+			return false;
+		}
+		while (true)
+		{
+			const TriangleBvh::Node& node = bvh._nodes[nodeIndex];
+			if (true == node.IsLeaf())
+			{
+				for (UINT i = node._leftOrFirst; i < node._leftOrFirst + node._triangleCount; ++i)
+				{
+					float t, u, v;
+					if (true == IntersectTriangle(bvh._triangles[i], ray._origin, ray._direction, t, u, v) && t < hit._distance)
+					{
+						hit = { t, u, v, 0, i };
+						if (true == IsAnyHit)
+						{
+							return true;
+						}
+					}
+				}
+			}
+			else
+			{
+				UINT nearIndex = node._leftOrFirst;
+				UINT farIndex = nearIndex + 1;
+				float nearEntry = IntersectNode(bvh._nodes[nearIndex], ray._origin, inverseDirection, hit._distance);
+				float farEntry = IntersectNode(bvh._nodes[farIndex], ray._origin, inverseDirection, hit._distance);
+				if (nearEntry > farEntry)
+				{
+					std::swap(nearIndex, farIndex);
+					std::swap(nearEntry, farEntry);
+				}
+				if (nearEntry != FLT_MAX)
+				{
+					if (farEntry != FLT_MAX)
+					{
+						stack[stackSize] = farIndex;
+						stackEntries[stackSize++] = farEntry;
+					}
+					nodeIndex = nearIndex;
+					continue;
+				}
+			}
+
+			//nodes behind a closer hit are skipped
+			do
+			{
+				if (stackSize == 0)
+				{
+					return hit._triangle != TriangleBvh::INVALID_TRIANGLE;
+				}
+				--stackSize;
+			} while (stackEntries[stackSize] >= hit._distance);
+			nodeIndex = stack[stackSize];
+		}
+	}
+
+	//leaf triangle to mesh and triangle of the input
+	void ResolveHit(const TriangleBvh::Bvh& bvh, TriangleBvh::Hit& hit)
+	{
+		if (hit._triangle == TriangleBvh::INVALID_TRIANGLE)
+		{
+			return;
+		}
+		const UINT triangle = bvh._triangleIndices[hit._triangle];
+		const auto mesh = std::upper_bound(bvh._meshFirstTriangles.begin(), bvh._meshFirstTriangles.end(), triangle) - 1;
+		hit._mesh = static_cast<UINT>(mesh - bvh._meshFirstTriangles.begin());
+		hit._triangle = triangle - *mesh;
+	}
+
+	//Four rays in SSE lanes
+	struct RayPacket
+	{
+		__m128 _origin[3];
+		__m128 _direction[3];
+		__m128 _inverseDirection[3];
+		__m128 _distance;
+		__m128 _u;
+		__m128 _v;
+		__m128i _triangle;
+	};
+
+	float GetHorizontalMin(const __m128 value)
+	{
+		const __m128 shuffled = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(_mm_min_ps(shuffled, _mm_shuffle_ps(shuffled, shuffled, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+
+	__m128 Select(const __m128 mask, const __m128 a, const __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	//Lane mask of the rays entering the node before their closest hit, entry distances of those
+	__m128 IntersectNodePacket(const TriangleBvh::Node& node, const RayPacket& packet, __m128& entry)
+	{
+		const float* minimum = &node._min.x;
+		const float* maximum = &node._max.x;
+		__m128 entries = _mm_setzero_ps();
+		__m128 exits = packet._distance;
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minimum[axis]), packet._origin[axis]), packet._inverseDirection[axis]);
+			const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maximum[axis]), packet._origin[axis]), packet._inverseDirection[axis]);
+			entries = _mm_max_ps(entries, _mm_min_ps(t1, t2));
+			exits = _mm_min_ps(exits, _mm_max_ps(t1, t2));
+		}
+		const __m128 mask = _mm_cmple_ps(entries, exits);
+		entry = Select(mask, entries, _mm_set1_ps(FLT_MAX));
+		return mask;
+	}
+
+	void IntersectTrianglePacket(const TriangleBvh::PreparedTriangle& triangle, const UINT triangleIndex, RayPacket& packet)
+	{
+		const __m128 e1x = _mm_set1_ps(triangle._edge1.x), e1y = _mm_set1_ps(triangle._edge1.y), e1z = _mm_set1_ps(triangle._edge1.z);
+		const __m128 e2x = _mm_set1_ps(triangle._edge2.x), e2y = _mm_set1_ps(triangle._edge2.y), e2z = _mm_set1_ps(triangle._edge2.z);
+		const __m128 dx = packet._direction[0], dy = packet._direction[1], dz = packet._direction[2];
+
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		const __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+		const __m128 sx = _mm_sub_ps(packet._origin[0], _mm_set1_ps(triangle._vertex0.x));
+		const __m128 sy = _mm_sub_ps(packet._origin[1], _mm_set1_ps(triangle._vertex0.y));
+		const __m128 sz = _mm_sub_ps(packet._origin[2], _mm_set1_ps(triangle._vertex0.z));
+		const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+		const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+		const __m128 zero = _mm_setzero_ps();
+		__m128 mask = _mm_cmpneq_ps(determinant, zero);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(HIT_EPSILON)));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, packet._distance));
+		if (_mm_movemask_ps(mask) == 0)
+		{
+			return;
+		}
+
+		packet._distance = Select(mask, t, packet._distance);
+		packet._u = Select(mask, u, packet._u);
+		packet._v = Select(mask, v, packet._v);
+		const __m128i maskI = _mm_castps_si128(mask);
+		packet._triangle = _mm_or_si128(_mm_and_si128(maskI, _mm_set1_epi32(static_cast<int>(triangleIndex))), _mm_andnot_si128(maskI, packet._triangle));
+	}
+
+	//Lanes past rayCount stay inactive
+	void IntersectRays(const TriangleBvh::Bvh& bvh, const TriangleBvh::Ray* rays, TriangleBvh::Hit* hits, const UINT rayCount)
+	{
+		alignas(16) float lanes[10][TriangleBvh::PACKET_SIZE] = {};
+		for (UINT lane = 0; lane < TriangleBvh::PACKET_SIZE; ++lane)
+		{
+			const TriangleBvh::Ray& ray = rays[std::min(lane, rayCount - 1)];
+			lanes[0][lane] = ray._origin.x;
+			lanes[1][lane] = ray._origin.y;
+			lanes[2][lane] = ray._origin.z;
+			lanes[3][lane] = ray._direction.x;
+			lanes[4][lane] = ray._direction.y;
+			lanes[5][lane] = ray._direction.z;
+			lanes[6][lane] = SafeInverse(ray._direction.x);
+			lanes[7][lane] = SafeInverse(ray._direction.y);
+			lanes[8][lane] = SafeInverse(ray._direction.z);
+			lanes[9][lane] = (lane < rayCount) ? ray._maxDistance : -1.0f;
+		}
+
+		RayPacket packet;
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			packet._origin[axis] = _mm_load_ps(lanes[axis]);
+			packet._direction[axis] = _mm_load_ps(lanes[3 + axis]);
+			packet._inverseDirection[axis] = _mm_load_ps(lanes[6 + axis]);
+		}
+		packet._distance = _mm_load_ps(lanes[9]);
+		packet._u = _mm_setzero_ps();
+		packet._v = _mm_setzero_ps();
+		packet._triangle = _mm_set1_epi32(static_cast<int>(TriangleBvh::INVALID_TRIANGLE));
+
+		UINT stack[STACK_SIZE];
+		float stackEntries[STACK_SIZE];
+		UINT stackSize = 0;
+		__m128 rootEntry;
+		if (false == bvh._nodes.empty() && _mm_movemask_ps(IntersectNodePacket(bvh._nodes[0], packet, rootEntry)) != 0)
+		{
+			stack[0] = 0;
+			stackEntries[0] = GetHorizontalMin(rootEntry);
+			stackSize = 1;
+		}
+
+		while (stackSize > 0)
+		{
+			--stackSize;
+			//every lane already hit something closer
+			alignas(16) float distances[TriangleBvh::PACKET_SIZE];
+			_mm_store_ps(distances, packet._distance);
+			if (stackEntries[stackSize] >= std::max(std::max(distances[0], distances[1]), std::max(distances[2], distances[3])))
+			{
+				continue;
+			}
+
+			const TriangleBvh::Node& node = bvh._nodes[stack[stackSize]];
+			if (true == node.IsLeaf())
+			{
+				for (UINT i = node._leftOrFirst; i < node._leftOrFirst + node._triangleCount; ++i)
+				{
+					IntersectTrianglePacket(bvh._triangles[i], i, packet);
+				}
+				continue;
+			}
+
+			__m128 leftEntry, rightEntry;
+			const bool isLeftHit = _mm_movemask_ps(IntersectNodePacket(bvh._nodes[node._leftOrFirst], packet, leftEntry)) != 0;
+			const bool isRightHit = _mm_movemask_ps(IntersectNodePacket(bvh._nodes[node._leftOrFirst + 1], packet, rightEntry)) != 0;
+			const float leftDistance = GetHorizontalMin(leftEntry);
+			const float rightDistance = GetHorizontalMin(rightEntry);
+			//the nearer child is pushed last and visited first
+			const bool isLeftFirst = leftDistance <= rightDistance;
+			if (true == isLeftHit && true == isRightHit)
+			{
+				stack[stackSize] = isLeftFirst ? node._leftOrFirst + 1 : node._leftOrFirst;
+				stackEntries[stackSize++] = isLeftFirst ? rightDistance : leftDistance;
+				stack[stackSize] = isLeftFirst ? node._leftOrFirst : node._leftOrFirst + 1;
+				stackEntries[stackSize++] = isLeftFirst ? leftDistance : rightDistance;
+			}
+			else if (true == isLeftHit || true == isRightHit)
+			{
+				stack[stackSize] = isLeftHit ? node._leftOrFirst : node._leftOrFirst + 1;
+				stackEntries[stackSize++] = isLeftHit ? leftDistance : rightDistance;
+			}
+		}
+
+		alignas(16) float distances[TriangleBvh::PACKET_SIZE];
+		alignas(16) float us[TriangleBvh::PACKET_SIZE];
+		alignas(16) float vs[TriangleBvh::PACKET_SIZE];
+		alignas(16) UINT triangles[TriangleBvh::PACKET_SIZE];
+		_mm_store_ps(distances, packet._distance);
+		_mm_store_ps(us, packet._u);
+		_mm_store_ps(vs, packet._v);
+		_mm_store_si128(reinterpret_cast<__m128i*>(triangles), packet._triangle);
+		for (UINT lane = 0; lane < rayCount; ++lane)
+		{
+			hits[lane] = { distances[lane], us[lane], vs[lane], 0, triangles[lane] };
+			ResolveHit(bvh, hits[lane]);
+		}
+	}
+}
+
+namespace TriangleBvh
+{
+	BuildStats Build(Bvh& bvh, const std::vector<MeshInput>& meshes)
+	{
+		const int64_t startTick = SystemTime::GetCurrentTick();
+		BuildStats stats = {};
+
+		bvh._meshFirstTriangles.clear();
+		UINT triangleCount = 0;
+		for (const MeshInput& mesh : meshes)
+		{
+			bvh._meshFirstTriangles.push_back(triangleCount);
+			triangleCount += mesh._indexCount / 3;
+		}
+
+		std::vector<PreparedTriangle> triangles(triangleCount);
+		std::vector<Bounds> triangleBounds(triangleCount);
+		std::vector<float3> centroids(triangleCount);
+		JobSystem::ParallelFor(0, static_cast<UINT>(meshes.size()), 1, [&](const UINT meshIndex)
+		{
+			const MeshInput& mesh = meshes[meshIndex];
+			const UINT8* positions = static_cast<const UINT8*>(mesh._positions);
+			const auto GetPosition = [&](const UINT vertex) { return *reinterpret_cast<const float3*>(positions + static_cast<size_t>(vertex) * mesh._positionStride); };
+			for (UINT i = 0; i < mesh._indexCount / 3; ++i)
+			{
+				const float3 p0 = GetPosition(mesh._indices[i * 3]);
+				const float3 p1 = GetPosition(mesh._indices[i * 3 + 1]);
+				const float3 p2 = GetPosition(mesh._indices[i * 3 + 2]);
+				const UINT triangle = bvh._meshFirstTriangles[meshIndex] + i;
+				triangles[triangle] = { p0, Subtract(p1, p0), Subtract(p2, p0) };
+				triangleBounds[triangle].Grow(p0);
+				triangleBounds[triangle].Grow(p1);
+				triangleBounds[triangle].Grow(p2);
+				centroids[triangle] = float3((p0.x + p1.x + p2.x) / 3.0f, (p0.y + p1.y + p2.y) / 3.0f, (p0.z + p1.z + p2.z) / 3.0f);
+			}
+		});
+
+		bvh._nodes.clear();
+		bvh._triangles.clear();
+		bvh._triangleIndices.resize(triangleCount);
+		if (triangleCount == 0)
+		{
+			return stats;
+		}
+		for (UINT i = 0; i < triangleCount; ++i)
+		{
+			bvh._triangleIndices[i] = i;
+		}
+
+		//a binary tree over n leaves has 2n - 1 nodes at most
+		bvh._nodes.resize(triangleCount * 2);
+		BuildContext context;
+		context._nodes = bvh._nodes.data();
+		context._triangleBounds = triangleBounds.data();
+		context._centroids = centroids.data();
+		context._references = bvh._triangleIndices.data();
+		context._nodeCount = 1;
+		context._leafCount = 0;
+		context._maxDepth = 0;
+		Subdivide(context, 0, 0, triangleCount, 0);
+		bvh._nodes.resize(context._nodeCount.load());
+		bvh._nodes.shrink_to_fit();
+
+		bvh._triangles.resize(triangleCount);
+		JobSystem::ParallelFor(0, triangleCount, 0, [&](const UINT i)
+		{
+			bvh._triangles[i] = triangles[bvh._triangleIndices[i]];
+		});
+
+		Bounds rootBounds;
+		rootBounds._min = bvh._nodes[0]._min;
+		rootBounds._max = bvh._nodes[0]._max;
+		const float rootArea = std::max(rootBounds.GetHalfArea(), FLT_MIN);
+		double sahCost = 0.0;
+		for (const Node& node : bvh._nodes)
+		{
+			Bounds nodeBounds;
+			nodeBounds._min = node._min;
+			nodeBounds._max = node._max;
+			const float cost = node.IsLeaf() ? INTERSECTION_COST * node._triangleCount : TRAVERSAL_COST;
+			sahCost += cost * nodeBounds.GetHalfArea() / rootArea;
+		}
+
+		stats._nodeCount = static_cast<UINT>(bvh._nodes.size());
+		stats._leafCount = context._leafCount.load();
+		stats._maxDepth = context._maxDepth.load();
+		stats._sahCost = static_cast<float>(sahCost);
+		stats._seconds = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+		return stats;
+	}
+
+	bool Intersect(const Bvh& bvh, const Ray& ray, Hit& hit)
+	{
+		const bool isHit = Traverse<false>(bvh, ray, hit);
+		ResolveHit(bvh, hit);
+		return isHit;
+	}
+
+	bool IsOccluded(const Bvh& bvh, const Ray& ray)
+	{
+		Hit hit;
+		return Traverse<true>(bvh, ray, hit);
+	}
+
+	void IntersectPacket(const Bvh& bvh, const Ray* rays, Hit* hits)
+	{
+		IntersectRays(bvh, rays, hits, PACKET_SIZE);
+	}
+
+	void IntersectBatch(const Bvh& bvh, const Ray* rays, Hit* hits, const size_t count)
+	{
+		const size_t packetCount = (count + PACKET_SIZE - 1) / PACKET_SIZE;
+		JobSystem::ParallelFor(0, static_cast<UINT>(packetCount), 0, [&](const UINT packet)
+		{
+			const size_t first = static_cast<size_t>(packet) * PACKET_SIZE;
+			IntersectRays(bvh, rays + first, hits + first, static_cast<UINT>(std::min(count - first, static_cast<size_t>(PACKET_SIZE))));
+		});
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "pch.h"
+#include "types.h"
+
+//CPU bounding volume hierarchy over triangle meshes for picking, line of sight and checking GPU ray tracing results.
+//Built with binned SAH on the worker threads, traversed one ray at a time or in SSE packets of four rays.
+namespace TriangleBvh
+{
+	constexpr UINT BIN_COUNT = 16;
+	//leaves are split while that is cheaper by SAH, and always above this size
+	constexpr UINT MAX_LEAF_TRIANGLES = 8;
+	constexpr UINT PACKET_SIZE = 4;
+	constexpr UINT INVALID_TRIANGLE = 0xffffffff;
+
+	//Interior nodes keep their two children next to each other at _leftOrFirst, leaves their triangles from _leftOrFirst
+	struct Node
+	{
+		float3 _min;
+		UINT _leftOrFirst;
+		float3 _max;
+		UINT _triangleCount;
+
+		bool IsLeaf(void) const { return _triangleCount > 0; }
+	};
+	static_assert(sizeof(Node) == 32, "A node has to fill half a cache line");
+
+	//Edges are stored for the Moller-Trumbore test
+	struct PreparedTriangle
+	{
+		float3 _vertex0;
+		float3 _edge1;
+		float3 _edge2;
+	};
+
+	struct MeshInput
+	{
+		const void* _positions;
+		//bytes between positions, sizeof(Geometry::Vertex) for geometry vertices
+		UINT _positionStride;
+		const UINT* _indices;
+		UINT _indexCount;
+	};
+
+	struct Bvh
+	{
+		std::vector<Node> _nodes;
+		//in leaf order
+		std::vector<PreparedTriangle> _triangles;
+		//triangle of the input, counted over all meshes, for every leaf triangle
+		std::vector<UINT> _triangleIndices;
+		//first input triangle of every mesh
+		std::vector<UINT> _meshFirstTriangles;
+	};
+
+	struct BuildStats
+	{
+		UINT _nodeCount;
+		UINT _leafCount;
+		UINT _maxDepth;
+		//expected traversal cost by surface area, in triangle tests
+		float _sahCost;
+		double _seconds;
+	};
+
+	struct Ray
+	{
+		float3 _origin;
+		float3 _direction;
+		float _maxDistance;
+	};
+
+	struct Hit
+	{
+		float _distance;
+		//barycentrics of vertex 1 and 2
+		float _u;
+		float _v;
+		UINT _mesh;
+		//inside its mesh, INVALID_TRIANGLE on a miss
+		UINT _triangle;
+	};
+
+	BuildStats Build(Bvh& bvh, const std::vector<MeshInput>& meshes);
+
+	//Closest hit
+	bool Intersect(const Bvh& bvh, const Ray& ray, Hit& hit);
+	//Any hit, for line of sight
+	bool IsOccluded(const Bvh& bvh, const Ray& ray);
+	//Four rays down the tree together, best for coherent rays
+	void IntersectPacket(const Bvh& bvh, const Ray* rays, Hit* hits);
+	//In packets on the worker threads
+	void IntersectBatch(const Bvh& bvh, const Ray* rays, Hit* hits, const size_t count);
+}
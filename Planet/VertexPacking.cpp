@@ -0,0 +1,257 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	constexpr float UNORM16_MAX = 65535.0f;
+	constexpr float SNORM8_MAX = 127.0f;
+
+	float GetQuantizationScale(const float extent)
+	{
+		return (extent > 0.0f) ? (UNORM16_MAX / extent) : 0.0f;
+	}
+
+	uint16_t QuantizeUnorm16(const float value, const float min, const float scale)
+	{
+		return static_cast<uint16_t>(std::nearbyint(std::min(std::max((value - min) * scale, 0.0f), UNORM16_MAX)));
+	}
+
+	int8_t QuantizeSnorm8(const float value)
+	{
+		return static_cast<int8_t>(std::nearbyint(std::min(std::max(value, -1.0f), 1.0f) * SNORM8_MAX));
+	}
+
+	float SignNotZero(const float value)
+	{
+		return (value >= 0.0f) ? 1.0f : -1.0f;
+	}
+
+	XMVECTOR XM_CALLCONV SignNotZeroVector(FXMVECTOR value)
+	{
+		return XMVectorSelect(XMVectorReplicate(-1.0f), XMVectorSplatOne(), XMVectorGreaterOrEqual(value, XMVectorZero()));
+	}
+
+	//x, y and z of four float3 with the given stride in three vectors
+	XMMATRIX XM_CALLCONV LoadTransposed(const uint8_t* first, const size_t stride)
+	{
+		const XMMATRIX rows(
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(first)),
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(first + stride)),
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(first + stride * 2)),
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(first + stride * 3)));
+		return XMMatrixTranspose(rows);
+	}
+
+	void XM_CALLCONV StoreUnorm16(FXMVECTOR value, FXMVECTOR min, FXMVECTOR scale, uint16_t* out, const size_t stride)
+	{
+		const XMVECTOR quantized = XMVectorRound(XMVectorClamp(XMVectorMultiply(XMVectorSubtract(value, min), scale), XMVectorZero(), XMVectorReplicate(UNORM16_MAX)));
+		XMUINT4 result;
+		XMStoreUInt4(&result, XMConvertVectorFloatToUInt(quantized, 0));
+		const uint32_t lanes[4] = { result.x, result.y, result.z, result.w };
+		for (UINT i = 0; i < 4; ++i)
+		{
+			*reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(out) + stride * i) = static_cast<uint16_t>(lanes[i]);
+		}
+	}
+
+	void XM_CALLCONV StoreSnorm8(FXMVECTOR value, int8_t* out, const size_t stride)
+	{
+		const XMVECTOR quantized = XMVectorRound(XMVectorMultiply(XMVectorClamp(value, XMVectorReplicate(-1.0f), XMVectorSplatOne()), XMVectorReplicate(SNORM8_MAX)));
+		XMINT4 result;
+		XMStoreSInt4(&result, XMConvertVectorFloatToInt(quantized, 0));
+		const int32_t lanes[4] = { result.x, result.y, result.z, result.w };
+		for (UINT i = 0; i < 4; ++i)
+		{
+			*reinterpret_cast<int8_t*>(reinterpret_cast<uint8_t*>(out) + stride * i) = static_cast<int8_t>(lanes[i]);
+		}
+	}
+
+	//Four positions at a time, stride apart in both streams
+	void EncodePositions(const uint8_t* positions, const size_t positionStride, uint8_t* packed, const size_t packedStride, const size_t count, const VertexPacking::QuantizationBounds& bounds)
+	{
+		const XMVECTOR minX = XMVectorReplicate(bounds._min.x);
+		const XMVECTOR minY = XMVectorReplicate(bounds._min.y);
+		const XMVECTOR minZ = XMVectorReplicate(bounds._min.z);
+		const XMVECTOR scaleX = XMVectorReplicate(GetQuantizationScale(bounds._extent.x));
+		const XMVECTOR scaleY = XMVectorReplicate(GetQuantizationScale(bounds._extent.y));
+		const XMVECTOR scaleZ = XMVectorReplicate(GetQuantizationScale(bounds._extent.z));
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMMATRIX position = LoadTransposed(positions + positionStride * i, positionStride);
+			VertexPacking::PackedPosition* out = reinterpret_cast<VertexPacking::PackedPosition*>(packed + packedStride * i);
+			StoreUnorm16(position.r[0], minX, scaleX, &out->_x, packedStride);
+			StoreUnorm16(position.r[1], minY, scaleY, &out->_y, packedStride);
+			StoreUnorm16(position.r[2], minZ, scaleZ, &out->_z, packedStride);
+		}
+		for (; i < count; ++i)
+		{
+			*reinterpret_cast<VertexPacking::PackedPosition*>(packed + packedStride * i) =
+				VertexPacking::EncodePosition(*reinterpret_cast<const float3*>(positions + positionStride * i), bounds);
+		}
+	}
+}
+
+namespace VertexPacking
+{
+	QuantizationBounds ComputeBounds(const Geometry::Vertex* vertices, const size_t count)
+	{
+		XMVECTOR min = XMVectorReplicate(FLT_MAX);
+		XMVECTOR max = XMVectorReplicate(-FLT_MAX);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const XMVECTOR position = XMLoadFloat3(&vertices[i]._position);
+			min = XMVectorMin(min, position);
+			max = XMVectorMax(max, position);
+		}
+
+		QuantizationBounds bounds = {};
+		if (count > 0)
+		{
+			XMStoreFloat3(&bounds._min, min);
+			XMStoreFloat3(&bounds._extent, XMVectorSubtract(max, min));
+		}
+		return bounds;
+	}
+
+	PackedPosition EncodePosition(const float3& position, const QuantizationBounds& bounds)
+	{
+		return {
+			QuantizeUnorm16(position.x, bounds._min.x, GetQuantizationScale(bounds._extent.x)),
+			QuantizeUnorm16(position.y, bounds._min.y, GetQuantizationScale(bounds._extent.y)),
+			QuantizeUnorm16(position.z, bounds._min.z, GetQuantizationScale(bounds._extent.z))
+		};
+	}
+
+	float3 DecodePosition(const PackedPosition& position, const QuantizationBounds& bounds)
+	{
+		return float3(
+			bounds._min.x + position._x * (bounds._extent.x / UNORM16_MAX),
+			bounds._min.y + position._y * (bounds._extent.y / UNORM16_MAX),
+			bounds._min.z + position._z * (bounds._extent.z / UNORM16_MAX));
+	}
+
+	void EncodeOctahedral(const float3& normal, int8_t (&encoded)[2])
+	{
+		//project on the octahedron |x| + |y| + |z| = 1 and fold the lower half over the diagonals
+		const float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+		float x = (l1 > 0.0f) ? normal.x / l1 : 0.0f;
+		float y = (l1 > 0.0f) ? normal.y / l1 : 0.0f;
+		if (normal.z < 0.0f)
+		{
+			const float foldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+			const float foldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+			x = foldedX;
+			y = foldedY;
+		}
+		encoded[0] = QuantizeSnorm8(x);
+		encoded[1] = QuantizeSnorm8(y);
+	}
+
+	float3 DecodeOctahedral(const int8_t (&encoded)[2])
+	{
+		float x = std::max(encoded[0] / SNORM8_MAX, -1.0f);
+		float y = std::max(encoded[1] / SNORM8_MAX, -1.0f);
+		const float z = 1.0f - fabsf(x) - fabsf(y);
+		const float t = std::max(-z, 0.0f);
+		x += (x >= 0.0f) ? -t : t;
+		y += (y >= 0.0f) ? -t : t;
+
+		const float length = sqrtf(x * x + y * y + z * z);
+		return float3(x / length, y / length, z / length);
+	}
+
+	PackedVertex Encode(const Geometry::Vertex& vertex, const QuantizationBounds& bounds)
+	{
+		PackedVertex packed;
+		packed._position = EncodePosition(vertex._position, bounds);
+		EncodeOctahedral(vertex._normal, packed._normal);
+		packed._uv[0] = XMConvertFloatToHalf(vertex._uv.x);
+		packed._uv[1] = XMConvertFloatToHalf(vertex._uv.y);
+		return packed;
+	}
+
+	Geometry::Vertex Decode(const PackedVertex& vertex, const QuantizationBounds& bounds)
+	{
+		return Geometry::Vertex(
+			DecodePosition(vertex._position, bounds),
+			DecodeOctahedral(vertex._normal),
+			float2(XMConvertHalfToFloat(vertex._uv[0]), XMConvertHalfToFloat(vertex._uv[1])));
+	}
+
+	void EncodeBatch(const Geometry::Vertex* vertices, PackedVertex* packed, const size_t count, const QuantizationBounds& bounds)
+	{
+		const uint8_t* source = reinterpret_cast<const uint8_t*>(vertices);
+		uint8_t* destination = reinterpret_cast<uint8_t*>(packed);
+		constexpr size_t sourceStride = sizeof(Geometry::Vertex);
+		constexpr size_t destinationStride = sizeof(PackedVertex);
+
+		EncodePositions(source + offsetof(Geometry::Vertex, _position), sourceStride,
+			destination + offsetof(PackedVertex, _position), destinationStride, count, bounds);
+
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const XMMATRIX normal = LoadTransposed(source + sourceStride * i + offsetof(Geometry::Vertex, _normal), sourceStride);
+			const XMVECTOR l1 = XMVectorAdd(XMVectorAdd(XMVectorAbs(normal.r[0]), XMVectorAbs(normal.r[1])), XMVectorAbs(normal.r[2]));
+			const XMVECTOR isValid = XMVectorGreater(l1, zero);
+			XMVECTOR x = XMVectorSelect(zero, XMVectorDivide(normal.r[0], l1), isValid);
+			XMVECTOR y = XMVectorSelect(zero, XMVectorDivide(normal.r[1], l1), isValid);
+
+			const XMVECTOR foldedX = XMVectorMultiply(XMVectorSubtract(one, XMVectorAbs(y)), SignNotZeroVector(x));
+			const XMVECTOR foldedY = XMVectorMultiply(XMVectorSubtract(one, XMVectorAbs(x)), SignNotZeroVector(y));
+			const XMVECTOR isLower = XMVectorLess(normal.r[2], zero);
+			x = XMVectorSelect(x, foldedX, isLower);
+			y = XMVectorSelect(y, foldedY, isLower);
+
+			PackedVertex* out = packed + i;
+			StoreSnorm8(x, &out->_normal[0], destinationStride);
+			StoreSnorm8(y, &out->_normal[1], destinationStride);
+		}
+		for (; i < count; ++i)
+		{
+			EncodeOctahedral(vertices[i]._normal, packed[i]._normal);
+		}
+
+		XMConvertFloatToHalfStream(&packed->_uv[0], destinationStride, &vertices->_uv.x, sourceStride, count);
+		XMConvertFloatToHalfStream(&packed->_uv[1], destinationStride, &vertices->_uv.y, sourceStride, count);
+	}
+
+	void EncodePositionBatch(const float3* positions, PackedPosition* packed, const size_t count, const QuantizationBounds& bounds)
+	{
+		EncodePositions(reinterpret_cast<const uint8_t*>(positions), sizeof(float3), reinterpret_cast<uint8_t*>(packed), sizeof(PackedPosition), count, bounds);
+	}
+
+	ErrorReport MeasureError(const Geometry::Vertex* vertices, const PackedVertex* packed, const size_t count, const QuantizationBounds& bounds)
+	{
+		ErrorReport report = {};
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Geometry::Vertex& reference = vertices[i];
+			const Geometry::Vertex decoded = Decode(packed[i], bounds);
+
+			report._maxPositionError = std::max({ report._maxPositionError,
+				fabsf(decoded._position.x - reference._position.x),
+				fabsf(decoded._position.y - reference._position.y),
+				fabsf(decoded._position.z - reference._position.z) });
+
+			const float cosine = decoded._normal.x * reference._normal.x + decoded._normal.y * reference._normal.y + decoded._normal.z * reference._normal.z;
+			report._maxNormalErrorDegrees = std::max(report._maxNormalErrorDegrees, XMConvertToDegrees(acosf(std::min(std::max(cosine, -1.0f), 1.0f))));
+
+			report._maxUVError = std::max({ report._maxUVError, fabsf(decoded._uv.x - reference._uv.x), fabsf(decoded._uv.y - reference._uv.y) });
+		}
+
+		const float step = std::max({ bounds._extent.x, bounds._extent.y, bounds._extent.z }) / UNORM16_MAX;
+		report._maxPositionErrorSteps = (step > 0.0f) ? report._maxPositionError / step : 0.0f;
+		return report;
+	}
+}
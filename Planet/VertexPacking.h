@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pch.h"
+#include "Geometry.h"
+#include "types.h"
+
+#include <DirectXPackedVector.h>
+
+//12 byte vertex for planet chunks: positions quantized to 16 bits inside the bounds of their mesh,
+//octahedral normals in two signed bytes and half precision uv. Decoded on the GPU by packedVertex.hlsli.
+namespace VertexPacking
+{
+	struct PackedPosition
+	{
+		uint16_t _x;
+		uint16_t _y;
+		uint16_t _z;
+	};
+
+	struct PackedVertex
+	{
+		PackedPosition _position;
+		int8_t _normal[2];
+		DirectX::PackedVector::HALF _uv[2];
+	};
+	static_assert(sizeof(PackedVertex) == 12, "PackedVertex has to match INPUT_LAYOUT");
+
+	//POSITION is the position with the normal in w, bit cast by DecodePackedNormal in packedVertex.hlsli
+	constexpr D3D12_INPUT_ELEMENT_DESC INPUT_LAYOUT[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
+	//Positions decode to _min + quantized * _extent / 65535
+	__declspec(align(16)) struct QuantizationBounds
+	{
+		float3 _min;
+		float pad0;
+		float3 _extent;
+		float pad1;
+	};
+
+	struct ErrorReport
+	{
+		//in units of the mesh positions and in quantization steps of the largest axis
+		float _maxPositionError;
+		float _maxPositionErrorSteps;
+		float _maxNormalErrorDegrees;
+		float _maxUVError;
+	};
+
+	QuantizationBounds ComputeBounds(const Geometry::Vertex* vertices, const size_t count);
+
+	PackedPosition EncodePosition(const float3& position, const QuantizationBounds& bounds);
+	float3 DecodePosition(const PackedPosition& position, const QuantizationBounds& bounds);
+	void EncodeOctahedral(const float3& normal, int8_t (&encoded)[2]);
+	float3 DecodeOctahedral(const int8_t (&encoded)[2]);
+
+	PackedVertex Encode(const Geometry::Vertex& vertex, const QuantizationBounds& bounds);
+	Geometry::Vertex Decode(const PackedVertex& vertex, const QuantizationBounds& bounds);
+
+	//Four vertices per iteration with DirectXMath, same bits as Encode
+	void EncodeBatch(const Geometry::Vertex* vertices, PackedVertex* packed, const size_t count, const QuantizationBounds& bounds);
+	void EncodePositionBatch(const float3* positions, PackedPosition* packed, const size_t count, const QuantizationBounds& bounds);
+
+	ErrorReport MeasureError(const Geometry::Vertex* vertices, const PackedVertex* packed, const size_t count, const QuantizationBounds& bounds);
+}
@@ -55,8 +55,14 @@ void VolumeTexture3D::CreateFromFile(const std::wstring& File)
 	{
 		m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	}
+	else
+	{
+		DynamicDescriptorHeap::InvalidateTableCaches();
+	}
 
     CreateDDSTextureFromFile(Graphics::g_Device, File.c_str(), 0, false, &m_pResource, m_SRVHandle);
+	if (m_PersistentSRVIndex != kNoPersistentSRV)
+		DynamicDescriptorHeap::SetPersistentDescriptor(m_PersistentSRVIndex, m_SRVHandle);
     m_UsageState = D3D12_RESOURCE_STATE_COMMON;
     m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
 	m_UAVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
@@ -96,9 +102,23 @@ void VolumeTexture3D::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Forma
         m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 		m_UAVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
+    else
+    {
+        DynamicDescriptorHeap::InvalidateTableCaches();
+    }
 
     ID3D12Resource* Resource = m_pResource.Get();
 
     Device->CreateShaderResourceView(Resource, &SRVDesc, m_SRVHandle);
 	Device->CreateUnorderedAccessView(Resource, nullptr, &UAVDesc, m_UAVHandle);
+	if (m_PersistentSRVIndex != kNoPersistentSRV)
+		DynamicDescriptorHeap::SetPersistentDescriptor(m_PersistentSRVIndex, m_SRVHandle);
+}
+
+void VolumeTexture3D::SetPersistentSRV(uint32_t Index)
+{
+	ASSERT(Index < DynamicDescriptorHeap::kNumPersistentDescriptors);
+	m_PersistentSRVIndex = Index;
+	if (m_SRVHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+		DynamicDescriptorHeap::SetPersistentDescriptor(Index, m_SRVHandle);
 }
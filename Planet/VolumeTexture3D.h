@@ -7,7 +7,7 @@ class VolumeTexture3D : public PixelBuffer
 {
 public:
 	VolumeTexture3D()
-		: m_NumMipMaps(0), m_FragmentCount(1), m_SampleCount(1)
+		: m_NumMipMaps(0), m_FragmentCount(1), m_SampleCount(1), m_PersistentSRVIndex(kNoPersistentSRV)
 	{
 		m_RTVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
 		m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
@@ -26,6 +26,9 @@ public:
 
 	void CreateFromFile(const std::wstring& File);
 
+	//same as ColorBuffer::SetPersistentSRV, set before Create
+	void SetPersistentSRV(uint32_t Index);
+
 protected:
 	void CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips = 1);
 
@@ -36,4 +39,7 @@ protected:
 	uint32_t m_NumMipMaps;
 	uint32_t m_FragmentCount;
 	uint32_t m_SampleCount;
+
+	static const uint32_t kNoPersistentSRV = ~0u;
+	uint32_t m_PersistentSRVIndex;
 };
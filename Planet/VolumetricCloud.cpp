@@ -3,26 +3,93 @@
 
 #include "VolumetricCloud.h"
 #include "CloudNoise.h"
+#include "CloudVolumeBake.h"
+#include "PersistentDescriptors.h"
+#include "FrameGraphExecutor.h"
 
 #include "CompiledShaders/fullscreenQuad.h"
 #include "CompiledShaders/volumetricCloud.h"
+#include "CompiledShaders/volumetricCloudBaked.h"
 #include "CompiledShaders/cloudDebug.h"
+#include "CompiledShaders/cloudShadowMap.h"
+
+namespace
+{
+	constexpr UINT CLOUD_SHADOW_MAP_SIZE = 1024;
+	//half the side of the ground area around the camera the shadow map covers, in km. about 60m per texel
+	constexpr double CLOUD_SHADOW_MAP_EXTENT = 32.0;
+
+	//about 0.8 degree of sun rotation
+	constexpr float CLOUD_SHADOW_SUN_COSINE_THRESHOLD = 0.9999f;
+	//wind drift allowed before re-rendering, in shadow map texels. the map is scrolled with the wind in between, a
+	//re-render only brings in the clouds that drifted in over the edge
+	constexpr float CLOUD_SHADOW_DRIFT_THRESHOLD = 16.0f;
+	//camera movement over the ground allowed before re-rendering, in shadow map texels
+	constexpr double CLOUD_SHADOW_TRANSLATION_THRESHOLD = 8.0;
+
+	//v rotated around the unit axis, same as mul(AngleAxis3x3(angle, axis), v) in common.hlsli
+	double3 RotateAroundAxis(const double3& v, const double3& axis, const double angle)
+	{
+		const double c = cos(angle);
+		const double s = sin(angle);
+		return v * c + Cross(axis, v) * s + axis * (Dot(axis, v) * (1.0 - c));
+	}
+
+	//the atmosphere LUTs and the cloud noise of the persistent descriptor region
+	void ReadPersistentTextures(FrameGraphExecutor& graph, const FrameGraph::PassHandle pass)
+	{
+		graph.Read(pass, graph.Import(AtmoSphereEffect::_transmittanceTexture2D, "Transmittance LUT"), FrameGraph::kShaderResource);
+		graph.Read(pass, graph.Import(AtmoSphereEffect::_ambientTexture2D, "Ambient LUT"), FrameGraph::kShaderResource);
+		graph.Read(pass, graph.Import(CloudNoise::_baseShapeNoise, "Base Shape Noise"), FrameGraph::kShaderResource);
+		graph.Read(pass, graph.Import(CloudNoise::_detailShapeNoise, "Detail Shape Noise"), FrameGraph::kShaderResource);
+		graph.Read(pass, graph.Import(CloudNoise::_weatherNoise, "Weather Noise"), FrameGraph::kShaderResource);
+	}
+}
 
 
 namespace VolumetricCloud
 {
 	RootSignature _skyCloudRS;
 	GraphicsPSO _skyCloudPSO;
+	RootSignature _skyCloudBakedRS;
+	GraphicsPSO _skyCloudBakedPSO;
 	ComputePSO _debugPSO;
+	ComputePSO _cloudShadowMapPSO;
 
 	ColorBuffer _cloudTransmittance;
-	ColorBuffer _cloudShadow;
 	ColorBuffer _cloudScattering;
 	ColorBuffer _cloudDistance;
+	ColorBuffer _cloudAccumulation;
 
 	ColorBuffer _cloudTemporalScattering;
 	ColorBuffer _cloudTemporalDistance;
 	ColorBuffer _cloudTemporalTransmittance;
+	ColorBuffer _cloudTemporalAccumulation;
+
+	ColorBuffer _cloudShadowMap;
+	//as rendered, and as sampled this frame
+	CloudShadowMapInfo _cloudShadowMapInfo;
+	CloudShadowMapInfo _cloudShadowMapSampleInfo;
+	CloudShadowMapStats _cloudShadowMapStats;
+	CloudProperty _cloudShadowMapCloudProperty;
+	double3 _cloudShadowMapGroundPoint;
+	bool _isCloudShadowMapValid = false;
+
+	bool IsSameCloudProperty(const CloudProperty& lhs, const CloudProperty& rhs)
+	{
+		return lhs._inRadius == rhs._inRadius
+			&& lhs._outRadius == rhs._outRadius
+			&& lhs._crispness == rhs._crispness
+			&& lhs._cloudDensityFactor == rhs._cloudDensityFactor
+			&& lhs._cloudCoverageFactor == rhs._cloudCoverageFactor
+			&& lhs._albedo == rhs._albedo
+			&& lhs._moveSpeed == rhs._moveSpeed
+			&& lhs._windDirectionAtTop.x == rhs._windDirectionAtTop.x
+			&& lhs._windDirectionAtTop.y == rhs._windDirectionAtTop.y
+			&& lhs._windDirectionAtTop.z == rhs._windDirectionAtTop.z
+			&& lhs._scale == rhs._scale
+			&& lhs._cloudScatteringPower == rhs._cloudScatteringPower;
+	}
 
 	void Initialize(const UINT SceneWidth, const UINT SceneHeight)
 	{
@@ -31,13 +98,18 @@ namespace VolumetricCloud
 
 		//Startup 4 GraphicsResources
 		_cloudTransmittance.Create(L"VolumetricCloud Transmittance", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R11G11B10_FLOAT);
-		_cloudShadow.Create(L"VolumetricCloud Shadow", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R32_FLOAT);
 		_cloudScattering.Create(L"VolumetricCloud Scattering", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R11G11B10_FLOAT);
 		_cloudDistance.Create(L"VolumetricCloud Distance", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R32_FLOAT);
+		_cloudAccumulation.Create(L"VolumetricCloud Accumulation", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R32G32B32A32_FLOAT);
 
 		_cloudTemporalScattering.Create(L"VolumetricCloud Temporal Scattering", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R11G11B10_FLOAT);
 		_cloudTemporalDistance.Create(L"VolumetricCloud Temporal Distance", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R32_FLOAT);
 		_cloudTemporalTransmittance.Create(L"VolumetricCloud Temporal Transmittance", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R11G11B10_FLOAT);
+		_cloudTemporalAccumulation.Create(L"VolumetricCloud Temporal Accumulation", SceneWidth, SceneHeight, 1, DXGI_FORMAT_R32G32B32A32_FLOAT);
+
+		_cloudShadowMap.Create(L"VolumetricCloud Shadow Map", CLOUD_SHADOW_MAP_SIZE, CLOUD_SHADOW_MAP_SIZE, 1, DXGI_FORMAT_R16_FLOAT);
+		_isCloudShadowMapValid = false;
+		_cloudShadowMapStats = {};
 
 		D3D12_DEPTH_STENCIL_DESC depthDesc = CD3DX12_DEPTH_STENCIL_DESC(CD3DX12_DEFAULT{});
 		depthDesc.DepthEnable = false;
@@ -50,20 +122,33 @@ namespace VolumetricCloud
 		SamplerCloudWrapDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 		SamplerCloudWrapDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 
-		_skyCloudRS.Reset(3, 3);
+		//the atmosphere LUTs and cloud noise come from the persistent descriptor region, the temporal targets follow them
+		_skyCloudRS.Reset(4, 3);
 		_skyCloudRS[0].InitAsConstantBuffer(0);
-		_skyCloudRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 8);
-		_skyCloudRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 1);
+		_skyCloudRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, PERSISTENT_SRV_COUNT);
+		_skyCloudRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, PERSISTENT_SRV_COUNT, 4);
+		_skyCloudRS[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 1);
 		_skyCloudRS.InitStaticSampler(0, Graphics::SamplerLinearClampDesc);
 		_skyCloudRS.InitStaticSampler(1, Graphics::SamplerPointClampDesc);
 		_skyCloudRS.InitStaticSampler(2, SamplerCloudWrapDesc);
 		_skyCloudRS.Finalize(L"VolumetricCloud Rootsignature");
 
+		//same layout plus the brick index and atlas of CloudVolumeBake
+		_skyCloudBakedRS.Reset(4, 3);
+		_skyCloudBakedRS[0].InitAsConstantBuffer(0);
+		_skyCloudBakedRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, PERSISTENT_SRV_COUNT);
+		_skyCloudBakedRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, PERSISTENT_SRV_COUNT, 6);
+		_skyCloudBakedRS[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 1);
+		_skyCloudBakedRS.InitStaticSampler(0, Graphics::SamplerLinearClampDesc);
+		_skyCloudBakedRS.InitStaticSampler(1, Graphics::SamplerPointClampDesc);
+		_skyCloudBakedRS.InitStaticSampler(2, SamplerCloudWrapDesc);
+		_skyCloudBakedRS.Finalize(L"VolumetricCloud Baked Rootsignature");
+
 		_skyCloudPSO.SetRootSignature(_skyCloudRS);
 		_skyCloudPSO.SetVertexShader(g_pfullscreenQuad, sizeof(g_pfullscreenQuad));
 		_skyCloudPSO.SetPixelShader(g_pvolumetricCloud, sizeof(g_pvolumetricCloud));
 
-		DXGI_FORMAT rtFormats[4] = { _cloudTransmittance.GetFormat(), _cloudShadow.GetFormat(), _cloudScattering.GetFormat(), _cloudDistance.GetFormat() };
+		DXGI_FORMAT rtFormats[4] = { _cloudTransmittance.GetFormat(), _cloudScattering.GetFormat(), _cloudDistance.GetFormat(), _cloudAccumulation.GetFormat() };
 		_skyCloudPSO.SetRenderTargetFormats(4, rtFormats, DXGI_FORMAT_UNKNOWN);
 		_skyCloudPSO.SetDepthStencilState(depthDesc);
 		_skyCloudPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
@@ -72,11 +157,21 @@ namespace VolumetricCloud
 		_skyCloudPSO.SetRasterizerState(rasterDesc);
 		_skyCloudPSO.SetSampleMask(D3D12_DEFAULT_SAMPLE_MASK);
 		_skyCloudPSO.SetBlendState(blendDesc);
+
+		_skyCloudBakedPSO = _skyCloudPSO;
+		_skyCloudBakedPSO.SetRootSignature(_skyCloudBakedRS);
+		_skyCloudBakedPSO.SetPixelShader(g_pvolumetricCloudBaked, sizeof(g_pvolumetricCloudBaked));
+
 		_skyCloudPSO.Finalize();
+		_skyCloudBakedPSO.Finalize();
 
 		_debugPSO.SetRootSignature(_skyCloudRS);
 		_debugPSO.SetComputeShader(g_pcloudDebug, sizeof(g_pcloudDebug));
 		_debugPSO.Finalize();
+
+		_cloudShadowMapPSO.SetRootSignature(_skyCloudRS);
+		_cloudShadowMapPSO.SetComputeShader(g_pcloudShadowMap, sizeof(g_pcloudShadowMap));
+		_cloudShadowMapPSO.Finalize();
 	}
 
 	void Shutdown(void)
@@ -85,112 +180,234 @@ namespace VolumetricCloud
 
 		_skyCloudRS.DestroyAll();
 		_skyCloudPSO.DestroyAll();
+		_skyCloudBakedRS.DestroyAll();
+		_skyCloudBakedPSO.DestroyAll();
 		_debugPSO.DestroyAll();
+		_cloudShadowMapPSO.DestroyAll();
 
 		_cloudTransmittance.Destroy();
-		_cloudShadow.Destroy();
 		_cloudScattering.Destroy();
 		_cloudDistance.Destroy();
+		_cloudAccumulation.Destroy();
 		_cloudTemporalScattering.Destroy();
 		_cloudTemporalDistance.Destroy();
 		_cloudTemporalTransmittance.Destroy();
+		_cloudTemporalAccumulation.Destroy();
+		_cloudShadowMap.Destroy();
 	}
 
-	void Render(const PerFrameSceneInfo& perFrameSceneInfo)
+	void Render(GraphicsContext& context, const PerFrameSceneInfo& perFrameSceneInfo)
 	{
-		GraphicsContext& context = GraphicsContext::Begin(L"Volumetric Cloud Render");
-		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[8] = {
-			AtmoSphereEffect::_transmittanceTexture2D.GetSRV(),
-			AtmoSphereEffect::_ambientTexture2D.GetSRV(),
-			CloudNoise::_baseShapeNoise.GetSRV(),
-			CloudNoise::_detailShapeNoise.GetSRV(),
-			CloudNoise::_weatherNoise.GetSRV(),
+		const bool isBaked = CloudVolumeBake::IsUsable(perFrameSceneInfo.atmosphereProperty, perFrameSceneInfo.cloudProperty);
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[6] = {
 			_cloudTemporalScattering.GetSRV(),
 			_cloudTemporalTransmittance.GetSRV(),
-			_cloudTemporalDistance.GetSRV()
+			_cloudTemporalDistance.GetSRV(),
+			_cloudTemporalAccumulation.GetSRV(),
+			CloudVolumeBake::_brickIndex.GetSRV(),
+			CloudVolumeBake::_brickAtlas.GetSRV()
 		};
 
-		context.TransitionResource(AtmoSphereEffect::_transmittanceTexture2D, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(AtmoSphereEffect::_ambientTexture2D, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.TransitionResource(CloudNoise::_baseShapeNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(CloudNoise::_detailShapeNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(CloudNoise::_weatherNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.TransitionResource(_cloudTemporalScattering, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_cloudTemporalTransmittance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_cloudTemporalDistance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.SetPipelineState(_skyCloudPSO);
-		context.SetRootSignature(_skyCloudRS);
-		context.SetDynamicConstantBufferView(0, sizeof(perFrameSceneInfo), &perFrameSceneInfo);
-		context.SetDynamicDescriptors(1, 0, 8, srvHandels);
-
-		context.TransitionResource(_cloudTransmittance, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-		context.TransitionResource(_cloudShadow, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-		context.TransitionResource(_cloudScattering, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-		context.TransitionResource(_cloudDistance, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-
-		context.ClearColor(_cloudTransmittance);
-		context.ClearColor(_cloudShadow);
-		context.ClearColor(_cloudScattering);
-		context.ClearColor(_cloudDistance);
-
-		context.SetViewportAndScissor(0, 0, _cloudScattering.GetWidth(), _cloudScattering.GetHeight());
-		D3D12_CPU_DESCRIPTOR_HANDLE rtv_handles[4] = { _cloudTransmittance.GetRTV(), _cloudShadow.GetRTV(), _cloudScattering.GetRTV(), _cloudDistance.GetRTV()};
-		context.SetRenderTargets(4, rtv_handles);
-		context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		context.DrawInstanced(3, 1);
-
-		context.TransitionResource(_cloudTransmittance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true);
-		context.TransitionResource(_cloudShadow, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true);
-		context.TransitionResource(_cloudScattering, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true);
-		context.TransitionResource(_cloudDistance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true);
-
-		context.CopyBuffer(_cloudTemporalScattering, _cloudScattering);
-		context.CopyBuffer(_cloudTemporalTransmittance, _cloudTransmittance);
-		context.CopyBuffer(_cloudTemporalDistance, _cloudDistance);
-
-		context.Finish();
+		ColorBuffer* const targets[4] = { &_cloudTransmittance, &_cloudScattering, &_cloudDistance, &_cloudAccumulation };
+		ColorBuffer* const history[4] = { &_cloudTemporalTransmittance, &_cloudTemporalScattering, &_cloudTemporalDistance, &_cloudTemporalAccumulation };
+
+		//the passes declare what they use, the frame graph works out the barriers
+		FrameGraphExecutor graph;
+		const FrameGraph::PassHandle raymarchPass = graph.AddPass("Cloud Raymarch", [&](CommandContext& passContext)
+		{
+			GraphicsContext& raymarchContext = passContext.GetGraphicsContext();
+			raymarchContext.SetPipelineState(isBaked ? _skyCloudBakedPSO : _skyCloudPSO);
+			raymarchContext.SetRootSignature(isBaked ? _skyCloudBakedRS : _skyCloudRS);
+			raymarchContext.SetDynamicConstantBufferView(0, sizeof(perFrameSceneInfo), &perFrameSceneInfo);
+			raymarchContext.SetPersistentDescriptorTable(1);
+			raymarchContext.SetDynamicDescriptors(2, 0, isBaked ? 6 : 4, srvHandels);
+
+			for (ColorBuffer* target : targets)
+			{
+				raymarchContext.ClearColor(*target);
+			}
+
+			raymarchContext.SetViewportAndScissor(0, 0, _cloudScattering.GetWidth(), _cloudScattering.GetHeight());
+			D3D12_CPU_DESCRIPTOR_HANDLE rtv_handles[4] = { _cloudTransmittance.GetRTV(), _cloudScattering.GetRTV(), _cloudDistance.GetRTV(), _cloudAccumulation.GetRTV()};
+			raymarchContext.SetRenderTargets(4, rtv_handles);
+			raymarchContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			raymarchContext.DrawInstanced(3, 1);
+		});
+
+		const FrameGraph::PassHandle historyPass = graph.AddPass("Cloud History Copy", [&](CommandContext& passContext)
+		{
+			for (UINT i = 0; i < 4; ++i)
+			{
+				passContext.CopyBuffer(*history[i], *targets[i]);
+			}
+		});
+
+		ReadPersistentTextures(graph, raymarchPass);
+		if (isBaked)
+		{
+			graph.Read(raymarchPass, graph.Import(CloudVolumeBake::_brickIndex, "Brick Index"), FrameGraph::kShaderResource);
+			graph.Read(raymarchPass, graph.Import(CloudVolumeBake::_brickAtlas, "Brick Atlas"), FrameGraph::kShaderResource);
+		}
+
+		//last frame is read while this frame is traced, then replaced by it
+		for (UINT i = 0; i < 4; ++i)
+		{
+			const FrameGraph::ResourceHandle target = graph.Import(*targets[i], "Cloud Target");
+			const FrameGraph::ResourceHandle previous = graph.Import(*history[i], "Cloud History");
+			graph.Read(raymarchPass, previous, FrameGraph::kShaderResource);
+			graph.Write(raymarchPass, target, FrameGraph::kRenderTarget);
+			graph.Read(historyPass, target, FrameGraph::kCopySource);
+			graph.Write(historyPass, previous, FrameGraph::kCopyDest);
+		}
+
+		graph.Execute(context);
 	}
 
 	void DebugRender(const PerFrameSceneInfo& perFrameSceneInfo, ColorBuffer& debugOutput)
 	{
 		ComputeContext& context = ComputeContext::Begin(L"Volumetric Cloud Debug Render");
-		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[8] = {
-			AtmoSphereEffect::_transmittanceTexture2D.GetSRV(),
-			AtmoSphereEffect::_ambientTexture2D.GetSRV(),
-			CloudNoise::_baseShapeNoise.GetSRV(),
-			CloudNoise::_detailShapeNoise.GetSRV(),
-			CloudNoise::_weatherNoise.GetSRV(),
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[4] = {
 			_cloudTemporalScattering.GetSRV(),
 			_cloudTemporalTransmittance.GetSRV(),
-			_cloudTemporalDistance.GetSRV()
+			_cloudTemporalDistance.GetSRV(),
+			_cloudTemporalAccumulation.GetSRV()
 		};
+		ColorBuffer* const history[4] = { &_cloudTemporalScattering, &_cloudTemporalTransmittance, &_cloudTemporalDistance, &_cloudTemporalAccumulation };
+
+		FrameGraphExecutor graph;
+		const FrameGraph::PassHandle debugPass = graph.AddPass("Cloud Debug", [&](CommandContext& passContext)
+		{
+			ComputeContext& debugContext = passContext.GetComputeContext();
+			debugContext.SetPipelineState(_debugPSO);
+			debugContext.SetRootSignature(_skyCloudRS);
+			debugContext.SetDynamicConstantBufferView(0, sizeof(perFrameSceneInfo), &perFrameSceneInfo);
+			debugContext.SetPersistentDescriptorTable(1);
+			debugContext.SetDynamicDescriptors(2, 0, 4, srvHandels);
+			debugContext.SetDynamicDescriptor(3, 0, debugOutput.GetUAV());
+			debugContext.Dispatch2D(debugOutput.GetWidth(), debugOutput.GetHeight(), 8, 8);
+		});
+
+		ReadPersistentTextures(graph, debugPass);
+		for (ColorBuffer* previous : history)
+		{
+			graph.Read(debugPass, graph.Import(*previous, "Cloud History"), FrameGraph::kShaderResource);
+		}
+
+		//the caller samples the output afterwards
+		const FrameGraph::ResourceHandle output = graph.Import(debugOutput, "Cloud Debug Output");
+		graph.Write(debugPass, output, FrameGraph::kUnorderedAccess);
+		graph.SetFinalState(output, FrameGraph::kShaderResource);
+
+		graph.Execute(context);
+		context.Finish();
+	}
 
-		context.TransitionResource(AtmoSphereEffect::_transmittanceTexture2D, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(AtmoSphereEffect::_ambientTexture2D, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.TransitionResource(CloudNoise::_baseShapeNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(CloudNoise::_detailShapeNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(CloudNoise::_weatherNoise, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.TransitionResource(_cloudTemporalScattering, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_cloudTemporalTransmittance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		context.TransitionResource(_cloudTemporalDistance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-		context.TransitionResource(debugOutput, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-
-		context.SetPipelineState(_debugPSO);
-		context.SetRootSignature(_skyCloudRS);
-		context.SetDynamicConstantBufferView(0, sizeof(perFrameSceneInfo), &perFrameSceneInfo);
-		context.SetDynamicDescriptors(1, 0, 8, srvHandels);
-		context.SetDynamicDescriptor(2, 0, debugOutput.GetUAV());
+	const CloudShadowMapInfo& UpdateShadowMap(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const CloudProperty& cloudProperty,
+		const double3& cameraPosition, const float3& sunRadianceDirection)
+	{
+		const float3 toSun(-sunRadianceDirection.x, -sunRadianceDirection.y, -sunRadianceDirection.z);
+		const float3& prevToSun = _cloudShadowMapInfo._toSunDirection;
+		const float sunCosine = toSun.x * prevToSun.x + toSun.y * prevToSun.y + toSun.z * prevToSun.z;
+		const double3 groundPoint = Normalize(cameraPosition) * static_cast<double>(atmosphereProperty._inRadius);
+
+		//angle and arc length the top of the cloud layer moved since the last update, see AnimatedPosition in cloudFunctions.hlsli
+		const double texelSize = 2.0 * CLOUD_SHADOW_MAP_EXTENT / static_cast<double>(CLOUD_SHADOW_MAP_SIZE);
+		const float driftAngle = (cloudProperty._time - _cloudShadowMapCloudProperty._time) * cloudProperty._moveSpeed * 0.001f / (2.0f * FPI);
+		const float windDrift = fabsf(driftAngle) * cloudProperty._outRadius;
+		const double translation = Length(groundPoint - _cloudShadowMapGroundPoint);
+
+		if (true == _isCloudShadowMapValid
+			&& sunCosine > CLOUD_SHADOW_SUN_COSINE_THRESHOLD
+			&& windDrift < static_cast<float>(texelSize) * CLOUD_SHADOW_DRIFT_THRESHOLD
+			&& translation < texelSize * CLOUD_SHADOW_TRANSLATION_THRESHOLD
+			&& IsSameCloudProperty(cloudProperty, _cloudShadowMapCloudProperty))
+		{
+			//the clouds turn around the wind axis, their shadows with them. moving the center the same way scrolls the
+			//map under the ground that samples it
+			_cloudShadowMapSampleInfo = _cloudShadowMapInfo;
+			if (0.0f != driftAngle)
+			{
+				const double3 windAxis = Normalize(double3(cloudProperty._windDirectionAtTop));
+				_cloudShadowMapSampleInfo._center = RotateAroundAxis(_cloudShadowMapInfo._center, windAxis, static_cast<double>(driftAngle));
+			}
+			++_cloudShadowMapStats._reusedFrames;
+			return _cloudShadowMapSampleInfo;
+		}
+
+		//same basis as CloudShadowMapBasis in cloudFunctions.hlsli. the center is snapped to whole texels of the sun
+		//facing plane, so a re-render after the camera moved samples the clouds at the same places and does not shimmer
+		const double3 toSunDirection(toSun);
+		const double3 helper = (fabs(toSunDirection.y) < 0.999) ? double3(0.0, 1.0, 0.0) : double3(1.0, 0.0, 0.0);
+		const double3 right = Normalize(Cross(helper, toSunDirection));
+		const double3 up = Cross(toSunDirection, right);
+		const double planeX = floor(Dot(groundPoint, right) / texelSize + 0.5) * texelSize;
+		const double planeY = floor(Dot(groundPoint, up) / texelSize + 0.5) * texelSize;
+
+		_cloudShadowMapInfo._toSunDirection = toSun;
+		_cloudShadowMapInfo._extent = static_cast<float>(CLOUD_SHADOW_MAP_EXTENT);
+		_cloudShadowMapInfo._center = right * planeX + up * planeY + toSunDirection * Dot(groundPoint, toSunDirection);
+		_cloudShadowMapSampleInfo = _cloudShadowMapInfo;
+		_cloudShadowMapCloudProperty = cloudProperty;
+		_cloudShadowMapGroundPoint = groundPoint;
+		_isCloudShadowMapValid = true;
+		++_cloudShadowMapStats._renderedFrames;
+
+		__declspec(align(16)) struct
+		{
+			AtmoSphereEffect::AtmoSphereProperty _atmosphereProperty;
+			CloudProperty _cloudProperty;
+			float3 _center;
+			float _extent;
+			float3 _toSunDirection;
+		} shadowMapInfo;
+
+		shadowMapInfo._atmosphereProperty = atmosphereProperty;
+		shadowMapInfo._cloudProperty = cloudProperty;
+		shadowMapInfo._center = ToRelativeFloat3(_cloudShadowMapInfo._center, double3());
+		shadowMapInfo._extent = _cloudShadowMapInfo._extent;
+		shadowMapInfo._toSunDirection = _cloudShadowMapInfo._toSunDirection;
+
+		ComputeContext& context = ComputeContext::Begin(L"Volumetric Cloud Shadow Map");
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[4] = {
+			_cloudTemporalScattering.GetSRV(),
+			_cloudTemporalTransmittance.GetSRV(),
+			_cloudTemporalDistance.GetSRV(),
+			_cloudTemporalAccumulation.GetSRV()
+		};
+		ColorBuffer* const history[4] = { &_cloudTemporalScattering, &_cloudTemporalTransmittance, &_cloudTemporalDistance, &_cloudTemporalAccumulation };
+
+		FrameGraphExecutor graph;
+		const FrameGraph::PassHandle shadowMapPass = graph.AddPass("Cloud Shadow Map", [&](CommandContext& passContext)
+		{
+			ComputeContext& shadowMapContext = passContext.GetComputeContext();
+			shadowMapContext.SetPipelineState(_cloudShadowMapPSO);
+			shadowMapContext.SetRootSignature(_skyCloudRS);
+			shadowMapContext.SetDynamicConstantBufferView(0, sizeof(shadowMapInfo), &shadowMapInfo);
+			shadowMapContext.SetPersistentDescriptorTable(1);
+			shadowMapContext.SetDynamicDescriptors(2, 0, 4, srvHandels);
+			shadowMapContext.SetDynamicDescriptor(3, 0, _cloudShadowMap.GetUAV());
+			shadowMapContext.Dispatch2D(_cloudShadowMap.GetWidth(), _cloudShadowMap.GetHeight(), 8, 8);
+		});
+
+		ReadPersistentTextures(graph, shadowMapPass);
+		for (ColorBuffer* previous : history)
+		{
+			graph.Read(shadowMapPass, graph.Import(*previous, "Cloud History"), FrameGraph::kShaderResource);
+		}
+
+		//the ground and the clouds sample the map for many frames after this one
+		const FrameGraph::ResourceHandle shadowMap = graph.Import(_cloudShadowMap, "Cloud Shadow Map");
+		graph.Write(shadowMapPass, shadowMap, FrameGraph::kUnorderedAccess);
+		graph.SetFinalState(shadowMap, FrameGraph::kShaderResource);
+
+		graph.Execute(context);
+		context.Finish();
 
-		context.Dispatch2D(debugOutput.GetWidth(), debugOutput.GetHeight(), 8, 8);
+		return _cloudShadowMapSampleInfo;
+	}
 
-		context.TransitionResource(debugOutput, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true);
-		context.Finish();
+	const CloudShadowMapStats& GetShadowMapStats(void)
+	{
+		return _cloudShadowMapStats;
 	}
 }
@@ -20,8 +20,14 @@ namespace VolumetricCloud
 {
     void Initialize(const UINT SceneWidth, const UINT SceneHeight);
     void Shutdown(void);
-    void Render(const struct PerFrameSceneInfo& perFrameSceneInfo);
+    //Records into context, which may be a pass of a ParallelPassRecorder
+    void Render(GraphicsContext& context, const struct PerFrameSceneInfo& perFrameSceneInfo);
 	void DebugRender(const struct PerFrameSceneInfo& perFrameSceneInfo, ColorBuffer& debugOutput);
+	const struct CloudShadowMapInfo& UpdateShadowMap(const AtmoSphereEffect::AtmoSphereProperty& atmosphereProperty, const struct CloudProperty& cloudProperty,
+		const double3& cameraPosition, const float3& sunRadianceDirection);
+	const struct CloudShadowMapStats& GetShadowMapStats(void);
+	//Compares every property but _time
+	bool IsSameCloudProperty(const struct CloudProperty& lhs, const struct CloudProperty& rhs);
 
 	__declspec(align(16)) struct CloudProperty
 	{
@@ -49,10 +55,35 @@ namespace VolumetricCloud
 		float3 sunRadianceDirection;
 		float resolutionX;
 		float _frame;
+		float3 cloudShadowToSun;
+		float cloudShadowExtent;
+		//relative to the render origin
+		float3 cloudShadowCenter;
+		float isStaticView;
+		//above the inner radius, from the double precision camera position
+		float cameraAltitude;
+	};
+
+	//Sun space projection to sample the cloud shadow map with
+	struct CloudShadowMapInfo
+	{
+		float3 _toSunDirection;
+		float _extent;
+		//ground point under the camera relative to the planet center, snapped to whole texels of the sun facing plane
+		//when the map was rendered and turned with the wind since
+		double3 _center;
+	};
+
+	//Frames since Initialize
+	struct CloudShadowMapStats
+	{
+		UINT64 _renderedFrames;
+		//sampled scrolled with the wind instead
+		UINT64 _reusedFrames;
 	};
 
     extern ColorBuffer _cloudTransmittance;
-    extern ColorBuffer _cloudShadow;
+    extern ColorBuffer _cloudShadowMap;
     extern ColorBuffer _cloudScattering;
     extern ColorBuffer _cloudDistance;
 };
@@ -2,6 +2,7 @@
 #define ATMOSPHERE_FUNCTIONS_HLSLI
 
 #include "common.hlsli"
+#include "phaseFunctions.hlsli"
 
 struct DensityProperty
 {
@@ -371,8 +372,7 @@ float rayleighPhaseFunction(const in float cosine)
 
 float miePhaseFunction(const in float g, const in float nu)
 {
-	float k = 3.0 / (8.0 * PI ) * (1.0 - g * g) / (2.0 + g * g);
-	return k * (1.0 + nu * nu) / pow(1.0 + g * g - 2.0 * g * nu, 1.5);
+	return CornetteShanks(nu, g);
 }
 
 void ComputeSingleScatteringTexture(
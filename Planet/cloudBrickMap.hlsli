@@ -0,0 +1,49 @@
+#ifndef CLOUD_BRICK_MAP_HLSLI
+#define CLOUD_BRICK_MAP_HLSLI
+
+//GPU side of CloudBrickMap.h, keep the two in sync.
+//index : one texel per grid cell over the sphere mapped (u, v) and the height percent in the cloud layer,
+//        atlas brick coordinate packed as x | y << 10 | z << 20 or CLOUD_BRICK_EMPTY
+//atlas : brickSize^3 bricks with a one voxel apron
+#define CLOUD_BRICK_EMPTY 0xFFFFFFFF
+
+uint3 UnpackCloudBrick(const in uint packed)
+{
+	return uint3(packed & 0x3FF, (packed >> 10) & 0x3FF, packed >> 20);
+}
+
+//Packed atlas brick of the cell containing uvh, CLOUD_BRICK_EMPTY where the map holds no cloud
+uint FindCloudBrick(const in float3 uvh, const in Texture3D<uint> brickIndex, out float3 gridCoord, out uint3 cell)
+{
+	uint3 gridSize;
+	brickIndex.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	gridCoord = saturate(uvh) * float3(gridSize);
+	cell = min(uint3(gridCoord), gridSize - 1);
+	return brickIndex.Load(int4(cell, 0));
+}
+
+bool IsCloudBrickEmpty(const in float3 uvh, const in Texture3D<uint> brickIndex)
+{
+	float3 gridCoord;
+	uint3 cell;
+	return FindCloudBrick(uvh, brickIndex, gridCoord, cell) == CLOUD_BRICK_EMPTY;
+}
+
+//Same result as CloudBrickMap::Sample, atlasSampler should be linear clamp
+float SampleCloudBrickMap(const in float3 uvh, const in uint brickSize, const in Texture3D<uint> brickIndex, const in Texture3D<float> brickAtlas, const in SamplerState atlasSampler)
+{
+	float3 gridCoord;
+	uint3 cell;
+	const uint packed = FindCloudBrick(uvh, brickIndex, gridCoord, cell);
+	if (packed == CLOUD_BRICK_EMPTY)
+	{
+		return 0.0;
+	}
+
+	float3 atlasSize;
+	brickAtlas.GetDimensions(atlasSize.x, atlasSize.y, atlasSize.z);
+	const float3 atlasCoord = float3(UnpackCloudBrick(packed) * (brickSize + 2)) + (gridCoord - float3(cell)) * brickSize + 1.0;
+	return brickAtlas.SampleLevel(atlasSampler, atlasCoord / atlasSize, 0);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "common.hlsli"
 #include "atmosphereFunctions.hlsli"
 #include "cloudFunctions.hlsli"
+#include "persistentTextures.hlsli"
 
 cbuffer PerFrame : register(b0)
 {
@@ -16,17 +17,9 @@ cbuffer PerFrame : register(b0)
 	float frame;
 }
 
-Texture2D<float4> transmittanceTexture: register(t0);
-Texture2D<float4> ambientTexture: register(t1);
-
-//Using to render cloud
-Texture3D<float> cloudBaseShapeTexture : register(t2);
-Texture3D<float> cloudDetailShapeTexture : register(t3);
-Texture2D<float4> cloudWeaderTexture : register(t4);
-
-Texture2D<float3> cloudTemporalScattering : register(t5);
-Texture2D<float3> cloudTemporalTransmittance : register(t6);
-Texture2D<float> cloudTemporalDistance : register(t7);
+Texture2D<float3> cloudTemporalScattering : register(t8);
+Texture2D<float3> cloudTemporalTransmittance : register(t9);
+Texture2D<float> cloudTemporalDistance : register(t10);
 
 RWTexture2D<float3> outputBuffer : register(u0);
 
@@ -124,7 +117,7 @@ float3 RenderCloudVolume(const in Ray r, const in AABBBoundingBox aabb, const in
 		const float3 pb = r.ro + r.rd * t1;
 		const float distance = length(pa - pb);
 		float3 scattering;
-		float3 t = Raymarching(pa - float3(0, 6359.5, -2.0), r.rd, distance, screenCoord, scattering);
+		float3 t = Raymarching(pa - planetCenter - float3(0, 6359.5, -2.0), r.rd, distance, screenCoord, scattering);
 		float3 background = float3(0, 0, 0);
 
 		return t * background + scattering;
@@ -144,8 +137,9 @@ void main(in uint2 DTID : SV_DispatchThreadID)
 	const float2 uv = DTID / float2(width, height);
 	const float2 ndc = float2(uv.x * 2.0 - 1, -2.0 * uv.y + 1.0);
 
-	const float3 aabbPosA = float3(-5.5, 6359.5, -1.5);
-	const float3 aabbPosB = float3(5.5, 6360.5, -7.5);
+	//placed on the planet surface, the camera is the render origin
+	const float3 aabbPosA = planetCenter + float3(-5.5, 6359.5, -1.5);
+	const float3 aabbPosB = planetCenter + float3(5.5, 6360.5, -7.5);
 
 	AABBBoundingBox aabb;
 	aabb.Init(aabbPosA, aabbPosB);
@@ -2,6 +2,8 @@
 #define CLOUD_FUNCTIONS_HLSLI
 
 #include "noise.hlsli"
+#include "phaseFunctions.hlsli"
+#include "cloudBrickMap.hlsli"
 
 //  ƼƮ Ÿ    ̾  : https://www.jpgrenier.org/clouds.html 
 #define BAYER_FACTOR 1.0/16.0
@@ -109,6 +111,15 @@ float GetCloudDensity(
 	const in Texture2D<float4> weatherTexture, const in SamplerState weatherSampler
 )
 {
+#ifdef CLOUD_BAKED_VOLUME
+	//static sky baked by CloudVolumeBake, replaces the weather, base and detail composite below
+	const float bakedHeight = HeightPercentInCloud(property, length(pos));
+	if (eps > bakedHeight || bakedHeight > 1.0 + eps)
+	{
+		return 0.0;
+	}
+	return SampleCloudBrickMap(float3(SphereUVMapping(normalize(pos)), bakedHeight), CLOUD_BAKED_BRICK_SIZE, cloudBrickIndex, cloudBrickAtlas, weatherSampler);
+#else
 	const float coverageFactor = property._cloudCoverageFactor;
 	float3 weatherPos = AnimatedPosition(property, pos);
 	const float2 uv = SphereUVMapping(normalize(weatherPos));
@@ -140,12 +151,24 @@ float GetCloudDensity(
 	}
 
 	return cloudSample;
+#endif
+}
+
+//basis of the sun facing plane the cloud shadow map is rendered on
+void CloudShadowMapBasis(const in float3 toSun, out float3 right, out float3 up)
+{
+	const float3 helper = (abs(toSun.y) < 0.999) ? float3(0, 1, 0) : float3(1, 0, 0);
+	right = normalize(cross(helper, toSun));
+	up = cross(toSun, right);
 }
 
-float HenyeyGreenstein(float nu, float g)
+float2 CloudShadowMapUV(const in float3 position, const in float3 center, const in float3 toSun, const in float extent)
 {
-	float gg = g * g;
-	return (1.0 - gg) / (pow(1.0 + gg - 2.0 * g * nu, 1.5) * 4.0 * PI);
+	float3 right, up;
+	CloudShadowMapBasis(toSun, right, up);
+	const float3 rv = position - center;
+	const float2 planeCoord = float2(dot(rv, right), dot(rv, up)) / extent;
+	return float2(planeCoord.x * 0.5 + 0.5, -planeCoord.y * 0.5 + 0.5);
 }
 
 float3 ComputeCloudOpticalDensity(
@@ -220,7 +243,8 @@ float3 CloudScatteringIntegrand(
 
 	const float opticalLength = dstep * 0.1;
 	float ns = dot(toSunDirection, direction);
-	float phaseDistribution = HenyeyGreenstein(ns, cloudHenyeyGreensteinG);
+	//Schlick stays within ~1% of HenyeyGreenstein at this g, see PhaseFunction::RunBenchmark
+	float phaseDistribution = HenyeyGreensteinSchlick(ns, HenyeyGreensteinSchlickK(cloudHenyeyGreensteinG));
 	//float phaseDistribution = miePhaseFunction(atmosphereProperty._miePhaseFunctionG, ns);
 	bool isEntered = false;
 	for (uint i = 0; i < stepCount; ++i)
@@ -0,0 +1,66 @@
+
+#include "common.hlsli"
+#include "atmosphereFunctions.hlsli"
+#include "cloudFunctions.hlsli"
+#include "persistentTextures.hlsli"
+
+cbuffer ShadowMap : register(b0)
+{
+	AtmoSphereProperty atmosphereProperty;
+	CloudProperty cloudProperty;
+	//relative to the planet center, the map is rendered in planet space and reused while the camera moves over it
+	float3 shadowMapCenter;
+	float shadowMapExtent;
+	float3 toSunDirection;
+}
+
+RWTexture2D<float> outShadowMap : register(u0);
+
+SamplerState samplerLinearClamp : register(s0);
+SamplerState samplerPointClamp : register(s1);
+SamplerState samplerCloudWrap : register(s2);
+
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	const uint marchingCount = 32;
+	const float minTransmittance = 0.01;
+
+	float2 dimensions;
+	outShadowMap.GetDimensions(dimensions.x, dimensions.y);
+	const float2 uv = (float2(DTid) + float2(0.5, 0.5)) / dimensions;
+
+	//texel -> point on the sun facing plane, pushed out past the cloud shell toward the sun
+	float3 right, up;
+	CloudShadowMapBasis(toSunDirection, right, up);
+	const float2 planeCoord = float2(uv.x * 2.0 - 1.0, -2.0 * uv.y + 1.0) * shadowMapExtent;
+	const float3 ro = shadowMapCenter + right * planeCoord.x + up * planeCoord.y + toSunDirection * cloudProperty._outRadius * 2.0;
+	const float3 rd = -toSunDirection;
+
+	//ends at the lit side ground, which is the point that reads this texel
+	float startShellDistance = -1.0;
+	float endShellDistance = -1.0;
+	const float travelDistance = RayShell(float3(0, 0, 0), cloudProperty._inRadius, cloudProperty._outRadius, ro, rd, startShellDistance, endShellDistance);
+
+	float transmittance = 1.0;
+	if (travelDistance > 0.0)
+	{
+		const float dstep = travelDistance / float(marchingCount);
+		float3 samplePosition = ro + rd * (startShellDistance + dstep * 0.5);
+
+		for (uint i = 0; i < marchingCount; ++i)
+		{
+			const float density = GetCloudDensity(atmosphereProperty, cloudProperty, samplePosition, samplePosition, 0,
+				cloudBaseShapeTexture, cloudDetailShapeTexture, samplerCloudWrap, cloudWeaderTexture, samplerLinearClamp);
+			transmittance *= exp(-(density * dstep * cloudProperty._cloudDensityFactor));
+
+			if (transmittance <= minTransmittance)
+			{
+				break;
+			}
+			samplePosition += rd * dstep;
+		}
+	}
+
+	outShadowMap[DTid] = transmittance;
+}
@@ -187,6 +187,25 @@ float2 RaySphere(const in float3 center, const in float radius, const in float3
     }
 }
 
+//RaySphere for a ray starting height above the sphere. The distance to the center is never squared,
+//so the ground and horizon stay stable close to the surface of a planet sized sphere.
+float2 RaySphereFromHeight(const in float3 center, const in float radius, const in float height, const in float3 ro, const in float3 rd)
+{
+    const float half_b = dot(normalize(ro - center), rd) * (radius + height);
+    const float c = height * (height + 2.0 * radius);
+    const float disc = half_b * half_b - c;
+
+    if (0.0 > disc)
+    {
+        return float2(-1, -1);
+    }
+
+    const float q = -(half_b + ((half_b >= 0.0) ? 1.0 : -1.0) * sqrt(disc));
+    const float t0 = q;
+    const float t1 = (q != 0.0) ? c / q : 0.0;
+    return float2(min(t0, t1), max(t0, t1));
+}
+
 float RayShell(const in float3 center, const in float inRadius, const in float outRadius, const in float3 ro, const in float3 rd, out float startShellDistance, out float endShellDistance)
 {
     float r = length(ro - center);
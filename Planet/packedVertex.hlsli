@@ -0,0 +1,46 @@
+#ifndef PACKED_VERTEX_HLSLI
+#define PACKED_VERTEX_HLSLI
+
+//Decoder for VertexPacking::PackedVertex, input layout VertexPacking::INPUT_LAYOUT.
+//Mirrored on the CPU by VertexPacking.h, keep the two in sync.
+
+struct PackedVertexIn
+{
+	//xyz : unorm16 position, w : octahedral normal as two snorm8
+	uint4 positionNormal : POSITION;
+	float2 uv : TEXCOORD;
+};
+
+struct QuantizationBounds
+{
+	float3 _min;
+	float pad0;
+	float3 _extent;
+	float pad1;
+};
+
+float3 DecodePackedPosition(const in uint3 position, const in QuantizationBounds bounds)
+{
+	return bounds._min + float3(position) * (bounds._extent / 65535.0);
+}
+
+//VertexPacking::PackedPosition array, three uint16 per entry so every other entry starts in the middle of a dword
+uint3 LoadPackedPosition(const in ByteAddressBuffer buffer, const in uint index)
+{
+	const uint address = index * 6;
+	const uint2 words = buffer.Load2(address & ~3);
+	return (0 == (address & 3)) ? uint3(words.x & 0xFFFF, words.x >> 16, words.y & 0xFFFF) : uint3(words.x >> 16, words.y & 0xFFFF, words.y >> 16);
+}
+
+float3 DecodePackedNormal(const in uint packedNormal)
+{
+	//sign extend both bytes
+	const int2 encoded = int2(packedNormal << 24, packedNormal << 16) >> 24;
+	float2 xy = max(float2(encoded) / 127.0, -1.0);
+	const float z = 1.0 - abs(xy.x) - abs(xy.y);
+	const float t = max(-z, 0.0);
+	xy += (xy >= 0.0) ? -t : t;
+	return normalize(float3(xy, z));
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PERSISTENT_TEXTURES_HLSLI
+#define PERSISTENT_TEXTURES_HLSLI
+
+//Textures of the persistent descriptor region, register tN is slot N of PersistentSRV (PersistentDescriptors.h).
+//Per pass textures start at t8.
+Texture2D<float4> transmittanceTexture : register(t0);
+Texture2D<float4> ambientTexture : register(t1);
+Texture3D<float4> multiscatteringTexture : register(t2);
+Texture3D<float4> raySinglescatteringTexture : register(t3);
+Texture3D<float4> mieSingleScatteringTexture : register(t4);
+
+//Using to render cloud
+Texture3D<float> cloudBaseShapeTexture : register(t5);
+Texture3D<float> cloudDetailShapeTexture : register(t6);
+Texture2D<float4> cloudWeaderTexture : register(t7);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PHASE_FUNCTIONS_HLSLI
+#define PHASE_FUNCTIONS_HLSLI
+
+#include "common.hlsli"
+
+//nu : cosine between the view direction and the light direction
+//Mirrored on the CPU by PhaseFunction.h, keep the two in sync.
+
+float HenyeyGreenstein(const in float nu, const in float g)
+{
+	const float gg = g * g;
+	const float denom = 1.0 + gg - 2.0 * g * nu;
+	//x^1.5 as x * sqrt(x), avoids pow
+	return (1.0 - gg) / (4.0 * PI * denom * sqrt(denom));
+}
+
+//Schlick's rational approximation of Henyey-Greenstein.
+//Relative error against HenyeyGreenstein: ~1% at g=0.1, ~8% at g=0.3, ~23% at g=0.5.
+float HenyeyGreensteinSchlickK(const in float g)
+{
+	return 1.55 * g - 0.55 * g * g * g;
+}
+
+float HenyeyGreensteinSchlick(const in float nu, const in float k)
+{
+	const float denom = 1.0 - k * nu;
+	return (1.0 - k * k) / (4.0 * PI * denom * denom);
+}
+
+//Weighted mix of a forward and a backward lobe
+float DualLobeHenyeyGreenstein(const in float nu, const in float gForward, const in float gBackward, const in float forwardWeight)
+{
+	return lerp(HenyeyGreenstein(nu, gBackward), HenyeyGreenstein(nu, gForward), forwardWeight);
+}
+
+//Cornette-Shanks, used for the atmospheric Mie term
+float CornetteShanks(const in float nu, const in float g)
+{
+	const float gg = g * g;
+	const float k = 3.0 / (8.0 * PI) * (1.0 - gg) / (2.0 + gg);
+	const float denom = 1.0 + gg - 2.0 * g * nu;
+	return k * (1.0 + nu * nu) / (denom * sqrt(denom));
+}
+
+#endif
@@ -3,11 +3,17 @@
 #include "AtmoSphereEffect.h"
 #include "VolumetricCloud.h"
 #include "Geometry.h"
+#include "CloudVolumeBake.h"
+#include "PlanetQuadTree.h"
+#include "TerrainStreaming.h"
+#include "TerrainRender.h"
+#include "PersistentDescriptors.h"
 
 #include "CompiledShaders/fullscreenQuad.h"
 #include "CompiledShaders/planet.h"
 
 #include "PostEffects.h"
+#include "PipelineLibrary.h"
 #include "PostProcess.h"
 #include "PlanetCamera.h"
 #include "DDSTextureLoader.h"
@@ -32,6 +38,8 @@ namespace {
 	constexpr int startWaveLength = 360;
 	constexpr int endWaveLength = 830;
 
+	const std::wstring cloudVolumeFile = L"CloudVolume.bake";
+
 	float CalculateSolarIrradiance(const float wavelength)
 	{
 		float wavelengths[48] = { 0.0 };
@@ -89,13 +97,20 @@ Planet::Planet(void)
 	, _CloudMoveSpeed("Cloud/MoveSpeed", 0.03, 0.0, 1.0, 0.01)
 	, _CloudScale("Cloud/Scale", 60.0, 1.0, 6000.0, 1.0)
 	, _CloudScatteringPower("Cloud/ScatteringPower", 4.0, 0.0, 10.0, 1.0)
+	, _CloudBake("Cloud/Bake/Start", false)
+	, _PlanetQuadTree("Planet/QuadTree/Enable", false)
+	, _ParallelPassRecording("Planet/ParallelPassRecording", true)
 	, _solarIrradiant{ 0.0f, 0.0f, 0.0f }
 	, _sunIrradianceDirection{ 0.0f, -1.0f, 0.0f }
-	, _planetCenterPosition{0.0f, 0.0f, 0.0f}
+	, _planetCenterPosition(0.0, 0.0, 0.0)
+	, _cameraAltitude(0.0)
+	, _prevCameraWorldPosition(0.0, 0.0, 0.0)
+	, _isPlanetQuadTreeStarted(false)
 	, _sunTheta(3.4)
 	, _sunPhi(0.0)
 	, _animationTime(0)
 	, _frame(0)
+	, _passStats()
 { 
 	_prevCameraInfo = {
 		_camera.GetPosition(),
@@ -156,11 +171,18 @@ void Planet::Startup( void )
 	const UINT rendertargetHeight = Graphics::g_SceneColorBuffer.GetHeight();
 
 	VolumetricCloud::Initialize(rendertargetWidth, rendertargetHeight);
+
+	CloudVolumeBake::BakedVolume bakedVolume;
+	if (true == CloudVolumeBake::Load(cloudVolumeFile, bakedVolume))
+	{
+		CloudVolumeBake::Upload(bakedVolume);
+	}
 	PlanetPostProcess::Initialize();
 
-    _camera.SetZRange(1.0f, 10000.0f);
+    //the terrain chunks are rasterized down to the lowest camera altitude
+    _camera.SetZRange(0.0005f, 10000.0f);
 
-	const PlanetCamera::PlanetCameraSetting cameraSettings(float3(0,0,0), _InRadius+0.001f, _OutRadius*4.0f, 100.0f, 100.0f);
+	const PlanetCamera::PlanetCameraSetting cameraSettings(_planetCenterPosition, static_cast<double>(_InRadius) + 0.001, static_cast<double>(_OutRadius) * 4.0, 100.0f, 100.0f);
     _cameraController.reset(new PlanetCamera(cameraSettings, _camera));
 
 	PostEffects::EnableAdaptation = false;
@@ -177,6 +199,13 @@ void Planet::Cleanup(void)
     AtmoSphereEffect::Shutdown();
 	PlanetPostProcess::Shutdown();
 	VolumetricCloud::Shutdown();
+	CloudVolumeBake::Shutdown();
+	if (true == _isPlanetQuadTreeStarted)
+	{
+		PlanetQuadTree::Shutdown();
+		_isPlanetQuadTreeStarted = false;
+	}
+	TerrainRender::Shutdown();
 	_planetPSO.DestroyAll();
 	_planetRS.DestroyAll();
 	_renderTarget.Destroy();
@@ -209,11 +238,9 @@ void Planet::Update( float deltaT )
 
 		AtmoSphereEffect::PreCompute(_atmosphricalProperty);
 		_ReComputation = false;
+		Reset();
 	}
 
-	const XMVECTOR planetCentre = Math::XMLoadFloat3(&_planetCenterPosition);
-	const XMVECTOR cameraForward = Math::XMVectorSubtract(_camera.GetPosition(), planetCentre);
-
 	if (true == GameInput::IsPressed(GameInput::kKey_q)) 
 	{
 		_sunPhi += GameInput::GetTimeCorrectedAnalogInput(GameInput::kAnalogMouseX) * 10.0f;
@@ -221,17 +248,32 @@ void Planet::Update( float deltaT )
 		Reset();
 	}
 	else {
-		Vector3 prev = _camera.GetPosition();
+		//camera motion is handled by the per pixel reprojection of the cloud history
 		_cameraController->Update(deltaT);
-		if ( static_cast<float>(Math::Length(prev - _camera.GetPosition())) > 0.0f)
-		{\
-			Reset();
+	}
+	_cameraAltitude = Length(_cameraController->GetWorldPosition() - _planetCenterPosition) - static_cast<double>(_InRadius);
+
+	if (true == _PlanetQuadTree)
+	{
+		//the root chunks and the streaming jobs only start once the terrain is enabled, and keep running after
+		if (false == _isPlanetQuadTreeStarted)
+		{
+			PlanetQuadTree::QuadTreeSettings quadTreeSettings;
+			quadTreeSettings._radius = _InRadius;
+			PlanetQuadTree::Initialize(quadTreeSettings, TerrainStreaming::StreamingSettings());
+			_isPlanetQuadTreeStarted = true;
 		}
+
+		float3 viewDirection;
+		XMStoreFloat3(&viewDirection, _camera.GetForwardVec());
+		PlanetQuadTree::Update(_cameraController->GetWorldPosition() - _planetCenterPosition, double3(viewDirection));
 	}
 	_sunIrradianceDirection = float3(-cosf(_sunTheta) * sinf(_sunPhi), sinf(_sunTheta), -cosf(_sunTheta) * cosf(_sunPhi));
 
 	_animationTime++;
 	_frame++;
+
+	const VolumetricCloud::CloudProperty prevCloudProperty = _cloudProperty;
 	_cloudProperty =
 	{
 		_InRadius + cloudMinHeightOffset,
@@ -246,6 +288,23 @@ void Planet::Update( float deltaT )
 		_CloudScale,
 		_CloudScatteringPower
 	};
+
+	if (false == VolumetricCloud::IsSameCloudProperty(prevCloudProperty, _cloudProperty))
+	{
+		Reset();
+	}
+
+	if (true == _CloudBake)
+	{
+		CloudVolumeBake::BakedVolume bakedVolume;
+		if (true == CloudVolumeBake::Bake(_atmosphricalProperty, _cloudProperty, CloudVolumeBake::BakeSettings(), bakedVolume))
+		{
+			CloudVolumeBake::Save(cloudVolumeFile, bakedVolume);
+			CloudVolumeBake::Upload(bakedVolume);
+			Reset();
+		}
+		_CloudBake = false;
+	}
 }
 
 void Planet::RenderScene( void )
@@ -259,59 +318,114 @@ void Planet::RenderScene( void )
 		_camera.GetFOV()
     };
 
+	//the camera is the render origin, so its float position never changes and the view is compared in double
+	const double3& cameraWorldPosition = _cameraController->GetWorldPosition();
+	const bool isStaticView = (0 == memcmp(&cameraInfo, &_prevCameraInfo, sizeof(CameraInfo)))
+		&& (0 == memcmp(&cameraWorldPosition, &_prevCameraWorldPosition, sizeof(double3)));
+
+	const float3 planetCenter = ToRelativeFloat3(_planetCenterPosition, cameraWorldPosition);
+
+	//the cloud history is reprojected through the previous camera, placed relative to this frame's render origin
+	CameraInfo prevCameraInfo = _prevCameraInfo;
+	prevCameraInfo.cameraPosition = ToRelativeFloat3(_prevCameraWorldPosition, cameraWorldPosition);
+
+	const double3 cameraPlanetPosition = cameraWorldPosition - _planetCenterPosition;
+	const VolumetricCloud::CloudShadowMapInfo& cloudShadowMapInfo = VolumetricCloud::UpdateShadowMap(
+		_atmosphricalProperty, _cloudProperty, cameraPlanetPosition, _sunIrradianceDirection);
+
 	const VolumetricCloud::PerFrameSceneInfo perframe
 	{
 		_atmosphricalProperty,
 		_cloudProperty,
 		cameraInfo,
-		_prevCameraInfo,
-		_planetCenterPosition,
+		prevCameraInfo,
+		planetCenter,
 		static_cast<float>(_animationTime),
 		_sunIrradianceDirection,
 		static_cast<float>(_renderTarget.GetWidth()),
-		static_cast<float>(_frame)
+		static_cast<float>(_frame),
+		cloudShadowMapInfo._toSunDirection,
+		cloudShadowMapInfo._extent,
+		ToRelativeFloat3(_planetCenterPosition + cloudShadowMapInfo._center, cameraWorldPosition),
+		isStaticView ? 1.0f : 0.0f,
+		static_cast<float>(_cameraAltitude)
 	};
 
-	VolumetricCloud::Render(perframe);
-	_prevCameraInfo = cameraInfo;
+	//chunk uploads change the streaming state, which only the frame thread touches
+	if (true == _PlanetQuadTree)
+	{
+		GraphicsContext& uploadContext = GraphicsContext::Begin(L"Terrain Upload");
+		TerrainStreaming::Upload(uploadContext);
+		uploadContext.Finish();
+	}
 
-	GraphicsContext& context = GraphicsContext::Begin(L"Planet Render");
-	D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[9] = {
-		AtmoSphereEffect::_multiScatteringTexture3D.GetSRV(),
-		AtmoSphereEffect::_singleRayleighScatteringTexture3D.GetSRV(),
-		AtmoSphereEffect::_singleMieScatteringTexture3D.GetSRV(),
-		AtmoSphereEffect::_transmittanceTexture2D.GetSRV(),
-		AtmoSphereEffect::_ambientTexture2D.GetSRV(),
-
-		VolumetricCloud::_cloudTransmittance.GetSRV(),
-		VolumetricCloud::_cloudShadow.GetSRV(),
-		VolumetricCloud::_cloudScattering.GetSRV(),
-		VolumetricCloud::_cloudDistance.GetSRV()
-	};
+	//the passes are not independent, each one reads what the one before it wrote. they are recorded at the same
+	//time on job system threads and the states they leave their resources in are resolved in submission order
+	ParallelPassRecorder passes(L"", true == _ParallelPassRecording);
 
-	context.SetPipelineState(_planetPSO);
-	context.SetRootSignature(_planetRS);
-	context.SetDynamicConstantBufferView(0, sizeof(perframe), &perframe);
-	context.SetDynamicDescriptors(1, 0, 9, srvHandels);
+	passes.AddGraphicsPass(L"Volumetric Cloud Render", [&perframe](GraphicsContext& context)
+	{
+		VolumetricCloud::Render(context, perframe);
+	});
 
-	context.TransitionResource(_renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-	context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
-	context.ClearColor(_renderTarget);
-	context.ClearColor(Graphics::g_SceneColorBuffer);
+	passes.AddGraphicsPass(L"Planet Render", [this, &perframe](GraphicsContext& context)
+	{
+		//the atmosphere LUTs are in the persistent descriptor region
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandels[4] = {
+			VolumetricCloud::_cloudTransmittance.GetSRV(),
+			VolumetricCloud::_cloudShadowMap.GetSRV(),
+			VolumetricCloud::_cloudScattering.GetSRV(),
+			VolumetricCloud::_cloudDistance.GetSRV()
+		};
 
-	context.SetViewportAndScissor(0, 0, _renderTarget.GetWidth(), _renderTarget.GetHeight());
-	context.SetRenderTarget(_renderTarget.GetRTV());
-	context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	context.DrawInstanced(3, 1);
-	context.Finish();
+		//the cloud pass is recorded at the same time, its outputs are only in a known state once they are transitioned here
+		context.TransitionResource(VolumetricCloud::_cloudTransmittance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudShadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudScattering, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		context.TransitionResource(VolumetricCloud::_cloudDistance, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+		context.SetPipelineState(_planetPSO);
+		context.SetRootSignature(_planetRS);
+		context.SetDynamicConstantBufferView(0, sizeof(perframe), &perframe);
+		context.SetPersistentDescriptorTable(1);
+		context.SetDynamicDescriptors(2, 0, 4, srvHandels);
+
+		context.TransitionResource(_renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+		context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+		context.ClearColor(_renderTarget);
+		context.ClearColor(Graphics::g_SceneColorBuffer);
+
+		context.SetViewportAndScissor(0, 0, _renderTarget.GetWidth(), _renderTarget.GetHeight());
+		context.SetRenderTarget(_renderTarget.GetRTV());
+		context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context.DrawInstanced(3, 1);
+	});
+
+	//the streamed chunks are drawn over the ray traced ground and shaded the same way
+	if (true == _PlanetQuadTree)
+	{
+		passes.AddGraphicsPass(L"Terrain Render", [this, &perframe, &cameraPlanetPosition](GraphicsContext& context)
+		{
+			TerrainRender::Render(context, perframe, _camera.GetViewProjMatrix(), cameraPlanetPosition, _renderTarget);
+		});
+	}
 
-	ComputeContext& computeContext = ComputeContext::Begin(L"Planet ComputeContext");
-	PlanetPostProcess::CrepuscularRays(computeContext, _renderTarget, g_SceneColorBuffer, cameraInfo, _sunIrradianceDirection);
-	PlanetPostProcess::GaussianBlur(computeContext, g_SceneColorBuffer, _renderTarget);
-	computeContext.CopyBuffer(Graphics::g_SceneColorBuffer, _renderTarget);
-	computeContext.Finish();
+	passes.AddComputePass(L"Crepuscular Rays", [this, &cameraInfo](ComputeContext& context)
+	{
+		PlanetPostProcess::CrepuscularRays(context, _renderTarget, g_SceneColorBuffer, cameraInfo, _sunIrradianceDirection);
+	});
+
+	passes.AddComputePass(L"Planet Blur", [this](ComputeContext& context)
+	{
+		PlanetPostProcess::GaussianBlur(context, g_SceneColorBuffer, _renderTarget);
+		context.CopyBuffer(Graphics::g_SceneColorBuffer, _renderTarget);
+	});
+
+	passes.Execute();
+	_passStats = passes.GetStats();
 
 	_prevCameraInfo = cameraInfo;
+	_prevCameraWorldPosition = cameraWorldPosition;
 }
 
 void Planet::RenderUI(GraphicsContext& context)
@@ -319,6 +433,32 @@ void Planet::RenderUI(GraphicsContext& context)
     TextContext text(context);
 	text.Begin();
 	text.DrawString("\n Camera Rotation: Mouse \n Sun Rotation: Mouse + Q \n control altitude: Mouses Wheel");
+
+	const DescriptorTableCacheStats tables = DynamicDescriptorHeap::GetTableCacheStats(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	const uint64_t committedTables = tables.TableHits + tables.TableMisses;
+	text.DrawFormattedString("\n Descriptor tables: %.1f%% reused, %llu descriptors copied, %llu not copied",
+		committedTables > 0 ? 100.0 * tables.TableHits / committedTables : 0.0, tables.DescriptorsCopied, tables.DescriptorsReused);
+	const PipelineLibraryStats pipelines = PipelineLibrary::GetStats();
+	text.DrawFormattedString("\n Pipelines: %s start, %u loaded in %.1f ms, %u compiled in %.1f ms",
+		true == pipelines.WarmStart ? "warm" : "cold", pipelines.Loaded, pipelines.LoadSeconds * 1000.0, pipelines.Compiled, pipelines.CompileSeconds * 1000.0);
+	text.DrawFormattedString("\n Pass recording: %u passes %s in %.2f ms, %.2f ms of recording",
+		_passStats.PassCount, true == _ParallelPassRecording ? "parallel" : "serial", _passStats.RecordSeconds * 1000.0, _passStats.PassSeconds * 1000.0);
+	const VolumetricCloud::CloudShadowMapStats& cloudShadowMap = VolumetricCloud::GetShadowMapStats();
+	text.DrawFormattedString("\n Cloud shadow map: %llu rendered, %llu reused",
+		cloudShadowMap._renderedFrames, cloudShadowMap._reusedFrames);
+	if (true == _PlanetQuadTree)
+	{
+		const PlanetQuadTree::FrameStats& stats = PlanetQuadTree::GetFrameStats();
+		text.DrawFormattedString("\n Planet chunks: %u drawn, %u selected, %u triangles, %u pending, %u requested, detail %.2f",
+			stats._drawnChunks, stats._selectedNodes, stats._triangles, stats._pendingChunks, stats._requestedChunks, stats._detailScale);
+
+		const TerrainStreaming::StreamingStats& streaming = TerrainStreaming::GetStats();
+		text.DrawFormattedString("\n Terrain streaming: %u queued, %u generating, %u ready, %u resident %.1f / %.1f MB, %u uploaded %.1f KB, %u evicted, %u stalled, latency %.2f ms (max %.2f), generation %.2f ms",
+			streaming._queueDepth, streaming._inFlightChunks, streaming._readyChunks, streaming._residentChunks,
+			streaming._residentBytes / (1024.0 * 1024.0), streaming._capacityBytes / (1024.0 * 1024.0),
+			streaming._uploadedChunks, streaming._uploadedBytes / 1024.0, streaming._evictedChunks, streaming._stalledUploads,
+			streaming._averageLatencyMilliseconds, streaming._maxLatencyMilliseconds, streaming._averageGenerationMilliseconds);
+	}
 	text.End();
 }
 
@@ -337,9 +477,10 @@ void Planet::StartUpForGraphicsResource(void)
 	SamplerCloudWrapDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 	SamplerCloudWrapDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 
-	_planetRS.Reset(2, 3);
+	_planetRS.Reset(3, 3);
 	_planetRS[0].InitAsConstantBuffer(0);
-	_planetRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 9);
+	_planetRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, PERSISTENT_SRV_COUNT);
+	_planetRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, PERSISTENT_SRV_COUNT, 4);
 
 	_planetRS.InitStaticSampler(0, Graphics::SamplerLinearClampDesc);
 	_planetRS.InitStaticSampler(1, Graphics::SamplerPointClampDesc);
@@ -359,6 +500,8 @@ void Planet::StartUpForGraphicsResource(void)
 	_planetPSO.SetSampleMask(D3D12_DEFAULT_SAMPLE_MASK);
 	_planetPSO.SetBlendState(blendDesc);
 	_planetPSO.Finalize();
+
+	TerrainRender::Initialize(_renderTarget.GetFormat());
 }
 
 void Planet::Reset()
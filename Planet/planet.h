@@ -13,6 +13,7 @@
 #include "Display.h"
 #include "Camera.h"
 #include "CameraController.h"
+#include "PlanetCamera.h"
 #include "AtmoSphereEffect.h"
 #include "VolumetricCloud.h"
 #include "VolumeTexture3D.h"
@@ -48,16 +49,23 @@ public:
     NumVar _CloudMoveSpeed;
     NumVar _CloudScale;
     NumVar _CloudScatteringPower;
+    BoolVar _CloudBake;
+    BoolVar _PlanetQuadTree;
+    BoolVar _ParallelPassRecording;
 
 private:
     Math::Camera _camera;
-    std::unique_ptr<CameraController> _cameraController;
+    std::unique_ptr<PlanetCamera> _cameraController;
     AtmoSphereEffect::AtmoSphereProperty _atmosphricalProperty;
     VolumetricCloud::CloudProperty _cloudProperty;
 	float3 _solarIrradiant;
     float3 _sunIrradianceDirection;
-    float3 _planetCenterPosition;
+    double3 _planetCenterPosition;
+    double _cameraAltitude;
     CameraInfo _prevCameraInfo;
+    double3 _prevCameraWorldPosition;
+    //PlanetQuadTree is initialized the first time _PlanetQuadTree is on
+    bool _isPlanetQuadTreeStarted;
 
 private:
     GraphicsPSO _planetPSO;
@@ -69,5 +77,6 @@ private:
 
 private:
     ColorBuffer _renderTarget;
+    ParallelPassStats _passStats;
 };
 
@@ -7,4 +7,13 @@ struct VertexOut
 	float2 uv : UV;
 };
 
+//terrain_vs.hlsl to terrain_ps.hlsl, positions are camera relative like the rays of the fullscreen passes
+struct TerrainVertexOut
+{
+	float4 position : SV_POSITION0;
+	float3 renderPosition : POSITION;
+	float3 normal : NORMAL;
+	float4 clipPosition : CLIP;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#ifndef PLANET_SHADING_HLSLI
+#define PLANET_SHADING_HLSLI
+
+#include "common.hlsli"
+#include "planet.hlsli"
+#include "atmosphereFunctions.hlsli"
+#include "cloudFunctions.hlsli"
+#include "persistentTextures.hlsli"
+
+cbuffer PerFrame : register(b0)
+{
+	AtmoSphereProperty atmosphereProperty;
+	CloudProperty cloudProperty;
+	Camera camera;
+	Camera prevCamera;
+	float3 planetCenter;
+	float time;
+	float3 sunRadianceDirection;
+	float screenResolutionX;
+	float frame;
+	float3 cloudShadowToSun;
+	float cloudShadowExtent;
+	float3 cloudShadowCenter;
+	float isStaticView;
+	float cameraAltitude;
+}
+
+Texture2D<float3> cloudTransmittance : register(t8);
+Texture2D<float> cloudShadowMap : register(t9);
+Texture2D<float3> cloudScattering : register(t10);
+Texture2D<float> cloudDistance : register(t11);
+
+SamplerState samplerLinearClamp : register(s0);
+SamplerState samplerPointClamp : register(s1);
+SamplerState samplerCloudWrap : register(s2);
+
+//the camera is the render origin, the atmosphere lookups take positions relative to the planet center
+Ray PlanetRelativeRay(const in Ray ray)
+{
+	Ray planetRay = ray;
+	planetRay.ro = ray.ro - planetCenter;
+	return planetRay;
+}
+
+float3 GetSkyRadiance(const in Ray r, const in bool groundVisibility)
+{
+	const float2 distances = RaySphere(planetCenter, atmosphereProperty._outRadius, r.ro, r.rd);
+	const float distance = (distances.x < 0.0) ? distances.y : distances.x;
+
+	return GetAtmoSphericalScattering(atmosphereProperty, sunRadianceDirection, PlanetRelativeRay(r), groundVisibility, distance > 0.0, raySinglescatteringTexture, mieSingleScatteringTexture, multiscatteringTexture, samplerLinearClamp);
+}
+
+float3 GetSolarRadiance(const in Ray ray, const in bool visibility)
+{
+	const float3 radiusVector = ray.ro - planetCenter;
+	const float radius = length(radiusVector);
+	const float sunZenothCosine = dot(radiusVector, -sunRadianceDirection) / radius;
+	const float diameter = atmosphereProperty._solarAngular * atmosphereProperty._solarAngular * PI;
+
+	const float3 solarRadiance = atmosphereProperty._solarIrradiance / diameter;
+	const float3 transmittance = GetTransmittanceToSun(atmosphereProperty, transmittanceTexture, samplerLinearClamp, radius, sunZenothCosine);
+
+	return (false == visibility) ? float3(0,0,0) : solarRadiance * transmittance;
+}
+
+float3 GetSunAndSkyIrradiance(const in Ray ray, const in float t, const in float3 normal)
+{
+	const float3 surfacePosition = ray.ro + ray.rd * t;
+	const float3 radiusVector = surfacePosition - planetCenter;
+	const float rlength = length(radiusVector);
+	const float sunZenithCosine = dot(radiusVector, -sunRadianceDirection) / rlength;
+	const float sunAzimuthCosine = dot(normal, -sunRadianceDirection);
+
+	const float3 skylight = GetAmbient(atmosphereProperty, atmosphereProperty._inRadius, sunZenithCosine, ambientTexture, samplerLinearClamp);
+	const float3 sunlight = atmosphereProperty._solarIrradiance * max(dot(normal, -sunRadianceDirection), 0.0);
+
+	const float3 transmittance = GetTransmittanceToSun(atmosphereProperty, transmittanceTexture, samplerLinearClamp, rlength, sunZenithCosine);
+	return sunlight * transmittance + skylight;
+}
+
+float3 GetSurfaceRadiance(const in Ray ray, const in float t, const in float3 normal)
+{
+	const float3 start = GetAtmoSphericalScattering(atmosphereProperty, sunRadianceDirection, PlanetRelativeRay(ray), true, true, raySinglescatteringTexture, mieSingleScatteringTexture, multiscatteringTexture, samplerLinearClamp);
+	const float3 surfacePosition = ray.ro + ray.rd * t;
+	const float3 rv = ray.ro - planetCenter;
+	const float r = length(rv);
+	const float u = dot(rv, ray.rd) / r;
+
+	Ray surfaceR;
+	surfaceR.ro = surfacePosition;
+	surfaceR.rd = ray.rd;
+	surfaceR.t = 0.0;
+	const float3 end = GetAtmoSphericalScattering(atmosphereProperty, sunRadianceDirection, PlanetRelativeRay(surfaceR),
+		true, true, raySinglescatteringTexture, mieSingleScatteringTexture, multiscatteringTexture, samplerLinearClamp);
+	const float3 inScatter = start - end;
+	const float3 transmittance = GetTransmittance(atmosphereProperty, transmittanceTexture, samplerLinearClamp, r, u, length(surfaceR.ro - ray.ro), true);
+	return atmosphereProperty._groundAlbedo * GetSunAndSkyIrradiance(ray, t, normal) * (1.0 / PI) * transmittance + inScatter;
+}
+
+float3 GetCloudColor(const in Ray ray, const in float2 uv, const in bool isIntersectGround, const in float3 background, const in float cloudDistanceValue)
+{
+	
+	float3 rv = ray.ro - planetCenter;
+	float r = length(rv);
+	float u = dot(rv, ray.rd) / r;
+
+	float3 cloudTransmittanceValue = cloudTransmittance.SampleLevel(samplerLinearClamp, uv, 0);
+	float3 cloudScatteringColor = cloudScattering.SampleLevel(samplerLinearClamp, uv, 0);
+
+	float startShellDistance = -1.0;
+	float endShellDistance = -1.0;
+
+	float cloudShellTravelDistance = RayShell(planetCenter, atmosphereProperty._inRadius, atmosphereProperty._outRadius, ray.ro, ray.rd, startShellDistance, endShellDistance);
+
+	if (cloudShellTravelDistance < 0.0 || cloudDistanceValue < 0.0)
+	{
+		return background;
+	}
+
+	float distance = 0;
+	if (r > atmosphereProperty._outRadius - eps)
+	{
+		distance = cloudDistanceValue - startShellDistance;
+		r = atmosphereProperty._outRadius;
+		u = dot(normalize(rv + ray.rd * startShellDistance), ray.rd);
+	}
+	else
+	{
+		distance = cloudDistanceValue;
+	}
+	const float3 perspectiveTransmittance = GetTransmittance(atmosphereProperty, transmittanceTexture, samplerLinearClamp, r, u, distance, isIntersectGround);
+
+	return cloudScatteringColor + cloudTransmittanceValue * background;
+}
+
+//Sky, clouds and the ground hit at groundDistance along a camera ray, no ground for a negative distance.
+//The ray traced planet and the rasterized terrain chunks both shade through here, so their ground matches.
+float3 ShadePlanetPixel(const in Ray cameraRay, const in float2 uv, const in float groundDistance, const in float3 groundNormal)
+{
+	Ray ray = cameraRay;
+	float cloudDistanceValue = cloudDistance.SampleLevel(samplerPointClamp, uv, 0);
+	const float t = groundDistance;
+
+	float3 groundAlpha = 0.0;
+	float3 groundColor = float3(0, 0, 0);
+	bool isIntersectGround = (t > 0.0);
+	if (true == isIntersectGround)
+	{
+		groundAlpha = 1.0;
+		groundColor = GetSurfaceRadiance(ray, t, groundNormal);
+	}
+
+	const bool solarVisibility = (false == isIntersectGround) && (dot(ray.rd, -sunRadianceDirection) > cos(atmosphereProperty._solarAngular));
+	const float3 solarRadiance = GetSolarRadiance(ray, solarVisibility);
+	if (true == isIntersectGround)
+	{
+		//sun space shadow map, one fetch per ground pixel
+		const float3 groundPosition = ray.ro + ray.rd * t;
+		//the map only covers the ground around the camera, beyond it the clouds cast no shadow
+		const float2 shadowUV = CloudShadowMapUV(groundPosition, cloudShadowCenter, cloudShadowToSun, cloudShadowExtent);
+		const bool isInShadowMap = all(shadowUV == saturate(shadowUV));
+		const float shadow = (isInShadowMap) ? cloudShadowMap.SampleLevel(samplerLinearClamp, shadowUV, 0) : 1.0;
+
+		const float r = length(groundPosition - planetCenter);
+		const float u = dot(normalize(groundPosition - planetCenter), -sunRadianceDirection);
+		const float sunPathDistance = DistanceToOutRadius(atmosphereProperty, r, u);
+		const float maxDistance = max(sqrt(atmosphereProperty._outRadius * atmosphereProperty._outRadius - atmosphereProperty._inRadius * atmosphereProperty._inRadius), 0.0);
+
+		groundColor *= lerp(shadow, 1.0, sunPathDistance / maxDistance);
+	}
+
+	float3 cloundLi = GetCloudColor(ray, uv, isIntersectGround, solarRadiance* (1.0 - groundAlpha) + groundColor * groundAlpha, cloudDistanceValue);
+	float3 skyColor = float3(0, 0, 0);
+	if (cloudDistanceValue > 0.0)
+	{
+		Ray cloudSamplePoint;
+
+		cloudSamplePoint = ray;
+		cloudSamplePoint.ro = cloudSamplePoint.ro + cloudSamplePoint.rd * (cloudDistanceValue);
+
+		skyColor = GetAtmoSphericalScattering(atmosphereProperty, sunRadianceDirection, PlanetRelativeRay(ray),
+			isIntersectGround, true, raySinglescatteringTexture, mieSingleScatteringTexture, multiscatteringTexture, samplerLinearClamp);
+		skyColor = skyColor - GetAtmoSphericalScattering(atmosphereProperty, sunRadianceDirection,
+			PlanetRelativeRay(cloudSamplePoint), isIntersectGround, true, raySinglescatteringTexture, mieSingleScatteringTexture, multiscatteringTexture, samplerLinearClamp);
+	}
+	else
+	{
+		skyColor = GetSkyRadiance(ray, isIntersectGround);
+	}
+
+	ray.li = skyColor + cloundLi;
+	return ray.GetLi();
+}
+
+#endif
\ No newline at end of file
@@ -1,7 +1,33 @@
-
 #ifndef TERRAIN_HLSLI
 #define TERRAIN_HLSLI
 
 #include "common.hlsli"
 
+//Mirrored on the CPU by TerrainSampler.cpp, keep the two in sync.
+
+//Random value in [0, 1) for an integer lattice point. Integer only so that the CPU gets the same bits.
+float hash3(const in float3 p)
+{
+    const uint3 q = uint3(int3(p));
+    uint h = (q.x * 73856093u) ^ (q.y * 19349663u) ^ (q.z * 83492791u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return float(h >> 8) * (1.0 / 16777216.0);
+}
+
+//Polynomial smooth minimum, blends over k
+float smin(const in float a, const in float b, const in float k)
+{
+    const float h = max(k - abs(a - b), 0.0) / k;
+    return min(a, b) - h * h * k * 0.25;
+}
+
+float smax(const in float a, const in float b, const in float k)
+{
+    return -smin(-a, -b, k);
+}
+
 #endif
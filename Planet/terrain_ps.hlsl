@@ -0,0 +1,22 @@
+#include "planetShading.hlsli"
+
+struct OutPS
+{
+	float3 mainColor : SV_TARGET0;
+};
+
+//Streamed terrain chunks over the ray traced planet, shaded like its ground
+OutPS main(const in TerrainVertexOut vIn)
+{
+	const float2 ndc = vIn.clipPosition.xy / vIn.clipPosition.w;
+	const float2 uv = float2(ndc.x * 0.5 + 0.5, -ndc.y * 0.5 + 0.5);
+
+	//the ray through the rasterized surface, the camera is the render origin
+	const float t = length(vIn.renderPosition - camera.cameraPosition);
+	Ray ray = camera.GenerateRay(ndc);
+	ray.rd = (vIn.renderPosition - camera.cameraPosition) / t;
+
+	OutPS outps;
+	outps.mainColor = ShadePlanetPixel(ray, uv, t, normalize(vIn.normal));
+	return outps;
+}
\ No newline at end of file
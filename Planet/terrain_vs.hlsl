@@ -0,0 +1,38 @@
+#include "planet.hlsli"
+#include "packedVertex.hlsli"
+
+cbuffer TerrainPass : register(b1)
+{
+	float4x4 viewProjection;
+}
+
+//TerrainRender::ChunkConstants
+cbuffer Chunk : register(b2)
+{
+	//chunk origin relative to the camera
+	float3 chunkOrigin;
+	float morphStart;
+	QuantizationBounds bounds;
+	float morphEnd;
+}
+
+//morph targets of the chunk inside the terrain streaming pool
+ByteAddressBuffer morphTargets : register(t12);
+
+TerrainVertexOut main(const in PackedVertexIn vIn, const in uint vid : SV_VertexID)
+{
+	const float3 position = DecodePackedPosition(vIn.positionNormal.xyz, bounds);
+	const float3 morphTarget = DecodePackedPosition(LoadPackedPosition(morphTargets, vid), bounds);
+
+	//CDLOD morph, the vertex slides onto the grid of the parent over [morphStart, morphEnd] from the camera
+	const float distance = length(chunkOrigin + position);
+	const float morph = saturate((distance - morphStart) / max(morphEnd - morphStart, 1e-6));
+	const float3 renderPosition = chunkOrigin + lerp(position, morphTarget, morph);
+
+	TerrainVertexOut vout;
+	vout.position = mul(viewProjection, float4(renderPosition, 1.0));
+	vout.renderPosition = renderPosition;
+	vout.normal = DecodePackedNormal(vIn.positionNormal.w);
+	vout.clipPosition = vout.position;
+	return vout;
+}
\ No newline at end of file
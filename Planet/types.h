@@ -2,6 +2,7 @@
 
 #include <DirectXMath.h>
 #include <Math/Vector.h>
+#include <cmath>
 
 typedef DirectX::XMFLOAT2 float2;
 typedef DirectX::XMFLOAT3 float3;
@@ -19,6 +20,34 @@ typedef DirectX::XMFLOAT4X3 float4x3;
 constexpr double PI = 3.141592;
 constexpr float FPI = 3.141592f;
 
+//World space position on the CPU. At planet scale a float only resolves about half a metre,
+//so positions are kept in double and turned into floats relative to a render origin once per frame.
+struct double3
+{
+	double3() : x(0.0), y(0.0), z(0.0) {}
+	double3(const double x, const double y, const double z) : x(x), y(y), z(z) {}
+	explicit double3(const float3& v) : x(v.x), y(v.y), z(v.z) {}
+
+	double3 operator+(const double3& rhs) const { return double3(x + rhs.x, y + rhs.y, z + rhs.z); }
+	double3 operator-(const double3& rhs) const { return double3(x - rhs.x, y - rhs.y, z - rhs.z); }
+	double3 operator*(const double s) const { return double3(x * s, y * s, z * s); }
+
+	double x;
+	double y;
+	double z;
+};
+
+inline double Dot(const double3& lhs, const double3& rhs) { return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z; }
+inline double Length(const double3& v) { return sqrt(Dot(v, v)); }
+inline double3 Normalize(const double3& v) { return v * (1.0 / Length(v)); }
+inline double3 Cross(const double3& lhs, const double3& rhs) { return double3(lhs.y * rhs.z - lhs.z * rhs.y, lhs.z * rhs.x - lhs.x * rhs.z, lhs.x * rhs.y - lhs.y * rhs.x); }
+
+//Offset from the render origin, subtracted in double and rounded once
+inline float3 ToRelativeFloat3(const double3& position, const double3& origin)
+{
+	return float3(static_cast<float>(position.x - origin.x), static_cast<float>(position.y - origin.y), static_cast<float>(position.z - origin.z));
+}
+
 __declspec(align(16)) struct CameraInfo
 {
 	CameraInfo() : cameraPosition(0,0,-4.0), aspectRatio(1920.0 / 1080.0), cameraDirection(0,0,1.0), fov(45.0/PI), cameraUp(0,1.0,0), pad0(0.f) {}
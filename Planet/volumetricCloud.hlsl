@@ -3,6 +3,7 @@
 #include "atmosphereFunctions.hlsli"
 #include "cloudFunctions.hlsli"
 #include "planet.hlsli"
+#include "persistentTextures.hlsli"
 
 cbuffer PerFrame : register(b0)
 {
@@ -15,19 +16,18 @@ cbuffer PerFrame : register(b0)
 	float3 sunRadianceDirection;
 	float screenResolutionX;
 	float frame;
+	float3 cloudShadowToSun;
+	float cloudShadowExtent;
+	float3 cloudShadowCenter;
+	float isStaticView;
+	float cameraAltitude;
 }
 
-Texture2D<float4> transmittanceTexture: register(t0);
-Texture2D<float4> ambientTexture: register(t1);
-
-//Using to render cloud
-Texture3D<float> cloudBaseShapeTexture : register(t2);
-Texture3D<float> cloudDetailShapeTexture : register(t3);
-Texture2D<float4> cloudWeaderTexture : register(t4);
-
-Texture2D<float3> cloudTemporalScattering : register(t5);
-Texture2D<float3> cloudTemporalTransmittance : register(t6);
-Texture2D<float> cloudTemporalDistance : register(t7);
+Texture2D<float3> cloudTemporalScattering : register(t8);
+Texture2D<float3> cloudTemporalTransmittance : register(t9);
+Texture2D<float> cloudTemporalDistance : register(t10);
+//x: accumulated sample count, y,z: second moment of scattering/transmittance luminance, w: relative error of the mean
+Texture2D<float4> cloudTemporalAccumulation : register(t11);
 
 SamplerState samplerLinearClamp : register(s0);
 SamplerState samplerPointClamp : register(s1);
@@ -36,11 +36,18 @@ SamplerState samplerCloudWrap : register(s2);
 struct OutPS
 {
 	float3 transmittance : SV_TARGET0;
-	float shadow : SV_TARGET1;
-	float3 scattering : SV_TARGET2;
-	float distance : SV_TARGET3;
+	float3 scattering : SV_TARGET1;
+	float distance : SV_TARGET2;
+	float4 accumulation : SV_TARGET3;
 };
 
+//one full bayerFilter x (frame % 16) jitter cycle
+static const float convergedSampleCount = 16.0;
+static const float convergedRelativeError = 0.02;
+static const float staticMaxSampleCount = 64.0;
+//same history weight as the former fixed 0.08 blend
+static const float movingMaxSampleCount = 12.0;
+
 float4 ComputeCloudRadiance(const in Ray ray, const in bool isIntersectGround, const in float2 uv, out float3 transmittance)
 {
 	transmittance = float3(1.0, 1.0, 1.0);
@@ -57,12 +64,13 @@ float4 ComputeCloudRadiance(const in Ray ray, const in bool isIntersectGround, c
 
 	if (cloudShellTravelDistance > 0.0)
 	{
-		float3 cloudLayerSurfacePos = ray.ro + ray.rd * startShellDistance;
+		//the camera is the render origin, the cloud functions work relative to the planet center
+		float3 cloudLayerSurfacePos = rv + ray.rd * startShellDistance;
 		const float3 ambientColor = GetAmbient(atmosphereProperty, atmosphereProperty._inRadius, sunZenithCosine, ambientTexture, samplerLinearClamp);// * atmosphereProperty._groundAlbedo * 1.0/PI;
 		const float2 screenResolution = float2(screenResolutionX, 1.0 / ((1.0 / screenResolutionX) * camera.aspectRatio));
 
 		cloudScattering = CloudScatteringIntegrand(
-			atmosphereProperty, cloudProperty, ray.ro, screenResolution * uv,
+			atmosphereProperty, cloudProperty, rv, screenResolution * uv,
 			cloudLayerSurfacePos, ray.rd, cloudShellTravelDistance, -sunRadianceDirection, time,
 			cloudBaseShapeTexture, cloudDetailShapeTexture, samplerCloudWrap, cloudWeaderTexture, samplerLinearClamp, ambientColor,
 			transmittanceTexture, samplerLinearClamp, isIntersectGround, outCloudDistance, transmittance
@@ -86,78 +94,75 @@ OutPS main(const in VertexOut vIn)
 	const float2 ndc = float2(uv.x * 2.0 - 1, -2.0 * uv.y + 1.0);
 	Ray ray = camera.GenerateRay(ndc);
 
-	const float distance = RaySphere(planetCenter, atmosphereProperty._inRadius + eps, ray.ro, ray.rd).x;
+	const float distance = RaySphereFromHeight(planetCenter, atmosphereProperty._inRadius + eps, cameraAltitude - eps, ray.ro, ray.rd).x;
 	const float t = distance - eps;
 	const bool isIntersectGround = (t > 0.0);
 
-	const bool solarVisibility = (false == isIntersectGround) && (dot(ray.rd, -sunRadianceDirection) > cos(atmosphereProperty._solarAngular));
+	const bool isStaticCloud = (cloudProperty._moveSpeed == 0.0);
+	const bool isStaticFrame = (isStaticView > 0.5) && isStaticCloud;
 
-	float outShadow = 1.0;
-	if (true == isIntersectGround)
+	//temporal Reprojection, a static frame reads the history of its own pixel
+	float2 prevUV = uv;
+	float4 history = float4(0, 0, 0, 0);
+	if (frame > 1.5 && isStaticFrame)
 	{
-		const float shadowEps = 0.1;
-		Ray shadowRay;
-		shadowRay = ray;
-		shadowRay.ro = ray.ro + ray.rd * (t - shadowEps);
-		shadowRay.rd = -sunRadianceDirection;
-		shadowRay.t = 0.0;
-		float3 shadow = float3(1, 1, 1);
-		float3 scattering = ComputeCloudRadiance(shadowRay, false, uv, shadow).xyz;
-		const float r = length(shadowRay.ro - planetCenter);
-		const float u = dot(normalize(shadowRay.ro - planetCenter), -sunRadianceDirection);
-		const float distance = DistanceToOutRadius(atmosphereProperty, r, u);
-		const float maxDistance = max(sqrt(atmosphereProperty._outRadius * atmosphereProperty._outRadius - atmosphereProperty._inRadius * atmosphereProperty._inRadius), 0.0);
-
-		outShadow = lerp(shadow.r, 1.0, distance / maxDistance);
+		history = cloudTemporalAccumulation.SampleLevel(samplerPointClamp, prevUV, 0);
 	}
-	outPS.shadow = outShadow;
-
-	float3 cloudTransmittance = float3(1,1,1);
-	float4 cloudLi = ComputeCloudRadiance(ray, isIntersectGround, uv, cloudTransmittance);
-	outPS.transmittance = cloudTransmittance;
-	outPS.scattering = cloudLi.rgb;
-	outPS.distance = cloudLi.a;
 
-	//temporal Reprojection
-	const float reprojectionMinDelta = 0.01;
-
-	if (frame < 1.5)
+	//converged pixels of a static frame are done, reuse them without marching
+	if (isStaticFrame && history.x >= convergedSampleCount && history.w < convergedRelativeError)
 	{
+		outPS.transmittance = cloudTemporalTransmittance.SampleLevel(samplerPointClamp, prevUV, 0);
+		outPS.scattering = cloudTemporalScattering.SampleLevel(samplerPointClamp, prevUV, 0);
+		outPS.distance = cloudTemporalDistance.SampleLevel(samplerPointClamp, prevUV, 0);
+		outPS.accumulation = history;
 		return outPS;
 	}
-	else
-	{
-		bool visibility = false;
-		const float2 prevScreenSpaceNDC = prevCamera.ClipSpaceProjectionFromDirection(ray.rd, visibility);
 
-		if (visibility)
-		{
-			const float blendFactor = 0.08;
-
-			float2 prevUV = NDCToUV(prevScreenSpaceNDC);
-			float2 texSize;
-			cloudTemporalScattering.GetDimensions(texSize.x, texSize.y);
-
-			float3 prevScattering = cloudTemporalScattering.SampleLevel(samplerPointClamp, prevUV, 0);
-			float3 prevTransmittance = cloudTemporalTransmittance.SampleLevel(samplerPointClamp, prevUV, 0);
-			float prevDistance = cloudTemporalDistance.SampleLevel(samplerPointClamp, prevUV, 0);
-			float discardedDistance = (length(outPS.transmittance) < 1.0) ? max(outPS.distance, prevDistance) : outPS.distance;
-
-			outPS.distance = discardedDistance;
-
-			Ray prevRay = prevCamera.GenerateRay(prevScreenSpaceNDC);
-			float3 prevWorldPosition = prevRay.ro + prevRay.rd * prevDistance;
-			float3 currWorldPosition = ray.ro + ray.rd * outPS.distance;
-
-			//float3 mergedScattering = (frame * prevScattering + outPS.scattering) / (frame + 1.0);
-			//float3 mergedTransmittance = (frame * prevTransmittance + outPS.transmittance) / (frame + 1.0);
-			//float mergedDistance = (frame * prevDistance + outPS.distance) / (frame + 1.0);
+	float3 cloudTransmittance = float3(1,1,1);
+	float4 cloudLi = ComputeCloudRadiance(ray, isIntersectGround, uv, cloudTransmittance);
 
-			outPS.scattering = lerp(prevScattering, outPS.scattering, blendFactor);
-			outPS.transmittance = lerp(prevTransmittance, outPS.transmittance, blendFactor);
-			//outPS.distance = lerp(mergedDistance, outPS.distance, blendFactor);
-		}
+	//a moving frame reprojects the point the cloud was hit at through the previous camera, whose position is relative
+	//to this frame's render origin. without a hit the sky behind is far enough away for the direction alone
+	if (frame > 1.5 && false == isStaticFrame)
+	{
+		bool historyVisibility = false;
+		const float2 prevNDC = (cloudLi.a > 0.0)
+			? prevCamera.ClipSpaceProjection(ray.ro + ray.rd * cloudLi.a, historyVisibility)
+			: prevCamera.ClipSpaceProjectionFromDirection(ray.rd, historyVisibility);
+		prevUV = NDCToUV(prevNDC);
+		history = (historyVisibility) ? cloudTemporalAccumulation.SampleLevel(samplerPointClamp, prevUV, 0) : float4(0, 0, 0, 0);
 	}
 
+	const float sampleCount = history.x;
+	const float3 prevScattering = cloudTemporalScattering.SampleLevel(samplerPointClamp, prevUV, 0);
+	const float3 prevTransmittance = cloudTemporalTransmittance.SampleLevel(samplerPointClamp, prevUV, 0);
+	const float prevDistance = cloudTemporalDistance.SampleLevel(samplerPointClamp, prevUV, 0);
+
+	const float maxSampleCount = isStaticFrame ? staticMaxSampleCount : movingMaxSampleCount;
+	const float newSampleCount = min(sampleCount + 1.0, maxSampleCount);
+	const float alpha = 1.0 / newSampleCount;
+
+	outPS.scattering = lerp(prevScattering, cloudLi.rgb, alpha);
+	outPS.transmittance = lerp(prevTransmittance, cloudTransmittance, alpha);
+	outPS.distance = (sampleCount > 0.0 && length(cloudTransmittance) < 1.0) ? max(cloudLi.a, prevDistance) : cloudLi.a;
+
+	//running variance of the luminance, relative standard error of the accumulated mean decides convergence
+	const float3 luminance = float3(0.2126, 0.7152, 0.0722);
+	const float scatteringSample = dot(cloudLi.rgb, luminance);
+	const float transmittanceSample = dot(cloudTransmittance, luminance);
+	const float scatteringMean = dot(outPS.scattering, luminance);
+	const float transmittanceMean = dot(outPS.transmittance, luminance);
+	const float scatteringMoment = lerp(history.y, scatteringSample * scatteringSample, alpha);
+	const float transmittanceMoment = lerp(history.z, transmittanceSample * transmittanceSample, alpha);
+
+	const float scatteringVariance = max(scatteringMoment - scatteringMean * scatteringMean, 0.0);
+	const float transmittanceVariance = max(transmittanceMoment - transmittanceMean * transmittanceMean, 0.0);
+	const float minMean = 1e-3;
+	const float relativeError = max(
+		sqrt(scatteringVariance / newSampleCount) / max(scatteringMean, minMean),
+		sqrt(transmittanceVariance / newSampleCount) / max(transmittanceMean, minMean));
+
+	outPS.accumulation = float4(newSampleCount, scatteringMoment, transmittanceMoment, relativeError);
 	return outPS;
 }
\ No newline at end of file
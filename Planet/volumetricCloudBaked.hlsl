@@ -0,0 +1,9 @@
+//volumetricCloud.hlsl reading GetCloudDensity from the baked brick volume (CloudVolumeBake.h)
+#define CLOUD_BAKED_VOLUME 1
+//CloudVolumeBake::BRICK_SIZE
+#define CLOUD_BAKED_BRICK_SIZE 8
+
+Texture3D<uint> cloudBrickIndex : register(t12);
+Texture3D<float> cloudBrickAtlas : register(t13);
+
+#include "volumetricCloud.hlsl"
@@ -0,0 +1,442 @@
+//
+// Description:  Tests and benchmarks of BuddyOffsetAllocator and ConcurrentBuddyOffsetAllocator
+//
+
+#include "TestFramework.h"
+#include "BuddyOffsetAllocator.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    // The free lists the BuddyAllocator used before, for comparison
+    class SetBuddyReference
+    {
+    public:
+        explicit SetBuddyReference(uint32_t maxOrder) : m_maxOrder(maxOrder), m_freeBlocks(maxOrder + 1)
+        {
+            m_freeBlocks[maxOrder].insert((size_t)0);
+        }
+
+        size_t Allocate(uint32_t order)
+        {
+            if (order > m_maxOrder)
+                return BuddyOffsetAllocator::kInvalidOffset;
+
+            auto it = m_freeBlocks[order].begin();
+            if (it == m_freeBlocks[order].end())
+            {
+                size_t left = Allocate(order + 1);
+                if (left == BuddyOffsetAllocator::kInvalidOffset)
+                    return left;
+                m_freeBlocks[order].insert(left + (((size_t)1) << order));
+                return left;
+            }
+
+            size_t offset = *it;
+            m_freeBlocks[order].erase(it);
+            return offset;
+        }
+
+        void Deallocate(size_t offset, uint32_t order)
+        {
+            size_t buddy = offset ^ (((size_t)1) << order);
+            auto it = order < m_maxOrder ? m_freeBlocks[order].find(buddy) : m_freeBlocks[order].end();
+            if (it != m_freeBlocks[order].end())
+            {
+                m_freeBlocks[order].erase(it);
+                Deallocate(min(offset, buddy), order + 1);
+            }
+            else
+            {
+                m_freeBlocks[order].insert(offset);
+            }
+        }
+
+    private:
+        uint32_t m_maxOrder;
+        vector<set<size_t>> m_freeBlocks;
+    };
+
+    struct LiveBlock
+    {
+        size_t offset;
+        uint32_t order;
+        // requested, the rest of the block is padding
+        size_t units;
+    };
+
+    // Mostly small blocks, every order above half as likely as the one below
+    uint32_t RandomOrder(uint32_t random, uint32_t maxOrder)
+    {
+        uint32_t order = 0;
+        while (order < maxOrder && (random & (1u << order)) != 0)
+            ++order;
+        return order;
+    }
+
+    struct ChurnResult
+    {
+        double seconds;
+        uint64_t checksum;
+        uint32_t failures;
+    };
+
+    // Allocates one block per pair of randoms, freeing a random live block first once liveTarget are live
+    template <typename Allocator>
+    ChurnResult RunChurn(Allocator& allocator, const vector<uint32_t>& randoms, size_t liveTarget, uint32_t maxBlockOrder)
+    {
+        ChurnResult result = {};
+        vector<LiveBlock> live;
+        live.reserve(liveTarget + 1);
+
+        int64_t startTick = SystemTime::GetCurrentTick();
+        for (size_t i = 0; i + 1 < randoms.size(); i += 2)
+        {
+            if (live.size() >= liveTarget)
+            {
+                size_t victim = randoms[i + 1] % live.size();
+                allocator.Deallocate(live[victim].offset, live[victim].order);
+                live[victim] = live.back();
+                live.pop_back();
+            }
+
+            uint32_t order = RandomOrder(randoms[i], maxBlockOrder);
+            size_t offset = allocator.Allocate(order);
+            if (offset == BuddyOffsetAllocator::kInvalidOffset)
+            {
+                ++result.failures;
+                continue;
+            }
+            result.checksum = result.checksum * 31 + offset;
+            live.push_back({ offset, order, (size_t)1 << order });
+        }
+        for (const LiveBlock& block : live)
+            allocator.Deallocate(block.offset, block.order);
+        result.seconds = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+        return result;
+    }
+
+    // A plain lock around the bitmaps, the baseline for the magazines
+    class LockedBuddyReference
+    {
+    public:
+        explicit LockedBuddyReference(uint32_t maxOrder) { m_allocator.Initialize(maxOrder); }
+
+        size_t Allocate(uint32_t order)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            return m_allocator.Allocate(order);
+        }
+
+        void Deallocate(size_t offset, uint32_t order)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_allocator.Deallocate(offset, order);
+        }
+
+    private:
+        mutex m_mutex;
+        BuddyOffsetAllocator m_allocator;
+    };
+
+    // Every thread keeps up to 256 blocks alive, mostly small ones as for vertex and index buffers
+    template <typename Allocator>
+    double RunThreads(Allocator& allocator, uint32_t threadCount, size_t pairsPerThread, atomic<uint32_t>& failures)
+    {
+        vector<thread> threads;
+        int64_t startTick = SystemTime::GetCurrentTick();
+        for (uint32_t t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&allocator, &failures, t, pairsPerThread]()
+            {
+                mt19937 random(t + 1);
+                vector<LiveBlock> live;
+                live.reserve(256);
+                for (size_t i = 0; i < pairsPerThread; ++i)
+                {
+                    if (live.size() == 256)
+                    {
+                        size_t victim = random() % live.size();
+                        allocator.Deallocate(live[victim].offset, live[victim].order);
+                        live[victim] = live.back();
+                        live.pop_back();
+                    }
+                    uint32_t order = RandomOrder(random(), 6);
+                    size_t offset = allocator.Allocate(order);
+                    if (offset == BuddyOffsetAllocator::kInvalidOffset)
+                        failures.fetch_add(1, memory_order_relaxed);
+                    else
+                        live.push_back({ offset, order, (size_t)1 << order });
+                }
+                for (const LiveBlock& block : live)
+                    allocator.Deallocate(block.offset, block.order);
+            });
+        }
+        for (thread& worker : threads)
+            worker.join();
+        return SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+    }
+
+    vector<uint32_t> MakeRandoms(size_t count)
+    {
+        mt19937 random(1234);
+        vector<uint32_t> randoms(count);
+        for (uint32_t& value : randoms)
+            value = random();
+        return randoms;
+    }
+}
+
+// Splits hand out the lowest offset and frees merge back up to a single block
+TEST_CASE(BuddyOffsetAllocatorSplitsAndMerges)
+{
+    BuddyOffsetAllocator allocator;
+    allocator.Initialize(4);
+    CHECK(allocator.GetTotalUnits() == 16);
+    CHECK(allocator.GetLargestFreeBlock() == 16);
+
+    CHECK(allocator.Allocate(0) == 0);
+    CHECK(allocator.Allocate(1) == 2);
+    CHECK(allocator.Allocate(0) == 1);
+    CHECK(allocator.Allocate(2) == 4);
+    CHECK(allocator.GetFreeUnits() == 8);
+    CHECK(allocator.GetLargestFreeBlock() == 8);
+    CHECK(allocator.IsFree(8, 3));
+    CHECK(!allocator.IsFree(4, 2));
+
+    CHECK(allocator.Allocate(4) == BuddyOffsetAllocator::kInvalidOffset);
+    CHECK(allocator.Allocate(3) == 8);
+    CHECK(allocator.Allocate(0) == BuddyOffsetAllocator::kInvalidOffset);
+    CHECK(allocator.GetLargestFreeBlock() == 0);
+
+    allocator.Deallocate(1, 0);
+    allocator.Deallocate(2, 1);
+    CHECK(allocator.GetLargestFreeBlock() == 2);
+    allocator.Deallocate(0, 0);
+    CHECK(allocator.GetLargestFreeBlock() == 4);
+    allocator.Deallocate(8, 3);
+    allocator.Deallocate(4, 2);
+    CHECK(allocator.GetFreeUnits() == 16);
+    CHECK(allocator.GetLargestFreeBlock() == 16);
+}
+
+// The bitmaps hand out the same offsets as the std::set free lists and merge everything back afterwards
+TEST_CASE(BuddyOffsetAllocatorMatchesSets)
+{
+    const uint32_t kMaxOrder = 16;
+    const uint32_t kMaxBlockOrder = 8;
+    const vector<uint32_t> randoms = MakeRandoms(400000);
+
+    for (size_t liveTarget : { (size_t)64, (size_t)1024, (size_t)16384 })
+    {
+        BuddyOffsetAllocator bitmaps;
+        bitmaps.Initialize(kMaxOrder);
+        SetBuddyReference sets(kMaxOrder);
+
+        ChurnResult bitmapResult = RunChurn(bitmaps, randoms, liveTarget, kMaxBlockOrder);
+        ChurnResult setResult = RunChurn(sets, randoms, liveTarget, kMaxBlockOrder);
+
+        CHECK(bitmapResult.checksum == setResult.checksum);
+        CHECK(bitmapResult.failures == setResult.failures);
+        CHECK(bitmaps.GetFreeUnits() == bitmaps.GetTotalUnits());
+        CHECK(bitmaps.GetLargestFreeBlock() == bitmaps.GetTotalUnits());
+    }
+}
+
+// Magazines keep freed small blocks until they are flushed, then everything merges back
+TEST_CASE(ConcurrentBuddyOffsetAllocatorMagazines)
+{
+    ConcurrentBuddyOffsetAllocator* allocator = new ConcurrentBuddyOffsetAllocator();
+    allocator->Initialize(10);
+
+    // the first allocation refills half a magazine and hands out the lowest offset
+    CHECK(allocator->Allocate(0) == 0);
+    BuddyOffsetStats stats = allocator->GetStats();
+    CHECK(stats.CachedUnits == ConcurrentBuddyOffsetAllocator::kBatchSize - 1);
+    CHECK(allocator->Allocate(0) == 1);
+    // larger orders go straight to the global allocator, past the half magazine
+    CHECK(allocator->Allocate(5) == 32);
+
+    ConcurrentBuddyOffsetAllocator::Block blocks[] = { { 0, 0 }, { 1, 0 }, { 32, 5 } };
+    allocator->DeallocateBatch(blocks, 3);
+    stats = allocator->GetStats();
+    CHECK(stats.Allocations == 3);
+    CHECK(stats.Deallocations == 3);
+    CHECK(stats.CachedUnits == ConcurrentBuddyOffsetAllocator::kBatchSize);
+    CHECK(stats.FreeUnits + stats.CachedUnits == allocator->GetTotalUnits());
+
+    allocator->FlushMagazines();
+    stats = allocator->GetStats();
+    CHECK(stats.CachedUnits == 0);
+    CHECK(stats.LargestFreeBlock == allocator->GetTotalUnits());
+
+    // blocks held by the magazine of this thread are given back when the global allocator runs dry
+    CHECK(allocator->Allocate(0) == 0);
+    CHECK(allocator->Allocate(10) == BuddyOffsetAllocator::kInvalidOffset);
+    allocator->Deallocate(0, 0);
+    CHECK(allocator->Allocate(10) == 0);
+    delete allocator;
+}
+
+// Threads churning through small blocks never fail on a mostly empty allocator and leave nothing behind
+TEST_CASE(ConcurrentBuddyOffsetAllocatorThreads)
+{
+    const uint32_t kThreadCount = 4;
+    const size_t kPairsPerThread = 100000;
+
+    atomic<uint32_t> failures(0);
+    ConcurrentBuddyOffsetAllocator* allocator = new ConcurrentBuddyOffsetAllocator();
+    allocator->Initialize(20);
+    RunThreads(*allocator, kThreadCount, kPairsPerThread, failures);
+
+    BuddyOffsetStats stats = allocator->GetStats();
+    CHECK(failures.load() == 0);
+    CHECK(stats.Failures == 0);
+    CHECK(stats.Allocations == kThreadCount * kPairsPerThread);
+    CHECK(stats.Deallocations == stats.Allocations);
+    CHECK(stats.MagazineHits > stats.Allocations / 2);
+
+    allocator->FlushMagazines();
+    stats = allocator->GetStats();
+    CHECK(stats.FreeUnits == allocator->GetTotalUnits());
+    CHECK(stats.LargestFreeBlock == allocator->GetTotalUnits());
+    delete allocator;
+}
+
+// Times the bitmaps against the std::set free lists over millions of alloc/free pairs and prints fragmentation curves
+BENCHMARK(BuddyOffsetAllocatorChurn)
+{
+    const uint32_t kMaxOrder = 20;
+    const uint32_t kMaxBlockOrder = 8;
+    const size_t kPairs = 4000000;
+    const vector<uint32_t> randoms = MakeRandoms(kPairs * 2);
+
+    printf("Buddy allocator, 2^%u units, blocks of 2^0 to 2^%u units, %zu alloc/free pairs\n", kMaxOrder, kMaxBlockOrder, kPairs);
+    for (size_t liveTarget : { (size_t)256, (size_t)4096, (size_t)65536 })
+    {
+        BuddyOffsetAllocator bitmaps;
+        bitmaps.Initialize(kMaxOrder);
+        SetBuddyReference sets(kMaxOrder);
+
+        ChurnResult bitmapResult = RunChurn(bitmaps, randoms, liveTarget, kMaxBlockOrder);
+        ChurnResult setResult = RunChurn(sets, randoms, liveTarget, kMaxBlockOrder);
+        CHECK(bitmapResult.checksum == setResult.checksum);
+        printf("  %6zu live: bitmaps %6.1f ns/pair, sets %6.1f ns/pair, %.1fx, %u failures\n",
+            liveTarget, bitmapResult.seconds * 1e9 / kPairs, setResult.seconds * 1e9 / kPairs, setResult.seconds / bitmapResult.seconds,
+            bitmapResult.failures);
+    }
+
+    // Fragmentation while filling up, then while churning at a fixed occupancy
+    const uint32_t kCurveOrder = 16;
+    mt19937 random(1234);
+    BuddyOffsetAllocator allocator;
+    allocator.Initialize(kCurveOrder);
+    vector<LiveBlock> live;
+    size_t requestedUnits = 0;
+
+    auto PrintRow = [&](const char* label)
+    {
+        size_t used = allocator.GetTotalUnits() - allocator.GetFreeUnits();
+        size_t largest = allocator.GetLargestFreeBlock();
+        double fragmentation = allocator.GetFreeUnits() > 0 ? 1.0 - (double)largest / allocator.GetFreeUnits() : 0.0;
+        printf("  %-12s used %5.1f%%, padding %5.1f%%, largest free block %6zu units, external fragmentation %5.1f%%\n",
+            label, 100.0 * used / allocator.GetTotalUnits(), used > 0 ? 100.0 * (used - requestedUnits) / used : 0.0,
+            largest, 100.0 * fragmentation);
+    };
+
+    // Requests are not powers of two, the rest of their block is padding
+    auto AllocateRandom = [&]()
+    {
+        uint32_t order = RandomOrder(random(), kMaxBlockOrder);
+        size_t units = order == 0 ? 1 : (((size_t)1) << (order - 1)) + 1 + random() % (((size_t)1) << (order - 1));
+        size_t offset = allocator.Allocate(order);
+        if (offset == BuddyOffsetAllocator::kInvalidOffset)
+            return false;
+        live.push_back({ offset, order, units });
+        requestedUnits += units;
+        return true;
+    };
+
+    printf("Fragmentation filling 2^%u units\n", kCurveOrder);
+    size_t nextReport = allocator.GetTotalUnits() / 10;
+    uint32_t failures = 0;
+    while (failures < 64)
+    {
+        if (!AllocateRandom())
+        {
+            ++failures;
+            continue;
+        }
+        size_t used = allocator.GetTotalUnits() - allocator.GetFreeUnits();
+        if (used >= nextReport)
+        {
+            char label[16];
+            snprintf(label, sizeof(label), "fill %2zu%%", used * 100 / allocator.GetTotalUnits());
+            PrintRow(label);
+            nextReport += allocator.GetTotalUnits() / 10;
+        }
+    }
+    PrintRow("full");
+
+    printf("Fragmentation churning around 70%% use\n");
+    const size_t kTargetUnits = allocator.GetTotalUnits() * 7 / 10;
+    uint32_t churnFailures = 0;
+    for (uint32_t step = 1; step <= 500000; ++step)
+    {
+        while (allocator.GetTotalUnits() - allocator.GetFreeUnits() > kTargetUnits && !live.empty())
+        {
+            size_t victim = random() % live.size();
+            allocator.Deallocate(live[victim].offset, live[victim].order);
+            requestedUnits -= live[victim].units;
+            live[victim] = live.back();
+            live.pop_back();
+        }
+        if (!AllocateRandom())
+            ++churnFailures;
+
+        if (step % 100000 == 0)
+        {
+            char label[16];
+            snprintf(label, sizeof(label), "%uk ops", step / 1000);
+            PrintRow(label);
+        }
+    }
+    printf("  %u of 500000 allocations failed\n", churnFailures);
+}
+
+// Threads allocating and freeing small blocks with one lock and with magazines
+BENCHMARK(ConcurrentBuddyOffsetAllocatorThroughput)
+{
+    const uint32_t kMaxOrder = 20;
+    const size_t kPairsPerThread = 1000000;
+    uint32_t hardwareThreads = max(1u, thread::hardware_concurrency());
+
+    printf("Concurrent buddy allocator, %zu alloc/free pairs per thread, %u hardware threads\n", kPairsPerThread, hardwareThreads);
+    for (uint32_t threadCount = 1; threadCount <= max(4u, hardwareThreads); threadCount *= 2)
+    {
+        atomic<uint32_t> lockedFailures(0);
+        LockedBuddyReference locked(kMaxOrder);
+        double lockedSeconds = RunThreads(locked, threadCount, kPairsPerThread, lockedFailures);
+
+        atomic<uint32_t> failures(0);
+        ConcurrentBuddyOffsetAllocator* magazines = new ConcurrentBuddyOffsetAllocator();
+        magazines->Initialize(kMaxOrder);
+        double seconds = RunThreads(*magazines, threadCount, kPairsPerThread, failures);
+        BuddyOffsetStats stats = magazines->GetStats();
+        CHECK(failures.load() + lockedFailures.load() == 0);
+
+        double pairs = (double)threadCount * kPairsPerThread;
+        printf("  %2u threads: one lock %6.2f M pairs/s, magazines %6.2f M pairs/s, %.1f%% hits, %.3f global locks per pair\n",
+            threadCount, pairs / lockedSeconds * 1e-6, pairs / seconds * 1e-6, 100.0 * stats.MagazineHits / max<uint64_t>(stats.Allocations, 1),
+            stats.GlobalLocks / pairs);
+        delete magazines;
+    }
+}
@@ -0,0 +1,247 @@
+//
+// Description:  Tests and benchmarks of ConcurrentObjectCache
+//
+
+#include "TestFramework.h"
+#include "ConcurrentObjectCache.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+    atomic<uint32_t> s_ReleaseCount(0);
+
+    struct BenchmarkObject
+    {
+        size_t Hash;
+        void Release( void ) { s_ReleaseCount.fetch_add(1, memory_order_relaxed); delete this; }
+    };
+
+    // What PipelineState.cpp and RootSignature.cpp did before: a std::map under a mutex, waiting on a yield loop
+    class MutexObjectMap
+    {
+    public:
+        ~MutexObjectMap()
+        {
+            for (auto& Entry : m_Map)
+                delete Entry.second;
+        }
+
+        template <typename CreateFunc>
+        BenchmarkObject* GetOrCreate( size_t Hash, CreateFunc Create )
+        {
+            BenchmarkObject* volatile* Ref = nullptr;
+            bool FirstCreate = false;
+            {
+                lock_guard<mutex> Lock(m_Mutex);
+                auto Iter = m_Map.find(Hash);
+                if (Iter == m_Map.end())
+                {
+                    FirstCreate = true;
+                    Ref = &m_Map[Hash];
+                }
+                else
+                    Ref = &Iter->second;
+            }
+
+            if (FirstCreate)
+            {
+                BenchmarkObject* Object = Create();
+                lock_guard<mutex> Lock(m_Mutex);
+                m_Map[Hash] = Object;
+                return Object;
+            }
+
+            BenchmarkObject* Object;
+            for (;;)
+            {
+                {
+                    lock_guard<mutex> Lock(m_Mutex);
+                    Object = *Ref;
+                }
+                if (Object != nullptr)
+                    return Object;
+                this_thread::yield();
+            }
+        }
+
+    private:
+        mutex m_Mutex;
+        map<size_t, BenchmarkObject*> m_Map;
+    };
+
+    // Stands in for shader compilation, a few microseconds of work
+    void SimulateCompile( size_t Hash )
+    {
+        volatile size_t Sink = Hash;
+        for (uint32_t i = 0; i < 20000; ++i)
+            Sink = Sink * 6364136223846793005ull + 1442695040888963407ull;
+    }
+
+    vector<size_t> MakeHashes( uint32_t Count )
+    {
+        mt19937_64 Random(7);
+        vector<size_t> Hashes(Count);
+        for (size_t& Hash : Hashes)
+            Hash = (size_t)Random();
+        return Hashes;
+    }
+
+    struct MeasureResult
+    {
+        double CreateSeconds;
+        double LookupSeconds;
+        uint32_t Creations;
+        // objects handed out for another hash
+        uint32_t Mismatches;
+    };
+
+    // Every thread finalizes all of the pipelines in its own order, as many loading threads asking for the same
+    // shared states would, then looks them up LookupsPerThread times
+    template <typename Cache>
+    MeasureResult Measure( Cache& ObjectCache, const vector<size_t>& Hashes, uint32_t ThreadCount, uint32_t LookupsPerThread )
+    {
+        atomic<uint32_t> CreationCount(0);
+        atomic<uint32_t> MismatchCount(0);
+        auto Create = [&CreationCount](size_t Hash)
+        {
+            CreationCount.fetch_add(1, memory_order_relaxed);
+            SimulateCompile(Hash);
+            BenchmarkObject* Object = new BenchmarkObject;
+            Object->Hash = Hash;
+            return Object;
+        };
+
+        MeasureResult Result;
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        {
+            vector<thread> Threads;
+            for (uint32_t t = 0; t < ThreadCount; ++t)
+            {
+                Threads.emplace_back([&, t]()
+                {
+                    for (size_t i = 0; i < Hashes.size(); ++i)
+                    {
+                        size_t Hash = Hashes[(i * (2 * t + 1) + t * 97) % Hashes.size()];
+                        if (ObjectCache.GetOrCreate(Hash, [&]() { return Create(Hash); })->Hash != Hash)
+                            MismatchCount.fetch_add(1, memory_order_relaxed);
+                    }
+                });
+            }
+            for (thread& Thread : Threads)
+                Thread.join();
+        }
+        Result.CreateSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        Result.Creations = CreationCount;
+
+        StartTick = SystemTime::GetCurrentTick();
+        {
+            vector<thread> Threads;
+            for (uint32_t t = 0; t < ThreadCount; ++t)
+            {
+                Threads.emplace_back([&, t]()
+                {
+                    mt19937 Random(t + 1);
+                    uint32_t ThreadMismatches = 0;
+                    for (uint32_t i = 0; i < LookupsPerThread; ++i)
+                    {
+                        size_t Hash = Hashes[Random() % Hashes.size()];
+                        if (ObjectCache.GetOrCreate(Hash, [&]() { return Create(Hash); })->Hash != Hash)
+                            ++ThreadMismatches;
+                    }
+                    MismatchCount.fetch_add(ThreadMismatches, memory_order_relaxed);
+                });
+            }
+            for (thread& Thread : Threads)
+                Thread.join();
+        }
+        Result.LookupSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        Result.Mismatches = MismatchCount;
+        return Result;
+    }
+}
+
+// Create runs once per key, Find sees the published object and Clear releases everything
+TEST_CASE(ConcurrentObjectCacheGetOrCreate)
+{
+    ConcurrentObjectCache<BenchmarkObject> Cache(6);
+    CHECK(Cache.GetCapacity() == 8);
+    CHECK(Cache.Find(42) == nullptr);
+
+    uint32_t CreateCount = 0;
+    auto Create = [&CreateCount](size_t Hash) { ++CreateCount; BenchmarkObject* Object = new BenchmarkObject; Object->Hash = Hash; return Object; };
+
+    bool Created = false;
+    BenchmarkObject* Object = Cache.GetOrCreate(42, [&]() { return Create(42); }, &Created);
+    CHECK(Created && Object->Hash == 42);
+    CHECK(Cache.GetOrCreate(42, [&]() { return Create(42); }, &Created) == Object);
+    CHECK(!Created && CreateCount == 1);
+    CHECK(Cache.Find(42) == Object);
+
+    // keys of the same slot probe on, 8 + 42 lands next to 42
+    BenchmarkObject* Collision = Cache.GetOrCreate(50, [&]() { return Create(50); });
+    CHECK(Collision != Object && Collision->Hash == 50);
+    CHECK(Cache.Find(50) == Collision);
+
+    // a hash of 0 is stored under the key of 1
+    BenchmarkObject* Zero = Cache.GetOrCreate(0, [&]() { return Create(0); });
+    CHECK(Cache.Find(1) == Zero);
+    CHECK(Cache.GetCount() == 3 && CreateCount == 3);
+
+    s_ReleaseCount = 0;
+    Cache.Clear();
+    CHECK(s_ReleaseCount == 3);
+    CHECK(Cache.GetCount() == 0);
+    CHECK(Cache.Find(42) == nullptr);
+}
+
+// Many threads asking for the same objects at once create each of them exactly once and all get the same one
+TEST_CASE(ConcurrentObjectCacheThreads)
+{
+    const uint32_t kObjectCount = 256;
+    const vector<size_t> Hashes = MakeHashes(kObjectCount);
+
+    ConcurrentObjectCache<BenchmarkObject> Cache(2 * kObjectCount);
+    MeasureResult Result = Measure(Cache, Hashes, 8, 10000);
+    CHECK(Result.Creations == kObjectCount);
+    CHECK(Result.Mismatches == 0);
+    CHECK(Cache.GetCount() == kObjectCount);
+}
+
+// Threads looking up and creating objects in the cache and in the mutex protected std::map it replaced
+BENCHMARK(ConcurrentObjectCacheThroughput)
+{
+    const uint32_t kObjectCount = 512;
+    const uint32_t kLookupsPerThread = 1000000;
+    const vector<size_t> Hashes = MakeHashes(kObjectCount);
+
+    uint32_t HardwareThreads = max(1u, thread::hardware_concurrency());
+    printf("Object cache, %u objects, %u lookups per thread, %u hardware threads\n", kObjectCount, kLookupsPerThread, HardwareThreads);
+
+    for (uint32_t ThreadCount = 1; ThreadCount <= max(8u, HardwareThreads); ThreadCount *= 2)
+    {
+        MeasureResult MapResult, CacheResult;
+        {
+            MutexObjectMap Map;
+            MapResult = Measure(Map, Hashes, ThreadCount, kLookupsPerThread);
+        }
+        {
+            ConcurrentObjectCache<BenchmarkObject> Cache(2 * kObjectCount);
+            CacheResult = Measure(Cache, Hashes, ThreadCount, kLookupsPerThread);
+            CHECK(Cache.GetCount() == kObjectCount);
+        }
+        CHECK(CacheResult.Creations == kObjectCount);
+
+        const double Lookups = (double)ThreadCount * kLookupsPerThread;
+        printf("  %u threads: creation %.1f ms (map) / %.1f ms (cache), lookups %.1f M/s (map) / %.1f M/s (cache), %u / %u creations\n",
+            ThreadCount, MapResult.CreateSeconds * 1000.0, CacheResult.CreateSeconds * 1000.0,
+            Lookups / MapResult.LookupSeconds * 1e-6, Lookups / CacheResult.LookupSeconds * 1e-6, MapResult.Creations, CacheResult.Creations);
+    }
+}
@@ -0,0 +1,81 @@
+//
+// Description:  Tests of FencedReleaseQueue against a simulated graphics queue
+//
+
+#include "TestFramework.h"
+#include "FencedReleaseQueue.h"
+
+#include <memory>
+
+using namespace std;
+
+namespace
+{
+    // Fence values are handed out per submission and complete when the test says so
+    struct SimulatedQueue
+    {
+        uint64_t NextFenceValue;
+        uint64_t CompletedFenceValue;
+
+        SimulatedQueue() : NextFenceValue(1), CompletedFenceValue(0) {}
+
+        uint64_t Submit( void ) { return NextFenceValue++; }
+        bool IsFenceComplete( uint64_t FenceValue ) const { return FenceValue <= CompletedFenceValue; }
+    };
+}
+
+TEST_CASE(FencedReleaseQueueWaitsForTheLastListOfTheFrame)
+{
+    SimulatedQueue Graphics;
+    FencedReleaseQueue<shared_ptr<int>> Queue;
+    auto IsFenceComplete = [&Graphics]( uint64_t FenceValue ) { return Graphics.IsFenceComplete(FenceValue); };
+
+    weak_ptr<int> Buffer;
+    {
+        shared_ptr<int> Object = make_shared<int>(1);
+        Buffer = Object;
+        Queue.Retire(Object);
+    }
+
+    // A list of the frame that retired the buffer completes, but the frame goes on and may still use it
+    Graphics.CompletedFenceValue = Graphics.Submit();
+    CHECK(Queue.Release(IsFenceComplete) == 0);
+    CHECK(Queue.GetPendingCount() == 1);
+    CHECK(!Buffer.expired());
+
+    uint64_t FrameFence = Graphics.Submit();
+    Queue.OnFrameSubmitted(FrameFence);
+    CHECK(Queue.GetPendingCount() == 0);
+    CHECK(Queue.Release(IsFenceComplete) == 0);
+    CHECK(!Buffer.expired());
+
+    Graphics.CompletedFenceValue = FrameFence;
+    CHECK(Queue.Release(IsFenceComplete) == 1);
+    CHECK(Buffer.expired());
+    CHECK(Queue.GetRetiredCount() == 0);
+}
+
+TEST_CASE(FencedReleaseQueueReleasesInFrameOrder)
+{
+    SimulatedQueue Graphics;
+    FencedReleaseQueue<shared_ptr<int>> Queue;
+    auto IsFenceComplete = [&Graphics]( uint64_t FenceValue ) { return Graphics.IsFenceComplete(FenceValue); };
+
+    uint64_t Fences[3];
+    for (int Frame = 0; Frame < 3; ++Frame)
+    {
+        for (int i = 0; i <= Frame; ++i)
+            Queue.Retire(make_shared<int>(i));
+        Fences[Frame] = Graphics.Submit();
+        Queue.OnFrameSubmitted(Fences[Frame]);
+    }
+    CHECK(Queue.GetRetiredCount() == 6);
+
+    Graphics.CompletedFenceValue = Fences[1];
+    CHECK(Queue.Release(IsFenceComplete) == 3);
+    CHECK(Queue.Release(IsFenceComplete) == 0);
+    CHECK(Queue.GetRetiredCount() == 3);
+
+    Queue.ReleaseAll();
+    CHECK(Queue.GetRetiredCount() == 0);
+}
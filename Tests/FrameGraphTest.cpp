@@ -0,0 +1,351 @@
+//
+// Description:  Tests and benchmarks of FrameGraph compilation
+//
+
+#include "TestFramework.h"
+#include "FrameGraph.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+    typedef vector<vector<pair<FrameGraph::ResourceHandle, uint32_t>>> PassUseList;
+
+    bool LifetimesOverlap( const FrameGraph::ResourceInfo& A, const FrameGraph::ResourceInfo& B )
+    {
+        return A.FirstPass <= B.LastPass && B.FirstPass <= A.LastPass;
+    }
+
+    // Replays the compiled barriers and counts the passes that find a resource in another state than they declared,
+    // barriers that do not start from the state the resource is in and transient resources alive at the same time
+    // that share memory
+    uint32_t Validate( const FrameGraph& Graph, const PassUseList& PassUses, const vector<uint32_t>& ImportedStates,
+        const vector<uint64_t>& Sizes )
+    {
+        const uint32_t ResourceCount = Graph.GetResourceCount();
+        const vector<FrameGraph::Barrier>& Barriers = Graph.GetBarriers();
+        uint32_t Errors = 0;
+
+        // Transient resources come into being in the state of their first use
+        vector<uint32_t> State(ImportedStates);
+        auto Apply = [&](uint32_t First, uint32_t Count)
+        {
+            for (uint32_t b = First; b < First + Count; ++b)
+            {
+                const FrameGraph::Barrier& Current = Barriers[b];
+                if (Current.Type == FrameGraph::Barrier::kTransition)
+                {
+                    if (State[Current.Resource] != Current.StateBefore || Current.StateBefore == Current.StateAfter)
+                        ++Errors;
+                    State[Current.Resource] = Current.StateAfter;
+                }
+                else if (Current.Type == FrameGraph::Barrier::kAliasing)
+                {
+                    if (State[Current.Resource] != ~0u || !Graph.IsTransient(Current.PreviousResource))
+                        ++Errors;
+                }
+            }
+        };
+
+        for (const FrameGraph::CompiledPass& Compiled : Graph.GetCompiledPasses())
+        {
+            Apply(Compiled.FirstBarrier, Compiled.BarrierCount);
+            for (const pair<FrameGraph::ResourceHandle, uint32_t>& Use : PassUses[Compiled.Pass])
+            {
+                if (State[Use.first] == ~0u)
+                    State[Use.first] = Use.second;
+                const uint32_t Current = State[Use.first];
+                if (Current != Use.second && !(FrameGraph::IsReadOnlyState(Use.second) && (Current & Use.second) == Use.second))
+                    ++Errors;
+            }
+        }
+
+        Apply(Graph.GetFinalBarrier(), (uint32_t)Barriers.size() - Graph.GetFinalBarrier());
+        for (uint32_t r = 0; r < ResourceCount; ++r)
+        {
+            if (!Graph.IsTransient(r) && State[r] != Graph.GetResourceInfo(r).FinalState)
+                ++Errors;
+        }
+
+        for (uint32_t a = 0; a < ResourceCount; ++a)
+        {
+            const FrameGraph::ResourceInfo& A = Graph.GetResourceInfo(a);
+            if (!Graph.IsTransient(a) || A.FirstPass == FrameGraph::kInvalidHandle)
+                continue;
+            for (uint32_t b = a + 1; b < ResourceCount; ++b)
+            {
+                const FrameGraph::ResourceInfo& B = Graph.GetResourceInfo(b);
+                if (!Graph.IsTransient(b) || B.FirstPass == FrameGraph::kInvalidHandle || !LifetimesOverlap(A, B))
+                    continue;
+                if (A.HeapOffset + Sizes[a] > B.HeapOffset && B.HeapOffset + Sizes[b] > A.HeapOffset)
+                    ++Errors;
+            }
+        }
+        return Errors;
+    }
+
+    // Passes over imported and transient resources in the shape of a frame: producers of transients, consumers
+    // reading a few of them in various shader stages, writers of imported outputs and some dead passes
+    void BuildRandomGraph( FrameGraph& Graph, uint32_t PassCount, uint32_t ResourceCount, uint32_t Seed,
+        PassUseList& PassUses, vector<uint32_t>& ImportedStates, vector<uint64_t>& Sizes )
+    {
+        static const uint32_t kReadStates[] = { FrameGraph::kPixelShaderResource, FrameGraph::kNonPixelShaderResource,
+            FrameGraph::kShaderResource, FrameGraph::kCopySource, FrameGraph::kIndirectArgument };
+        static const uint32_t kWriteStates[] = { FrameGraph::kRenderTarget, FrameGraph::kUnorderedAccess, FrameGraph::kCopyDest };
+
+        mt19937 Random(Seed);
+        Graph.Clear();
+        PassUses.assign(PassCount, vector<pair<FrameGraph::ResourceHandle, uint32_t>>());
+        ImportedStates.assign(ResourceCount, ~0u);
+        Sizes.assign(ResourceCount, 0);
+
+        vector<bool> Written(ResourceCount, false);
+        for (uint32_t r = 0; r < ResourceCount; ++r)
+        {
+            char Name[32];
+            snprintf(Name, sizeof(Name), "Resource %u", r);
+            if (r % 4 == 0)
+            {
+                ImportedStates[r] = kReadStates[Random() % 3];
+                Graph.ImportResource(Name, ImportedStates[r]);
+                Written[r] = true;
+                if (Random() % 2 == 0)
+                    Graph.SetFinalState(r, FrameGraph::kShaderResource);
+            }
+            else
+            {
+                Sizes[r] = (uint64_t)(1 + Random() % 64) << 16;
+                Graph.CreateTransientResource(Name, Sizes[r], 1 << 16);
+            }
+        }
+
+        for (uint32_t p = 0; p < PassCount; ++p)
+        {
+            char Name[32];
+            snprintf(Name, sizeof(Name), "Pass %u", p);
+            FrameGraph::PassHandle Pass = Graph.AddPass(Name, Random() % 16 == 0);
+
+            const uint32_t ReadCount = 1 + Random() % 4;
+            for (uint32_t i = 0; i < ReadCount; ++i)
+            {
+                FrameGraph::ResourceHandle r = Random() % ResourceCount;
+                if (!Written[r])
+                    continue;
+                uint32_t State = kReadStates[Random() % 5];
+                Graph.Read(Pass, r, State);
+                PassUses[p].push_back(make_pair(r, State));
+            }
+
+            const uint32_t WriteCount = 1 + Random() % 2;
+            for (uint32_t i = 0; i < WriteCount; ++i)
+            {
+                FrameGraph::ResourceHandle r = Random() % ResourceCount;
+                bool AlreadyUsed = false;
+                for (const pair<FrameGraph::ResourceHandle, uint32_t>& Use : PassUses[p])
+                    AlreadyUsed = AlreadyUsed || Use.first == r;
+                if (AlreadyUsed)
+                    continue;
+                uint32_t State = kWriteStates[Random() % 3];
+                Graph.Write(Pass, r, State);
+                PassUses[p].push_back(make_pair(r, State));
+                Written[r] = true;
+            }
+        }
+
+        // Read states merged within a pass are what the pass is checked against
+        for (vector<pair<FrameGraph::ResourceHandle, uint32_t>>& Uses : PassUses)
+        {
+            for (size_t i = 0; i < Uses.size(); ++i)
+            {
+                for (size_t j = i + 1; j < Uses.size(); )
+                {
+                    if (Uses[j].first == Uses[i].first)
+                    {
+                        Uses[i].second |= Uses[j].second;
+                        Uses.erase(Uses.begin() + j);
+                    }
+                    else
+                        ++j;
+                }
+            }
+        }
+    }
+}
+
+// The shape of a Planet frame.  The debug view is culled, the reads of the shadow map and of the cloud buffer take one
+// transition each, the blur target reuses the memory of the cloud buffer that is dead by then.
+TEST_CASE(FrameGraphPlanetFrame)
+{
+    FrameGraph Graph;
+    FrameGraph::ResourceHandle Shadow = Graph.ImportResource("Cloud Shadow Map", FrameGraph::kPixelShaderResource);
+    FrameGraph::ResourceHandle History = Graph.ImportResource("Cloud History", FrameGraph::kCopyDest);
+    FrameGraph::ResourceHandle SceneColor = Graph.ImportResource("Scene Color", FrameGraph::kCommon);
+    FrameGraph::ResourceHandle Cloud = Graph.CreateTransientResource("Cloud Scattering", 8 << 20, 1 << 16);
+    FrameGraph::ResourceHandle Planet = Graph.CreateTransientResource("Planet Target", 8 << 20, 1 << 16);
+    FrameGraph::ResourceHandle Blur = Graph.CreateTransientResource("Blur Target", 8 << 20, 1 << 16);
+    FrameGraph::ResourceHandle Debug = Graph.CreateTransientResource("Debug View", 8 << 20, 1 << 16);
+    Graph.SetFinalState(History, FrameGraph::kShaderResource);
+
+    FrameGraph::PassHandle Shadows = Graph.AddPass("Cloud Shadow Map");
+    Graph.Write(Shadows, Shadow, FrameGraph::kUnorderedAccess);
+
+    FrameGraph::PassHandle Clouds = Graph.AddPass("Cloud Raymarch");
+    Graph.Read(Clouds, Shadow, FrameGraph::kPixelShaderResource);
+    Graph.Read(Clouds, History, FrameGraph::kPixelShaderResource);
+    Graph.Write(Clouds, Cloud, FrameGraph::kRenderTarget);
+
+    FrameGraph::PassHandle Copy = Graph.AddPass("Cloud History Copy");
+    Graph.Read(Copy, Cloud, FrameGraph::kCopySource);
+    Graph.Write(Copy, History, FrameGraph::kCopyDest);
+
+    FrameGraph::PassHandle Composite = Graph.AddPass("Planet Composite");
+    Graph.Read(Composite, Cloud, FrameGraph::kPixelShaderResource);
+    Graph.Read(Composite, Shadow, FrameGraph::kNonPixelShaderResource);
+    Graph.Write(Composite, Planet, FrameGraph::kRenderTarget);
+
+    FrameGraph::PassHandle DebugView = Graph.AddPass("Cloud Debug View");
+    Graph.Read(DebugView, Cloud, FrameGraph::kNonPixelShaderResource);
+    Graph.Write(DebugView, Debug, FrameGraph::kUnorderedAccess);
+
+    FrameGraph::PassHandle Rays = Graph.AddPass("Crepuscular Rays");
+    Graph.Read(Rays, Planet, FrameGraph::kNonPixelShaderResource);
+    Graph.Write(Rays, Blur, FrameGraph::kUnorderedAccess);
+
+    FrameGraph::PassHandle Resolve = Graph.AddPass("Blur");
+    Graph.Read(Resolve, Blur, FrameGraph::kNonPixelShaderResource);
+    Graph.Write(Resolve, SceneColor, FrameGraph::kUnorderedAccess);
+
+    Graph.Compile();
+
+    const FrameGraph::CompileStats& Stats = Graph.GetStats();
+    CHECK(Stats.PassCount == 6 && Stats.CulledPassCount == 1);
+    CHECK(Graph.GetResourceInfo(Debug).FirstPass == FrameGraph::kInvalidHandle);
+    CHECK(Graph.GetResourceInfo(Shadow).FinalState == (FrameGraph::kPixelShaderResource | FrameGraph::kNonPixelShaderResource));
+    CHECK(Graph.GetResourceInfo(History).FinalState == FrameGraph::kShaderResource);
+    CHECK(Graph.GetResourceInfo(Blur).HeapOffset == Graph.GetResourceInfo(Cloud).HeapOffset);
+    CHECK(Stats.TransientHeapSize == (16 << 20) && Stats.AliasingBarrierCount == 1);
+    CHECK(Stats.MergedTransitionCount == 2);
+
+    // the aliasing barrier hands the memory of the cloud buffer to the blur target right before the pass that writes it
+    const vector<FrameGraph::Barrier>& Barriers = Graph.GetBarriers();
+    const FrameGraph::CompiledPass& RaysPass = Graph.GetCompiledPasses()[4];
+    CHECK(RaysPass.Pass == Rays);
+    bool IsAliasedBeforeRays = false;
+    for (uint32_t b = RaysPass.FirstBarrier; b < RaysPass.FirstBarrier + RaysPass.BarrierCount; ++b)
+    {
+        IsAliasedBeforeRays = IsAliasedBeforeRays || (Barriers[b].Type == FrameGraph::Barrier::kAliasing &&
+            Barriers[b].Resource == Blur && Barriers[b].PreviousResource == Cloud);
+    }
+    CHECK(IsAliasedBeforeRays);
+
+    string Dump;
+    Graph.Dump(Dump);
+    CHECK(Dump.find("Cloud Debug View (culled)") != string::npos);
+    printf("%s", Dump.c_str());
+}
+
+// A transient resource that only a side effect free pass writes is culled with the pass, and units of the frame
+// that depend on each other through transients survive together
+TEST_CASE(FrameGraphCullsDeadTransients)
+{
+    FrameGraph Graph;
+    FrameGraph::ResourceHandle Output = Graph.ImportResource("Output", FrameGraph::kCommon);
+    FrameGraph::ResourceHandle Used = Graph.CreateTransientResource("Used", 1 << 16, 1 << 16);
+    FrameGraph::ResourceHandle Dead = Graph.CreateTransientResource("Dead", 1 << 16, 1 << 16);
+    FrameGraph::ResourceHandle Logged = Graph.CreateTransientResource("Logged", 1 << 16, 1 << 16);
+
+    FrameGraph::PassHandle Produce = Graph.AddPass("Produce");
+    Graph.Write(Produce, Used, FrameGraph::kUnorderedAccess);
+    FrameGraph::PassHandle Unused = Graph.AddPass("Unused");
+    Graph.Read(Unused, Used, FrameGraph::kNonPixelShaderResource);
+    Graph.Write(Unused, Dead, FrameGraph::kUnorderedAccess);
+    FrameGraph::PassHandle Capture = Graph.AddPass("Capture", true);
+    Graph.Write(Capture, Logged, FrameGraph::kCopyDest);
+    FrameGraph::PassHandle Consume = Graph.AddPass("Consume");
+    Graph.Read(Consume, Used, FrameGraph::kPixelShaderResource);
+    Graph.Write(Consume, Output, FrameGraph::kRenderTarget);
+
+    Graph.Compile();
+    const vector<FrameGraph::CompiledPass>& Passes = Graph.GetCompiledPasses();
+    CHECK(Passes.size() == 3);
+    CHECK(Passes[0].Pass == Produce && Passes[1].Pass == Capture && Passes[2].Pass == Consume);
+    CHECK(Graph.GetResourceInfo(Dead).FirstPass == FrameGraph::kInvalidHandle);
+    CHECK(Graph.GetResourceInfo(Logged).FirstPass == 1);
+    // Used and Logged are alive at the same time
+    CHECK(Graph.GetResourceInfo(Used).HeapOffset != Graph.GetResourceInfo(Logged).HeapOffset);
+    CHECK(Graph.GetStats().TransientHeapSize == (2 << 16));
+}
+
+// Random graphs replay to the declared states and never overlap live transient memory
+TEST_CASE(FrameGraphRandomGraphs)
+{
+    FrameGraph Graph;
+    PassUseList PassUses;
+    vector<uint32_t> ImportedStates;
+    vector<uint64_t> Sizes;
+
+    const uint32_t kPassCounts[] = { 16, 64, 256 };
+    for (uint32_t PassCount : kPassCounts)
+    {
+        uint32_t Errors = 0;
+        uint64_t Aliased = 0;
+        for (uint32_t Seed = 1; Seed <= 16; ++Seed)
+        {
+            BuildRandomGraph(Graph, PassCount, PassCount / 2 + 8, Seed, PassUses, ImportedStates, Sizes);
+            Graph.Compile();
+            Errors += Validate(Graph, PassUses, ImportedStates, Sizes);
+            Aliased += Graph.GetStats().AliasingBarrierCount;
+            CHECK(Graph.GetStats().TransientHeapSize <= Graph.GetStats().TransientBytes);
+        }
+        CHECK(Errors == 0);
+        CHECK(Aliased > 0);
+    }
+}
+
+// Compile times of random graphs, with the barriers, merged transitions, culled passes and heap savings they get
+BENCHMARK(FrameGraphCompile)
+{
+    printf("Frame graph compile\n");
+
+    const uint32_t kPassCounts[] = { 16, 64, 256, 1024 };
+    for (uint32_t PassCount : kPassCounts)
+    {
+        const uint32_t ResourceCount = PassCount / 2 + 8;
+        const uint32_t kGraphCount = 8;
+        const uint32_t kCompilesPerGraph = max(1u, 4096u / PassCount);
+
+        FrameGraph Graph;
+        PassUseList PassUses;
+        vector<uint32_t> ImportedStates;
+        vector<uint64_t> Sizes;
+        double Seconds = 0.0;
+        uint64_t Barriers = 0, Merged = 0, Culled = 0, TransientBytes = 0, HeapBytes = 0;
+
+        for (uint32_t g = 0; g < kGraphCount; ++g)
+        {
+            BuildRandomGraph(Graph, PassCount, ResourceCount, g + 1, PassUses, ImportedStates, Sizes);
+
+            int64_t StartTick = SystemTime::GetCurrentTick();
+            for (uint32_t i = 0; i < kCompilesPerGraph; ++i)
+                Graph.Compile();
+            Seconds += SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+
+            CHECK(Validate(Graph, PassUses, ImportedStates, Sizes) == 0);
+
+            const FrameGraph::CompileStats& Stats = Graph.GetStats();
+            Barriers += Stats.TransitionCount + Stats.UAVBarrierCount + Stats.AliasingBarrierCount;
+            Merged += Stats.MergedTransitionCount;
+            Culled += Stats.CulledPassCount;
+            TransientBytes += Stats.TransientBytes;
+            HeapBytes += Stats.TransientHeapSize;
+        }
+
+        printf("  %4u passes, %4u resources: compile %.1f us, %.2f barriers per pass, %.1f transitions merged, %.1f passes culled, transient heap %.0f%% of the resources\n",
+            PassCount, ResourceCount, Seconds * 1e6 / (kGraphCount * kCompilesPerGraph), (double)Barriers / (kGraphCount * PassCount),
+            (double)Merged / kGraphCount, (double)Culled / kGraphCount, TransientBytes > 0 ? 100.0 * HeapBytes / TransientBytes : 0.0);
+    }
+}
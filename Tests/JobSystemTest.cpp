@@ -0,0 +1,243 @@
+//
+// Description:  Tests and benchmarks of JobSystem
+//
+
+#include "TestFramework.h"
+#include "Util/JobSystem.h"
+#include "SystemTime.h"
+
+#ifdef _MSC_VER
+#include <ppl.h>
+#endif
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // A few octaves of value noise, about the cost of a texel of CPU noise baking
+    float NoiseKernel( uint32_t Index )
+    {
+        float Sum = 0.0f;
+        float Amplitude = 0.5f;
+        float X = (Index & 1023) * 0.031f, Y = (Index >> 10) * 0.027f;
+        for (uint32_t Octave = 0; Octave < 6; ++Octave)
+        {
+            Sum += Amplitude * sinf(X * 12.9898f + Y * 78.233f) * cosf(X * 4.1414f - Y * 1.7f);
+            X *= 2.03f;
+            Y *= 1.97f;
+            Amplitude *= 0.5f;
+        }
+        return Sum;
+    }
+
+    uint32_t Fibonacci( uint32_t N )
+    {
+        if (N < 2)
+            return N;
+        if (N < 16)
+            return Fibonacci(N - 1) + Fibonacci(N - 2);
+
+        // Every level submits a job and waits for it, which only works if waiting runs other jobs
+        uint32_t Left = 0;
+        JobSystem::JobCounter Counter;
+        JobSystem::Run([&Left, N]() { Left = Fibonacci(N - 1); }, &Counter);
+        uint32_t Right = Fibonacci(N - 2);
+        JobSystem::Wait(Counter);
+        return Left + Right;
+    }
+
+    // Layers of tasks, every task depends on two tasks of the layer before.  FinishOrder receives the position
+    // every task finished at.
+    void BuildLayeredGraph( JobSystem::TaskGraph& Graph, uint32_t Layers, uint32_t Width, uint32_t Work,
+        vector<uint32_t>& FinishOrder, atomic<uint32_t>& Sequence )
+    {
+        FinishOrder.assign(Layers * Width, 0);
+        for (uint32_t Layer = 0; Layer < Layers; ++Layer)
+        {
+            for (uint32_t i = 0; i < Width; ++i)
+            {
+                const uint32_t Id = Layer * Width + i;
+                Graph.AddTask([&FinishOrder, &Sequence, Id, Work]()
+                {
+                    volatile float Sink = 0.0f;
+                    for (uint32_t j = 0; j < Work; ++j)
+                        Sink = Sink + NoiseKernel(Id * Work + j);
+                    FinishOrder[Id] = Sequence.fetch_add(1, memory_order_relaxed);
+                });
+                if (Layer > 0)
+                {
+                    Graph.AddDependency((Layer - 1) * Width + i, Id);
+                    Graph.AddDependency((Layer - 1) * Width + (i * 7 + 1) % Width, Id);
+                }
+            }
+        }
+    }
+
+    bool IsInDependencyOrder( const vector<uint32_t>& FinishOrder, uint32_t Layers, uint32_t Width )
+    {
+        for (uint32_t Layer = 1; Layer < Layers; ++Layer)
+        {
+            for (uint32_t i = 0; i < Width; ++i)
+            {
+                const uint32_t Id = Layer * Width + i;
+                if (FinishOrder[Id] < FinishOrder[(Layer - 1) * Width + i] ||
+                    FinishOrder[Id] < FinishOrder[(Layer - 1) * Width + (i * 7 + 1) % Width])
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+// Every submitted job runs once, and every index of a parallel loop is visited once whatever the grain
+TEST_CASE(JobSystemRunsEveryJob)
+{
+    const uint32_t kJobCount = 20000;
+    atomic<uint32_t> Executed(0);
+    JobSystem::JobCounter Counter;
+    for (uint32_t i = 0; i < kJobCount; ++i)
+        JobSystem::Run([&Executed]() { Executed.fetch_add(1, memory_order_relaxed); }, &Counter);
+    JobSystem::Wait(Counter);
+    CHECK(Counter.IsDone());
+    CHECK(Executed == kJobCount);
+
+    const uint32_t kCount = 100003;
+    unique_ptr<atomic<uint32_t>[]> Visits(new atomic<uint32_t>[kCount]);
+    const uint32_t kGrains[] = { 0, 1, 7, 1024, kCount, 2 * kCount };
+    for (uint32_t Grain : kGrains)
+    {
+        for (uint32_t i = 0; i < kCount; ++i)
+            Visits[i].store(0, memory_order_relaxed);
+        JobSystem::ParallelFor(3, kCount, Grain, [&Visits](uint32_t i) { Visits[i].fetch_add(1, memory_order_relaxed); });
+
+        bool IsEachVisitedOnce = Visits[0] == 0 && Visits[1] == 0 && Visits[2] == 0;
+        for (uint32_t i = 3; i < kCount; ++i)
+            IsEachVisitedOnce = IsEachVisitedOnce && Visits[i] == 1;
+        CHECK(IsEachVisitedOnce);
+    }
+
+    // an empty range returns without calling the body
+    bool IsCalled = false;
+    JobSystem::ParallelFor(5, 5, 0, [&IsCalled](uint32_t) { IsCalled = true; });
+    CHECK(!IsCalled);
+}
+
+// Jobs waiting for jobs of their own, nested loops, and task graphs that finish in dependency order
+TEST_CASE(JobSystemNestedWaitsAndGraphs)
+{
+    CHECK(Fibonacci(24) == 46368);
+
+    const uint32_t kOuter = 64;
+    const uint32_t kInner = 1000;
+    vector<uint32_t> Sums(kOuter, 0);
+    JobSystem::ParallelFor(0, kOuter, 1, [&Sums](uint32_t Outer)
+    {
+        atomic<uint32_t> Sum(0);
+        JobSystem::ParallelFor(0, kInner, 16, [&Sum](uint32_t Inner) { Sum.fetch_add(Inner, memory_order_relaxed); });
+        Sums[Outer] = Sum;
+    });
+    CHECK(all_of(Sums.begin(), Sums.end(), [](uint32_t Sum) { return Sum == kInner * (kInner - 1) / 2; }));
+
+    const uint32_t kLayers = 16;
+    const uint32_t kWidth = 16;
+    JobSystem::TaskGraph Graph;
+    vector<uint32_t> FinishOrder;
+    atomic<uint32_t> Sequence(0);
+    BuildLayeredGraph(Graph, kLayers, kWidth, 16, FinishOrder, Sequence);
+    CHECK(Graph.GetTaskCount() == kLayers * kWidth);
+
+    // a graph can be run again
+    CHECK(Graph.IsAcyclic());
+    for (uint32_t Run = 0; Run < 2; ++Run)
+    {
+        Sequence = 0;
+        CHECK(Graph.Run());
+        CHECK(Sequence == kLayers * kWidth);
+        CHECK(IsInDependencyOrder(FinishOrder, kLayers, kWidth));
+    }
+
+    // a dependency back to the first layer closes a cycle, which is found in every configuration
+    Graph.AddDependency((kLayers - 1) * kWidth, 0);
+    CHECK(!Graph.IsAcyclic());
+}
+
+// Job throughput, parallel loops against a serial loop and PPL (MSVC only), nested waits and task graphs
+BENCHMARK(JobSystemThroughput)
+{
+    printf("Job system, %u threads\n", JobSystem::GetThreadCount());
+
+    // Submission and stealing overhead
+    {
+        const uint32_t kJobCount = 200000;
+        atomic<uint32_t> Executed(0);
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        JobSystem::JobCounter Counter;
+        for (uint32_t i = 0; i < kJobCount; ++i)
+            JobSystem::Run([&Executed]() { Executed.fetch_add(1, memory_order_relaxed); }, &Counter);
+        JobSystem::Wait(Counter);
+        double Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        CHECK(Executed == kJobCount);
+        printf("  %u empty jobs: %.2f M jobs/s\n", kJobCount, kJobCount / Seconds * 1e-6);
+    }
+
+    // Parallel loop over a noise kernel
+    {
+        const uint32_t kCount = 1 << 21;
+        vector<float> Serial(kCount), Parallel(kCount);
+
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        for (uint32_t i = 0; i < kCount; ++i)
+            Serial[i] = NoiseKernel(i);
+        double SerialSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+
+#ifdef _MSC_VER
+        StartTick = SystemTime::GetCurrentTick();
+        concurrency::parallel_for(0u, kCount, [&](const uint32_t i) { Parallel[i] = NoiseKernel(i); });
+        double PplSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        CHECK(Parallel == Serial);
+
+        printf("  noise over %u texels: serial %.1f ms, PPL parallel_for %.1f ms\n", kCount, SerialSeconds * 1000.0, PplSeconds * 1000.0);
+#else
+        printf("  noise over %u texels: serial %.1f ms\n", kCount, SerialSeconds * 1000.0);
+#endif
+
+        const uint32_t kGrains[] = { 0, 64, 1024, 16384 };
+        for (uint32_t Grain : kGrains)
+        {
+            fill(Parallel.begin(), Parallel.end(), 0.0f);
+            StartTick = SystemTime::GetCurrentTick();
+            JobSystem::ParallelFor(0, kCount, Grain, [&](uint32_t i) { Parallel[i] = NoiseKernel(i); });
+            double Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+            CHECK(Parallel == Serial);
+            printf("    ParallelFor grain %5u%s: %.1f ms, %.1fx serial\n", Grain, Grain == 0 ? " (auto)" : "",
+                Seconds * 1000.0, SerialSeconds / Seconds);
+        }
+    }
+
+    // Nested submission and waiting
+    {
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        uint32_t Result = Fibonacci(30);
+        double Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        CHECK(Result == 832040);
+        printf("  nested jobs, fibonacci(30): %.1f ms\n", Seconds * 1000.0);
+    }
+
+    // Task graph
+    {
+        const uint32_t kLayers = 64;
+        const uint32_t kWidth = 64;
+        JobSystem::TaskGraph Graph;
+        vector<uint32_t> FinishOrder;
+        atomic<uint32_t> Sequence(0);
+        BuildLayeredGraph(Graph, kLayers, kWidth, 256, FinishOrder, Sequence);
+
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        Graph.Run();
+        double Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        CHECK(IsInDependencyOrder(FinishOrder, kLayers, kWidth));
+        printf("  task graph of %u tasks in %u layers: %.1f ms\n", Graph.GetTaskCount(), kLayers, Seconds * 1000.0);
+    }
+}
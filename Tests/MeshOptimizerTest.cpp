@@ -0,0 +1,188 @@
+#include "TestFramework.h"
+#include "MeshOptimizer.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <array>
+
+using namespace MeshOptimizer;
+
+namespace
+{
+	//Row ordered grid of width x height quads, positions only
+	void BuildGridMesh(const UINT width, const UINT height, std::vector<float3>& vertices, std::vector<UINT>& indices)
+	{
+		vertices.clear();
+		indices.clear();
+		for (UINT y = 0; y <= height; ++y)
+		{
+			for (UINT x = 0; x <= width; ++x)
+			{
+				vertices.emplace_back(static_cast<float>(x), static_cast<float>(y), 0.0f);
+			}
+		}
+		for (UINT y = 0; y < height; ++y)
+		{
+			for (UINT x = 0; x < width; ++x)
+			{
+				const UINT a = y * (width + 1) + x;
+				const UINT c = a + width + 1;
+				indices.insert(indices.end(), { a, a + 1, c + 1, a, c + 1, c });
+			}
+		}
+	}
+
+	//Triangles as corner positions, rotated to start at the smallest corner so that the winding is kept, sorted
+	std::vector<std::array<float, 9>> GetTriangles(const std::vector<float3>& vertices, const std::vector<UINT>& indices)
+	{
+		std::vector<std::array<float, 9>> triangles;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			std::array<std::array<float, 3>, 3> corners;
+			for (UINT corner = 0; corner < 3; ++corner)
+			{
+				const float3& position = vertices[indices[i + corner]];
+				corners[corner] = { position.x, position.y, position.z };
+			}
+			std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+
+			std::array<float, 9> triangle;
+			for (UINT corner = 0; corner < 3; ++corner)
+			{
+				std::copy(corners[corner].begin(), corners[corner].end(), triangle.begin() + corner * 3);
+			}
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void PrintReport(const std::vector<MeshReport>& reports)
+	{
+		//triangle weighted, ACMR * triangles is the number of misses
+		double trianglesTotal = 0.0, missesBefore = 0.0, missesAfter = 0.0, atvrBefore = 0.0, atvrAfter = 0.0;
+		UINT meshlets = 0;
+		for (const MeshReport& report : reports)
+		{
+			const double triangles = (report._before._acmr > 0.0f) ? report._before._misses / report._before._acmr : 0.0;
+			trianglesTotal += triangles;
+			missesBefore += report._before._misses;
+			missesAfter += report._after._misses;
+			atvrBefore += report._before._atvr * triangles;
+			atvrAfter += report._after._atvr * triangles;
+			meshlets += report._meshletCount;
+		}
+		if (trianglesTotal <= 0.0)
+		{
+			return;
+		}
+
+		printf("  %u meshes, %.0f triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u meshlets\n",
+			static_cast<UINT>(reports.size()), trianglesTotal, missesBefore / trianglesTotal, missesAfter / trianglesTotal,
+			atvrBefore / trianglesTotal, atvrAfter / trianglesTotal, meshlets);
+	}
+}
+
+//Optimizing keeps every triangle with its winding, lowers the cache misses and numbers vertices in order of first use
+TEST_CASE(MeshOptimizerGrids)
+{
+	for (const UINT size : { 8u, 16u, 32u, 64u })
+	{
+		std::vector<float3> vertices;
+		std::vector<UINT> indices;
+		BuildGridMesh(size, size, vertices, indices);
+		const std::vector<std::array<float, 9>> triangles = GetTriangles(vertices, indices);
+
+		MeshletData meshlets;
+		Mesh mesh = { &indices, vertices.data(), vertices.size(), sizeof(float3), &meshlets };
+		Settings settings;
+		settings._buildMeshlets = true;
+		const MeshReport report = OptimizeMesh(mesh, settings);
+
+		printf("  %2ux%-2u grid, ACMR %.3f -> %.3f, %u meshlets\n", size, size, report._before._acmr, report._after._acmr, report._meshletCount);
+		CHECK(report._after._acmr < report._before._acmr);
+		CHECK(report._after._acmr < 0.8f);
+		CHECK(GetTriangles(vertices, indices) == triangles);
+
+		UINT nextVertex = 0;
+		bool isFetchOrdered = true;
+		for (const UINT index : indices)
+		{
+			isFetchOrdered = isFetchOrdered && index <= nextVertex;
+			nextVertex = std::max(nextVertex, index + 1);
+		}
+		CHECK(isFetchOrdered);
+
+		//every triangle lands in exactly one meshlet, through local indices that point back at its vertices
+		size_t meshletTriangles = 0;
+		bool isMeshletValid = true;
+		for (const Meshlet& meshlet : meshlets._meshlets)
+		{
+			isMeshletValid = isMeshletValid && meshlet._vertexCount <= MESHLET_MAX_VERTICES && meshlet._triangleCount <= MESHLET_MAX_TRIANGLES;
+			for (UINT triangle = 0; triangle < meshlet._triangleCount; ++triangle)
+			{
+				for (UINT corner = 0; corner < 3; ++corner)
+				{
+					const UINT local = meshlets._primitiveIndices[(meshlet._triangleOffset + triangle) * 3 + corner];
+					isMeshletValid = isMeshletValid && local < meshlet._vertexCount &&
+						meshlets._vertexIndices[meshlet._vertexOffset + local] == indices[(meshletTriangles + triangle) * 3 + corner];
+				}
+			}
+			meshletTriangles += meshlet._triangleCount;
+		}
+		CHECK(isMeshletValid);
+		CHECK(meshletTriangles == indices.size() / 3);
+		CHECK(meshlets._meshlets.size() == report._meshletCount);
+	}
+}
+
+//Optimizes a set of row ordered grids serially and on the worker threads
+BENCHMARK(MeshOptimizerThroughput)
+{
+	constexpr UINT GridSizes[] = { 16, 32, 64, 128, 256 };
+	constexpr UINT MeshesPerSize = 32;
+
+	std::vector<std::vector<float3>> vertices;
+	std::vector<std::vector<UINT>> indices;
+	for (const UINT size : GridSizes)
+	{
+		for (UINT i = 0; i < MeshesPerSize; ++i)
+		{
+			vertices.emplace_back();
+			indices.emplace_back();
+			BuildGridMesh(size, size, vertices.back(), indices.back());
+		}
+	}
+
+	std::vector<std::vector<float3>> parallelVertices = vertices;
+	std::vector<std::vector<UINT>> parallelIndices = indices;
+	std::vector<MeshletData> meshlets(vertices.size());
+	std::vector<MeshletData> parallelMeshlets(vertices.size());
+	std::vector<Mesh> serialMeshes;
+	std::vector<Mesh> parallelMeshes;
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		serialMeshes.push_back({ &indices[i], vertices[i].data(), vertices[i].size(), sizeof(float3), &meshlets[i] });
+		parallelMeshes.push_back({ &parallelIndices[i], parallelVertices[i].data(), parallelVertices[i].size(), sizeof(float3), &parallelMeshlets[i] });
+	}
+
+	Settings settings;
+	settings._buildMeshlets = true;
+
+	int64_t startTick = SystemTime::GetCurrentTick();
+	std::vector<MeshReport> reports;
+	for (Mesh& mesh : serialMeshes)
+	{
+		reports.push_back(OptimizeMesh(mesh, settings));
+	}
+	const double serialSeconds = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+
+	startTick = SystemTime::GetCurrentTick();
+	OptimizeMeshes(parallelMeshes, settings);
+	const double parallelSeconds = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+	CHECK(parallelIndices == indices);
+
+	printf("Mesh optimizer benchmark, row ordered grids, FIFO cache of %u\n", settings._fifoCacheSize);
+	PrintReport(reports);
+	printf("  serial %.1f ms, worker threads %.1f ms\n", serialSeconds * 1000.0, parallelSeconds * 1000.0);
+}
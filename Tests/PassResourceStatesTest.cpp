@@ -0,0 +1,126 @@
+//
+// Description:  Tests of the resource states ParallelPassRecorder resolves between passes
+//
+
+#include "TestFramework.h"
+#include "PassResourceStates.h"
+
+#include <map>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    typedef PassResourceStates::State State;
+
+    enum : State
+    {
+        kCommon = 0,
+        kRenderTarget = 0x4,
+        kUnorderedAccess = 0x8,
+        kPixelShaderResource = 0x80
+    };
+
+    struct Barrier
+    {
+        int List;
+        void* Resource;
+        State Before;
+        State After;
+    };
+
+    // Stands in for the resources and the command lists of one batch.  The lists record what
+    // CommandContext::TransitionResource would, a barrier whenever the state changes.
+    struct SimulatedBatch
+    {
+        map<void*, State> ResourceStates;
+        vector<Barrier> Barriers;
+
+        void Transition( int List, void* Resource, State NewState )
+        {
+            State& Current = ResourceStates[Resource];
+            if (Current != NewState)
+            {
+                Barrier Recorded = { List, Resource, Current, NewState };
+                Barriers.push_back(Recorded);
+                Current = NewState;
+            }
+        }
+
+        // Recording inside a pass, transitions after the first use go into the pass' own list
+        void Use( int List, PassResourceStates& Pass, void* Resource, State NewState )
+        {
+            State OldState;
+            if (Pass.Use(Resource, NewState, OldState) && OldState != NewState)
+            {
+                Barrier Recorded = { List, Resource, OldState, NewState };
+                Barriers.push_back(Recorded);
+            }
+        }
+
+        // What the recorder does on submission, the preceding list gets the transitions into the pass
+        void Resolve( int PrecedingList, PassResourceStates& Pass )
+        {
+            Pass.Resolve(
+                [&]( void* Resource, State InitialState ) { Transition(PrecedingList, Resource, InitialState); },
+                [&]( void* Resource, State FinalState ) { ResourceStates[Resource] = FinalState; });
+        }
+    };
+
+    bool IsBarrier( const Barrier& Recorded, int List, void* Resource, State Before, State After )
+    {
+        return Recorded.List == List && Recorded.Resource == Resource && Recorded.Before == Before && Recorded.After == After;
+    }
+}
+
+TEST_CASE(PassResourceStatesFirstUseIsRecordedInThePrecedingList)
+{
+    int Target, Texture;
+    SimulatedBatch Batch;
+    Batch.ResourceStates[&Target] = kPixelShaderResource;
+    Batch.ResourceStates[&Texture] = kCommon;
+
+    PassResourceStates Pass;
+    Batch.Use(1, Pass, &Target, kRenderTarget);
+    Batch.Use(1, Pass, &Texture, kPixelShaderResource);
+
+    // Recording neither touches the resources nor records the first uses
+    CHECK(Batch.Barriers.empty());
+    CHECK(Batch.ResourceStates[&Target] == kPixelShaderResource);
+    CHECK(Pass.GetState(&Target, kCommon) == kRenderTarget);
+    CHECK(Pass.GetState(&Batch, kUnorderedAccess) == kUnorderedAccess);
+
+    Batch.Resolve(0, Pass);
+    CHECK(Batch.Barriers.size() == 2);
+    CHECK(IsBarrier(Batch.Barriers[0], 0, &Target, kPixelShaderResource, kRenderTarget));
+    CHECK(IsBarrier(Batch.Barriers[1], 0, &Texture, kCommon, kPixelShaderResource));
+    CHECK(Pass.IsEmpty());
+}
+
+TEST_CASE(PassResourceStatesFinalStateCarriesIntoTheNextPass)
+{
+    int Target;
+    SimulatedBatch Batch;
+    Batch.ResourceStates[&Target] = kCommon;
+
+    // Pass 1 writes the target and leaves it readable, pass 2 reads it, pass 3 writes it again through a UAV
+    PassResourceStates Passes[3];
+    Batch.Use(1, Passes[0], &Target, kRenderTarget);
+    Batch.Use(1, Passes[0], &Target, kPixelShaderResource);
+    Batch.Use(2, Passes[1], &Target, kPixelShaderResource);
+    Batch.Use(3, Passes[2], &Target, kUnorderedAccess);
+
+    // The only barrier recorded while recording is the one inside pass 1
+    CHECK(Batch.Barriers.size() == 1);
+    CHECK(IsBarrier(Batch.Barriers[0], 1, &Target, kRenderTarget, kPixelShaderResource));
+
+    for (int i = 0; i < 3; ++i)
+        Batch.Resolve(i, Passes[i]);
+
+    // Prologue into pass 1, nothing between 1 and 2 which agree on the state, and pass 2 into pass 3
+    CHECK(Batch.Barriers.size() == 3);
+    CHECK(IsBarrier(Batch.Barriers[1], 0, &Target, kCommon, kRenderTarget));
+    CHECK(IsBarrier(Batch.Barriers[2], 2, &Target, kPixelShaderResource, kUnorderedAccess));
+    CHECK(Batch.ResourceStates[&Target] == kUnorderedAccess);
+}
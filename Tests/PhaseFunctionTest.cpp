@@ -0,0 +1,142 @@
+#include "TestFramework.h"
+#include "PhaseFunction.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace PhaseFunction;
+
+namespace
+{
+	constexpr float Asymmetries[] = { 0.08f, 0.3f, 0.5f, 0.8f };
+
+	std::vector<float> MakeCosines(const size_t count)
+	{
+		std::vector<float> nu(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			nu[i] = (static_cast<float>(i) + 0.5f) / static_cast<float>(count) * 2.0f - 1.0f;
+		}
+		return nu;
+	}
+
+	float MaxRelativeError(const std::vector<float>& reference, const std::vector<float>& values)
+	{
+		float maxError = 0.0f;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			maxError = std::max(maxError, fabsf(values[i] - reference[i]) / reference[i]);
+		}
+		return maxError;
+	}
+
+	//Integral over the sphere, 2 pi times the midpoint sum over nu
+	float IntegrateSphere(const std::vector<float>& values)
+	{
+		double sum = 0.0;
+		for (const float value : values)
+		{
+			sum += value;
+		}
+		return static_cast<float>(sum * 2.0 / values.size() * 2.0 * FPI);
+	}
+
+	template<typename Evaluate>
+	double MeasureThroughput(const size_t sampleCount, Evaluate evaluate)
+	{
+		const int64_t start = SystemTime::GetCurrentTick();
+		evaluate();
+		const double seconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+		return (seconds > 0.0) ? (static_cast<double>(sampleCount) / seconds * 1e-6) : 0.0;
+	}
+}
+
+//Batches match the scalar versions and every variant is normalized over the sphere
+TEST_CASE(PhaseFunctionBatchesMatchScalar)
+{
+	constexpr size_t SampleCount = 4099;
+	const std::vector<float> nu = MakeCosines(SampleCount);
+	std::vector<float> reference(SampleCount);
+	std::vector<float> values(SampleCount);
+
+	for (const float g : Asymmetries)
+	{
+		for (size_t i = 0; i < SampleCount; ++i) { reference[i] = HenyeyGreenstein(nu[i], g); }
+		CHECK(fabsf(IntegrateSphere(reference) - 1.0f) < 1e-3f);
+
+		HenyeyGreensteinBatch(nu.data(), values.data(), SampleCount, g);
+		CHECK(MaxRelativeError(reference, values) < 1e-5f);
+
+		const float k = HenyeyGreensteinSchlickK(g);
+		for (size_t i = 0; i < SampleCount; ++i) { reference[i] = HenyeyGreensteinSchlick(nu[i], k); }
+		HenyeyGreensteinSchlickBatch(nu.data(), values.data(), SampleCount, g);
+		CHECK(MaxRelativeError(reference, values) < 1e-5f);
+		CHECK(fabsf(IntegrateSphere(values) - 1.0f) < 1e-3f);
+
+		for (size_t i = 0; i < SampleCount; ++i) { reference[i] = DualLobeHenyeyGreenstein(nu[i], g, -0.3f, 0.7f); }
+		DualLobeHenyeyGreensteinBatch(nu.data(), values.data(), SampleCount, g, -0.3f, 0.7f);
+		CHECK(MaxRelativeError(reference, values) < 1e-5f);
+
+		for (size_t i = 0; i < SampleCount; ++i) { reference[i] = CornetteShanks(nu[i], g); }
+		CornetteShanksBatch(nu.data(), values.data(), SampleCount, g);
+		CHECK(MaxRelativeError(reference, values) < 1e-5f);
+		CHECK(fabsf(IntegrateSphere(values) - 1.0f) < 1e-3f);
+	}
+}
+
+//A 256 entry table stays close to the exact function for the asymmetries the clouds use
+TEST_CASE(PhaseFunctionTableError)
+{
+	constexpr size_t SampleCount = 4096;
+	const std::vector<float> nu = MakeCosines(SampleCount);
+	std::vector<float> reference(SampleCount);
+	std::vector<float> values(SampleCount);
+
+	for (const float g : { 0.08f, 0.3f, 0.5f })
+	{
+		for (size_t i = 0; i < SampleCount; ++i) { reference[i] = HenyeyGreenstein(nu[i], g); }
+
+		PhaseFunctionTable table;
+		table.Build([g](float x) { return HenyeyGreenstein(x, g); }, 256);
+		CHECK(table.GetSize() == 256);
+		table.EvaluateBatch(nu.data(), values.data(), SampleCount);
+		CHECK(MaxRelativeError(reference, values) < 2e-3f);
+		CHECK(fabsf(table.Evaluate(1.0f) - HenyeyGreenstein(1.0f, g)) / HenyeyGreenstein(1.0f, g) < 1e-5f);
+	}
+}
+
+//Prints max relative error against exact Henyey-Greenstein and throughput of every variant
+BENCHMARK(PhaseFunctionThroughput)
+{
+	constexpr size_t SampleCount = 1 << 20;
+	constexpr UINT TableSize = 256;
+
+	const std::vector<float> nu = MakeCosines(SampleCount);
+	std::vector<float> reference(SampleCount);
+	std::vector<float> values(SampleCount);
+
+	printf("Phase function benchmark, %u samples, throughput in Msamples/s\n", static_cast<UINT>(SampleCount));
+	for (const float g : Asymmetries)
+	{
+		const double scalar = MeasureThroughput(SampleCount, [&]() {
+			for (size_t i = 0; i < SampleCount; ++i) { reference[i] = HenyeyGreenstein(nu[i], g); }
+		});
+
+		const double batch = MeasureThroughput(SampleCount, [&]() { HenyeyGreensteinBatch(nu.data(), values.data(), SampleCount, g); });
+		const float batchError = MaxRelativeError(reference, values);
+
+		const double schlick = MeasureThroughput(SampleCount, [&]() { HenyeyGreensteinSchlickBatch(nu.data(), values.data(), SampleCount, g); });
+		const float schlickError = MaxRelativeError(reference, values);
+
+		PhaseFunctionTable table;
+		table.Build([g](float x) { return HenyeyGreenstein(x, g); }, TableSize);
+		const double lookup = MeasureThroughput(SampleCount, [&]() { table.EvaluateBatch(nu.data(), values.data(), SampleCount); });
+		const float lookupError = MaxRelativeError(reference, values);
+
+		const double cornetteShanks = MeasureThroughput(SampleCount, [&]() { CornetteShanksBatch(nu.data(), values.data(), SampleCount, g); });
+
+		printf("  g=%.2f  HG %.1f | HG batch %.1f (err %.2e) | Schlick batch %.1f (err %.2e) | table[%u] %.1f (err %.2e) | Cornette-Shanks batch %.1f\n",
+			g, scalar, batch, batchError, schlick, schlickError, TableSize, lookup, lookupError, cornetteShanks);
+	}
+}
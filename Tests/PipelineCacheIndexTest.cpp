@@ -0,0 +1,150 @@
+//
+// Description:  Tests and benchmarks of PipelineCacheIndex, the device independent part of PipelineLibrary
+//
+
+#include "TestFramework.h"
+#include "PipelineLibrary.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+    // stands in for the serialized library
+    vector<uint8_t> MakeLibrary( size_t Size, mt19937_64& Random )
+    {
+        vector<uint8_t> Library(Size);
+        for (uint8_t& Byte : Library)
+            Byte = (uint8_t)Random();
+        return Library;
+    }
+
+    PipelineCacheIndex::PipelineType GetType( uint32_t Pipeline )
+    {
+        return (Pipeline & 3) == 0 ? PipelineCacheIndex::kCompute : PipelineCacheIndex::kGraphics;
+    }
+}
+
+// Pipelines are keyed by hash and type, and the index survives a round trip only with the library it describes
+TEST_CASE(PipelineCacheIndexRoundTrip)
+{
+    const uint32_t kPipelineCount = 1024;
+
+    mt19937_64 Random(11);
+    vector<uint8_t> Library = MakeLibrary(64 << 10, Random);
+    vector<uint64_t> Hashes(kPipelineCount);
+    for (uint64_t& Hash : Hashes)
+        Hash = Random();
+
+    PipelineCacheIndex Index;
+    uint32_t Inserted = 0;
+    for (uint32_t i = 0; i < kPipelineCount; ++i)
+    {
+        CHECK(!Index.Contains(Hashes[i], GetType(i)));
+        Inserted += Index.Insert(Hashes[i], GetType(i)) ? 1 : 0;
+    }
+    CHECK(Inserted == kPipelineCount);
+    CHECK(Index.GetCount() == kPipelineCount);
+    CHECK(!Index.Insert(Hashes[5], GetType(5)));
+
+    // the same hash as the other type is another pipeline
+    CHECK(!Index.Contains(Hashes[4], PipelineCacheIndex::kGraphics));
+    CHECK(Index.Insert(Hashes[4], PipelineCacheIndex::kGraphics));
+    CHECK(Index.GetCount() == kPipelineCount + 1);
+
+    vector<uint8_t> Serialized;
+    Index.Serialize(Serialized, Library.data(), Library.size());
+
+    PipelineCacheIndex WarmIndex;
+    CHECK(WarmIndex.Deserialize(Serialized.data(), Serialized.size(), Library.data(), Library.size()));
+    CHECK(WarmIndex.GetCount() == kPipelineCount + 1);
+    bool IsEveryPipelineFound = true;
+    bool IsAnyOtherFound = false;
+    for (uint32_t i = 0; i < kPipelineCount; ++i)
+    {
+        IsEveryPipelineFound = IsEveryPipelineFound && WarmIndex.Contains(Hashes[i], GetType(i));
+        IsAnyOtherFound = IsAnyOtherFound || WarmIndex.Contains(Hashes[i] ^ 0x5555, GetType(i));
+    }
+    CHECK(IsEveryPipelineFound);
+    CHECK(!IsAnyOtherFound);
+
+    // damaged files are refused and leave the index empty
+    PipelineCacheIndex Rejected;
+    vector<uint8_t> Damaged = Serialized;
+    CHECK(!Rejected.Deserialize(Damaged.data(), Damaged.size() - 1, Library.data(), Library.size()));
+    CHECK(Rejected.GetCount() == 0);
+    CHECK(!Rejected.Deserialize(Damaged.data(), Damaged.size(), Library.data(), Library.size() - 1));
+    Library[Library.size() / 2] ^= 1;
+    CHECK(!Rejected.Deserialize(Damaged.data(), Damaged.size(), Library.data(), Library.size()));
+    Library[Library.size() / 2] ^= 1;
+    Damaged[4] ^= 1;
+    CHECK(!Rejected.Deserialize(Damaged.data(), Damaged.size(), Library.data(), Library.size()));
+
+    // entries out of order would make lookups miss, the header is 32 bytes and an entry 16
+    Damaged = Serialized;
+    std::swap_ranges(Damaged.begin() + 32, Damaged.begin() + 48, Damaged.begin() + 48);
+    CHECK(!Rejected.Deserialize(Damaged.data(), Damaged.size(), Library.data(), Library.size()));
+    CHECK(Rejected.GetCount() == 0);
+
+    CHECK(PipelineCacheIndex::Checksum(Library.data(), Library.size()) != PipelineCacheIndex::Checksum(Library.data(), Library.size() - 1));
+}
+
+// Times index insertion, serialization and lookups
+BENCHMARK(PipelineCacheIndexThroughput)
+{
+    const uint32_t kPipelineCount = 4096;
+    const uint32_t kLookupCount = 1000000;
+
+    mt19937_64 Random(11);
+    vector<uint8_t> Library = MakeLibrary(4 << 20, Random);
+    vector<uint64_t> Hashes(kPipelineCount);
+    for (uint64_t& Hash : Hashes)
+        Hash = Random();
+
+    // cold start: every pipeline misses and is added
+    PipelineCacheIndex Index;
+    int64_t StartTick = SystemTime::GetCurrentTick();
+    uint32_t Misses = 0;
+    for (uint32_t i = 0; i < kPipelineCount; ++i)
+    {
+        if (!Index.Contains(Hashes[i], GetType(i)))
+        {
+            ++Misses;
+            Index.Insert(Hashes[i], GetType(i));
+        }
+    }
+    double ColdSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+    CHECK(Misses == kPipelineCount);
+
+    StartTick = SystemTime::GetCurrentTick();
+    vector<uint8_t> Serialized;
+    Index.Serialize(Serialized, Library.data(), Library.size());
+    double SerializeSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+
+    // warm start: the index is read back and every pipeline is found
+    StartTick = SystemTime::GetCurrentTick();
+    PipelineCacheIndex WarmIndex;
+    bool Loaded = WarmIndex.Deserialize(Serialized.data(), Serialized.size(), Library.data(), Library.size());
+    double DeserializeSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+    CHECK(Loaded);
+
+    StartTick = SystemTime::GetCurrentTick();
+    uint32_t Hits = 0;
+    for (uint32_t i = 0; i < kLookupCount; ++i)
+    {
+        uint32_t Pipeline = (uint32_t)(Random() % kPipelineCount);
+        // every other lookup asks for a pipeline that was never stored
+        uint64_t Hash = (i & 1) ? Hashes[Pipeline] : Hashes[Pipeline] ^ 0x5555;
+        Hits += WarmIndex.Contains(Hash, GetType(Pipeline)) ? 1 : 0;
+    }
+    double LookupSeconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+    CHECK(Hits == kLookupCount / 2);
+
+    printf("Pipeline index, %u pipelines, %u KB index for a %u MB library\n", kPipelineCount,
+        uint32_t(Serialized.size() >> 10), uint32_t(Library.size() >> 20));
+    printf("  cold start %.2f ms to miss and insert, serialize %.2f ms, warm start %.2f ms to read back, %.1f M lookups/s\n",
+        ColdSeconds * 1000.0, SerializeSeconds * 1000.0, DeserializeSeconds * 1000.0, kLookupCount / LookupSeconds * 1e-6);
+}
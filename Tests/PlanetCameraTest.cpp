@@ -0,0 +1,85 @@
+#include "TestFramework.h"
+#include "pch.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//RaySphere in common.hlsli, the distance to the sphere is formed from the squared distance to the center
+	float RaySphereFromCenter(const float3& oc, const float radius, const float3& rd)
+	{
+		const float halfB = oc.x * rd.x + oc.y * rd.y + oc.z * rd.z;
+		const float c = (oc.x * oc.x + oc.y * oc.y + oc.z * oc.z) - radius * radius;
+		const float disc = halfB * halfB - c;
+		return (0.0f > disc) ? -1.0f : (-halfB - sqrtf(disc));
+	}
+
+	//RaySphereFromHeight in common.hlsli, the distance to the sphere is given as the height above it
+	float RaySphereFromHeight(const float3& normal, const float radius, const float height, const float3& rd)
+	{
+		const float halfB = (normal.x * rd.x + normal.y * rd.y + normal.z * rd.z) * (radius + height);
+		const float c = height * (height + 2.0f * radius);
+		const float disc = halfB * halfB - c;
+		if (0.0f > disc)
+		{
+			return -1.0f;
+		}
+		const float q = -(halfB + ((halfB >= 0.0f) ? 1.0f : -1.0f) * sqrtf(disc));
+		const float t0 = q;
+		const float t1 = (q != 0.0f) ? c / q : 0.0f;
+		return std::min(t0, t1);
+	}
+
+	double RaySphereReference(const double3& oc, const double radius, const double3& rd)
+	{
+		const double halfB = Dot(oc, rd);
+		const double disc = halfB * halfB - (Dot(oc, oc) - radius * radius);
+		return (0.0 > disc) ? -1.0 : (-halfB - sqrt(disc));
+	}
+}
+
+//Altitude and ground distance errors of a float world position against the double precision pipeline
+TEST_CASE(PlanetCameraPrecision)
+{
+	constexpr double planetRadius = 6360.0;
+	constexpr double Altitudes[] = { 0.001, 0.01, 0.1, 1.0, 10.0, 100.0 };
+	//away from the planet origin and off the axes, like a planet placed somewhere in a larger world
+	const double3 planetCenter(1234.5678, -2345.6789, 3456.7891);
+	const double3 normal = Normalize(double3(0.3, 0.8, 0.52));
+	const double3 tangent = Normalize(double3(0.8, -0.3, 0.0));
+
+	printf("Planet camera precision, radius %.1f, errors in metres (float world position | double pipeline)\n", planetRadius);
+	for (const double altitude : Altitudes)
+	{
+		const double3 worldPosition = planetCenter + normal * (planetRadius + altitude);
+
+		//a ray dipping under the horizon by its own angle, hits the ground close to the grazing point
+		const double dip = std::min(2.0 * acos(planetRadius / (planetRadius + altitude)), PI * 0.5);
+		const double3 rayDirection = Normalize(tangent * cos(dip) - normal * sin(dip));
+		const double referenceDistance = RaySphereReference(worldPosition - planetCenter, planetRadius, rayDirection);
+
+		const float3 rd = ToRelativeFloat3(rayDirection, double3());
+
+		//float world positions, everything relative to the planet formed from rounded absolutes
+		const float3 floatPosition = ToRelativeFloat3(worldPosition, double3());
+		const float3 floatCenter = ToRelativeFloat3(planetCenter, double3());
+		const float3 floatOffset(floatPosition.x - floatCenter.x, floatPosition.y - floatCenter.y, floatPosition.z - floatCenter.z);
+		const float floatAltitude = sqrtf(floatOffset.x * floatOffset.x + floatOffset.y * floatOffset.y + floatOffset.z * floatOffset.z) - static_cast<float>(planetRadius);
+		const float floatDistance = RaySphereFromCenter(floatOffset, static_cast<float>(planetRadius), rd);
+
+		//double world positions, camera offset and altitude rounded once as sent to the shaders
+		const float3 relativeNormal = ToRelativeFloat3(Normalize(worldPosition - planetCenter), double3());
+		const float relativeAltitude = static_cast<float>(Length(worldPosition - planetCenter) - planetRadius);
+		const float relativeDistance = RaySphereFromHeight(relativeNormal, static_cast<float>(planetRadius), relativeAltitude, rd);
+
+		printf("  altitude %9.3f km  altitude %10.4f | %10.4f  ground distance %10.4f | %10.4f\n", altitude,
+			fabs(floatAltitude - altitude) * 1000.0, fabs(relativeAltitude - altitude) * 1000.0,
+			fabs(floatDistance - referenceDistance) * 1000.0, fabs(relativeDistance - referenceDistance) * 1000.0);
+
+		//the double pipeline stays within a millimetre of altitude and ten centimetres of ground distance
+		CHECK(fabs(relativeAltitude - altitude) < 1e-6);
+		CHECK(fabs(relativeDistance - referenceDistance) < 1e-4);
+	}
+}
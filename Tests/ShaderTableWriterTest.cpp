@@ -0,0 +1,174 @@
+//
+// Description:  Tests and benchmark of the shader table layout written by ShaderTableWriter
+//
+
+#include "TestFramework.h"
+#include "ShaderTableWriter.h"
+#include "SystemTime.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    struct ShaderIdentifier
+    {
+        uint8_t Bytes[ShaderTableWriter::kShaderIdentifierSize];
+
+        explicit ShaderIdentifier( uint8_t Value ) { memset(Bytes, Value, sizeof(Bytes)); }
+    };
+
+    bool IsFilled( const uint8_t* Data, size_t Size, uint8_t Value )
+    {
+        for (size_t i = 0; i < Size; ++i)
+        {
+            if (Data[i] != Value)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE(ShaderTableWriterRecordStride)
+{
+    CHECK(ShaderTableWriter::GetRecordStride(0) == 32);
+    CHECK(ShaderTableWriter::GetRecordStride(4) == 64);
+    CHECK(ShaderTableWriter::GetRecordStride(8) == 64);
+    CHECK(ShaderTableWriter::GetRecordStride(32) == 64);
+    CHECK(ShaderTableWriter::GetRecordStride(33) == 96);
+}
+
+TEST_CASE(ShaderTableWriterRecordsAreAlignedAndZeroPadded)
+{
+    ShaderTableWriter Writer;
+    Writer.Reset();
+    Writer.BeginTable(12);
+
+    const uint64_t Address = 0x123456789abcdef0ull;
+    const uint32_t MaterialID = 7;
+    for (uint8_t i = 0; i < 5; ++i)
+    {
+        ShaderTableWriter::Record Record = Writer.AddRecord(ShaderIdentifier(i + 1).Bytes);
+        Record.Write(Address);
+        Record.Write(MaterialID);
+        CHECK(Record.GetSize() == 12);
+    }
+
+    const ShaderTableWriter::TableRange& Table = Writer.GetTable(0);
+    CHECK(Table.Offset == 0);
+    CHECK(Table.Stride == 64);
+    CHECK(Table.RecordCount == 5);
+    CHECK(Table.Size == 5 * 64);
+    CHECK(Writer.GetSize() == 5 * 64);
+
+    for (uint8_t i = 0; i < 5; ++i)
+    {
+        const uint8_t* Record = Writer.GetData() + Table.Offset + i * Table.Stride;
+        CHECK(IsFilled(Record, 32, i + 1));
+        CHECK(memcmp(Record + 32, &Address, 8) == 0);
+        CHECK(memcmp(Record + 40, &MaterialID, 4) == 0);
+        CHECK(IsFilled(Record + 44, 64 - 44, 0));
+    }
+}
+
+TEST_CASE(ShaderTableWriterTableOffsets)
+{
+    // Ray generation, miss and hit group tables in one buffer, like one D3D12_DISPATCH_RAYS_DESC uses them
+    ShaderTableWriter Writer;
+    Writer.Reset();
+
+    CHECK(Writer.BeginTable(8) == 0);
+    Writer.AddRecord(ShaderIdentifier(1).Bytes);
+
+    CHECK(Writer.BeginTable(0) == 1);
+    Writer.AddRecord(ShaderIdentifier(2).Bytes);
+    Writer.AddRecord(ShaderIdentifier(3).Bytes);
+    Writer.AddRecord(ShaderIdentifier(4).Bytes);
+
+    CHECK(Writer.BeginTable(40) == 2);
+    Writer.AddRecord(ShaderIdentifier(5).Bytes);
+    Writer.AddRecord(ShaderIdentifier(6).Bytes);
+
+    CHECK(Writer.GetTableCount() == 3);
+    const ShaderTableWriter::TableRange& RayGen = Writer.GetTable(0);
+    const ShaderTableWriter::TableRange& Miss = Writer.GetTable(1);
+    const ShaderTableWriter::TableRange& HitGroups = Writer.GetTable(2);
+
+    CHECK(RayGen.Offset == 0 && RayGen.Size == 64);
+    // Three records of 32 bytes end at 160, the hit groups start at the next 64 byte boundary
+    CHECK(Miss.Offset == 64 && Miss.Stride == 32 && Miss.Size == 96);
+    CHECK(HitGroups.Offset == 192 && HitGroups.Stride == 96 && HitGroups.Size == 192);
+    CHECK(Writer.GetSize() == 384);
+
+    for (uint32_t i = 0; i < Writer.GetTableCount(); ++i)
+        CHECK(Writer.GetTable(i).Offset % ShaderTableWriter::kTableAlignment == 0);
+
+    CHECK(IsFilled(Writer.GetData() + Miss.Offset + 2 * Miss.Stride, 32, 4));
+    CHECK(IsFilled(Writer.GetData() + 160, 32, 0));
+    CHECK(IsFilled(Writer.GetData() + HitGroups.Offset + HitGroups.Stride, 32, 6));
+}
+
+TEST_CASE(ShaderTableWriterWritesInPlace)
+{
+    // Stands in for mapped upload memory
+    vector<uint8_t> Mapped(256, 0xcd);
+
+    ShaderTableWriter Writer;
+    Writer.Reset(Mapped.data(), Mapped.size());
+    Writer.BeginTable(4);
+    Writer.AddRecord(ShaderIdentifier(9).Bytes).Write(42u);
+
+    CHECK(Writer.GetData() == Mapped.data());
+    CHECK(IsFilled(Mapped.data(), 32, 9));
+    CHECK(Mapped[32] == 42);
+    CHECK(IsFilled(Mapped.data() + 36, 28, 0));
+    // Nothing past the record is touched
+    CHECK(IsFilled(Mapped.data() + 64, 256 - 64, 0xcd));
+}
+
+TEST_CASE(ShaderTableWriterRebuildKeepsStorage)
+{
+    ShaderTableWriter Writer;
+    const uint8_t* Data = nullptr;
+    for (int Build = 0; Build < 3; ++Build)
+    {
+        Writer.Reset();
+        Writer.BeginTable(8);
+        for (uint32_t i = 0; i < 1000; ++i)
+            Writer.AddRecord(ShaderIdentifier(uint8_t(i)).Bytes).Write(uint64_t(i));
+
+        if (Build == 0)
+            Data = Writer.GetData();
+        CHECK(Writer.GetData() == Data);
+        CHECK(Writer.GetSize() == 1000 * 64);
+    }
+}
+
+BENCHMARK(ShaderTableWriterRebuild)
+{
+    const uint32_t kHitGroups = 4096;
+    const int kBuilds = 200;
+    ShaderIdentifier Identifier(1);
+
+    ShaderTableWriter Writer;
+    vector<uint8_t> Mapped(kHitGroups * ShaderTableWriter::GetRecordStride(16));
+
+    int64_t Start = SystemTime::GetCurrentTick();
+    for (int Build = 0; Build < kBuilds; ++Build)
+    {
+        Writer.Reset(Mapped.data(), Mapped.size());
+        Writer.BeginTable(16);
+        for (uint32_t i = 0; i < kHitGroups; ++i)
+        {
+            ShaderTableWriter::Record Record = Writer.AddRecord(Identifier.Bytes);
+            Record.Write(uint64_t(i) << 16);
+            Record.Write(i);
+            Record.Write(i + 1);
+        }
+    }
+    double Seconds = SystemTime::TimeBetweenTicks(Start, SystemTime::GetCurrentTick());
+
+    printf("Shader table rebuild, %u hit group records into mapped memory: %.1f us per table\n", kHitGroups, Seconds * 1e6 / kBuilds);
+}
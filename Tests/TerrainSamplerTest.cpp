@@ -0,0 +1,176 @@
+#include "TestFramework.h"
+#include "TerrainSampler.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace TerrainSampler;
+
+namespace
+{
+	float3 Add(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+	float3 Scale(const float3& v, const float s) { return float3(v.x * s, v.y * s, v.z * s); }
+	float3 Cross(const float3& a, const float3& b) { return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	float3 Normalize(const float3& v) { return Scale(v, 1.0f / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z)); }
+
+	//deterministic directions spread over the sphere
+	float3 GetDirection(const UINT i, const UINT count)
+	{
+		const float z = 1.0f - 2.0f * (i + 0.5f) / count;
+		const float phi = i * 2.39996323f;
+		const float r = sqrtf(std::max(1.0f - z * z, 0.0f));
+		return float3(r * cosf(phi), r * sinf(phi), z);
+	}
+
+	struct RayComparison
+	{
+		double _naiveEvaluations;
+		double _hierarchyEvaluations;
+		double _hierarchySteps;
+		double _naiveSeconds;
+		double _hierarchySeconds;
+		float _maxDistanceError;
+		UINT _disagreements;
+	};
+
+	//rays from a few units above the ground towards the horizon and down, cast with and without the hierarchy
+	RayComparison CompareRayCasts(const HeightHierarchy& hierarchy, const UINT rayCount)
+	{
+		std::vector<float3> origins(rayCount);
+		std::vector<float3> rayDirections(rayCount);
+		for (UINT i = 0; i < rayCount; ++i)
+		{
+			const float3 up = GetDirection(i, rayCount);
+			const float3 side = Normalize(Cross(up, (fabsf(up.y) < 0.9f) ? float3(0.0f, 1.0f, 0.0f) : float3(1.0f, 0.0f, 0.0f)));
+			const float dip = 0.05f + 0.6f * (i % 16) / 16.0f;
+			origins[i] = Scale(up, RADIUS + 1.0f + 4.0f * ((i * 7) % 13) / 13.0f);
+			rayDirections[i] = Normalize(Add(Scale(side, cosf(dip)), Scale(up, -sinf(dip))));
+		}
+
+		std::vector<float> naiveDistances(rayCount);
+		std::vector<float> hierarchyDistances(rayCount);
+		std::vector<RayCastStats> naiveStats(rayCount);
+		std::vector<RayCastStats> hierarchyStats(rayCount);
+		RayComparison comparison = {};
+
+		int64_t start = SystemTime::GetCurrentTick();
+		JobSystem::ParallelFor(0, rayCount, 1, [&](const UINT i) { naiveDistances[i] = RayCast(nullptr, origins[i], rayDirections[i], 1000.0f, &naiveStats[i]); });
+		comparison._naiveSeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+
+		start = SystemTime::GetCurrentTick();
+		JobSystem::ParallelFor(0, rayCount, 1, [&](const UINT i) { hierarchyDistances[i] = RayCast(&hierarchy, origins[i], rayDirections[i], 1000.0f, &hierarchyStats[i]); });
+		comparison._hierarchySeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+
+		for (UINT i = 0; i < rayCount; ++i)
+		{
+			comparison._naiveEvaluations += naiveStats[i]._evaluations;
+			comparison._hierarchyEvaluations += hierarchyStats[i]._evaluations;
+			comparison._hierarchySteps += hierarchyStats[i]._steps;
+			if ((naiveDistances[i] < 0.0f) != (hierarchyDistances[i] < 0.0f))
+			{
+				++comparison._disagreements;
+			}
+			else if (naiveDistances[i] >= 0.0f)
+			{
+				comparison._maxDistanceError = std::max(comparison._maxDistanceError, fabsf(naiveDistances[i] - hierarchyDistances[i]));
+			}
+		}
+		return comparison;
+	}
+
+	void PrintComparison(const RayComparison& comparison, const UINT rayCount)
+	{
+		printf("  %u rays, field evaluations per ray %.1f -> %.1f (%.1f steps), %.1f ms -> %.1f ms, max hit difference %.4f, %u hit/miss disagreements\n",
+			rayCount, comparison._naiveEvaluations / rayCount, comparison._hierarchyEvaluations / rayCount, comparison._hierarchySteps / rayCount,
+			comparison._naiveSeconds * 1000.0, comparison._hierarchySeconds * 1000.0, comparison._maxDistanceError, comparison._disagreements);
+	}
+}
+
+//Ground heights come back exactly at the texel corners, the bounds hold the field and
+//skipping texels never changes what a ray hits
+TEST_CASE(TerrainSamplerHierarchy)
+{
+	constexpr UINT Resolution = 32;
+	constexpr UINT RayCount = 512;
+	constexpr UINT HeightQueryCount = 1024;
+
+	HeightHierarchy hierarchy;
+	BuildHierarchy(hierarchy, Resolution);
+	CHECK(hierarchy.GetLevelCount() == 6);
+	CHECK(hierarchy._cornerHeights.size() == 6 * (Resolution + 1) * (Resolution + 1));
+
+	//corners of the +x face, whose u axis is -z and v axis is +y
+	float maxCornerError = 0.0f;
+	for (UINT y = 1; y < Resolution; y += 5)
+	{
+		for (UINT x = 1; x < Resolution; x += 5)
+		{
+			const float3 direction = Normalize(float3(1.0f, static_cast<float>(y) / Resolution * 2.0f - 1.0f, 1.0f - static_cast<float>(x) / Resolution * 2.0f));
+			const float expected = hierarchy._cornerHeights[y * (Resolution + 1) + x];
+			maxCornerError = std::max(maxCornerError, fabsf(GetGroundHeight(hierarchy, direction) - expected));
+			maxCornerError = std::max(maxCornerError, fabsf(FindGroundHeight(direction) - expected));
+		}
+	}
+	CHECK(maxCornerError < 1e-3f);
+
+	std::vector<float3> directions(HeightQueryCount);
+	for (UINT i = 0; i < HeightQueryCount; ++i)
+	{
+		directions[i] = GetDirection(i, HeightQueryCount);
+	}
+	std::vector<float> heights(HeightQueryCount);
+	GetGroundHeightBatch(hierarchy, directions.data(), heights.data(), HeightQueryCount);
+	bool isBatchExact = true;
+	bool isInsideBounds = true;
+	for (UINT i = 0; i < HeightQueryCount; ++i)
+	{
+		isBatchExact = isBatchExact && heights[i] == GetGroundHeight(hierarchy, directions[i]);
+		const float height = FindGroundHeight(directions[i]);
+		isInsideBounds = isInsideBounds && height >= hierarchy._minHeight && height <= hierarchy._maxHeight;
+	}
+	CHECK(isBatchExact);
+	CHECK(isInsideBounds);
+
+	const RayComparison comparison = CompareRayCasts(hierarchy, RayCount);
+	PrintComparison(comparison, RayCount);
+	//both traces stop within SURFACE_EPSILON of the field, along different steps they can stop a little apart
+	CHECK(0 == comparison._disagreements);
+	CHECK(comparison._maxDistanceError < 0.1f);
+	CHECK(comparison._hierarchyEvaluations < comparison._naiveEvaluations);
+}
+
+//Builds a hierarchy and times ground heights and ray casts with and without it
+BENCHMARK(TerrainSamplerThroughput)
+{
+	constexpr UINT Resolution = 128;
+	constexpr UINT RayCount = 4096;
+	constexpr UINT HeightQueryCount = 1 << 16;
+
+	HeightHierarchy hierarchy;
+	int64_t start = SystemTime::GetCurrentTick();
+	BuildHierarchy(hierarchy, Resolution);
+	const double buildSeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+	printf("Terrain sampler, hierarchy %u^2 x 6, %u levels, heights [%.3f, %.3f], built in %.2f s\n",
+		Resolution, hierarchy.GetLevelCount(), hierarchy._minHeight, hierarchy._maxHeight, buildSeconds);
+
+	std::vector<float3> directions(HeightQueryCount);
+	for (UINT i = 0; i < HeightQueryCount; ++i)
+	{
+		directions[i] = GetDirection(i, HeightQueryCount);
+	}
+	std::vector<float> heights(HeightQueryCount);
+	start = SystemTime::GetCurrentTick();
+	GetGroundHeightBatch(hierarchy, directions.data(), heights.data(), HeightQueryCount);
+	const double batchSeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+	float maxHeightError = 0.0f;
+	for (UINT i = 0; i < HeightQueryCount; i += 64)
+	{
+		maxHeightError = std::max(maxHeightError, fabsf(heights[i] - FindGroundHeight(directions[i])));
+	}
+	printf("  ground heights, %.1f Mqueries/s, max error against the field %.4f\n",
+		(batchSeconds > 0.0) ? HeightQueryCount / batchSeconds * 1e-6 : 0.0, maxHeightError);
+
+	PrintComparison(CompareRayCasts(hierarchy, RayCount), RayCount);
+}
@@ -0,0 +1,81 @@
+//
+// Description:  Registry and entry point of the test runner, see TestFramework.h
+//
+
+#include "TestFramework.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
+
+#include <vector>
+#include <cstring>
+
+namespace
+{
+    struct TestEntry
+    {
+        const char* Name;
+        Test::TestFunction Function;
+        bool IsBenchmark;
+    };
+
+    // Function local so that registrations from any translation unit find it constructed
+    std::vector<TestEntry>& GetRegistry( void )
+    {
+        static std::vector<TestEntry> s_Registry;
+        return s_Registry;
+    }
+
+    uint32_t s_FailureCount = 0;
+}
+
+Test::Registration::Registration( const char* Name, TestFunction Function, bool IsBenchmark )
+{
+    GetRegistry().push_back({ Name, Function, IsBenchmark });
+}
+
+void Test::ReportFailure( const char* File, int Line, const char* Expression )
+{
+    ++s_FailureCount;
+    printf("%s(%d): CHECK(%s) failed\n", File, Line, Expression);
+}
+
+int main( int argc, char** argv )
+{
+    bool RunBenchmarks = false;
+    const char* Filter = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-bench") == 0)
+            RunBenchmarks = true;
+        else
+            Filter = argv[i];
+    }
+
+    SystemTime::Initialize();
+    JobSystem::Initialize();
+
+    uint32_t RunCount = 0;
+    uint32_t FailedCount = 0;
+    for (const TestEntry& Entry : GetRegistry())
+    {
+        if (Entry.IsBenchmark && !RunBenchmarks)
+            continue;
+        if (Filter != nullptr && strstr(Entry.Name, Filter) == nullptr)
+            continue;
+
+        printf("[ RUN  ] %s\n", Entry.Name);
+        uint32_t FailuresBefore = s_FailureCount;
+        Entry.Function();
+        bool IsPassed = s_FailureCount == FailuresBefore;
+        printf("[ %s ] %s\n", IsPassed ? " OK " : "FAIL", Entry.Name);
+
+        ++RunCount;
+        if (!IsPassed)
+            ++FailedCount;
+    }
+
+    JobSystem::Shutdown();
+
+    printf("%u of %u passed\n", RunCount - FailedCount, RunCount);
+    return FailedCount == 0 ? 0 : 1;
+}
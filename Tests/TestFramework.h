@@ -0,0 +1,41 @@
+//
+// Description:  Minimal test runner for the CPU side of Core and Planet.
+//
+// Tests register themselves at static initialization and run in the order their files were linked.  CHECK stays
+// compiled in every configuration, unlike ASSERT, and the runner exits with 1 when any check failed.  Benchmarks
+// only report timings and run when the runner is started with -bench.
+//
+//   Tests.exe [-bench] [name filter]
+//
+// CMakeLists.txt builds the device-free Core tests on their own, on any platform.
+//
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+
+namespace Test
+{
+    typedef void (*TestFunction)( void );
+
+    struct Registration
+    {
+        Registration( const char* Name, TestFunction Function, bool IsBenchmark );
+    };
+
+    void ReportFailure( const char* File, int Line, const char* Expression );
+}
+
+#define TEST_CASE( Name ) \
+    static void Name( void ); \
+    static Test::Registration s_##Name##Registration(#Name, Name, false); \
+    static void Name( void )
+
+#define BENCHMARK( Name ) \
+    static void Name( void ); \
+    static Test::Registration s_##Name##Registration(#Name, Name, true); \
+    static void Name( void )
+
+#define CHECK( Condition ) \
+    do { if (!(Condition)) Test::ReportFailure(__FILE__, __LINE__, #Condition); } while (0)
@@ -0,0 +1,229 @@
+//
+// Description:  Tests of the dirty tracking, build decisions and buffer sizing of TlasInstanceTracker
+//
+
+#include "TestFramework.h"
+#include "TlasInstanceTracker.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    TlasInstanceDesc MakeInstance( uint32_t InstanceID, uint64_t BottomLevel )
+    {
+        TlasInstanceDesc Desc;
+        memset(&Desc, 0, sizeof(Desc));
+        Desc.Transform[0][0] = Desc.Transform[1][1] = Desc.Transform[2][2] = 1.0f;
+        Desc.InstanceID = InstanceID;
+        Desc.InstanceMask = 0xff;
+        Desc.AccelerationStructure = BottomLevel;
+        return Desc;
+    }
+
+    // Builds the way RTHelper::tlas::Generate does, into a ring of three regions
+    struct SimulatedTlas
+    {
+        TlasInstanceTracker Tracker;
+        vector<TlasInstanceDesc> Ring;
+        uint32_t RingRecreations;
+        uint64_t Frame;
+
+        SimulatedTlas() : RingRecreations(0), Frame(0) {}
+
+        // Returns the kind of build and how many descs were written into the ring
+        TlasBuildKind Build( uint32_t& Written )
+        {
+            Written = 0;
+            TlasBuildKind Kind = Tracker.GetPendingBuild();
+            if (Kind != TlasBuildKind::None)
+            {
+                if (Tracker.ReserveInstanceRing())
+                {
+                    Ring.assign(Tracker.GetRegionCapacity() * Tracker.GetRegionCount(), TlasInstanceDesc());
+                    ++RingRecreations;
+                }
+                uint32_t Region = uint32_t(Frame % Tracker.GetRegionCount());
+                Written = Tracker.WriteInstances(&Ring[Region * Tracker.GetRegionCapacity()], Region);
+                Tracker.OnBuilt(Kind);
+            }
+            ++Frame;
+            return Kind;
+        }
+
+        const TlasInstanceDesc* GetRegion( uint64_t BuiltFrame ) const
+        {
+            return &Ring[uint32_t(BuiltFrame % Tracker.GetRegionCount()) * Tracker.GetRegionCapacity()];
+        }
+    };
+}
+
+TEST_CASE(GrowOnlySizeReservesWithHeadroom)
+{
+    GrowOnlySize Size;
+    CHECK(Size.Reserve(1000));
+    CHECK(Size.Capacity == 1536);
+    CHECK(Size.Capacity % 256 == 0);
+    CHECK(!Size.Reserve(1000));
+    CHECK(!Size.Reserve(1536));
+    // Smaller builds keep the buffer
+    CHECK(!Size.Reserve(10));
+    CHECK(Size.Capacity == 1536);
+    CHECK(Size.Reserve(1537));
+    CHECK(Size.Capacity == 2560);
+}
+
+TEST_CASE(TlasInstanceTrackerBuildDecisions)
+{
+    SimulatedTlas Tlas;
+    uint32_t Written;
+    CHECK(Tlas.Build(Written) == TlasBuildKind::None);
+
+    uint32_t A = Tlas.Tracker.AddInstance(MakeInstance(1, 0x1000));
+    uint32_t B = Tlas.Tracker.AddInstance(MakeInstance(2, 0x2000));
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+    CHECK(Written == 2);
+
+    // Nothing changed, nothing recorded
+    CHECK(Tlas.Build(Written) == TlasBuildKind::None);
+
+    // Moving an instance refits
+    float Transform[3][4] = { { 1, 0, 0, 5 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+    Tlas.Tracker.SetTransform(B, Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit);
+
+    // So does SetInstance with only a new transform
+    TlasInstanceDesc Moved = Tlas.Tracker.GetInstance(A);
+    Moved.Transform[1][3] = 2.0f;
+    Tlas.Tracker.SetInstance(A, Moved);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit);
+
+    // Another bottom level, mask or hit group rebuilds
+    TlasInstanceDesc Other = Tlas.Tracker.GetInstance(A);
+    Other.AccelerationStructure = 0x3000;
+    Tlas.Tracker.SetInstance(A, Other);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+
+    Tlas.Tracker.RemoveInstance(A);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+    CHECK(Tlas.Tracker.GetInstanceCount() == 1);
+    CHECK(Tlas.Tracker.GetInstance(B).InstanceID == 2);
+}
+
+TEST_CASE(TlasInstanceTrackerRebuildsAfterManyRefits)
+{
+    SimulatedTlas Tlas;
+    uint32_t Written;
+    uint32_t Handle = Tlas.Tracker.AddInstance(MakeInstance(1, 0x1000));
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+
+    float Transform[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+    for (uint32_t i = 0; i < TlasInstanceTracker::kMaxRefitsBeforeRebuild; ++i)
+    {
+        Transform[0][3] = float(i);
+        Tlas.Tracker.SetTransform(Handle, Transform);
+        CHECK(Tlas.Build(Written) == TlasBuildKind::Refit);
+    }
+    Tlas.Tracker.SetTransform(Handle, Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+    Tlas.Tracker.SetTransform(Handle, Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit);
+}
+
+TEST_CASE(TlasInstanceTrackerWritesOnlyWhatARegionMissed)
+{
+    SimulatedTlas Tlas;
+    uint32_t Written;
+    vector<uint32_t> Handles;
+    for (uint32_t i = 0; i < 100; ++i)
+        Handles.push_back(Tlas.Tracker.AddInstance(MakeInstance(i, 0x1000 + i)));
+
+    // Every region starts out empty and gets all instances once
+    float Transform[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild && Written == 100);
+    for (int i = 0; i < 2; ++i)
+    {
+        Tlas.Tracker.SetTransform(Handles[0], Transform);
+        CHECK(Tlas.Build(Written) == TlasBuildKind::Refit && Written == 100);
+    }
+
+    // Region 0 has seen everything but the last two changes to instance 0, and now instance 7
+    Transform[0][3] = 7.0f;
+    Tlas.Tracker.SetTransform(Handles[7], Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit);
+    CHECK(Written == 2);
+    CHECK(Tlas.GetRegion(3)[7].Transform[0][3] == 7.0f);
+
+    // Region 1 missed the second change to instance 0 and both to instance 7
+    Tlas.Tracker.SetTransform(Handles[7], Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit && Written == 2);
+
+    // Region 2 only the changes to instance 7
+    Tlas.Tracker.SetTransform(Handles[7], Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit && Written == 1);
+
+    // A removal reorders, the next region is written in full
+    Tlas.Tracker.RemoveInstance(Handles[10]);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild && Written == 99);
+    CHECK(Tlas.GetRegion(6)[10].InstanceID == 99);
+    CHECK(Tlas.RingRecreations == 1);
+}
+
+TEST_CASE(TlasInstanceTrackerGrowsTheRing)
+{
+    SimulatedTlas Tlas;
+    uint32_t Written;
+    for (uint32_t i = 0; i < 10; ++i)
+        Tlas.Tracker.AddInstance(MakeInstance(i, 0x1000));
+    Tlas.Build(Written);
+    CHECK(Tlas.RingRecreations == 1);
+    CHECK(Tlas.Tracker.GetRegionCapacity() == 64);
+
+    // Within capacity, the ring stays
+    for (uint32_t i = 10; i < 64; ++i)
+        Tlas.Tracker.AddInstance(MakeInstance(i, 0x1000));
+    Tlas.Build(Written);
+    CHECK(Tlas.RingRecreations == 1);
+
+    // Past it every region of the new ring is written in full once
+    Tlas.Tracker.AddInstance(MakeInstance(64, 0x1000));
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild && Written == 65);
+    CHECK(Tlas.RingRecreations == 2);
+    CHECK(Tlas.Tracker.GetRegionCapacity() >= 65);
+
+    float Transform[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+    Tlas.Tracker.SetTransform(0, Transform);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Refit && Written == 65);
+    CHECK(Tlas.GetRegion(Tlas.Frame - 1)[64].InstanceID == 64);
+}
+
+TEST_CASE(TlasInstanceTrackerReplacesCompactedBottomLevels)
+{
+    SimulatedTlas Tlas;
+    uint32_t Written;
+    uint32_t A = Tlas.Tracker.AddInstance(MakeInstance(1, 0x1000));
+    uint32_t B = Tlas.Tracker.AddInstance(MakeInstance(2, 0x2000));
+    uint32_t C = Tlas.Tracker.AddInstance(MakeInstance(3, 0x1000));
+    Tlas.Build(Written);
+
+    CHECK(Tlas.Tracker.ReplaceBottomLevel(0x5000, 0x6000) == 0);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::None);
+
+    // Compacting 0x1000 moves two instances, which a refit may not pick up
+    CHECK(Tlas.Tracker.ReplaceBottomLevel(0x1000, 0x8000) == 2);
+    CHECK(Tlas.Build(Written) == TlasBuildKind::Rebuild);
+    CHECK(Tlas.Tracker.GetInstance(A).AccelerationStructure == 0x8000);
+    CHECK(Tlas.Tracker.GetInstance(B).AccelerationStructure == 0x2000);
+    CHECK(Tlas.Tracker.GetInstance(C).AccelerationStructure == 0x8000);
+
+    // Every region the GPU reads from here on has the new address
+    for (uint32_t i = 0; i < Tlas.Tracker.GetRegionCount(); ++i)
+    {
+        Tlas.Tracker.SetTransform(B, Tlas.Tracker.GetInstance(B).Transform);
+        Tlas.Build(Written);
+        const TlasInstanceDesc* Region = Tlas.GetRegion(Tlas.Frame - 1);
+        CHECK(Region[0].AccelerationStructure == 0x8000 && Region[2].AccelerationStructure == 0x8000);
+    }
+}
@@ -0,0 +1,252 @@
+#include "TestFramework.h"
+#include "TriangleBvh.h"
+#include "Geometry.h"
+#include "SystemTime.h"
+#include "Util/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace TriangleBvh;
+
+namespace
+{
+	struct SphereScene
+	{
+		std::vector<std::vector<float3>> _positions;
+		std::vector<std::vector<UINT>> _indices;
+		std::vector<MeshInput> _meshes;
+		float _size;
+	};
+
+	//A grid of spheres of different sizes on the xz plane
+	void BuildSphereScene(SphereScene& scene, const UINT grid, const UINT columns, const UINT rows)
+	{
+		scene._positions.assign(grid * grid, std::vector<float3>());
+		scene._indices.assign(grid * grid, std::vector<UINT>());
+		scene._meshes.clear();
+		scene._size = (grid - 1) * 2.5f;
+		for (UINT i = 0; i < grid * grid; ++i)
+		{
+			const std::shared_ptr<Geometry::GeometryInfo> sphere = Geometry::GenerateIdentitySphere(columns, rows);
+			const float radius = 0.6f + 0.4f * ((i * 7) % 5) / 4.0f;
+			const float3 center((i % grid) * 2.5f, radius, (i / grid) * 2.5f);
+			for (const Geometry::Vertex& vertex : sphere->_vertices)
+			{
+				scene._positions[i].emplace_back(center.x + vertex._position.x * radius, center.y + vertex._position.y * radius, center.z + vertex._position.z * radius);
+			}
+			scene._indices[i] = sphere->_indices;
+			scene._meshes.push_back({ scene._positions[i].data(), sizeof(float3), scene._indices[i].data(), static_cast<UINT>(scene._indices[i].size()) });
+		}
+	}
+
+	//xorshift, the rays are the same on every run
+	float GetRandom(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	//Camera rays from above the grid
+	std::vector<Ray> GetCameraRays(const float sceneSize, const UINT resolution)
+	{
+		std::vector<Ray> rays;
+		const float3 origin(sceneSize * 0.5f, 6.0f, -6.0f);
+		for (UINT y = 0; y < resolution; ++y)
+		{
+			for (UINT x = 0; x < resolution; ++x)
+			{
+				const float3 target(sceneSize * (x + 0.5f) / resolution, 0.0f, sceneSize * (y + 0.5f) / resolution);
+				float3 direction(target.x - origin.x, target.y - origin.y, target.z - origin.z);
+				const float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+				direction = float3(direction.x / length, direction.y / length, direction.z / length);
+				rays.push_back({ origin, direction, FLT_MAX });
+			}
+		}
+		return rays;
+	}
+
+	//Rays from random points of the scene in random directions
+	std::vector<Ray> GetScatteredRays(const float sceneSize, const UINT count)
+	{
+		uint32_t state = 0x9e3779b9u;
+		std::vector<Ray> rays(count);
+		for (Ray& ray : rays)
+		{
+			ray._origin = float3(GetRandom(state) * sceneSize, GetRandom(state) * 2.0f, GetRandom(state) * sceneSize);
+			const float z = GetRandom(state) * 2.0f - 1.0f;
+			const float phi = GetRandom(state) * 6.2831853f;
+			const float r = sqrtf(std::max(1.0f - z * z, 0.0f));
+			ray._direction = float3(r * cosf(phi), z, r * sinf(phi));
+			ray._maxDistance = FLT_MAX;
+		}
+		return rays;
+	}
+
+	//Moller-Trumbore against every triangle of the tree, hits closer than HIT_EPSILON of TriangleBvh.cpp do not count
+	float GetBruteForceDistance(const Bvh& bvh, const Ray& ray)
+	{
+		float closest = ray._maxDistance;
+		const float3& o = ray._origin;
+		const float3& d = ray._direction;
+		for (const PreparedTriangle& triangle : bvh._triangles)
+		{
+			const float3& e1 = triangle._edge1;
+			const float3& e2 = triangle._edge2;
+			const float3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+			const float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+			if (determinant == 0.0f)
+			{
+				continue;
+			}
+			const float inverseDeterminant = 1.0f / determinant;
+			const float3 s(o.x - triangle._vertex0.x, o.y - triangle._vertex0.y, o.z - triangle._vertex0.z);
+			const float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverseDeterminant;
+			const float3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+			const float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverseDeterminant;
+			const float t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverseDeterminant;
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 1e-5f && t < closest)
+			{
+				closest = t;
+			}
+		}
+		return closest;
+	}
+
+	struct RayComparison
+	{
+		UINT _hitCount;
+		//packets against single rays
+		UINT _mismatches;
+		UINT _occlusionMismatches;
+		UINT _bruteForceMismatches;
+		UINT _bruteForceCount;
+		double _singleSeconds;
+		double _packetSeconds;
+	};
+
+	//Traces single rays and packets, checks occlusion on every 16th ray and the closest hit by brute force on bruteForceCount rays
+	RayComparison CompareRays(const Bvh& bvh, const std::vector<Ray>& rays, const UINT bruteForceCount)
+	{
+		RayComparison comparison = {};
+		std::vector<Hit> singleHits(rays.size());
+		std::vector<Hit> packetHits(rays.size());
+
+		int64_t start = SystemTime::GetCurrentTick();
+		JobSystem::ParallelFor(0, static_cast<UINT>(rays.size()), 0, [&](const UINT i) { Intersect(bvh, rays[i], singleHits[i]); });
+		comparison._singleSeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+
+		start = SystemTime::GetCurrentTick();
+		IntersectBatch(bvh, rays.data(), packetHits.data(), rays.size());
+		comparison._packetSeconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			const bool isHit = singleHits[i]._triangle != INVALID_TRIANGLE;
+			comparison._hitCount += isHit ? 1 : 0;
+			if (isHit != (packetHits[i]._triangle != INVALID_TRIANGLE) || (true == isHit && fabsf(singleHits[i]._distance - packetHits[i]._distance) > 1e-4f * singleHits[i]._distance))
+			{
+				++comparison._mismatches;
+			}
+			if (i % 16 == 0 && isHit != IsOccluded(bvh, rays[i]))
+			{
+				++comparison._occlusionMismatches;
+			}
+		}
+
+		const size_t bruteForceStride = std::max(rays.size() / bruteForceCount, static_cast<size_t>(1));
+		for (size_t i = 0; i < rays.size(); i += bruteForceStride)
+		{
+			const float closest = GetBruteForceDistance(bvh, rays[i]);
+			if (fabsf(closest - singleHits[i]._distance) > 1e-4f * closest)
+			{
+				++comparison._bruteForceMismatches;
+			}
+			++comparison._bruteForceCount;
+		}
+		return comparison;
+	}
+
+	void PrintComparison(const char* name, const RayComparison& comparison, const size_t rayCount)
+	{
+		printf("  %s rays, %u of %u hit, single %.2f Mrays/s, packets %.2f Mrays/s, %u packet mismatches, %u occlusion mismatches, %u of %u brute force mismatches\n",
+			name, comparison._hitCount, static_cast<UINT>(rayCount),
+			(comparison._singleSeconds > 0.0) ? rayCount / comparison._singleSeconds * 1e-6 : 0.0,
+			(comparison._packetSeconds > 0.0) ? rayCount / comparison._packetSeconds * 1e-6 : 0.0,
+			comparison._mismatches, comparison._occlusionMismatches, comparison._bruteForceMismatches, comparison._bruteForceCount);
+	}
+}
+
+//Every triangle lands in one leaf and single rays, packets, occlusion and brute force agree on the closest hit
+TEST_CASE(TriangleBvhMatchesBruteForce)
+{
+	SphereScene scene;
+	BuildSphereScene(scene, 3, 24, 12);
+
+	Bvh bvh;
+	const BuildStats stats = Build(bvh, scene._meshes);
+	const UINT triangleCount = static_cast<UINT>(bvh._triangles.size());
+	printf("  %u triangles, %u nodes, %u leaves, depth %u, SAH cost %.1f\n", triangleCount, stats._nodeCount, stats._leafCount, stats._maxDepth, stats._sahCost);
+
+	UINT expectedTriangles = 0;
+	for (const MeshInput& mesh : scene._meshes)
+	{
+		expectedTriangles += mesh._indexCount / 3;
+	}
+	CHECK(triangleCount == expectedTriangles);
+	CHECK(stats._nodeCount <= 2 * triangleCount - 1);
+
+	std::vector<UINT> references = bvh._triangleIndices;
+	std::sort(references.begin(), references.end());
+	bool isPermutation = true;
+	for (UINT i = 0; i < triangleCount; ++i)
+	{
+		isPermutation = isPermutation && references[i] == i;
+	}
+	CHECK(isPermutation);
+
+	UINT leafTriangles = 0;
+	for (const Node& node : bvh._nodes)
+	{
+		leafTriangles += node._triangleCount;
+	}
+	CHECK(leafTriangles == triangleCount);
+
+	const std::vector<Ray> cameraRays = GetCameraRays(scene._size, 64);
+	const std::vector<Ray> scatteredRays = GetScatteredRays(scene._size, 4096);
+	for (const std::vector<Ray>* rays : { &cameraRays, &scatteredRays })
+	{
+		const RayComparison comparison = CompareRays(bvh, *rays, 256);
+		CHECK(comparison._hitCount > 0);
+		CHECK(0 == comparison._mismatches);
+		CHECK(0 == comparison._occlusionMismatches);
+		CHECK(0 == comparison._bruteForceMismatches);
+	}
+
+	//a hit resolves to its mesh and the triangle inside it
+	Hit hit;
+	const Ray down = { float3(0.0f, 10.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), FLT_MAX };
+	CHECK(true == Intersect(bvh, down, hit));
+	CHECK(0 == hit._mesh);
+	CHECK(hit._triangle < scene._meshes[0]._indexCount / 3);
+}
+
+//Builds a scene of spheres and measures rays per second for camera and scattered rays
+BENCHMARK(TriangleBvhThroughput)
+{
+	SphereScene scene;
+	BuildSphereScene(scene, 6, 96, 48);
+
+	Bvh bvh;
+	const BuildStats stats = Build(bvh, scene._meshes);
+	printf("Triangle BVH, %u triangles, %u nodes, %u leaves, depth %u, SAH cost %.1f, built in %.1f ms\n",
+		static_cast<UINT>(bvh._triangles.size()), stats._nodeCount, stats._leafCount, stats._maxDepth, stats._sahCost, stats._seconds * 1000.0);
+
+	const std::vector<Ray> cameraRays = GetCameraRays(scene._size, 512);
+	PrintComparison("camera", CompareRays(bvh, cameraRays, 256), cameraRays.size());
+	const std::vector<Ray> scatteredRays = GetScatteredRays(scene._size, 1 << 18);
+	PrintComparison("scattered", CompareRays(bvh, scatteredRays, 256), scatteredRays.size());
+}
@@ -0,0 +1,275 @@
+//
+// Description:  Tests and benchmarks of UploadRing against a simulated GPU
+//
+
+#include "TestFramework.h"
+#include "UploadRing.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+    // Fences are handed out on submission, a fence completes once Latency more command lists were submitted after it.
+    // A GPU that keeps up with a fixed delay, independent of how the CPU threads are scheduled.
+    struct SimulatedGpu
+    {
+        atomic<uint64_t> NextFenceValue;
+        uint64_t Latency;
+
+        explicit SimulatedGpu( uint64_t SubmissionLatency ) : NextFenceValue(1), Latency(SubmissionLatency) {}
+
+        uint64_t Submit( void ) { return NextFenceValue.fetch_add(1, memory_order_relaxed); }
+        bool IsFenceComplete( uint64_t FenceValue ) const { return FenceValue + Latency < NextFenceValue.load(memory_order_relaxed); }
+    };
+
+    // What LinearAllocatorPageManager does: one mutex around fence polling of a queue of retired pages
+    class MutexPagePool
+    {
+    public:
+        MutexPagePool( size_t PageSize, const SimulatedGpu& Gpu ) : m_PageSize(PageSize), m_Gpu(Gpu), m_PageCount(0) {}
+
+        size_t AcquireChunk( void )
+        {
+            lock_guard<mutex> LockGuard(m_Mutex);
+            while (!m_RetiredPages.empty() && m_Gpu.IsFenceComplete(m_RetiredPages.front().first))
+            {
+                m_AvailablePages.push(m_RetiredPages.front().second);
+                m_RetiredPages.pop();
+            }
+            if (!m_AvailablePages.empty())
+            {
+                size_t Offset = m_AvailablePages.front();
+                m_AvailablePages.pop();
+                return Offset;
+            }
+            // would be a new committed resource
+            return m_PageSize * m_PageCount++;
+        }
+
+        void RetireChunk( size_t Offset, uint64_t FenceValue )
+        {
+            lock_guard<mutex> LockGuard(m_Mutex);
+            m_RetiredPages.push(make_pair(FenceValue, Offset));
+        }
+
+        size_t GetChunkSize( void ) const { return m_PageSize; }
+        size_t GetPageCount( void ) const { return m_PageCount; }
+
+    private:
+        size_t m_PageSize;
+        const SimulatedGpu& m_Gpu;
+        size_t m_PageCount;
+        mutex m_Mutex;
+        queue<pair<uint64_t, size_t>> m_RetiredPages;
+        queue<size_t> m_AvailablePages;
+    };
+
+    // Counts chunks handed to a thread while another one still owns them, and chunks handed out before their fence
+    class CheckedRing
+    {
+    public:
+        CheckedRing( UploadRing& Ring, const SimulatedGpu& Gpu, uint32_t ChunkCount )
+            : m_Ring(Ring), m_Gpu(Gpu), m_Owned(new atomic<bool>[ChunkCount]), m_Fences(new atomic<uint64_t>[ChunkCount]), m_Errors(0)
+        {
+            for (uint32_t i = 0; i < ChunkCount; ++i)
+            {
+                m_Owned[i].store(false, memory_order_relaxed);
+                m_Fences[i].store(0, memory_order_relaxed);
+            }
+        }
+
+        size_t AcquireChunk( void )
+        {
+            size_t Offset = m_Ring.AcquireChunk();
+            if (Offset == UploadRing::kInvalidOffset)
+                return Offset;
+            size_t Index = Offset / m_Ring.GetChunkSize();
+            uint64_t FenceValue = m_Fences[Index].load(memory_order_relaxed);
+            if (m_Owned[Index].exchange(true, memory_order_acq_rel) || (FenceValue != 0 && !m_Gpu.IsFenceComplete(FenceValue)))
+                m_Errors.fetch_add(1, memory_order_relaxed);
+            return Offset;
+        }
+
+        void RetireChunk( size_t Offset, uint64_t FenceValue )
+        {
+            size_t Index = Offset / m_Ring.GetChunkSize();
+            m_Fences[Index].store(FenceValue, memory_order_relaxed);
+            m_Owned[Index].store(false, memory_order_release);
+            m_Ring.RetireChunk(Offset, FenceValue);
+        }
+
+        size_t GetChunkSize( void ) const { return m_Ring.GetChunkSize(); }
+        uint32_t GetErrors( void ) const { return m_Errors.load(); }
+
+    private:
+        UploadRing& m_Ring;
+        const SimulatedGpu& m_Gpu;
+        unique_ptr<atomic<bool>[]> m_Owned;
+        unique_ptr<atomic<uint64_t>[]> m_Fences;
+        atomic<uint32_t> m_Errors;
+    };
+
+    struct SimulationResult
+    {
+        double Seconds;
+        uint64_t Allocations;
+        uint64_t Fallbacks;
+    };
+
+    // Every thread records command lists of small constant and vertex uploads, bump allocating in its own chunk
+    template <typename ChunkSource>
+    SimulationResult Simulate( ChunkSource& Source, SimulatedGpu& Gpu, uint32_t ThreadCount, uint32_t CommandListsPerThread )
+    {
+        atomic<uint64_t> Allocations(0);
+        atomic<uint64_t> Fallbacks(0);
+
+        int64_t StartTick = SystemTime::GetCurrentTick();
+        vector<thread> Threads;
+        for (uint32_t t = 0; t < ThreadCount; ++t)
+        {
+            Threads.emplace_back([&, t]()
+            {
+                mt19937 Random(t + 1);
+                vector<size_t> UsedChunks;
+                uint64_t ThreadAllocations = 0;
+                uint64_t ThreadFallbacks = 0;
+                const size_t ChunkSize = Source.GetChunkSize();
+
+                for (uint32_t List = 0; List < CommandListsPerThread; ++List)
+                {
+                    size_t Offset = 0;
+                    size_t End = 0;
+                    for (uint32_t i = 0; i < 64; ++i)
+                    {
+                        // 256 byte aligned like constant buffers
+                        size_t Size = (size_t)(64 + Random() % 4096 + 255) & ~(size_t)255;
+                        if (Offset + Size > End)
+                        {
+                            size_t Chunk = Source.AcquireChunk();
+                            if (Chunk == UploadRing::kInvalidOffset)
+                            {
+                                // a page of its own, not simulated further
+                                ++ThreadFallbacks;
+                                continue;
+                            }
+                            UsedChunks.push_back(Chunk);
+                            Offset = Chunk;
+                            End = Chunk + ChunkSize;
+                        }
+                        Offset += Size;
+                        ++ThreadAllocations;
+                    }
+
+                    uint64_t FenceValue = Gpu.Submit();
+                    for (size_t Chunk : UsedChunks)
+                        Source.RetireChunk(Chunk, FenceValue);
+                    UsedChunks.clear();
+                }
+                Allocations.fetch_add(ThreadAllocations, memory_order_relaxed);
+                Fallbacks.fetch_add(ThreadFallbacks, memory_order_relaxed);
+            });
+        }
+        for (thread& Thread : Threads)
+            Thread.join();
+
+        SimulationResult Result;
+        Result.Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+        Result.Allocations = Allocations;
+        Result.Fallbacks = Fallbacks;
+        return Result;
+    }
+}
+
+// Chunks come back in ring order once their fence has completed, in flight ones are skipped
+TEST_CASE(UploadRingReusesRetiredChunks)
+{
+    uint64_t CompletedFence = 0;
+    UploadRing Ring;
+    Ring.Initialize(256, 4, [&CompletedFence](uint64_t FenceValue) { return FenceValue <= CompletedFence; });
+    CHECK(Ring.GetSize() == 1024);
+
+    for (size_t i = 0; i < 4; ++i)
+        CHECK(Ring.AcquireChunk() == i * 256);
+    CHECK(Ring.AcquireChunk() == UploadRing::kInvalidOffset);
+
+    UploadRingStats Stats = Ring.GetStats();
+    CHECK(Stats.Acquisitions == 4);
+    CHECK(Stats.Failures == 1);
+    CHECK(Stats.ChunksInUse == 4);
+
+    // the head is back at the first chunk, which waits for fence 1, the second one is free right away
+    Ring.RetireChunk(0, 1);
+    Ring.RetireChunk(256, 0);
+    CHECK(Ring.AcquireChunk() == 256);
+    CHECK(Ring.AcquireChunk() == UploadRing::kInvalidOffset);
+
+    CompletedFence = 1;
+    CHECK(Ring.AcquireChunk() == 0);
+
+    Ring.RetireChunk(0, 2);
+    Ring.RetireChunk(256, 2);
+    Ring.RetireChunk(512, 2);
+    Ring.RetireChunk(768, 2);
+    Stats = Ring.GetStats();
+    CHECK(Stats.ChunksInUse == 0);
+    CHECK(Stats.Acquisitions == 6);
+}
+
+// Threads recording against a GPU a few frames behind never share a chunk or reuse one early
+TEST_CASE(UploadRingThreads)
+{
+    const uint32_t kChunkCount = 256;
+    const uint32_t kThreadCount = 4;
+    const uint32_t kFramesInFlight = 3;
+
+    SimulatedGpu Gpu(kFramesInFlight * kThreadCount);
+    UploadRing Ring;
+    Ring.Initialize(0x10000, kChunkCount, [&Gpu](uint64_t FenceValue) { return Gpu.IsFenceComplete(FenceValue); });
+    CheckedRing Checked(Ring, Gpu, kChunkCount);
+    SimulationResult Result = Simulate(Checked, Gpu, kThreadCount, 2000);
+
+    UploadRingStats Stats = Ring.GetStats();
+    CHECK(Checked.GetErrors() == 0);
+    CHECK(Result.Fallbacks == 0);
+    CHECK(Stats.Failures == 0);
+    CHECK(Stats.ChunksInUse == 0);
+    CHECK(Result.Allocations == kThreadCount * 2000 * 64);
+}
+
+// Chunk acquisitions per second of the ring against a mutex protected page pool
+BENCHMARK(UploadRingSimulation)
+{
+    const size_t kChunkSize = 0x10000;
+    const uint32_t kChunkCount = 256;
+    const uint32_t kCommandListsPerThread = 20000;
+    const uint32_t kFramesInFlight = 3;
+
+    printf("Upload ring, %u chunks of %u KB, %u command lists of 64 uploads per thread\n",
+        kChunkCount, uint32_t(kChunkSize >> 10), kCommandListsPerThread);
+    for (uint32_t ThreadCount = 1; ThreadCount <= 8; ThreadCount *= 2)
+    {
+        // every thread submits a command list per frame
+        SimulatedGpu PoolGpu(kFramesInFlight * ThreadCount);
+        MutexPagePool Pool(kChunkSize, PoolGpu);
+        SimulationResult PoolResult = Simulate(Pool, PoolGpu, ThreadCount, kCommandListsPerThread);
+
+        SimulatedGpu RingGpu(kFramesInFlight * ThreadCount);
+        UploadRing Ring;
+        Ring.Initialize(kChunkSize, kChunkCount, [&RingGpu](uint64_t FenceValue) { return RingGpu.IsFenceComplete(FenceValue); });
+        SimulationResult RingResult = Simulate(Ring, RingGpu, ThreadCount, kCommandListsPerThread);
+        UploadRingStats Stats = Ring.GetStats();
+
+        printf("  %u threads: mutex pool %6.1f M allocs/s with %u pages, ring %6.1f M allocs/s, %.2f%% skipped chunks, %llu fallbacks, %u chunks still owned\n",
+            ThreadCount, PoolResult.Allocations / PoolResult.Seconds * 1e-6, uint32_t(Pool.GetPageCount()),
+            RingResult.Allocations / RingResult.Seconds * 1e-6, 100.0 * Stats.Skips / max<uint64_t>(Stats.Acquisitions + Stats.Skips, 1),
+            (unsigned long long)RingResult.Fallbacks, Stats.ChunksInUse);
+    }
+}
@@ -0,0 +1,114 @@
+#include "TestFramework.h"
+#include "VertexPacking.h"
+#include "PlanetQuadTree.h"
+#include "SystemTime.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace VertexPacking;
+
+namespace
+{
+	constexpr UINT Levels[] = { 0, 4, 8, 12, 14 };
+
+	//Chunk grid of a tile a third of the way into the face, with ridges in every direction so that the normals cover the octahedron
+	std::vector<Geometry::Vertex> GenerateVertices(const UINT face, const UINT level)
+	{
+		PlanetQuadTree::QuadTreeSettings settings;
+		settings._maxHeight = 8.0;
+		const PlanetQuadTree::HeightFunction heightFunction = [](const double3& direction)
+		{
+			return 4.0 + 4.0 * sin(direction.x * 900.0) * cos(direction.y * 700.0) * sin(direction.z * 800.0);
+		};
+
+		const UINT tile = (1u << level) / 3;
+		const PlanetQuadTree::NodeKey key = { face, level, tile, tile };
+
+		double3 origin;
+		std::vector<Geometry::Vertex> vertices;
+		std::vector<float3> morphTargets;
+		PlanetQuadTree::GenerateChunkVertices(key, settings, heightFunction, origin, vertices, morphTargets);
+		return vertices;
+	}
+
+	template<typename Function>
+	double MeasureThroughput(const size_t vertexCount, Function function)
+	{
+		const int64_t start = SystemTime::GetCurrentTick();
+		function();
+		const double seconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+		return (seconds > 0.0) ? (static_cast<double>(vertexCount) / seconds * 1e-6) : 0.0;
+	}
+}
+
+//Packs planet chunks from the finest to the coarsest level, the batch encoder has to give the same bits as Encode
+TEST_CASE(VertexPackingErrors)
+{
+	printf("Vertex packing, %u -> %u bytes per vertex, position errors in metres\n",
+		static_cast<UINT>(sizeof(Geometry::Vertex)), static_cast<UINT>(sizeof(PackedVertex)));
+
+	for (const UINT level : Levels)
+	{
+		ErrorReport levelReport = {};
+		size_t mismatches = 0;
+		for (UINT face = 0; face < 6; ++face)
+		{
+			const std::vector<Geometry::Vertex> vertices = GenerateVertices(face, level);
+
+			const QuantizationBounds bounds = ComputeBounds(vertices.data(), vertices.size());
+			std::vector<PackedVertex> scalar(vertices.size());
+			std::vector<PackedVertex> batch(vertices.size());
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				scalar[i] = Encode(vertices[i], bounds);
+			}
+			EncodeBatch(vertices.data(), batch.data(), vertices.size(), bounds);
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				mismatches += (0 != memcmp(&scalar[i], &batch[i], sizeof(PackedVertex))) ? 1 : 0;
+			}
+
+			const ErrorReport report = MeasureError(vertices.data(), batch.data(), vertices.size(), bounds);
+			levelReport._maxPositionError = std::max(levelReport._maxPositionError, report._maxPositionError);
+			levelReport._maxPositionErrorSteps = std::max(levelReport._maxPositionErrorSteps, report._maxPositionErrorSteps);
+			levelReport._maxNormalErrorDegrees = std::max(levelReport._maxNormalErrorDegrees, report._maxNormalErrorDegrees);
+			levelReport._maxUVError = std::max(levelReport._maxUVError, report._maxUVError);
+		}
+
+		printf("  level %2u  position %.4f (%.2f steps)  normal %.3f deg  uv %.2e  batch mismatches %u\n", level,
+			levelReport._maxPositionError * 1000.0f, levelReport._maxPositionErrorSteps, levelReport._maxNormalErrorDegrees,
+			levelReport._maxUVError, static_cast<UINT>(mismatches));
+
+		//rounding to the closest step, 8 bit octahedral normals within about a degree, half uv in [0, 1] within 2^-12
+		CHECK(0 == mismatches);
+		CHECK(levelReport._maxPositionErrorSteps <= 0.51f);
+		CHECK(levelReport._maxNormalErrorDegrees < 1.2f);
+		CHECK(levelReport._maxUVError <= 2.5e-4f);
+	}
+}
+
+BENCHMARK(VertexPackingEncodeThroughput)
+{
+	std::vector<Geometry::Vertex> chunkVertices;
+	for (UINT face = 0; face < 6; ++face)
+	{
+		const std::vector<Geometry::Vertex> vertices = GenerateVertices(face, Levels[_countof(Levels) - 1]);
+		chunkVertices.insert(chunkVertices.end(), vertices.begin(), vertices.end());
+	}
+
+	constexpr size_t BenchmarkVertexCount = 1 << 20;
+	std::vector<Geometry::Vertex> vertices(BenchmarkVertexCount);
+	for (size_t i = 0; i < BenchmarkVertexCount; ++i)
+	{
+		vertices[i] = chunkVertices[i % chunkVertices.size()];
+	}
+	const QuantizationBounds bounds = ComputeBounds(vertices.data(), vertices.size());
+	std::vector<PackedVertex> packed(BenchmarkVertexCount);
+
+	const double scalar = MeasureThroughput(BenchmarkVertexCount, [&]() {
+		for (size_t i = 0; i < BenchmarkVertexCount; ++i) { packed[i] = Encode(vertices[i], bounds); }
+	});
+	const double batch = MeasureThroughput(BenchmarkVertexCount, [&]() { EncodeBatch(vertices.data(), packed.data(), BenchmarkVertexCount, bounds); });
+	printf("  encode %u vertices, scalar %.1f Mvertices/s, batch %.1f Mvertices/s\n", static_cast<UINT>(BenchmarkVertexCount), scalar, batch);
+}